@@ -625,6 +625,21 @@ static inline void cpitem_unpack_init(struct cpitem *item) {
 [[gnu::nonnull]]
 size_t chainpack_unpack(FILE *f, struct cpitem *item);
 
+/** Unpack item from ChainPack data stored in memory.
+ *
+ * This is the same as :c:func:`chainpack_unpack` but bytes are read directly
+ * from the memory instead of the file. Reaching the end of the buffer is
+ * reported as :c:enumerator:`CPERR_EOF`.
+ *
+ * :param buf: Pointer to the ChainPack bytes.
+ * :param siz: Number of valid bytes in **buf**.
+ * :param item: Item where info about the unpacked item and its value is placed
+ *   to.
+ * :return: Number of bytes consumed from **buf**.
+ */
+[[gnu::nonnull(3)]]
+size_t chainpack_unpack_buf(const uint8_t *buf, size_t siz, struct cpitem *item);
+
 /** Pack next item to ChainPack data format.
  *
  * :pram f: File to which ChainPack bytes are written to. It can be ``NULL`` and
@@ -639,6 +654,23 @@ size_t chainpack_unpack(FILE *f, struct cpitem *item);
 [[gnu::nonnull(2)]]
 ssize_t chainpack_pack(FILE *f, const struct cpitem *item);
 
+/** Pack next item to ChainPack data format directly to the memory.
+ *
+ * This is the same as :c:func:`chainpack_pack` but bytes are written directly
+ * to the memory instead of the file.
+ *
+ * :param buf: Pointer to the memory where ChainPack bytes are written to. It
+ *   can be ``NULL`` and in such a case packer only calculates number of bytes
+ *   item would take when packed.
+ * :param siz: Size of the **buf** in bytes.
+ * :param item: Item to be packed.
+ * :return: Number of bytes written to **buf**. On error, that is if item
+ *   doesn't fit, ``-1`` is returned. Note that some bytes might have been
+ *   written before the error was detected.
+ */
+[[gnu::nonnull(3)]]
+ssize_t chainpack_pack_buf(uint8_t *buf, size_t siz, const struct cpitem *item);
+
 
 /** State for the CPON packer and unpacker.
  *
@@ -65,6 +65,37 @@ struct cp_pack_chainpack {
 [[gnu::nonnull]]
 cp_pack_t cp_pack_chainpack_init(struct cp_pack_chainpack *pack, FILE *f);
 
+/** Handle for the ChainPack generic packer writing to memory.
+ *
+ * This is the preferred packer if you need to get ChainPack bytes in memory
+ * because it avoids the overhead of the :c:type:`FILE`.
+ */
+struct cp_pack_buf {
+	/** Generic packer function. */
+	cp_pack_func_t func;
+	/** Pointer where the next item is packed to. It is moved with every packed
+	 * item. It is set to ``NULL`` when item doesn't fit to the rest of the
+	 * buffer and no other item is packed after that.
+	 */
+	uint8_t *ptr;
+	/** Number of bytes left in :c:var:`cp_pack_buf.ptr`. */
+	size_t len;
+};
+
+/** Initialize :c:struct:`cp_pack_buf`.
+ *
+ * There is no need for a special resource deallocation afterward. The number
+ * of packed bytes can be calculated as difference between
+ * :c:var:`cp_pack_buf.ptr` and **buf**.
+ *
+ * :param pack: Pointer to the handle to be initialized.
+ * :param buf: Memory where ChainPack bytes are written to.
+ * :param len: Size of the **buf** in bytes.
+ * :return: Generic packer.
+ */
+[[gnu::nonnull]]
+cp_pack_t cp_pack_buf_init(struct cp_pack_buf *pack, uint8_t *buf, size_t len);
+
 
 /** Handle for the CPON generic packer. */
 struct cp_pack_cpon {
@@ -60,6 +60,35 @@ struct cp_unpack_chainpack {
 [[gnu::nonnull]]
 cp_unpack_t cp_unpack_chainpack_init(struct cp_unpack_chainpack *unpack, FILE *f);
 
+/** Handle for the ChainPack generic unpacker reading from memory.
+ *
+ * This is the preferred unpacker if you have the whole message in memory
+ * because it avoids the overhead of the :c:type:`FILE`.
+ */
+struct cp_unpack_buf {
+	/** Generic unpacker function. */
+	cp_unpack_func_t func;
+	/** Pointer to the next byte to be unpacked. It is moved with every unpacked
+	 * item.
+	 */
+	const uint8_t *ptr;
+	/** Number of bytes left in :c:var:`cp_unpack_buf.ptr`. */
+	size_t len;
+};
+
+/** Initialize :c:struct:`cp_unpack_buf`.
+ *
+ * There is no need for a special resource deallocation afterward.
+ *
+ * :param unpack: Pointer to the handle to be initialized.
+ * :param buf: Memory with ChainPack bytes.
+ * :param len: Number of valid bytes in **buf**.
+ * :return: Generic unpacker.
+ */
+[[gnu::nonnull(1)]]
+cp_unpack_t cp_unpack_buf_init(
+	struct cp_unpack_buf *unpack, const uint8_t *buf, size_t len);
+
 /** Handle for the CPON generic unpacker. */
 struct cp_unpack_cpon {
 	/** Generic unpacker function. */
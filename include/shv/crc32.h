@@ -24,13 +24,17 @@ static inline crc32_t crc32_init(void) {
  * This doesn't directly update the provided CRC state and instead returns the
  * new value. The common use case is `crc = crc32_update(crc, buf, len)`.
  *
+ * The calculation uses carry-less multiplication (x86-64) or CRC32
+ * instructions (AArch64) if CPU supports them. Otherwise eight bytes are
+ * processed at once with lookup tables.
+ *
  * :param crc: The previous CRC state. For the initial calculation you should
  *   use :c:func:`crc32_init`.
  * :param data: Pointer to the bytes CRC should be calculated for.
  * :param len: Number of bytes CRC should be calculated for.
  * :return: The new CRC32 state.
  */
-crc32_t crc32_update(crc32_t crc, uint8_t *data, size_t len);
+crc32_t crc32_update(crc32_t crc, const uint8_t *data, size_t len);
 
 /** Provide updated CRC value from a single byte.
  *
@@ -71,4 +75,16 @@ static inline uint32_t crc32(uint8_t *data, size_t len) {
 	return crc32_finalize(crc32_update(crc32_init(), data, len));
 }
 
+/** Combine CRC-32 values of two consecutive blocks of data.
+ *
+ * This allows calculation of CRC-32 for data in parts (such as file ranges)
+ * and merging them afterward.
+ *
+ * :param crc1: The CRC-32 value of the first block of data.
+ * :param crc2: The CRC-32 value of the second block of data.
+ * :param len2: Number of bytes of the second block.
+ * :return: The CRC-32 value of the first block followed by the second one.
+ */
+uint32_t crc32_combine(uint32_t crc1, uint32_t crc2, size_t len2);
+
 #endif
@@ -130,6 +130,38 @@ rpcbroker_t rpcbroker_new(
 /** Destroy the SHV RPC Broker object. */
 void rpcbroker_destroy(rpcbroker_t broker);
 
+/** Policy applied to clients with too much data queued. */
+enum rpcbroker_overflow {
+	/** Signals are dropped until client catches up. Clients sending requests
+	 * or responses to it are not read until then.
+	 */
+	RPCBROKER_OVERFLOW_DROP,
+	/** Client is disconnected once it reaches the high watermark. */
+	RPCBROKER_OVERFLOW_DISCONNECT,
+};
+
+/** Set limits on the data queued for the clients.
+ *
+ * Clients with :c:member:`rpcclient.queue` set (such as those accepted by
+ * :c:func:`rpcbroker_run`) queue data that can't be written right away. Signals
+ * with repeat flag are not sent to clients that have more than ``low`` bytes
+ * queued and no signals are sent to clients with more than ``high`` bytes
+ * queued. Requests and responses are never dropped. The run loop instead stops
+ * reading messages from clients with more than ``high`` bytes queued as well as
+ * from clients that sent request or response to such client until the client
+ * with data queued goes bellow ``low``.
+ *
+ * This should be called before clients are registered.
+ *
+ * :param broker: Broker object.
+ * :param low: Low watermark in bytes.
+ * :param high: High watermark in bytes.
+ * :param overflow: Policy applied when high watermark is reached.
+ */
+[[gnu::nonnull]]
+void rpcbroker_queue_limits(rpcbroker_t broker, size_t low, size_t high,
+	enum rpcbroker_overflow overflow);
+
 /** Register client to the broker.
  *
  * This is client that has immediate access to the broker without having to
@@ -288,6 +320,10 @@ struct rpcbroker_state {
 	 * :c:var:`rpcbroker_state.del_client`.
 	 */
 	void *cookie;
+	/** Maximum number of messages handled for a single client before other
+	 * clients are served. Zero selects the default value.
+	 */
+	unsigned budget;
 };
 
 /** Run broker handling loop.
@@ -295,6 +331,9 @@ struct rpcbroker_state {
  * This is single-threaded implementation (you can use
  * :c:macro:`RPCBROKER_F_NOLOCK`).
  *
+ * Accepted clients have :c:member:`rpcclient.queue` set and their queued data
+ * is written once they are writable. See :c:func:`rpcbroker_queue_limits`.
+ *
  * :param state: The state used for the broker execution.
  * :param halt: Pointer to the variable that can be set non-zero in the signal
  *   handler to halt the loop on next iteration. You can pass ``NULL`` if you do
@@ -305,4 +344,30 @@ struct rpcbroker_state {
 void rpcbroker_run(
 	const struct rpcbroker_state *state, volatile sig_atomic_t *halt);
 
+/** Run broker handling loop with clients distributed to multiple threads.
+ *
+ * The calling thread only accepts new clients and passes them in round-robin
+ * fashion to the given number of threads. Every thread has its own loop
+ * handling messages and idling of its clients. Messages are routed between
+ * threads directly and thus broker must be created without
+ * :c:macro:`RPCBROKER_F_NOLOCK`.
+ *
+ * The callback :c:var:`rpcbroker_state.new_client` is always called from the
+ * calling thread while :c:var:`rpcbroker_state.del_client` can be called from
+ * any of the threads.
+ *
+ * :param state: The state used for the broker execution.
+ * :param halt: Pointer to the variable that can be set non-zero in the signal
+ *   handler to halt the loop on next iteration. You can pass ``NULL`` if you do
+ *   not plan on terminating loop this way. All signals are blocked in the
+ *   spawned threads and thus they are delivered to the calling thread (unless
+ *   you have other threads).
+ * :param threads: Number of threads to handle clients in. Zero means that
+ *   clients are handled in the calling thread, which is the same as
+ *   :c:func:`rpcbroker_run`.
+ */
+[[gnu::nonnull(1)]]
+void rpcbroker_run_threads(const struct rpcbroker_state *state,
+	volatile sig_atomic_t *halt, unsigned threads);
+
 #endif
@@ -95,6 +95,10 @@ enum rpccall_stage {
 	 */
 	CALL_S_DONE,
 	/** Communication error was encountered when sending message.
+	 *
+	 * This is also used without any request being sent if response can't be
+	 * expected (the request ID is already expected in RPC Responses Handler or
+	 * memory allocation failed).
 	 *
 	 * There will be no further call attempts.
 	 *
@@ -129,6 +133,11 @@ struct rpccall_ctx {
 	void *lcookie;
 	/** The request ID for this RPC call. */
 	const int request_id;
+	/** Index of this call in :c:func:`rpccall_many`.
+	 *
+	 * This is always ``0`` for :c:macro:`rpccall`.
+	 */
+	const unsigned index;
 	/** */
 	union {
 		/** Packer you should use to pack request message.
@@ -199,7 +208,45 @@ int _rpccall(rpchandler_t handler, rpchandler_responses_t responses,
  * :return: Integer that is returned from ``FUNC`` (:c:type:`rpccall_func_t`).
  */
 #define rpccall(HANDLER, RESPONSES, FUNC, ...) \
-	__rpccall_value_select(__VA_ARGS_ __VA_OPT__(, ) _rpccall, __rpccall_deft, \
-		__rpccall_def, __rpccall_noctx)(HANDLER, RESPONSES, FUNC, ##__VA_ARGS__)
+	__rpccall_value_select(__VA_ARGS__ __VA_OPT__(, ) _rpccall, \
+		__rpccall_deft, __rpccall_def, \
+		__rpccall_noctx)(HANDLER, RESPONSES, FUNC, ##__VA_ARGS__)
+
+/** Call multiple SHV RPC Methods at once.
+ *
+ * This is variant of :c:macro:`rpccall` that sends all requests right away
+ * without waiting for responses. Responses are collected as they are received
+ * in any order. The request is sent again if response for it is not received
+ * in time and this repeats until attempts limit is reached, independently for
+ * every call. This way the call of many methods takes approximately only
+ * single round trip time instead of one per method.
+ *
+ * The provided function is called for every call in the same way as it is for
+ * :c:macro:`rpccall`. The calls are distinguished by
+ * :c:var:`rpccall_ctx.index`. Be aware that :c:enumerator:`CALL_S_RESULT` is
+ * called from the thread handling the messages and thus for different calls
+ * in parallel with other stages.
+ *
+ * :param handler: The :c:type:`rpchandler_t` object.
+ * :param responses: The :c:type:`rpchandler_responses_t` object that is
+ *   registered as one of the stages in ``handler``.
+ * :param func: Callback function :c:type:`rpccall_func_t` that is used to
+ *   integrate SHV RPC Method calls with caller's code.
+ * :param ctx: Pointer to custom data passed to the :c:type:`rpccall_func_t`
+ *   for all calls.
+ * :param cnt: Number of calls to perform.
+ * :param results: Array of ``cnt`` integers where values returned from
+ *   ``func`` for every call are stored. It can be ``NULL`` if you are not
+ *   interested in them.
+ * :param attempts: Number of attempts for every call before call timeout is
+ *   concluded.
+ * :param timeout: Time in milliseconds before single call attempt is
+ *   abandoned and new request is sent.
+ * :return: Number of calls concluded with :c:enumerator:`CALL_S_DONE`.
+ */
+[[gnu::nonnull(1, 2, 3)]]
+unsigned rpccall_many(rpchandler_t handler, rpchandler_responses_t responses,
+	rpccall_func_t func, void *ctx, unsigned cnt, int *results, int attempts,
+	int timeout);
 
 #endif
@@ -2,6 +2,7 @@
 #ifndef SHV_RPCCLIENT_H
 #define SHV_RPCCLIENT_H
 #include <stdbool.h>
+#include <stdlib.h>
 #include <errno.h>
 #include <shv/cp_pack.h>
 #include <shv/cp_unpack.h>
@@ -47,8 +48,74 @@ enum rpcclient_ctrlop {
 	RPCC_CTRLOP_CONTRACK,
 	/** :c:macro:`rpcclient_pollfd` */
 	RPCC_CTRLOP_POLLFD,
+	/** :c:macro:`rpcclient_pending` */
+	RPCC_CTRLOP_PENDING,
+	/** :c:macro:`rpcclient_flush` */
+	RPCC_CTRLOP_FLUSH,
+	/** :c:macro:`rpcclient_queued` */
+	RPCC_CTRLOP_QUEUED,
+	/** :c:macro:`rpcclient_sendmsg_more` */
+	RPCC_CTRLOP_SENDMSG_MORE,
 };
 
+/** Reference counted buffer with data of the message.
+ *
+ * This allows the same data to be written to multiple RPC Clients without
+ * copying them for every one of them. RPC Client that can't write data right
+ * away keeps reference to the buffer instead of copying the data.
+ *
+ * The buffer must not be modified while there is more than one reference.
+ */
+struct rpcbuf {
+	/** Number of references. Use :c:func:`rpcbuf_ref` and
+	 * :c:func:`rpcbuf_unref` to modify it.
+	 */
+	_Atomic unsigned refs;
+	/** Number of valid bytes in :c:member:`rpcbuf.data`. */
+	size_t len;
+	/** Allocated size of :c:member:`rpcbuf.data`. */
+	size_t siz;
+	/** The data. */
+	uint8_t data[];
+};
+
+/** Allocate new buffer with a single reference.
+ *
+ * :param siz: Size of the data to be allocated.
+ * :return: New buffer or ``NULL`` if allocation failed.
+ */
+[[gnu::malloc]]
+static inline struct rpcbuf *rpcbuf_new(size_t siz) {
+	struct rpcbuf *res = malloc(sizeof *res + siz);
+	if (res) {
+		res->refs = 1;
+		res->len = 0;
+		res->siz = siz;
+	}
+	return res;
+}
+
+/** Take a new reference to the buffer.
+ *
+ * :param buf: The buffer.
+ * :return: The same buffer.
+ */
+[[gnu::nonnull]]
+static inline struct rpcbuf *rpcbuf_ref(struct rpcbuf *buf) {
+	buf->refs++;
+	return buf;
+}
+
+/** Release reference to the buffer. It is freed once the last one is
+ * released.
+ *
+ * :param buf: The buffer. It can be ``NULL`` and in such case nothing is done.
+ */
+static inline void rpcbuf_unref(struct rpcbuf *buf) {
+	if (buf && --buf->refs == 0)
+		free(buf);
+}
+
 /** Public definition of RPC Client object.
  *
  * It provides abstraction on top of multiple different protocols providing
@@ -67,6 +134,28 @@ struct rpcclient {
 	/** Pack function. Please use :c:macro:`rpcclient_pack` instead. */
 	cp_pack_func_t pack;
 
+	/** Optional raw read of the received message. Please use
+	 * :c:func:`rpcclient_rawfwd` instead.
+	 */
+	size_t (*rawread)(struct rpcclient *, void *buf, size_t siz);
+	/** Optional raw write to the message being sent. Please use
+	 * :c:func:`rpcclient_rawfwd` instead.
+	 */
+	bool (*rawwrite)(struct rpcclient *, const void *buf, size_t siz);
+	/** Optional raw write of the rest of the message being sent from the
+	 * shared buffer. The client takes its own reference to the buffer if it
+	 * needs to keep it. Nothing can be written to the message after this.
+	 * Please use :c:func:`rpcclient_rawshare` instead.
+	 */
+	bool (*rawshare)(struct rpcclient *, struct rpcbuf *buf);
+
+	/** Queue data that can't be written right away instead of waiting for it.
+	 *
+	 * The queued data is written by :c:macro:`rpcclient_flush`. Not all clients
+	 * support this and those that don't simply ignore it.
+	 */
+	bool queue;
+
 	/** Loggers used to log messages received by this client. */
 	rpclogger_t logger_in;
 	/** Loggers used to log message sent by this client. */
@@ -242,6 +331,20 @@ enum rpcclient_msg_type {
 #define rpcclient_sendmsg(CLIENT) \
 	((bool)(CLIENT)->ctrl(CLIENT, RPCC_CTRLOP_SENDMSG))
 
+/** Send packed message but hold it until :c:macro:`rpcclient_flush`.
+ *
+ * This is variant of :c:macro:`rpcclient_sendmsg` that only queues the message
+ * if :c:member:`rpcclient.queue` is set. It allows multiple messages to be
+ * written at once. You must call :c:macro:`rpcclient_flush` afterwards because
+ * the message is not written otherwise. Clients without queue send message
+ * right away.
+ *
+ * :param CLIENT: The RPC client object.
+ * :return: Same as :c:macro:`rpcclient_sendmsg`.
+ */
+#define rpcclient_sendmsg_more(CLIENT) \
+	((bool)(CLIENT)->ctrl(CLIENT, RPCC_CTRLOP_SENDMSG_MORE))
+
 /** Drop packed message.
  *
  * This drops not yet sent message and invalidates partially sent one. You can
@@ -273,6 +376,43 @@ enum rpcclient_msg_type {
 #define rpcclient_pollfd(CLIENT) \
 	((int)(CLIENT)->ctrl(CLIENT, RPCC_CTRLOP_POLLFD))
 
+/** Check if client has a complete message already received and buffered.
+ *
+ * Clients can read more data from the file descriptor than a single message
+ * and such data won't be signaled by poll on :c:macro:`rpcclient_pollfd`. You
+ * should call :c:macro:`rpcclient_nextmsg` repeatedly while this returns
+ * ``true`` before you go back to the poll.
+ *
+ * :param CLIENT: The RPC client object.
+ * :return: ``true`` if :c:macro:`rpcclient_nextmsg` can be called without
+ *   blocking and ``false`` if you should poll first.
+ */
+#define rpcclient_pending(CLIENT) \
+	((bool)(CLIENT)->ctrl(CLIENT, RPCC_CTRLOP_PENDING))
+
+/** Write data queued when :c:member:`rpcclient.queue` is set.
+ *
+ * This writes as much as possible without blocking. You should call it when
+ * :c:macro:`rpcclient_pollfd` becomes writable and :c:macro:`rpcclient_queued`
+ * is non-zero.
+ *
+ * :param CLIENT: The RPC client object.
+ * :return: ``true`` if write was successful (even if not all data could be
+ *   written) and ``false`` otherwise. The failure is caused by the disconnect.
+ */
+#define rpcclient_flush(CLIENT) \
+	((bool)(CLIENT)->ctrl(CLIENT, RPCC_CTRLOP_FLUSH))
+
+/** Get number of bytes queued to be written.
+ *
+ * This is safe to be called from other threads than the one sending messages.
+ *
+ * :param CLIENT: The RPC client object.
+ * :return: Number of bytes waiting for :c:macro:`rpcclient_flush`.
+ */
+#define rpcclient_queued(CLIENT) \
+	((size_t)(CLIENT)->ctrl(CLIENT, RPCC_CTRLOP_QUEUED))
+
 /** Check if client supports connection tracking of the peer.
  *
  * Connection tracking in this sense tells you if disconnect is propagated
@@ -309,4 +449,71 @@ static inline size_t rpcclient_peername(rpcclient_t client, char *buf, size_t si
 	return 0;
 }
 
+/** Check if raw forwarding with :c:func:`rpcclient_rawfwd` is possible.
+ *
+ * Both clients must support raw access to the message data. Raw forwarding is
+ * also not possible if any of the involved loggers is set because loggers
+ * operate on the unpacked items.
+ *
+ * :param from: The RPC client object message is being received from.
+ * :param to: The RPC client object message is being sent to.
+ * :return: ``true`` if :c:func:`rpcclient_rawfwd` can be used and ``false``
+ *   if you have to repack the message instead.
+ */
+[[gnu::nonnull]]
+static inline bool rpcclient_rawfwd_possible(rpcclient_t from, rpcclient_t to) {
+	return from->rawread && to->rawwrite && !from->logger_in && !to->logger_out;
+}
+
+/** Copy the rest of the received message to the message being sent.
+ *
+ * The data are copied without being unpacked and packed again. This is
+ * intended for the message forwarding where only the message meta needs to be
+ * modified. You can unpack and pack some part of the message and copy the rest
+ * with this function.
+ *
+ * The received message still needs to be validated with
+ * :c:macro:`rpcclient_validmsg` and the sent message must be finished with
+ * :c:macro:`rpcclient_sendmsg` or :c:macro:`rpcclient_dropmsg`. Data are copied
+ * as they are and thus invalid message is forwarded as it is.
+ *
+ * This can be used only if :c:func:`rpcclient_rawfwd_possible` returns
+ * ``true``.
+ *
+ * :param from: The RPC client object message is being received from.
+ * :param to: The RPC client object message is being sent to.
+ * :return: ``true`` if all data were copied and ``false`` if write failed.
+ */
+[[gnu::nonnull]]
+static inline bool rpcclient_rawfwd(rpcclient_t from, rpcclient_t to) {
+	uint8_t buf[BUFSIZ];
+	size_t siz;
+	while ((siz = from->rawread(from, buf, BUFSIZ)) > 0)
+		if (!to->rawwrite(to, buf, siz))
+			return false;
+	return true;
+}
+
+/** Write the rest of the message being sent from the shared buffer.
+ *
+ * This is intended for the message sent to multiple clients. Clients that
+ * support it take reference to the buffer instead of copying the data when
+ * they need to queue them. Others get data written with
+ * :c:member:`rpcclient.rawwrite`. Nothing can be written to the message after
+ * this.
+ *
+ * This can be used only if :c:member:`rpcclient.rawwrite` is supported and
+ * no output logger is set (the same as for :c:func:`rpcclient_rawfwd`).
+ *
+ * :param client: The RPC client object message is being sent to.
+ * :param buf: The buffer with the rest of the message.
+ * :return: ``true`` if data were written and ``false`` if write failed.
+ */
+[[gnu::nonnull]]
+static inline bool rpcclient_rawshare(rpcclient_t client, struct rpcbuf *buf) {
+	if (client->rawshare)
+		return client->rawshare(client, buf);
+	return client->rawwrite(client, buf->data, buf->len);
+}
+
 #endif
@@ -45,10 +45,11 @@ struct rpcclient_stream_funcs {
 	 * The default operation if ``NULL`` is to simply close file descriptors.
 	 */
 	void (*disconnect)(void *cookie, int fd[2], bool destroy);
-	/** Called for write file descriptor when message is written. Some protocols
-	 * such as TCP would wait for additional data that might not come so instead
-	 * this function is called to force immediate send out. The write socket is
-	 * provided in ``fd``. It can be ``NULL`` if this is not required.
+	/** Called for write file descriptor when message or queued data are
+	 * written. Some protocols could wait for additional data that might not
+	 * come so instead this function is called to force immediate send out. The
+	 * write socket is provided in ``fd``. It can be ``NULL`` if this is not
+	 * required.
 	 */
 	void (*flush)(void *cookie, int fd);
 	/** Called as propagation of :c:macro:`rpcclient_peername`. The provided
@@ -82,4 +83,62 @@ struct rpcclient_stream_funcs {
 rpcclient_t rpcclient_stream_new(const struct rpcclient_stream_funcs *sclient,
 	void *sclient_cookie, enum rpcstream_proto proto, int rfd, int wfd);
 
+/** Classes of the messages sent by RPC Client Stream.
+ *
+ * Requests and responses (messages with request ID) are preferred to signals.
+ * The class is deduced from the message meta. They have their own write
+ * timeout and with :c:member:`rpcclient.queue` they are written before already
+ * queued signals (on message boundaries).
+ */
+enum rpcstream_class {
+	/** Requests and responses. */
+	RPCSTREAM_C_REQUEST,
+	/** Signals and any other messages. */
+	RPCSTREAM_C_SIGNAL,
+};
+/** Number of message classes in :c:enum:`rpcstream_class`. */
+#define RPCSTREAM_C_CNT (2)
+
+/** Statistics of RPC Client Stream. Arrays are indexed by
+ * :c:enum:`rpcstream_class`.
+ */
+struct rpcstream_stats {
+	/** Number of messages sent. */
+	unsigned long long sent[RPCSTREAM_C_CNT];
+	/** Number of messages that couldn't be written right away and thus were
+	 * queued.
+	 */
+	unsigned long long queued[RPCSTREAM_C_CNT];
+	/** Number of times write timed out. */
+	unsigned long long timeouts[RPCSTREAM_C_CNT];
+};
+
+/** Set write timeout for the given class of messages.
+ *
+ * The timeout is used only if :c:member:`rpcclient.queue` is not set. The
+ * default is 2 seconds for requests and responses and 200 ms for signals (1
+ * second for Block protocol because it can't recover from partially sent
+ * message).
+ *
+ * :param client: RPC Client created with :c:func:`rpcclient_stream_new`.
+ * :param cls: Class of the messages.
+ * :param timeout: Timeout in milliseconds.
+ * :return: ``false`` if client is not RPC Client Stream and ``true`` otherwise.
+ */
+[[gnu::nonnull]]
+bool rpcclient_stream_timeout(
+	rpcclient_t client, enum rpcstream_class cls, int timeout);
+
+/** Get statistics of the sent messages.
+ *
+ * This must be called with the same locking as is used for message sending
+ * (such as :c:macro:`rpchandler_msg_new`).
+ *
+ * :param client: RPC Client created with :c:func:`rpcclient_stream_new`.
+ * :param stats: Pointer to the structure statistics are copied to.
+ * :return: ``false`` if client is not RPC Client Stream and ``true`` otherwise.
+ */
+[[gnu::nonnull]]
+bool rpcclient_stream_stats(rpcclient_t client, struct rpcstream_stats *stats);
+
 #endif
@@ -107,6 +107,50 @@ struct rpcdir {
 /** Method description for the standard ``ls`` and ``dir`` methods. */
 extern struct rpcdir rpcdir_ls, rpcdir_dir;
 
+/** Method description with its cached ChainPack representation.
+ *
+ * The method descriptions are commonly static and thus there is no need to
+ * pack them again and again. The description is packed on the first use and
+ * the packed one is used from then on. It can be defined statically:
+ *
+ * .. code-block:: c
+ *
+ *    static struct rpcdir_packed method = {
+ *       .method = &(const struct rpcdir){.name = "method", ...},
+ *    };
+ *
+ * Packed data are allocated and if you don't define it statically then you
+ * need to free them with :c:func:`rpcdir_packed_free`.
+ */
+struct rpcdir_packed {
+	/** The method description. It must not change after first use. */
+	const struct rpcdir *method;
+	/** Packed description. This is internal and must be initialized to
+	 * ``NULL``.
+	 */
+	struct rpcdir_packed_data *_Atomic packed;
+};
+
+/** Get ChainPack representation of the method description.
+ *
+ * The description is packed on the first call. It is safe to call this
+ * concurrently.
+ *
+ * :param method: The method description with its cache.
+ * :param len: Pointer where number of packed bytes is stored.
+ * :return: Pointer to the packed bytes or ``NULL`` in case of allocation
+ *   failure.
+ */
+[[gnu::nonnull]]
+const uint8_t *rpcdir_packed(struct rpcdir_packed *method, size_t *len);
+
+/** Free the packed representation of the method description.
+ *
+ * :param method: The method description with its cache.
+ */
+[[gnu::nonnull]]
+void rpcdir_packed_free(struct rpcdir_packed *method);
+
 /** Pack dir's method description.
  *
  * :param pack: The generic packer where it is about to be packed.
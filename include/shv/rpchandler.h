@@ -227,6 +227,25 @@ struct rpchandler_funcs {
 	void (*reset)(void *cookie);
 };
 
+/** Route of the requests to the stage.
+ *
+ * Routes allow RPC Handler to call :c:var:`rpchandler_funcs.msg` only for
+ * requests the stage can handle instead of for all of them. Handler indexes
+ * routes of all stages and thus finds stages for the request without calling
+ * them one by one.
+ */
+struct rpchandler_route {
+	/** SHV path of the request. It is matched exactly unless it ends with
+	 * ``/``; such path matches all paths under it. ``NULL`` matches any path.
+	 *
+	 * Exactly matched path also states that the node exists. Handler then
+	 * doesn't have to use :c:var:`rpchandler_funcs.ls` to validate it.
+	 */
+	const char *path;
+	/** Name of the method or ``NULL`` for any method. */
+	const char *method;
+};
+
 /** Single stage in the RPC Handler.
  *
  * RPC Handler works with array of these stages and handler implementations
@@ -242,6 +261,13 @@ struct rpchandler_stage {
 	 * instances where only cookies are different.
 	 */
 	void *cookie;
+	/** Optional array of routes terminated by route with both path and method
+	 * ``NULL``. If provided then :c:var:`rpchandler_funcs.msg` is called for
+	 * requests only if they match at least one of the routes. Other messages
+	 * are passed to it as usual. Routes must not be modified while stage is
+	 * used.
+	 */
+	const struct rpchandler_route *routes;
 };
 
 
@@ -270,6 +296,9 @@ rpchandler_t rpchandler_new(rpcclient_t client,
  *
  * The RPC Client that Handle manages is not destroyed nor disconnected.
  *
+ * This waits for any other thread that is still sending message through this
+ * handler. It is up to you to ensure that no new message can be started.
+ *
  * :param rpchandler: RPC Handler object.
  */
 void rpchandler_destroy(rpchandler_t rpchandler);
@@ -307,6 +336,88 @@ void rpchandler_change_stages(
 [[gnu::nonnull]]
 rpcclient_t rpchandler_client(rpchandler_t handler);
 
+/** Enable or disable cache of existing nodes.
+ *
+ * RPC Handler has to verify that node exists before it responds to ``ls`` and
+ * ``dir`` methods. That is done by calling :c:member:`rpchandler_funcs.ls` of
+ * all stages for the parent node. The cache remembers nodes that were located
+ * this way and thus repeated discovery of the same nodes requires only a hash
+ * lookup.
+ *
+ * The cache contains only nodes that exist and thus it must be invalidated
+ * with :c:func:`rpchandler_nodes_changed` when some node is removed. Do not
+ * enable it if your stages do not do that.
+ *
+ * The cache is disabled by default and it is cleared when stages are changed
+ * with :c:func:`rpchandler_change_stages`.
+ *
+ * :param handler: RPC handler instance.
+ * :param enable: ``true`` to enable cache and ``false`` to disable it.
+ */
+[[gnu::nonnull]]
+void rpchandler_cache_nodes(rpchandler_t handler, bool enable);
+
+/** Invalidate cache of existing nodes in all RPC Handlers.
+ *
+ * This must be called by stages when some node is removed from the tree (the
+ * situation when ``lsmod`` signal would be sent). It is cheap and thread safe.
+ * The caches are cleared lazily the next time they are used.
+ */
+void rpchandler_nodes_changed(void);
+
+/** Get new request ID for the request sent through this handler.
+ *
+ * The request IDs are allocated in sequence from 4 up to ``INT_MAX`` and then
+ * they wrap (1 - 3 are reserved for login and ping operations). IDs of the
+ * requests that are still waiting for the response are skipped and thus they
+ * are never reused. This allows a lot of requests to be in flight at the same
+ * time compared to :c:func:`rpcmsg_request_id`.
+ *
+ * The request ID stays allocated until it is released with
+ * :c:func:`rpchandler_release_request_id`. RPC Responses Handler releases it
+ * once the response expectation is completed or discarded.
+ *
+ * This is thread safe.
+ *
+ * :param HANDLER: RPC handler instance or :c:var:`rpchandler_funcs.idle`
+ *   context.
+ * :return: Request ID.
+ */
+#define rpchandler_next_request_id(HANDLER) \
+	_Generic((HANDLER), \
+		rpchandler_t: _rpchandler_next_request_id, \
+		struct rpchandler_idle *: _rpchandler_idle_next_request_id)(HANDLER)
+[[gnu::nonnull]]
+int _rpchandler_next_request_id(rpchandler_t handler);
+[[gnu::nonnull]]
+int _rpchandler_idle_next_request_id(struct rpchandler_idle *ctx);
+
+/** Release request ID allocated with :c:func:`rpchandler_next_request_id`.
+ *
+ * This should be called once the response is received or when you stop waiting
+ * for it.
+ *
+ * This is thread safe.
+ *
+ * :param HANDLER: RPC handler instance, :c:var:`rpchandler_funcs.msg` or
+ *   :c:var:`rpchandler_funcs.idle` context.
+ * :param REQUEST_ID: Request ID to be released.
+ */
+#define rpchandler_release_request_id(HANDLER, REQUEST_ID) \
+	_Generic((HANDLER), \
+		rpchandler_t: _rpchandler_release_request_id, \
+		struct rpchandler_msg *: _rpchandler_msg_release_request_id, \
+		struct rpchandler_idle *: _rpchandler_idle_release_request_id)( \
+		HANDLER, REQUEST_ID)
+[[gnu::nonnull]]
+void _rpchandler_release_request_id(rpchandler_t handler, int request_id);
+[[gnu::nonnull]]
+void _rpchandler_msg_release_request_id(
+	struct rpchandler_msg *ctx, int request_id);
+[[gnu::nonnull]]
+void _rpchandler_idle_release_request_id(
+	struct rpchandler_idle *ctx, int request_id);
+
 /** Handle next message.
  *
  * This blocks until the next message is received and fully handled. In general
@@ -314,6 +425,10 @@ rpcclient_t rpchandler_client(rpchandler_t handler);
  * :c:member:`rpchandler_idling`. These two steps are provided separatelly to
  * allow handler to be included in poll based even loops.
  *
+ * All messages that were already received and buffered by RPC Client (see
+ * :c:macro:`rpcclient_pending`) are handled as well before this returns. You
+ * won't be notified about them by poll.
+ *
  * :param rpchandler: RPC Handler instance.
  * :return: ``true`` if message handled (even by dropping) and ``false`` if
  *   error was encountered by RPC Client. ``false`` pretty much means that loop
@@ -322,6 +437,33 @@ rpcclient_t rpchandler_client(rpchandler_t handler);
 [[gnu::nonnull]]
 bool rpchandler_next(rpchandler_t rpchandler);
 
+/** Handle next message but at most given number of already received messages.
+ *
+ * This is variant of :c:func:`rpchandler_next` that stops after ``budget``
+ * messages even if there are more messages already received by RPC Client.
+ * You need to check :c:macro:`rpcclient_pending` and call this again later on
+ * for those because poll won't notify you about them. This allows you to fairly
+ * serve multiple handlers in the single loop.
+ *
+ * :param rpchandler: RPC Handler instance.
+ * :param budget: Maximum number of messages to handle. Zero is handled same as
+ *   one.
+ * :return: Same as :c:func:`rpchandler_next`.
+ */
+[[gnu::nonnull]]
+bool rpchandler_next_budget(rpchandler_t rpchandler, unsigned budget);
+
+/** Write data queued by RPC Client.
+ *
+ * This calls :c:macro:`rpcclient_flush` while holding the send lock and thus
+ * it is safe to be called while other threads are sending messages.
+ *
+ * :param rpchandler: RPC Handler instance.
+ * :return: Same as :c:macro:`rpcclient_flush`.
+ */
+[[gnu::nonnull]]
+bool rpchandler_flush(rpchandler_t rpchandler);
+
 /** Call idle callbacks and determine maximal timeout.
  *
  * This should be used in combination with :c:func:`rpchandler_next` if you are
@@ -431,6 +573,29 @@ bool _rpchandler_idle_msg_send(struct rpchandler_idle *ctx);
 		struct rpchandler_msg *: _rpchandler_impl_msg_send, \
 		struct rpchandler_idle *: _rpchandler_idle_msg_send)(HANDLER)
 
+[[gnu::nonnull]]
+bool _rpchandler_msg_send_more(rpchandler_t rpchandler);
+[[gnu::nonnull]]
+bool _rpchandler_idle_msg_send_more(struct rpchandler_idle *ctx);
+/** Send the packed message but hold it in the queue.
+ *
+ * This is variant of :c:func:`rpchandler_msg_send` for
+ * :c:macro:`rpcclient_sendmsg_more`. It allows multiple messages to be
+ * written at once by :c:func:`rpchandler_flush` that you must call later on.
+ *
+ * In :c:var:`rpchandler_funcs.idle` this allows you to send any number of
+ * messages instead of just one. They are written once idle of all stages is
+ * called and thus you do not call :c:func:`rpchandler_flush` in such case.
+ *
+ * :param HANDLER: RPC Handler instance or :c:var:`rpchandler_funcs.idle`
+ *   context.
+ * :return: ``true`` if send was successful and ``false`` otherwise.
+ */
+#define rpchandler_msg_send_more(HANDLER) \
+	_Generic((HANDLER), \
+		rpchandler_t: _rpchandler_msg_send_more, \
+		struct rpchandler_idle *: _rpchandler_idle_msg_send_more)(HANDLER)
+
 [[gnu::nonnull]]
 bool _rpchandler_msg_drop(rpchandler_t rpchandler);
 [[gnu::nonnull]]
@@ -105,6 +105,20 @@ void rpchandler_ls_exists(struct rpchandler_ls *ctx);
 [[gnu::nonnull]]
 void rpchandler_dir_result(struct rpchandler_dir *ctx, const struct rpcdir *method);
 
+/** The variant of the :c:func:`rpchandler_dir_result` with packed method
+ * description.
+ *
+ * The packed description is written to the response as it is if RPC Client
+ * allows it. This is faster and thus it should be preferred for static method
+ * descriptions.
+ *
+ * :param ctx: Context passed to the :c:member:`rpchandler_funcs.dir`.
+ * :param method: The method description with its cache.
+ */
+[[gnu::nonnull]]
+void rpchandler_dir_result_packed(
+	struct rpchandler_dir *ctx, struct rpcdir_packed *method);
+
 /** Mark the method :c:var:`rpchandler_dir.name` as existing.
  *
  * This should be used only if :c:var:`rpchandler_dir.name` is not ``NULL``.
@@ -60,7 +60,8 @@ typedef struct rpcresponse *rpcresponse_t;
  * :c:func:`rpchandler_msg_valid`. In case that function returns ``true`` then
  * no subsequent message with this request ID will be received and in case of
  * ``false`` this might be an abandoned response and new response will be sent
- * instead and thus we should keep waiting for it.
+ * instead and thus we should keep waiting for it. The request ID is released in
+ * the RPC Handler once ``true`` is returned.
  *
  * :param ctx: This is :c:var:`rpchandler_funcs.msg` context.
  * :param cookie: This is the pointer provided as context when response
@@ -78,12 +79,50 @@ typedef bool (*rpcresponse_callback_t)(struct rpchandler_msg *ctx, void *cookie)
  * :param request_id: Request ID of response to be waited for.
  * :param func: The callback function that is called when response is received.
  * :param cookie: Pointer passed as an extra argument to the callback function.
- * :return: Object you need to use to reference to this response.
+ * :return: Object you need to use to reference to this response or ``NULL``
+ *   if response with the same request ID is already expected.
  */
-[[gnu::nonnull]]
+[[gnu::nonnull(1, 3)]]
 rpcresponse_t rpcresponse_expect(rpchandler_responses_t responses,
 	int request_id, rpcresponse_callback_t func, void *cookie);
 
+/** Register that new response will be received without waiting for it.
+ *
+ * This is variant of :c:func:`rpcresponse_expect` for asynchronous
+ * processing. The response is delivered only to the callback and the
+ * expectation is automatically released once callback returns ``true``. There
+ * is no response object and thus you can't wait for it. Use
+ * :c:func:`rpcresponse_cancel` if you no longer need the response.
+ *
+ * This allows you to have many requests in flight without a thread waiting
+ * for every one of them.
+ *
+ * :param responses: RPC Responses Handler object.
+ * :param request_id: Request ID of response to be waited for.
+ * :param func: The callback function that is called when response is received.
+ * :param cookie: Pointer passed as an extra argument to the callback function.
+ * :return: ``true`` if expectation was registered and ``false`` if response
+ *   with the same request ID is already expected.
+ */
+[[gnu::nonnull(1, 3)]]
+bool rpcresponse_expect_async(rpchandler_responses_t responses,
+	int request_id, rpcresponse_callback_t func, void *cookie);
+
+/** Cancel the expectation of the response with given request ID.
+ *
+ * This is intended for the expectations registered with
+ * :c:func:`rpcresponse_expect_async`. If callback is just being called then
+ * this waits for it to finish. The request ID is not released in the RPC
+ * Handler; use :c:func:`rpchandler_release_request_id` if it was allocated
+ * there.
+ *
+ * :param responses: RPC Responses Handler object.
+ * :param request_id: Request ID of the response no longer expected.
+ * :return: ``true`` if response was still expected and ``false`` otherwise.
+ */
+[[gnu::nonnull]]
+bool rpcresponse_cancel(rpchandler_responses_t responses, int request_id);
+
 /** Provide request ID of the given response.
  *
  * :param response: Response object the request ID should be provided for.
@@ -110,7 +149,7 @@ void rpcresponse_discard(rpcresponse_t response);
  * you can be sure that callback was executed.
  *
  * :param response: Response object to wait for.
- * :param timeout: Number of seconds we wait before we stop waiting.
+ * :param timeout: Number of milliseconds we wait before we stop waiting.
  * :return: ``true`` if response received or ``false`` otherwise (timeout
  *   encountered).
  */
@@ -128,6 +167,11 @@ bool rpcresponse_waitfor(rpcresponse_t response, int timeout);
 bool rpcresponse_validmsg(rpcresponse_t response);
 
 
+[[gnu::nonnull(1, 2, 4)]]
+rpcresponse_t _rpcresponse_send_request(rpchandler_t handler,
+	rpchandler_responses_t responses, int request_id,
+	rpcresponse_callback_t func, void *ctx);
+
 // clang-format off
 /** Macro that helps you pack request with parameter, registers response
  * expectation and sends the request.
@@ -139,20 +183,20 @@ bool rpcresponse_validmsg(rpcresponse_t response);
  * (thus your code is executed only once). You can use ``continue`` to skip rest
  * of the compound statement. To terminate packing for whatever reason you can
  * use ``break``. Do not use ``return`` or you must call
- * :c:func:`rpchandler_msg_drop` before you use ``return`` to prevent deadlock.
+ * :c:func:`rpchandler_msg_drop` before you use ``return`` to prevent deadlock
+ * and :c:func:`rpchandler_release_request_id` with ``request_id`` to not leak
+ * the request ID.
  *
  * The example usage:
  *
  * .. code-block:: c
  *
  *   rpcresponse_t response;
- *   rpcresponse_send_request(handler, responses_handler, "test/device/prop", "set", response) {
+ *   rpcresponse_send_request(handler, responses_handler, "test/device/prop", "set", NULL, callback, NULL, response) {
  *   	cp_pack_int(packer, 42);
  *   }
- *   struct rpcreceive *receive;
- *   const struct rpcmsg_meta *meta;
- *   if (response && rpcresponse_waitfor(response, &receive, &meta, 300)) {
- *   	// Parse result value here
+ *   if (response && rpcresponse_waitfor(response, 300)) {
+ *   	// Result was handled by the callback
  *   }
  *
  * :param handler: The :c:type:`rpchandler_t` object associated with ``responses``.
@@ -172,21 +216,19 @@ bool rpcresponse_validmsg(rpcresponse_t response);
 	for (int request_id = rpchandler_next_request_id(handler), __ = 1; __; ({ \
 			 if (__) { \
 				 rpchandler_msg_drop(handler); \
+				 rpchandler_release_request_id(handler, request_id); \
 				 response = NULL; \
 				 __--; \
 			 } \
 		 })) \
-		for (cp_pack_t packer = rpchandler_msg_new_request( \
-				 (handler), (path), (method), (uid), request_id); \
-			packer; ({ \
+		for (cp_pack_t packer = rpchandler_msg_new(handler); packer && \
+			rpcmsg_pack_request(packer, (path), (method), (uid), request_id); \
+			({ \
 				cp_pack_container_end(packer); \
 				packer = NULL; \
-				response = rpcresponse_expect((responses), request_id, func, ctx); \
+				response = _rpcresponse_send_request( \
+					(handler), (responses), request_id, func, ctx); \
 				__ = 0; \
-				if (!rpchandler_msg_send(handler)) { \
-					rpcresponse_discard(responses, response); \
-					response = NULL; \
-				} \
 			}))
 
 /** Send request without any parameter and provide response object for it.
@@ -195,8 +237,9 @@ bool rpcresponse_validmsg(rpcresponse_t response);
  * response.
  *
  * The used functions in this order: :c:func:`rpchandler_msg_new`,
- * :c:func:`rpcmsg_request_id`, :c:func:`rpcmsg_pack_request_void`,
- * :c:func:`rpcresponse_expect`, and :c:func:`rpchandler_msg_send`.
+ * :c:func:`rpchandler_next_request_id`, :c:func:`rpcmsg_pack_request_void`,
+ * :c:func:`rpcresponse_expect`, and :c:func:`rpchandler_msg_send`. The request
+ * ID is released by :c:func:`rpcresponse_discard` if response wasn't received.
  *
  * :param handler: The RPC Handler responses object is registered in.
  * :param responses: The RPC Responses Handler object to be used.
@@ -209,7 +252,7 @@ bool rpcresponse_validmsg(rpcresponse_t response);
  * :return: Object referencing response to this request or `NULL` in case
  *   request sending failed.
  */
-[[gnu::nonnull]]
+[[gnu::nonnull(1, 2, 3, 4, 6)]]
 rpcresponse_t rpcresponse_send_request_void(rpchandler_t handler,
 	rpchandler_responses_t responses, const char *path, const char *method,
 	const char *uid, rpcresponse_callback_t func, void *ctx);
@@ -32,7 +32,9 @@ typedef void (*rpchandler_signal_func_t)(
 
 /** Create new RPC Signals Handle.
  *
- * :param func: The function that is called when signal is received.
+ * :param func: The function that is called when signal is received. It is
+ *   called only for signals without route (:c:func:`rpchandler_signals_route`)
+ *   and it can be ``NULL``.
  * :param cookie: The cookie passed to the `func`.
  * :return: A new RPC Signals Handler object.
  */
@@ -69,7 +71,8 @@ struct rpchandler_stage rpchandler_signals_stage(
  *
  * The subscription happens on the background and thus return from this function
  * doesn't signal immediate propagation. You can even call this before you start
- * RPC handler or even include this object in the stages.
+ * RPC handler or even include this object in the stages. All pending subscribe
+ * and unsubscribe requests are sent at once in the next RPC Handler's idle.
  *
  * :param rpchandler_signals: RPC Signals Handler object.
  * :param ri: String containing RPC RI. It doesn't have to stay valid after
@@ -92,6 +95,42 @@ void rpchandler_signals_subscribe(
 void rpchandler_signals_unsubscribe(
 	rpchandler_signals_t rpchandler_signals, const char *ri);
 
+/** Register function to be called for signals matching given RI.
+ *
+ * Signals are dispatched to the routes through an index of RIs' paths and
+ * thus this is efficient even with a lot of routes. Only one function is
+ * called for every signal; if multiple RIs match then the one with more
+ * literal path nodes is preferred. The function passed to
+ * :c:func:`rpchandler_signals_new` is called only for signals not matching any
+ * route.
+ *
+ * This doesn't subscribe for the RI. Use
+ * :c:func:`rpchandler_signals_subscribe` to do so.
+ *
+ * :param rpchandler_signals: RPC Signals Handler object.
+ * :param ri: String containing RPC RI. It doesn't have to stay valid after
+ *   function return.
+ * :param func: The function that is called when matching signal is received.
+ * :param cookie: The cookie passed to the ``func``.
+ * :return: ``true`` if route was added and ``false`` if RI is invalid.
+ */
+[[gnu::nonnull(1, 2, 3)]]
+bool rpchandler_signals_route(rpchandler_signals_t rpchandler_signals,
+	const char *ri, rpchandler_signal_func_t func, void *cookie);
+
+/** Remove route previously added with :c:func:`rpchandler_signals_route`.
+ *
+ * :param rpchandler_signals: RPC Signals Handler object.
+ * :param ri: String containing RPC RI.
+ * :param func: The function passed to :c:func:`rpchandler_signals_route`.
+ * :param cookie: The cookie passed to :c:func:`rpchandler_signals_route`.
+ * :return: ``true`` if route was removed and ``false`` if there is no such
+ *   route.
+ */
+[[gnu::nonnull(1, 2, 3)]]
+bool rpchandler_signals_unroute(rpchandler_signals_t rpchandler_signals,
+	const char *ri, rpchandler_signal_func_t func, void *cookie);
+
 /** Query if all subscribe and unsubscribe operations were performed.
  *
  * :param rpchandler_signals: RPC Signals Handler object.
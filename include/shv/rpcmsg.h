@@ -313,6 +313,9 @@ static inline bool rpcmsg_has_value(struct cpitem *item) {
  * login and ping operations. The upper limit of 63 comes from ChainPack where
  * it is the largest value still packed as a single integer.
  *
+ * Only a few requests can be in flight with these IDs. Prefer
+ * :c:func:`rpchandler_next_request_id` if you are using RPC Handler.
+ *
  * :return: Request ID.
  */
 int rpcmsg_request_id(void);
@@ -28,6 +28,43 @@
 bool rpcri_match(
 	const char *ri, const char *path, const char *method, const char *signal);
 
+/*! Compiled RPC RI. */
+typedef struct rpcri *rpcri_t;
+
+/*! Compile RPC RI for repeated matching.
+ *
+ * The @ref rpcri_match parses RI on every call and its wildcards matching can
+ * take time that grows faster than linear with the number of nodes. The
+ * compiled RI matches the same way but in time linear to the length of the
+ * matched strings. It is beneficial when the same RI is matched many times.
+ *
+ * @param ri: RPC RI to be compiled.
+ * @returns Compiled RI that needs to be freed with @ref rpcri_free or `NULL`
+ *   in case RI is invalid (there is no `:`) or memory allocation failed.
+ */
+[[gnu::nonnull]]
+rpcri_t rpcri_compile(const char *ri);
+
+/*! Check if given method or signal matches compiled RPC RI.
+ *
+ * This provides the same result as @ref rpcri_match.
+ *
+ * @param ri: Compiled RPC RI (@ref rpcri_compile).
+ * @param path: SHV Path that RI should match.
+ * @param method: SHV RPC method name that RI should match.
+ * @param signal: RPC signal name that RI should match or `NULL`.
+ * @returns `true` if RI matches, `false` otherwise.
+ */
+[[gnu::nonnull(1, 2, 3)]]
+bool rpcri_match_compiled(
+	rpcri_t ri, const char *path, const char *method, const char *signal);
+
+/*! Free compiled RPC RI.
+ *
+ * @param ri: Compiled RPC RI. It can be `NULL` and in such case it does nothing.
+ */
+void rpcri_free(rpcri_t ri);
+
 /*! Check if given path matches given pattern.
  *
  * This is provided separately from RI due to not being valid RI. It is the same
@@ -36,6 +36,76 @@ void rpcbroker_api_ls(struct clientctx *c, struct rpchandler_ls *ctx) {
 	broker_unlock(c->broker);
 }
 
+static struct rpcdir_packed broker_methods[] = {
+	{.method = &(const struct rpcdir){
+		.name = "name",
+		.result = "s",
+		.flags = RPCDIR_F_GETTER,
+		.access = RPCACCESS_BROWSE,
+	}},
+	{.method = &(const struct rpcdir){
+		.name = "clientInfo",
+		.param = "i",
+		.result = "!clientInfo|n",
+		.access = RPCACCESS_SUPER_SERVICE,
+	}},
+	{.method = &(const struct rpcdir){
+		.name = "mountedClientInfo",
+		.param = "s",
+		.result = "!clientInfo|n",
+		.access = RPCACCESS_SUPER_SERVICE,
+	}},
+	{.method = &(const struct rpcdir){
+		.name = "clients",
+		.result = "[i]",
+		.access = RPCACCESS_SUPER_SERVICE,
+	}},
+	{.method = &(const struct rpcdir){
+		.name = "mounts",
+		.result = "[s]",
+		.access = RPCACCESS_SUPER_SERVICE,
+	}},
+	{.method = &(const struct rpcdir){
+		.name = "disconnectClient",
+		.param = "i",
+		.access = RPCACCESS_SUPER_SERVICE,
+	}},
+	{.method = &(const struct rpcdir){
+		.name = "signalCache",
+		.result = "{i:hits,i:misses,i:size}",
+		.access = RPCACCESS_SUPER_SERVICE,
+	}},
+};
+#define BROKER_METHODS_CNT (sizeof broker_methods / sizeof *broker_methods)
+
+static struct rpcdir_packed current_client_methods[] = {
+	{.method = &(const struct rpcdir){
+		.name = "info",
+		.result = "!clientInfo",
+		.flags = RPCDIR_F_GETTER,
+		.access = RPCACCESS_BROWSE,
+	}},
+	{.method = &(const struct rpcdir){
+		.name = "subscribe",
+		.param = "s|[s:RPCRI,i:TTL]",
+		.result = "b",
+		.access = RPCACCESS_BROWSE,
+	}},
+	{.method = &(const struct rpcdir){
+		.name = "unsubscribe",
+		.param = "s",
+		.result = "b",
+		.access = RPCACCESS_BROWSE,
+	}},
+	{.method = &(const struct rpcdir){
+		.name = "subscriptions",
+		.result = "{i|n}",
+		.access = RPCACCESS_BROWSE,
+	}},
+};
+#define CURRENT_CLIENT_METHODS_CNT \
+	(sizeof current_client_methods / sizeof *current_client_methods)
+
 bool rpcbroker_api_dir(struct rpchandler_dir *ctx) {
 	if (!strcmp(ctx->path, ".broker")) {
 		if (ctx->name) { /* Faster match against gperf */
@@ -43,78 +113,16 @@ bool rpcbroker_api_dir(struct rpchandler_dir *ctx) {
 				rpchandler_dir_exists(ctx);
 			return true;
 		}
-		rpchandler_dir_result(ctx,
-			&(const struct rpcdir){
-				.name = "name",
-				.result = "s",
-				.flags = RPCDIR_F_GETTER,
-				.access = RPCACCESS_BROWSE,
-			});
-		rpchandler_dir_result(ctx,
-			&(const struct rpcdir){
-				.name = "clientInfo",
-				.param = "i",
-				.result = "!clientInfo|n",
-				.access = RPCACCESS_SUPER_SERVICE,
-			});
-		rpchandler_dir_result(ctx,
-			&(const struct rpcdir){
-				.name = "mountedClientInfo",
-				.param = "s",
-				.result = "!clientInfo|n",
-				.access = RPCACCESS_SUPER_SERVICE,
-			});
-		rpchandler_dir_result(ctx,
-			&(const struct rpcdir){
-				.name = "clients",
-				.result = "[i]",
-				.access = RPCACCESS_SUPER_SERVICE,
-			});
-		rpchandler_dir_result(ctx,
-			&(const struct rpcdir){
-				.name = "mounts",
-				.result = "[s]",
-				.access = RPCACCESS_SUPER_SERVICE,
-			});
-		rpchandler_dir_result(ctx,
-			&(const struct rpcdir){
-				.name = "disconnectClient",
-				.param = "i",
-				.access = RPCACCESS_SUPER_SERVICE,
-			});
+		for (size_t i = 0; i < BROKER_METHODS_CNT; i++)
+			rpchandler_dir_result_packed(ctx, &broker_methods[i]);
 	} else if (!strcmp(ctx->path, ".broker/currentClient")) {
 		if (ctx->name) { /* Faster match against gperf */
 			if (gperf_api_current_client_method(ctx->name, strlen(ctx->name)))
 				rpchandler_dir_exists(ctx);
 			return true;
 		}
-		rpchandler_dir_result(ctx,
-			&(const struct rpcdir){
-				.name = "info",
-				.result = "!clientInfo",
-				.flags = RPCDIR_F_GETTER,
-				.access = RPCACCESS_BROWSE,
-			});
-		rpchandler_dir_result(ctx,
-			&(const struct rpcdir){
-				.name = "subscribe",
-				.param = "s|[s:RPCRI,i:TTL]",
-				.result = "b",
-				.access = RPCACCESS_BROWSE,
-			});
-		rpchandler_dir_result(ctx,
-			&(const struct rpcdir){
-				.name = "unsubscribe",
-				.param = "s",
-				.result = "b",
-				.access = RPCACCESS_BROWSE,
-			});
-		rpchandler_dir_result(ctx,
-			&(const struct rpcdir){
-				.name = "subscriptions",
-				.result = "{i|n}",
-				.access = RPCACCESS_BROWSE,
-			});
+		for (size_t i = 0; i < CURRENT_CLIENT_METHODS_CNT; i++)
+			rpchandler_dir_result_packed(ctx, &current_client_methods[i]);
 	}
 	return false;
 }
@@ -125,11 +133,11 @@ static void pack_subscriptions(cp_pack_t pack, struct clientctx *client) {
 	struct timespec now;
 	clock_gettime(CLOCK_MONOTONIC, &now);
 	for (size_t i = 0; i < client->broker->subscriptions_cnt; i++)
-		if (nbool(client->broker->subscriptions[i].clients, client->cid)) {
-			cp_pack_str(pack, client->broker->subscriptions[i].ri);
+		if (nbool(client->broker->subscriptions[i]->clients, client->cid)) {
+			cp_pack_str(pack, client->broker->subscriptions[i]->ri);
 			size_t y = 0;
 			while (y < client->ttlsubs_cnt &&
-				client->ttlsubs[y].ri != client->broker->subscriptions[i].ri)
+				client->ttlsubs[y].ri != client->broker->subscriptions[i]->ri)
 				y++;
 			if (y < client->ttlsubs_cnt)
 				cp_pack_int(pack, client->ttlsubs[y].ttl - now.tv_sec);
@@ -144,6 +152,8 @@ static void send_client_info(struct clientctx *client, struct rpchandler_msg *ct
 	cp_pack_map_begin(pack);
 	cp_pack_str(pack, "clientId");
 	cp_pack_int(pack, client->cid);
+	cp_pack_str(pack, "sendQueue");
+	cp_pack_uint(pack, rpcclient_queued(rpchandler_client(client->handler)));
 	if (client->role) {
 		if (client->username) {
 			cp_pack_str(pack, "userName");
@@ -179,10 +189,9 @@ static inline bool rpc_msg_request_broker(
 						ctx, RPCERR_INVALID_PARAM, "Must be 'null'");
 					return true;
 				}
+				/* Name is set on broker creation and never changes */
 				cp_pack_t pack = rpchandler_msg_new_response(ctx);
-				broker_lock(c->broker);
 				cp_pack_str(pack, c->broker->name);
-				broker_unlock(c->broker);
 				rpchandler_msg_send_response(ctx, pack);
 				return true;
 			}
@@ -238,14 +247,20 @@ static inline bool rpc_msg_request_broker(
 						ctx, RPCERR_INVALID_PARAM, "Must be 'null'");
 					return true;
 				}
-				cp_pack_t pack = rpchandler_msg_new_response(ctx);
-				cp_pack_list_begin(pack);
+				/* Copied first as broker lock can't be taken with send lock */
+				struct obstack *obs = rpchandler_obstack(ctx);
 				broker_lock(c->broker);
 				for_cid(c->broker) {
 					if (cid_valid(c->broker, cid))
-						cp_pack_int(pack, cid);
+						obstack_grow(obs, &cid, sizeof cid);
 				}
 				broker_unlock(c->broker);
+				size_t cnt = obstack_object_size(obs) / sizeof(int);
+				int *cids = obstack_finish(obs);
+				cp_pack_t pack = rpchandler_msg_new_response(ctx);
+				cp_pack_list_begin(pack);
+				for (size_t i = 0; i < cnt; i++)
+					cp_pack_int(pack, cids[i]);
 				cp_pack_container_end(pack);
 				rpchandler_msg_send_response(ctx, pack);
 				return true;
@@ -261,12 +276,19 @@ static inline bool rpc_msg_request_broker(
 						ctx, RPCERR_INVALID_PARAM, "Must be 'null'");
 					return true;
 				}
-				cp_pack_t pack = rpchandler_msg_new_response(ctx);
-				cp_pack_list_begin(pack);
+				struct obstack *obs = rpchandler_obstack(ctx);
 				broker_lock(c->broker);
-				for (size_t i = 0; i < c->broker->mounts_cnt; i++)
-					cp_pack_str(pack, c->broker->mounts[i].path);
+				size_t cnt = c->broker->mounts_cnt;
+				char **paths = obstack_alloc(obs, cnt * sizeof *paths);
+				for (size_t i = 0; i < cnt; i++) {
+					const char *path = c->broker->mounts[i].path;
+					paths[i] = obstack_copy0(obs, path, strlen(path));
+				}
 				broker_unlock(c->broker);
+				cp_pack_t pack = rpchandler_msg_new_response(ctx);
+				cp_pack_list_begin(pack);
+				for (size_t i = 0; i < cnt; i++)
+					cp_pack_str(pack, paths[i]);
 				cp_pack_container_end(pack);
 				rpchandler_msg_send_response(ctx, pack);
 				return true;
@@ -296,6 +318,34 @@ static inline bool rpc_msg_request_broker(
 						ctx, RPCERR_METHOD_CALL_EXCEPTION, "No such client");
 				return true;
 			}
+			case M_SIGNAL_CACHE: {
+				if (ctx->meta.access < RPCACCESS_SUPER_SERVICE)
+					break;
+				bool has_param = rpcmsg_has_value(ctx->item);
+				if (!rpchandler_msg_valid(ctx))
+					return true;
+				if (has_param) {
+					rpchandler_msg_send_error(
+						ctx, RPCERR_INVALID_PARAM, "Must be 'null'");
+					return true;
+				}
+				broker_lock(c->broker);
+				unsigned long hits = c->broker->sigcache.hits;
+				unsigned long misses = c->broker->sigcache.misses;
+				size_t size = c->broker->sigcache.cnt;
+				broker_unlock(c->broker);
+				cp_pack_t pack = rpchandler_msg_new_response(ctx);
+				cp_pack_map_begin(pack);
+				cp_pack_str(pack, "hits");
+				cp_pack_int(pack, hits);
+				cp_pack_str(pack, "misses");
+				cp_pack_int(pack, misses);
+				cp_pack_str(pack, "size");
+				cp_pack_int(pack, size);
+				cp_pack_container_end(pack);
+				rpchandler_msg_send_response(ctx, pack);
+				return true;
+			}
 		}
 	return false;
 }
@@ -6,11 +6,26 @@
 #include <shv/rpcbroker.h>
 
 #include "arr.h"
+#include "msgbuf.h"
 #include "nbool.h"
+#include "sigcache.h"
+#include "subindex.h"
 
 #define REUSE_TIMEOUT (600) /* Ten minutes before client ID reuse */
 #define NONCE_LEN (10)
 #define IDLE_TIMEOUT_LOGIN (5)
+#define QUEUE_LOW (64 * 1024)
+#define QUEUE_HIGH (1024 * 1024)
+
+/* Clients pinned so they can be used without holding the lock.
+ *
+ * The memory is reused and thus no allocation is required once it is large
+ * enough.
+ */
+struct pinned {
+	struct clientctx **clients;
+	size_t cnt, siz;
+};
 
 struct clientctx {
 	int cid;
@@ -25,6 +40,23 @@ struct clientctx {
 	char *username;
 	unsigned activity_timeout;
 	time_t last_activity;
+	/* Signals propagated from this client */
+	struct msgbuf sigbuf;
+	nbool_t sigdest;
+	struct pinned sigpinned;
+	/* Number of pins by other threads. Unregister waits for it to drop to
+	 * zero. Use only while holding lock.
+	 */
+	unsigned pins;
+	/* Clients messages from this client are held for (NULL to send them right
+	 * away). The loop handling this client has to flush them.
+	 */
+	nbool_t *held;
+	/* Client ID of the client with too much data queued this client sent
+	 * messages to (NULL to ignore). The loop handling this client has to stop
+	 * reading its messages until that client catches up.
+	 */
+	int *blocked;
 	/* Subscriptions TTL */
 	ARR(
 		struct ttlsub {
@@ -51,14 +83,25 @@ struct rpcbroker {
 		},
 		mounts);
 
-	ARR(
-		struct subscription {
-			const char *ri;
-			nbool_t clients;
-		},
-		subscriptions);
+	/* Subscriptions sorted by RI and their index for signals matching */
+	ARR(struct subscription *, subscriptions);
+	struct subindex subindex;
+	/* Destinations of recently propagated signals */
+	struct sigcache sigcache;
+
+	/* Signals sent by broker itself. Use only while holding lock. */
+	struct msgbuf sigbuf;
+	nbool_t sigdest;
+	/* Released signal context kept for reuse */
+	struct rpcbroker_sigctx *sigctx;
+
+	/* Limits of the data queued for clients */
+	size_t queue_low, queue_high;
+	enum rpcbroker_overflow overflow;
 
 	pthread_mutex_t lock;
+	/* Broadcasted when some unregistered client is no longer pinned */
+	pthread_cond_t unpinned;
 };
 
 [[gnu::nonnull]]
@@ -134,4 +177,86 @@ bool unsubscribe(struct rpcbroker *broker, const char *ri, int cid);
 [[gnu::nonnull]]
 void unsubscribe_all(struct rpcbroker *broker, int cid);
 
+/* Collect clients signal should be sent to.
+ *
+ * The memory of `dest` is reused and thus no allocation is required once it is
+ * large enough. The destinations are cached and thus the cache must be
+ * invalidated on any change that can affect them.
+ *
+ * Make sure to call this while holding lock.
+ */
+[[gnu::nonnull]]
+bool signal_destinations(struct rpcbroker *broker, nbool_t *dest,
+	const char *path, const char *source, const char *signal,
+	rpcaccess_t access);
+
+/* Mark message for the client `to` to be held if messages from `from` are.
+ * The message then has to be sent with rpchandler_msg_send_more.
+ *
+ * Make sure to call this while holding lock.
+ */
+[[gnu::nonnull(2)]]
+static inline bool held_mark(struct clientctx *from, struct clientctx *to) {
+	if (from == NULL || from->held == NULL)
+		return false;
+	nbool_set(from->held, to->cid);
+	return true;
+}
+
+/* Check if client has more than `limit` bytes queued.
+ *
+ * The client is disconnected if it is over high watermark and
+ * RPCBROKER_OVERFLOW_DISCONNECT policy is used. See rpcbroker_queue_limits.
+ */
+[[gnu::nonnull]]
+bool queue_overflow(struct rpcbroker *broker, rpcclient_t client, size_t limit);
+
+/* Pin the client so its handler can be used without holding lock.
+ *
+ * Make sure to call this while holding lock.
+ */
+[[gnu::nonnull]]
+bool client_pin(struct pinned *pinned, struct clientctx *c);
+
+/* Release all pinned clients.
+ *
+ * Make sure to call this while holding lock.
+ */
+[[gnu::nonnull]]
+void clients_unpin(struct rpcbroker *broker, struct pinned *pinned);
+
+/* Send packed signal to all destinations.
+ *
+ * Destinations with too much data queued are skipped (repeated signals are
+ * skipped earlier). See rpcbroker_queue_limits. The signal is held if `from`
+ * is not `NULL` (see held_mark).
+ *
+ * Make sure to call this while holding lock. Prefer signal_pin with
+ * signal_send that write to the destinations without it.
+ */
+[[gnu::nonnull(1, 3)]]
+void signal_fanout(struct rpcbroker *broker, nbool_t dest,
+	const struct msgbuf *msgbuf, bool repeat, struct clientctx *from);
+
+/* Pin all destinations for signal_send. The signal is held for them if `from`
+ * is not `NULL` (see held_mark).
+ *
+ * Make sure to call this while holding lock.
+ */
+[[gnu::nonnull(1, 3)]]
+void signal_pin(struct rpcbroker *broker, nbool_t dest, struct pinned *pinned,
+	struct clientctx *from);
+
+/* Send packed signal to all destinations pinned with signal_pin. They have to
+ * be released with clients_unpin afterward.
+ *
+ * The same as signal_fanout but this has to be called without holding lock.
+ */
+[[gnu::nonnull(1, 2, 3)]]
+void signal_send(struct rpcbroker *broker, const struct pinned *pinned,
+	const struct msgbuf *msgbuf, bool repeat, struct clientctx *from);
+
+[[gnu::nonnull]]
+void sigctx_free(struct rpcbroker_sigctx *ctx);
+
 #endif
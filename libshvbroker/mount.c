@@ -1,5 +1,4 @@
 #include "mount.h"
-#include "multipack.h"
 
 static int mntcmp(const void *a, const void *b) {
 	const struct mount *da = a;
@@ -38,20 +37,18 @@ static void lsmod(struct clientctx *c, bool val) {
 	}
 	*strchrnul(node, '/') = '\0';
 
-	nbool_t dest =
-		signal_destinations(c->broker, prefix, "ls", "lsmod", RPCACCESS_BROWSE);
-	if (dest == NULL)
+	if (!signal_destinations(c->broker, &c->broker->sigdest, prefix, "ls",
+			"lsmod", RPCACCESS_BROWSE))
 		return;
-	struct multipack multipack;
-	cp_pack_t pack = multipack_init(c->broker, &multipack, dest);
+	cp_pack_t pack = msgbuf_pack(&c->broker->sigbuf);
 	rpcmsg_pack_signal(pack, prefix, "ls", "lsmod", NULL, RPCACCESS_BROWSE, false);
 	cp_pack_map_begin(pack);
 	cp_pack_str(pack, node);
 	cp_pack_bool(pack, val);
 	cp_pack_container_end(pack);
 	cp_pack_container_end(pack);
-	multipack_done(c->broker, &multipack, dest, true);
-	free(dest);
+	signal_fanout(
+		c->broker, c->broker->sigdest, &c->broker->sigbuf, false, NULL);
 }
 
 bool mount_register(struct clientctx *c) {
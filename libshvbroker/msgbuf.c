@@ -0,0 +1,97 @@
+#include "msgbuf.h"
+#include <stdlib.h>
+#include <string.h>
+#include <shv/chainpack.h>
+#include <shv/cp_tools.h>
+
+static bool reserve(struct msgbuf *msgbuf, size_t siz) {
+	struct rpcbuf *buf = msgbuf->buf;
+	size_t len = buf ? buf->len : 0;
+	size_t osiz = buf ? buf->siz : 0;
+	if (osiz - len >= siz)
+		return true;
+	size_t nsiz = osiz ? 2 * osiz : 64;
+	while (nsiz - len < siz)
+		nsiz *= 2;
+	/* Only the buffer no client holds can be modified */
+	struct rpcbuf *nbuf = realloc(buf, sizeof *nbuf + nsiz);
+	if (nbuf == NULL)
+		return false;
+	if (buf == NULL) {
+		nbuf->refs = 1;
+		nbuf->len = 0;
+	}
+	nbuf->siz = nsiz;
+	msgbuf->buf = nbuf;
+	return true;
+}
+
+static bool pack_func(void *ptr, const struct cpitem *item) {
+	struct msgbuf *msgbuf = ptr;
+	/* Buffer must be allocated, pack to NULL only calculates size. */
+	if (!reserve(msgbuf, 1))
+		return false;
+	struct rpcbuf *buf = msgbuf->buf;
+	ssize_t res;
+	while ((res = chainpack_pack_buf(
+				buf->data + buf->len, buf->siz - buf->len, item)) < 0) {
+		if (!reserve(msgbuf, buf->siz - buf->len + 1))
+			return false;
+		buf = msgbuf->buf;
+	}
+	buf->len += res;
+	return true;
+}
+
+cp_pack_t msgbuf_pack(struct msgbuf *msgbuf) {
+	msgbuf->func = pack_func;
+	if (msgbuf->buf && msgbuf->buf->refs > 1) {
+		/* Some client still has the previous message queued */
+		rpcbuf_unref(msgbuf->buf);
+		msgbuf->buf = NULL;
+	}
+	if (msgbuf->buf)
+		msgbuf->buf->len = 0;
+	return &msgbuf->func;
+}
+
+bool msgbuf_rawcopy(struct msgbuf *msgbuf, rpcclient_t client) {
+	size_t siz;
+	do {
+		if (!reserve(msgbuf, BUFSIZ))
+			return false;
+		struct rpcbuf *buf = msgbuf->buf;
+		siz = client->rawread(client, buf->data + buf->len, BUFSIZ);
+		buf->len += siz;
+	} while (siz > 0);
+	return true;
+}
+
+bool msgbuf_send(const struct msgbuf *msgbuf, rpchandler_t handler, bool more) {
+	if (msgbuf->buf == NULL)
+		return false; /* Packing failed */
+	rpcclient_t client = rpchandler_client(handler);
+	cp_pack_t pack = rpchandler_msg_new(handler);
+	bool res;
+	if (client->rawwrite && !client->logger_out)
+		res = rpcclient_rawshare(client, msgbuf->buf);
+	else {
+		/* Loggers need items and not all clients support raw write. */
+		struct cp_unpack_buf unpack_buf;
+		cp_unpack_t unpack = cp_unpack_buf_init(
+			&unpack_buf, msgbuf->buf->data, msgbuf->buf->len);
+		struct cpitem item;
+		cpitem_unpack_init(&item);
+		while (cp_repack(unpack, &item, pack)) {}
+		res = item.type == CPITEM_INVALID && item.as.Error == CPERR_EOF;
+	}
+	if (res)
+		return more ? rpchandler_msg_send_more(handler)
+					: rpchandler_msg_send(handler);
+	rpchandler_msg_drop(handler);
+	return false;
+}
+
+void msgbuf_free(struct msgbuf *msgbuf) {
+	rpcbuf_unref(msgbuf->buf);
+}
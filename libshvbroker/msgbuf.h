@@ -0,0 +1,37 @@
+#ifndef SHVBROKER_MSGBUF_H
+#define SHVBROKER_MSGBUF_H
+
+#include <shv/cp_pack.h>
+#include <shv/rpcclient.h>
+#include <shv/rpchandler.h>
+
+/* Message packed once to the memory so it can be sent to multiple clients.
+ *
+ * The zero initialized structure is valid. The data are in reference counted
+ * buffer that clients queue by reference instead of copying it. The buffer is
+ * reused between messages if no client holds it and thus no allocation is
+ * needed once it grows large enough.
+ */
+struct msgbuf {
+	cp_pack_func_t func;
+	struct rpcbuf *buf;
+};
+
+/* Start a new message and get packer for it. */
+[[gnu::nonnull]]
+cp_pack_t msgbuf_pack(struct msgbuf *msgbuf);
+
+/* Copy rest of the received message without unpacking it. */
+[[gnu::nonnull]]
+bool msgbuf_rawcopy(struct msgbuf *msgbuf, rpcclient_t client);
+
+/* Send the packed message through the given handler. The `more` selects
+ * rpchandler_msg_send_more instead of rpchandler_msg_send.
+ */
+[[gnu::nonnull]]
+bool msgbuf_send(const struct msgbuf *msgbuf, rpchandler_t handler, bool more);
+
+[[gnu::nonnull]]
+void msgbuf_free(struct msgbuf *msgbuf);
+
+#endif
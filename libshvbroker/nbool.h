@@ -51,6 +51,18 @@ static inline void nbool_clear(nbool_t *v, unsigned i) {
 	}
 }
 
+/* Clear bit without releasing memory even if all bits are cleared. */
+static inline void nbool_unset(nbool_t v, unsigned i) {
+	if (nbool_valid_index(v, i))
+		v->vals[i / NBOOL_N] &= ~(1 << (i % NBOOL_N));
+}
+
+/* Clear all bits without releasing memory so it can be reused. */
+static inline void nbool_zero(nbool_t v) {
+	if (v)
+		memset(v->vals, 0, v->cnt * NBOOL_B);
+}
+
 [[gnu::nonnull(1)]]
 static inline void nbool_or(nbool_t *v, const nbool_t o) {
 	if (o == NULL)
@@ -3,6 +3,7 @@
 
 enum role_res role_assign(struct clientctx *ctx, const struct rpcbroker_role *role) {
 	enum role_res res = ROLE_RES_OK;
+	sigcache_invalidate(&ctx->broker->sigcache);
 	ctx->role = role;
 	if (role->mount_point) {
 		if (*role->mount_point == '\0' ||
@@ -32,6 +33,8 @@ error:
 void role_unassign(struct clientctx *ctx) {
 	if (ctx->role == NULL)
 		return;
+	sigcache_invalidate(&ctx->broker->sigcache);
+	rpchandler_nodes_changed(); /* Client's nodes are removed */
 	if (ctx->role->mount_point)
 		mount_unregister(ctx);
 	if (ctx->role->free)
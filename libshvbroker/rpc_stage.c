@@ -3,24 +3,41 @@
 
 #include "api.h"
 #include "broker.h"
-#include "multipack.h"
 #include "stages.h"
 
 
-static void propagate_msg(struct rpchandler_msg *ctx, struct clientctx *client) {
+static void propagate_msg(struct rpchandler_msg *ctx, struct clientctx *from,
+	struct clientctx *client) {
 	rpchandler_t handler = client->handler;
 	cp_pack_t pack = rpchandler_msg_new(handler);
+	bool held = held_mark(from, client);
 	broker_unlock(client->broker); /* We can unlock now, we have handler lock */
 	if (rpcmsg_has_value(ctx->item)) {
 		rpcmsg_pack_meta(pack, &ctx->meta);
-		cp_repack(ctx->unpack, ctx->item, pack);
-		cp_pack_container_end(pack);
+		/* Only meta is modified and thus the rest of the message can be copied
+		 * as it is without unpacking it.
+		 */
+		rpcclient_t src = rpchandler_client(from->handler);
+		rpcclient_t dst = rpchandler_client(handler);
+		if (rpcclient_rawfwd_possible(src, dst))
+			rpcclient_rawfwd(src, dst);
+		else {
+			cp_repack(ctx->unpack, ctx->item, pack);
+			cp_pack_container_end(pack);
+		}
 	} else
 		rpcmsg_pack_meta_void(pack, &ctx->meta);
-	if (rpchandler_msg_valid(ctx))
-		rpchandler_msg_send(handler);
-	else
+	/* Source has to wait if destination doesn't read what it already got */
+	if (queue_overflow(client->broker, rpchandler_client(handler),
+			client->broker->queue_high) &&
+		from->blocked)
+		*from->blocked = client->cid;
+	if (!rpchandler_msg_valid(ctx))
 		rpchandler_msg_drop(handler);
+	else if (held)
+		rpchandler_msg_send_more(handler);
+	else
+		rpchandler_msg_send(handler);
 }
 
 static inline enum rpchandler_msg_res rpc_msg_request(
@@ -58,7 +75,7 @@ static inline enum rpchandler_msg_res rpc_msg_request(
 		obstack_1grow(obs, '\0');
 		ctx->meta.user_id = obstack_finish(obs);
 	}
-	propagate_msg(ctx, client);
+	propagate_msg(ctx, c, client);
 	return RPCHANDLER_MSG_DONE;
 }
 
@@ -74,15 +91,17 @@ static inline enum rpchandler_msg_res rpc_msg_response(
 	struct clientctx *dest =
 		c->broker->clients[ctx->meta.cids[ctx->meta.cids_cnt - 1]];
 	ctx->meta.cids_cnt--;
-	propagate_msg(ctx, dest);
+	propagate_msg(ctx, c, dest);
 	return RPCHANDLER_MSG_DONE;
 }
 
 static inline enum rpchandler_msg_res rpc_msg_signal(
 	struct clientctx *c, struct rpchandler_msg *ctx) {
 	broker_lock(c->broker);
-	if (!c->role || !c->role->mount_point)
+	if (!c->role || !c->role->mount_point) {
+		broker_unlock(c->broker);
 		return RPCHANDLER_MSG_SKIP;
+	}
 	if (ctx->meta.path && *ctx->meta.path != '\0') {
 		struct obstack *obs = rpchandler_obstack(ctx);
 		obstack_printf(obs, "%s/%s", c->role->mount_point, ctx->meta.path);
@@ -91,20 +110,35 @@ static inline enum rpchandler_msg_res rpc_msg_signal(
 	} else
 		ctx->meta.path = (char *)c->role->mount_point;
 
-	nbool_t dest = signal_destinations(c->broker, ctx->meta.path,
+	bool has_dest = signal_destinations(c->broker, &c->sigdest, ctx->meta.path,
 		ctx->meta.source, ctx->meta.signal, ctx->meta.access);
-	if (dest == NULL) /* Not handling. Nobody cares about it */
+	broker_unlock(c->broker);
+	if (!has_dest) /* Not handling. Nobody cares about it */
 		return RPCHANDLER_MSG_SKIP;
-	struct multipack multipack;
-	cp_pack_t pack = multipack_init(c->broker, &multipack, dest);
+
+	/* Pack signal only once and send the same data to all destinations */
+	cp_pack_t pack = msgbuf_pack(&c->sigbuf);
 	if (rpcmsg_has_value(ctx->item)) {
 		rpcmsg_pack_meta(pack, &ctx->meta);
-		cp_repack(ctx->unpack, ctx->item, pack);
-		cp_pack_container_end(pack);
+		rpcclient_t client = rpchandler_client(c->handler);
+		if (client->rawread && !client->logger_in)
+			msgbuf_rawcopy(&c->sigbuf, client);
+		else {
+			cp_repack(ctx->unpack, ctx->item, pack);
+			cp_pack_container_end(pack);
+		}
 	} else
 		rpcmsg_pack_meta_void(pack, &ctx->meta);
-	multipack_done(c->broker, &multipack, dest, rpchandler_msg_valid(ctx));
-	free(dest);
+	if (rpchandler_msg_valid(ctx)) {
+		/* Lock is held only to pin destinations and not while writing */
+		broker_lock(c->broker);
+		signal_pin(c->broker, c->sigdest, &c->sigpinned, c);
+		broker_unlock(c->broker);
+		signal_send(c->broker, &c->sigpinned, &c->sigbuf, ctx->meta.repeat, c);
+		broker_lock(c->broker);
+		clients_unpin(c->broker, &c->sigpinned);
+		broker_unlock(c->broker);
+	}
 	return RPCHANDLER_MSG_SKIP;
 }
 
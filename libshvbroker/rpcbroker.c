@@ -14,8 +14,10 @@
 rpcbroker_t rpcbroker_new(
 	const char *name, rpcbroker_login_t login, void *login_cookie, int flags) {
 	struct rpcbroker *res = malloc(sizeof *res);
-	if (!(flags & RPCBROKER_F_NOLOCK))
+	if (!(flags & RPCBROKER_F_NOLOCK)) {
 		pthread_mutex_init(&res->lock, NULL);
+		pthread_cond_init(&res->unpinned, NULL);
+	}
 	res->name = name;
 	res->flags = flags;
 	res->login = login;
@@ -25,20 +27,43 @@ rpcbroker_t rpcbroker_new(
 	res->clients_lastuse = calloc(res->clients_siz, sizeof *res->clients_lastuse);
 	ARR_INIT(res->mounts);
 	ARR_INIT(res->subscriptions);
+	res->subindex = (struct subindex){};
+	res->sigcache = (struct sigcache){};
+	res->sigbuf = (struct msgbuf){};
+	res->sigdest = NULL;
+	res->sigctx = NULL;
+	res->queue_low = QUEUE_LOW;
+	res->queue_high = QUEUE_HIGH;
+	res->overflow = RPCBROKER_OVERFLOW_DROP;
 	return res;
 }
 
 void rpcbroker_destroy(rpcbroker_t broker) {
 	if (broker == NULL)
 		return;
-	if (!(broker->flags & RPCBROKER_F_NOLOCK))
+	if (!(broker->flags & RPCBROKER_F_NOLOCK)) {
 		pthread_mutex_destroy(&broker->lock);
+		pthread_cond_destroy(&broker->unpinned);
+	}
 	/* Note that all clients should be already unregistered */
 	// TODO possibly do no rely on that
 	free(broker->clients);
 	free(broker->clients_lastuse);
+	sigcache_free(&broker->sigcache);
+	msgbuf_free(&broker->sigbuf);
+	free(broker->sigdest);
+	if (broker->sigctx)
+		sigctx_free(broker->sigctx);
 	free(broker);
 }
+void rpcbroker_queue_limits(rpcbroker_t broker, size_t low, size_t high,
+	enum rpcbroker_overflow overflow) {
+	broker_lock(broker);
+	broker->queue_low = low;
+	broker->queue_high = high;
+	broker->overflow = overflow;
+	broker_unlock(broker);
+}
 
 
 int rpcbroker_client_register(rpcbroker_t broker, rpchandler_t handler,
@@ -81,10 +106,18 @@ int rpcbroker_client_register(rpcbroker_t broker, rpchandler_t handler,
 		? -1
 		: IDLE_TIMEOUT_LOGIN;
 	ctx->last_activity = now.tv_sec;
+	ctx->sigbuf = (struct msgbuf){};
+	ctx->sigdest = NULL;
+	ctx->sigpinned = (struct pinned){};
+	ctx->pins = 0;
+	ctx->held = NULL;
+	ctx->blocked = NULL;
 	ARR_INIT(ctx->ttlsubs);
 	if (role && role_assign(ctx, role) != ROLE_RES_OK) {
+		broker->clients[cid] = NULL;
 		broker->clients_lastuse[cid] = 0;
 		free(ctx);
+		broker_unlock(broker);
 		return -1;
 	}
 	*access_stage =
@@ -106,15 +139,26 @@ void rpcbroker_client_unregister(rpcbroker_t broker, int client_id) {
 	unsubscribe_all(broker, client_id);
 	free(ctx->username);
 	free(ctx->ttlsubs);
+	msgbuf_free(&ctx->sigbuf);
+	free(ctx->sigdest);
+	free(ctx->sigpinned.clients);
+	/* Other threads get the handler only while holding the broker's lock and
+	 * they either lock the handler for sending or pin the client before they
+	 * release it. Nobody can thus start using it after this point. Pinned
+	 * client is waited for here and rpchandler_destroy waits for anyone still
+	 * sending.
+	 */
+	while (ctx->pins > 0)
+		pthread_cond_wait(&broker->unpinned, &broker->lock);
 	free(ctx);
 	broker_unlock(broker);
-	if (!(broker->flags & RPCBROKER_F_NOLOCK)) {
-		// TODO ensure that nobody is using it through broker from other threads
-	}
 }
 
 rpchandler_t rpcbroker_client_handler(rpcbroker_t broker, int client_id) {
+	rpchandler_t res = NULL;
+	broker_lock(broker);
 	if (cid_valid(broker, client_id))
-		return broker->clients[client_id]->handler;
-	return NULL;
+		res = broker->clients[client_id]->handler;
+	broker_unlock(broker);
+	return res;
 }
@@ -1,12 +1,27 @@
 #include <stdlib.h>
 #include <errno.h>
 #include <limits.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdatomic.h>
+#include <time.h>
+#include <syslog.h>
+#include <unistd.h>
 #include <sys/epoll.h>
+#include <sys/eventfd.h>
 #include <shv/rpcbroker.h>
 
+#include "broker.h"
+
+#define EVENTS (64) /* Number of events fetched with single epoll_wait */
+#define DEFAULT_BUDGET (16)
+#define BLOCKED_POLL (10) /* Period in ms blocked peers are checked in */
+
 enum evtype {
 	EVT_SERVER,
 	EVT_PEER,
+	EVT_HANDOFF,
+	EVT_WRITABLE,
 };
 
 struct evgeneric {
@@ -21,50 +36,308 @@ struct evserver {
 struct evpeer {
 	enum evtype type;
 	int cid;
+	rpchandler_t handler;
 	struct evpeer *prev, *next;
+	/* Queue of peers with messages to be handled */
+	struct evpeer *rnext;
+	bool ready;
+	/* When idle has to be called (CLOCK_MONOTONIC in ms) */
+	long long deadline;
+	size_t timeri;
+	unsigned idle_pass;
+	/* Messages are not read until queued data are written */
+	bool throttled;
+	/* Client ID of the client this peer is blocked on or -1 */
+	int blocked;
+	/* Peer can't be polled and is removed once handled */
+	bool dropped;
 };
 
+/* Loop handling its own set of peers.
+ *
+ * Clients accepted by other thread are passed to the reactor through `handoff`
+ * list and `evfd` is used to wake it up.
+ *
+ * Peers are also polled for being writable in `wepfd` (edge triggered) so
+ * their queued data can be written. That one is polled through `epfd`.
+ *
+ * Messages propagated from our peers are only queued and clients they are
+ * queued for are collected in `held`. They are all written at the end of the
+ * loop iteration and thus multiple messages are written at once. The broker's
+ * lock is not held while writing; clients are only pinned with it.
+ */
+struct reactor {
+	enum evtype type; /* EVT_HANDOFF */
+	const struct rpcbroker_state *state;
+	int epfd;
+	int evfd;
+	int wepfd;
+	struct evgeneric writable;
+	struct evpeer *latest_peer;
+	struct evpeer *ready, *ready_last;
+	nbool_t held;
+	struct pinned held_pinned;
+	/* Min-heap of peers ordered by their deadline */
+	struct evpeer **timers;
+	size_t timers_cnt, timers_siz;
+	unsigned idle_pass;
+	size_t blocked_cnt;
+	pthread_mutex_t lock;
+	struct evpeer *handoff;
+	atomic_bool stop;
+	/* Reactors accepted clients are distributed to (none means this one) */
+	struct reactor *reactors;
+	size_t reactors_cnt, reactors_next;
+	pthread_t thread;
+};
+
+
+[[gnu::nonnull]]
+static void reactor_destroy(struct reactor *r) {
+	free(r->timers);
+	free(r->held);
+	free(r->held_pinned.clients);
+	close(r->wepfd);
+	close(r->evfd);
+	close(r->epfd);
+	pthread_mutex_destroy(&r->lock);
+}
+
+/* Returns false if reactor can't be initialized. It is destroyed in such case.
+ */
+[[gnu::nonnull]]
+static bool reactor_init(
+	struct reactor *r, const struct rpcbroker_state *state) {
+	*r = (struct reactor){
+		.type = EVT_HANDOFF,
+		.state = state,
+		.epfd = epoll_create1(0),
+		.evfd = eventfd(0, EFD_NONBLOCK),
+		.wepfd = epoll_create1(0),
+		.writable.type = EVT_WRITABLE,
+	};
+	pthread_mutex_init(&r->lock, NULL);
+	atomic_init(&r->stop, false);
+	struct epoll_event eev;
+	eev.events = EPOLLIN;
+	eev.data.ptr = r;
+	bool res = r->epfd >= 0 && r->evfd >= 0 && r->wepfd >= 0 &&
+		epoll_ctl(r->epfd, EPOLL_CTL_ADD, r->evfd, &eev) == 0;
+	eev.data.ptr = &r->writable;
+	res = res && epoll_ctl(r->epfd, EPOLL_CTL_ADD, r->wepfd, &eev) == 0;
+	if (!res) { // GCOVR_EXCL_START
+		syslog(LOG_ERR, "Broker loop initialization failed: %m");
+		reactor_destroy(r);
+	} // GCOVR_EXCL_STOP
+	return res;
+}
+
+[[gnu::nonnull]]
+static void reactor_wake(struct reactor *r) {
+	uint64_t v = 1;
+	/* EAGAIN means that counter is full and thus reactor is woken anyway */
+	if (write(r->evfd, &v, sizeof v) != sizeof v && errno != EAGAIN)
+		syslog(LOG_ERR, "Broker loop wake up failed: %m"); // GCOVR_EXCL_LINE
+}
+
+static long long now_ms(void) {
+	struct timespec t;
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return t.tv_sec * 1000LL + t.tv_nsec / 1000000;
+}
 
 [[gnu::nonnull]]
-static inline void evpeer_add(const struct rpcbroker_state *state, int epfd,
-	rpcserver_t server, struct evpeer **last) {
+static void timer_swap(struct reactor *r, size_t a, size_t b) {
+	struct evpeer *ev = r->timers[a];
+	r->timers[a] = r->timers[b];
+	r->timers[b] = ev;
+	r->timers[a]->timeri = a;
+	r->timers[b]->timeri = b;
+}
+
+[[gnu::nonnull]]
+static void timer_up(struct reactor *r, size_t i) {
+	while (i > 0 && r->timers[(i - 1) / 2]->deadline > r->timers[i]->deadline) {
+		timer_swap(r, i, (i - 1) / 2);
+		i = (i - 1) / 2;
+	}
+}
+
+[[gnu::nonnull]]
+static void timer_down(struct reactor *r, size_t i) {
+	while (true) {
+		size_t min = i;
+		for (size_t c = 2 * i + 1; c <= 2 * i + 2 && c < r->timers_cnt; c++)
+			if (r->timers[c]->deadline < r->timers[min]->deadline)
+				min = c;
+		if (min == i)
+			return;
+		timer_swap(r, i, min);
+		i = min;
+	}
+}
+
+[[gnu::nonnull]]
+static void timer_add(struct reactor *r, struct evpeer *ev) {
+	if (r->timers_cnt == r->timers_siz) {
+		r->timers_siz = r->timers_siz ? r->timers_siz * 2 : 8;
+		r->timers = realloc(r->timers, r->timers_siz * sizeof *r->timers);
+	}
+	ev->timeri = r->timers_cnt++;
+	r->timers[ev->timeri] = ev;
+	timer_up(r, ev->timeri);
+}
+
+[[gnu::nonnull]]
+static void timer_set(
+	struct reactor *r, struct evpeer *ev, long long deadline) {
+	bool earlier = deadline < ev->deadline;
+	ev->deadline = deadline;
+	if (earlier)
+		timer_up(r, ev->timeri);
+	else
+		timer_down(r, ev->timeri);
+}
+
+[[gnu::nonnull]]
+static void timer_del(struct reactor *r, struct evpeer *ev) {
+	size_t i = ev->timeri;
+	if (i != --r->timers_cnt) {
+		r->timers[i] = r->timers[r->timers_cnt];
+		r->timers[i]->timeri = i;
+		timer_up(r, i);
+		timer_down(r, r->timers[i]->timeri);
+	}
+}
+
+[[gnu::nonnull]]
+static void evpeer_ready(struct reactor *r, struct evpeer *ev) {
+	if (ev->ready)
+		return;
+	ev->ready = true;
+	ev->rnext = NULL;
+	if (r->ready_last)
+		r->ready_last->rnext = ev;
+	else
+		r->ready = ev;
+	r->ready_last = ev;
+}
+
+/* Remove peer that can't be polled. It is removed only once it is handled
+ * because it can be referenced by the currently handled events.
+ */
+[[gnu::nonnull]]
+static void evpeer_drop(struct reactor *r, struct evpeer *ev) {
+	syslog(LOG_ERR, "Dropping client [%d]: %m", ev->cid);
+	ev->dropped = true;
+	evpeer_ready(r, ev);
+}
+
+[[gnu::nonnull]]
+static void evpeer_link(struct reactor *r, struct evpeer *ev) {
+	ev->next = NULL;
+	ev->prev = r->latest_peer;
+	if (r->latest_peer)
+		r->latest_peer->next = ev;
+	r->latest_peer = ev;
+	ev->deadline = 0; /* Idle must be called right away */
+	timer_add(r, ev);
+
+	struct rpcbroker *broker = r->state->broker;
+	broker_lock(broker);
+	if (cid_valid(broker, ev->cid)) {
+		broker->clients[ev->cid]->held = &r->held;
+		broker->clients[ev->cid]->blocked = &ev->blocked;
+	}
+	broker_unlock(broker);
+
+	struct epoll_event eev;
+	eev.events = EPOLLIN | EPOLLHUP;
+	eev.data.ptr = ev;
+	int fd = rpcclient_pollfd(rpchandler_client(ev->handler));
+	if (epoll_ctl(r->epfd, EPOLL_CTL_ADD, fd, &eev) == -1) {
+		evpeer_drop(r, ev); // GCOVR_EXCL_LINE
+		return;				// GCOVR_EXCL_LINE
+	}
+	eev.events = EPOLLOUT | EPOLLET;
+	if (epoll_ctl(r->wepfd, EPOLL_CTL_ADD, fd, &eev) == -1)
+		evpeer_drop(r, ev); // GCOVR_EXCL_LINE
+}
+
+[[gnu::nonnull]]
+static inline void evpeer_add(struct reactor *r, rpcserver_t server) {
 	rpcclient_t client = rpcserver_accept(server);
 	if (!client)
 		return;
+	client->queue = true;
+	const struct rpcbroker_state *state = r->state;
 	int cid = state->new_client(state->cookie, state->broker, server, client);
 	if (cid < 0)
 		return;
 	struct evpeer *ev = malloc(sizeof *ev);
+	if (ev == NULL) { // GCOVR_EXCL_START malloc failure only
+		state->del_client(state->cookie, state->broker, cid);
+		return;
+	} // GCOVR_EXCL_STOP
 	*ev = (struct evpeer){
 		.type = EVT_PEER,
 		.cid = cid,
-		.next = NULL,
-		.prev = *last,
+		.handler = rpcbroker_client_handler(state->broker, cid),
+		.blocked = -1,
 	};
-	if (*last)
-		(*last)->next = ev;
-	*last = ev;
+	if (r->reactors_cnt == 0) {
+		evpeer_link(r, ev);
+		return;
+	}
+	struct reactor *target = &r->reactors[r->reactors_next++ % r->reactors_cnt];
+	pthread_mutex_lock(&target->lock);
+	ev->next = target->handoff;
+	target->handoff = ev;
+	pthread_mutex_unlock(&target->lock);
+	reactor_wake(target);
+}
 
-	struct epoll_event eev;
-	eev.events = EPOLLIN | EPOLLHUP;
-	eev.data.ptr = ev;
-	epoll_ctl( // TODO epoll error?
-		epfd, EPOLL_CTL_ADD, rpcclient_pollfd(client), &eev);
+[[gnu::nonnull]]
+static void evpeer_takeover(struct reactor *r) {
+	uint64_t v;
+	if (read(r->evfd, &v, sizeof v) != sizeof v && errno != EAGAIN)
+		syslog(LOG_ERR, "Broker loop wake up failed: %m"); // GCOVR_EXCL_LINE
+	pthread_mutex_lock(&r->lock);
+	struct evpeer *ev = r->handoff;
+	r->handoff = NULL;
+	pthread_mutex_unlock(&r->lock);
+	while (ev) {
+		struct evpeer *next = ev->next;
+		evpeer_link(r, ev);
+		ev = next;
+	}
 }
 
 [[gnu::nonnull]]
-static inline struct evpeer *evpeer_del(const struct rpcbroker_state *state,
-	int epfd, struct evpeer *ev, struct evpeer **last) {
-	epoll_ctl(epfd, EPOLL_CTL_DEL,
-		rpcclient_pollfd(
-			rpchandler_client(rpcbroker_client_handler(state->broker, ev->cid))),
-		NULL);
-	state->del_client(state->cookie, state->broker, ev->cid);
+static inline struct evpeer *evpeer_del(struct reactor *r, struct evpeer *ev) {
+	int fd = rpcclient_pollfd(rpchandler_client(ev->handler));
+	epoll_ctl(r->epfd, EPOLL_CTL_DEL, fd, NULL);
+	epoll_ctl(r->wepfd, EPOLL_CTL_DEL, fd, NULL);
+	r->state->del_client(r->state->cookie, r->state->broker, ev->cid);
+	timer_del(r, ev);
+	if (ev->blocked >= 0)
+		r->blocked_cnt--;
+	if (ev->ready) { /* Idle can remove peer still waiting in ready queue */
+		struct evpeer **pev = &r->ready;
+		struct evpeer *last = NULL;
+		while (*pev != ev) {
+			last = *pev;
+			pev = &(*pev)->rnext;
+		}
+		*pev = ev->rnext;
+		if (ev == r->ready_last)
+			r->ready_last = last;
+	}
 	if (ev->prev)
 		ev->prev->next = ev->next; // NOLINT(clang-analyzer-unix.Malloc)
 								   // clang-tidy doesn't understand sequence
-	if (ev == *last)
-		*last = ev->prev;
+	if (ev == r->latest_peer)
+		r->latest_peer = ev->prev;
 	else
 		ev->next->prev = ev->prev;
 	struct evpeer *res = ev->prev;
@@ -72,9 +345,216 @@ static inline struct evpeer *evpeer_del(const struct rpcbroker_state *state,
 	return res;
 }
 
+[[gnu::nonnull]]
+static void evpeer_throttle(
+	struct reactor *r, struct evpeer *ev, bool throttle) {
+	ev->throttled = throttle;
+	struct epoll_event eev;
+	eev.events = throttle ? EPOLLHUP : EPOLLIN | EPOLLHUP;
+	eev.data.ptr = ev;
+	if (epoll_ctl(r->epfd, EPOLL_CTL_MOD,
+			rpcclient_pollfd(rpchandler_client(ev->handler)), &eev) == -1) {
+		evpeer_drop(r, ev); // GCOVR_EXCL_LINE
+		return;				// GCOVR_EXCL_LINE
+	}
+	if (!throttle && rpcclient_pending(rpchandler_client(ev->handler)))
+		evpeer_ready(r, ev);
+}
+
+/* Write queued data of peers that became writable. */
+[[gnu::nonnull]]
+static void evpeer_flush(struct reactor *r) {
+	struct epoll_event events[EVENTS];
+	int pr;
+	do {
+		pr = epoll_wait(r->wepfd, events, EVENTS, 0);
+		for (int i = 0; i < pr; i++) {
+			struct evpeer *ev = events[i].data.ptr;
+			rpcclient_t client = rpchandler_client(ev->handler);
+			if (!rpchandler_flush(ev->handler))
+				evpeer_ready(r, ev); /* Handling detects the disconnect */
+			else if (ev->throttled && ev->blocked < 0 &&
+				rpcclient_queued(client) <= r->state->broker->queue_low)
+				evpeer_throttle(r, ev, false);
+		}
+	} while (pr == EVENTS);
+}
+
+/* Handle messages of all ready peers. Every peer gets only limited number of
+ * messages handled and if it has more already received it is queued again to
+ * be served after the others.
+ */
+[[gnu::nonnull]]
+static void evpeer_round(struct reactor *r) {
+	unsigned budget = r->state->budget ?: DEFAULT_BUDGET;
+	struct evpeer *ev = r->ready;
+	r->ready = r->ready_last = NULL;
+	while (ev) {
+		struct evpeer *next = ev->rnext;
+		ev->ready = false;
+		bool blocked = ev->blocked >= 0;
+		bool valid =
+			!ev->dropped && rpchandler_next_budget(ev->handler, budget);
+		if (!blocked && ev->blocked >= 0)
+			r->blocked_cnt++;
+		if (!valid) {
+			evpeer_del(r, ev);
+		} else {
+			/* Idle must be called again after message is received */
+			timer_set(r, ev, 0);
+			rpcclient_t client = rpchandler_client(ev->handler);
+			/* Do not read more messages if peer doesn't read responses or
+			 * the client it sends messages to doesn't read them.
+			 */
+			if (ev->blocked >= 0 ||
+				rpcclient_queued(client) > r->state->broker->queue_high)
+				evpeer_throttle(r, ev, true);
+			else if (rpcclient_pending(client))
+				evpeer_ready(r, ev);
+		}
+		ev = next;
+	}
+}
+
+/* Resume reading of peers that were blocked on clients that caught up or
+ * disconnected. Those clients can be handled by other reactors and thus this is
+ * polled.
+ */
+[[gnu::nonnull]]
+static void evpeer_unblock(struct reactor *r) {
+	if (r->blocked_cnt == 0)
+		return;
+	struct rpcbroker *broker = r->state->broker;
+	broker_lock(broker);
+	for (struct evpeer *ev = r->latest_peer; ev; ev = ev->prev) {
+		if (ev->blocked < 0)
+			continue;
+		if (cid_valid(broker, ev->blocked)) {
+			rpchandler_t dest = broker->clients[ev->blocked]->handler;
+			if (rpcclient_queued(rpchandler_client(dest)) > broker->queue_low)
+				continue;
+		}
+		ev->blocked = -1;
+		r->blocked_cnt--;
+		rpcclient_t client = rpchandler_client(ev->handler);
+		if (rpcclient_queued(client) <= broker->queue_low)
+			evpeer_throttle(r, ev, false);
+	}
+	broker_unlock(broker);
+}
+
+/* Write messages held while peers were handled. */
+[[gnu::nonnull]]
+static void reactor_flush(struct reactor *r) {
+	if (r->held == NULL || nbool_nbits(r->held) == 0)
+		return;
+	struct rpcbroker *broker = r->state->broker;
+	struct pinned *pinned = &r->held_pinned;
+	broker_lock(broker);
+	for_nbool(r->held, cid) {
+		/* Client is flushed right away if it can't be pinned */
+		if (cid_valid(broker, cid) && !client_pin(pinned, broker->clients[cid]))
+			rpchandler_flush(broker->clients[cid]->handler); // GCOVR_EXCL_LINE
+	}
+	nbool_zero(r->held);
+	broker_unlock(broker);
+	/* Disconnect is detected by the reactor handling that client */
+	for (size_t i = 0; i < pinned->cnt; i++)
+		rpchandler_flush(pinned->clients[i]->handler);
+	broker_lock(broker);
+	clients_unpin(broker, pinned);
+	broker_unlock(broker);
+}
+
+/* Call idle only for peers with expired deadline and return timeout till the
+ * next one. Every peer is called at most once so those that request immediate
+ * call are called only after next poll.
+ */
+[[gnu::nonnull]]
+static int evpeer_idle(struct reactor *r) {
+	long long now = now_ms();
+	r->idle_pass++;
+	while (r->timers_cnt && r->timers[0]->deadline <= now &&
+		r->timers[0]->idle_pass != r->idle_pass) {
+		struct evpeer *ev = r->timers[0];
+		ev->idle_pass = r->idle_pass;
+		int ntimeout = rpchandler_idling(ev->handler);
+		if (ntimeout < 0)
+			evpeer_del(r, ev);
+		else
+			timer_set(r, ev, now + ntimeout);
+	}
+	if (r->timers_cnt == 0)
+		return INT_MAX;
+	long long res = r->timers[0]->deadline - now;
+	return res < 0 ? 0 : res > INT_MAX ? INT_MAX : res;
+}
+
+[[gnu::nonnull(1)]]
+static void reactor_loop(struct reactor *r, volatile sig_atomic_t *halt) {
+	struct epoll_event events[EVENTS];
+	while ((!halt || !*halt) && !atomic_load(&r->stop)) {
+		/* Deadlines are checked every iteration so busy peers can't starve
+		 * idle handling (pings and timeouts) of the others.
+		 */
+		int timeout = evpeer_idle(r);
+		evpeer_unblock(r);
+		if (r->blocked_cnt && timeout > BLOCKED_POLL)
+			timeout = BLOCKED_POLL;
+		int pr = epoll_wait(r->epfd, events, EVENTS, r->ready ? 0 : timeout);
+		if (pr == -1) {
+			if (errno == EINTR)
+				continue;
+			syslog(LOG_ERR, "Broker loop poll failed: %m"); // GCOVR_EXCL_LINE
+			break;											// GCOVR_EXCL_LINE
+		}
+		for (int i = 0; i < pr; i++) {
+			struct evgeneric *evg = events[i].data.ptr;
+			switch (evg->type) {
+				case EVT_SERVER:
+					struct evserver *evs = events[i].data.ptr;
+					evpeer_add(r, evs->server);
+					break;
+				case EVT_PEER:
+					evpeer_ready(r, events[i].data.ptr);
+					break;
+				case EVT_HANDOFF:
+					evpeer_takeover(r);
+					break;
+				case EVT_WRITABLE:
+					evpeer_flush(r);
+					break;
+			}
+		}
+		evpeer_round(r);
+		reactor_flush(r);
+	}
+}
+
+[[gnu::nonnull]]
+static void reactor_disconnect(struct reactor *r) {
+	for (struct evpeer *ev = r->latest_peer; ev; ev = ev->prev)
+		rpcclient_disconnect(rpchandler_client(ev->handler));
+}
+
+static void *reactor_thread(void *arg) {
+	struct reactor *r = arg;
+	reactor_loop(r, NULL);
+	evpeer_takeover(r); /* Clients passed to us right before halt */
+	reactor_disconnect(r);
+	return NULL;
+}
+
 void rpcbroker_run(
 	const struct rpcbroker_state *state, volatile sig_atomic_t *halt) {
-	int epfd = epoll_create1(0);
+	rpcbroker_run_threads(state, halt, 0);
+}
+
+void rpcbroker_run_threads(const struct rpcbroker_state *state,
+	volatile sig_atomic_t *halt, unsigned threads) {
+	struct reactor acceptor;
+	if (!reactor_init(&acceptor, state))
+		return; // GCOVR_EXCL_LINE
 
 	struct evserver evservers[state->servers_cnt];
 	for (size_t i = 0; i < state->servers_cnt; i++) {
@@ -85,58 +565,58 @@ void rpcbroker_run(
 		struct epoll_event eev;
 		eev.events = EPOLLIN | EPOLLHUP;
 		eev.data.ptr = &evservers[i];
-		epoll_ctl( // TODO epoll error?
-			epfd, EPOLL_CTL_ADD, rpcserver_pollfd(state->servers[i]), &eev);
+		if (epoll_ctl(acceptor.epfd, EPOLL_CTL_ADD,
+				rpcserver_pollfd(state->servers[i]), &eev) == -1)
+			/* Broker still serves clients of other servers */
+			syslog(LOG_ERR, "Failed to poll server: %m"); // GCOVR_EXCL_LINE
 	}
 
-	struct evpeer *latest_peer = NULL;
-
-	int timeout = 0;
-	while (!halt || !*halt) {
-		struct epoll_event eev;
-		int pr = epoll_wait(epfd, &eev, 1, timeout);
-		if (pr == -1) {
-			if (errno != EINTR)
-				abort(); // TODO
-			timeout = 0;
-		} else if (pr != 0) {
-			timeout = 0;
-			struct evgeneric *evg = eev.data.ptr;
-			switch (evg->type) {
-				case EVT_SERVER:
-					struct evserver *evs = eev.data.ptr;
-					evpeer_add(state, epfd, evs->server, &latest_peer);
-					break;
-				case EVT_PEER:
-					struct evpeer *evp = eev.data.ptr;
-					rpchandler_t h =
-						rpcbroker_client_handler(state->broker, evp->cid);
-					if (h && !rpchandler_next(h))
-						evpeer_del(state, epfd, evp, &latest_peer);
-					break;
+	struct reactor *reactors = NULL;
+	if (threads > 0) {
+		reactors = malloc(threads * sizeof *reactors);
+		if (reactors == NULL) // GCOVR_EXCL_BR_LINE malloc failure only
+			threads = 0;	  // GCOVR_EXCL_LINE
+		/* Signals are blocked in reactors to be delivered to this thread */
+		sigset_t sigset, oldset;
+		sigfillset(&sigset);
+		pthread_sigmask(SIG_BLOCK, &sigset, &oldset);
+		for (unsigned i = 0; i < threads; i++) {
+			/* Continue with threads we were able to start */
+			if (!reactor_init(&reactors[i], state)) {
+				threads = i; // GCOVR_EXCL_LINE
+				break;		 // GCOVR_EXCL_LINE
 			}
-		} else {
-			timeout = INT_MAX;
-			for (struct evpeer *ev = latest_peer; ev;) {
-				int ntimeout = rpchandler_idling(
-					rpcbroker_client_handler(state->broker, ev->cid));
-				if (ntimeout < 0) {
-					ev = evpeer_del(state, epfd, ev, &latest_peer);
-					continue;
-				} else if (ntimeout < timeout)
-					timeout = ntimeout;
-				ev = ev->prev;
+			if (pthread_create(&reactors[i].thread, NULL, reactor_thread,
+					&reactors[i]) != 0) {
+				reactor_destroy(&reactors[i]);
+				threads = i;
+				break;
 			}
 		}
+		pthread_sigmask(SIG_SETMASK, &oldset, NULL);
+		acceptor.reactors = reactors;
+		acceptor.reactors_cnt = threads;
 	}
 
+	reactor_loop(&acceptor, halt);
+
 	/* The connection to all clients is first terminated before we unregister
 	 * them to ensure that we do not attempt to send signals.
 	 */
-	for (struct evpeer *ev = latest_peer; ev; ev = ev->prev)
-		rpcclient_disconnect(
-			rpchandler_client(rpcbroker_client_handler(state->broker, ev->cid)));
-	while (latest_peer)
-		evpeer_del(state, epfd, latest_peer, &latest_peer);
-	close(epfd);
+	for (unsigned i = 0; i < threads; i++) {
+		atomic_store(&reactors[i].stop, true);
+		reactor_wake(&reactors[i]);
+	}
+	for (unsigned i = 0; i < threads; i++)
+		pthread_join(reactors[i].thread, NULL);
+	reactor_disconnect(&acceptor);
+	while (acceptor.latest_peer)
+		evpeer_del(&acceptor, acceptor.latest_peer);
+	for (unsigned i = 0; i < threads; i++) {
+		while (reactors[i].latest_peer)
+			evpeer_del(&reactors[i], reactors[i].latest_peer);
+		reactor_destroy(&reactors[i]);
+	}
+	free(reactors);
+	reactor_destroy(&acceptor);
 }
@@ -0,0 +1,116 @@
+#include "sigcache.h"
+#include <assert.h>
+#include <string.h>
+
+static uint32_t fnv1a(uint32_t hash, const char *str, size_t len) {
+	for (size_t i = 0; i < len; i++) {
+		hash ^= (uint8_t)str[i];
+		hash *= 16777619;
+	}
+	return hash;
+}
+
+static void lru_unlink(struct sigcache *cache, struct sigcache_entry *e) {
+	if (e->prev)
+		e->prev->next = e->next;
+	else
+		cache->head = e->next;
+	if (e->next)
+		e->next->prev = e->prev;
+	else
+		cache->tail = e->prev;
+}
+
+static void lru_push(struct sigcache *cache, struct sigcache_entry *e) {
+	e->prev = NULL;
+	e->next = cache->head;
+	if (cache->head)
+		cache->head->prev = e;
+	else
+		cache->tail = e;
+	cache->head = e;
+}
+
+static void bucket_unlink(struct sigcache *cache, struct sigcache_entry *e) {
+	struct sigcache_entry **b = &cache->buckets[e->hash % SIGCACHE_BUCKETS];
+	while (*b != e)
+		b = &(*b)->hnext;
+	*b = e->hnext;
+}
+
+struct sigcache_entry *sigcache_entry(struct sigcache *cache, const char *path,
+	const char *source, const char *signal, rpcaccess_t access, bool *hit) {
+	size_t pathlen = strlen(path) + 1;
+	size_t sourcelen = strlen(source) + 1;
+	size_t signallen = signal ? strlen(signal) : 0;
+	size_t keylen = pathlen + sourcelen + signallen;
+	uint32_t hash = fnv1a(2166136261, path, pathlen);
+	hash = fnv1a(hash, source, sourcelen);
+	if (signal)
+		hash = fnv1a(hash, signal, signallen);
+	hash = fnv1a(hash, (const char *)&access, sizeof access);
+
+	struct sigcache_entry *e = cache->buckets[hash % SIGCACHE_BUCKETS];
+	for (; e; e = e->hnext)
+		if (e->hash == hash && e->access == access &&
+			e->has_signal == (signal != NULL) && e->keylen == keylen &&
+			!memcmp(e->key, path, pathlen) &&
+			!memcmp(e->key + pathlen, source, sourcelen) &&
+			(!signal || !memcmp(e->key + pathlen + sourcelen, signal, signallen)))
+			break;
+	if (e) {
+		if (e != cache->head) {
+			lru_unlink(cache, e);
+			lru_push(cache, e);
+		}
+		if (e->gen == cache->gen) {
+			cache->hits++;
+			*hit = true;
+			return e;
+		}
+	} else {
+		if (cache->cnt < SIGCACHE_SIZE) {
+			e = calloc(1, sizeof *e);
+			assert(e);
+			cache->cnt++;
+		} else {
+			/* Replace the least recently used entry */
+			e = cache->tail;
+			lru_unlink(cache, e);
+			bucket_unlink(cache, e);
+		}
+		if (e->keysiz < keylen) {
+			e->key = realloc(e->key, keylen);
+			assert(e->key);
+			e->keysiz = keylen;
+		}
+		memcpy(e->key, path, pathlen);
+		memcpy(e->key + pathlen, source, sourcelen);
+		if (signal)
+			memcpy(e->key + pathlen + sourcelen, signal, signallen);
+		e->keylen = keylen;
+		e->has_signal = signal != NULL;
+		e->access = access;
+		e->hash = hash;
+		e->hnext = cache->buckets[hash % SIGCACHE_BUCKETS];
+		cache->buckets[hash % SIGCACHE_BUCKETS] = e;
+		lru_push(cache, e);
+	}
+	cache->misses++;
+	*hit = false;
+	e->gen = cache->gen;
+	nbool_zero(e->dest);
+	e->any = false;
+	return e;
+}
+
+void sigcache_free(struct sigcache *cache) {
+	struct sigcache_entry *e = cache->head;
+	while (e) {
+		struct sigcache_entry *next = e->next;
+		free(e->key);
+		free(e->dest);
+		free(e);
+		e = next;
+	}
+}
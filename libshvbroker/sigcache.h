@@ -0,0 +1,62 @@
+#ifndef SHVBROKER_SIGCACHE_H
+#define SHVBROKER_SIGCACHE_H
+
+#include <stdint.h>
+#include <shv/rpcaccess.h>
+
+#include "nbool.h"
+
+#define SIGCACHE_SIZE (256) /* Maximum number of cached signals */
+#define SIGCACHE_BUCKETS (512)
+
+/* Cache of the signal destinations.
+ *
+ * Devices commonly send the same signal on the same path over and over again.
+ * The destinations (already filtered by the access level) are cached for such
+ * signals. The least recently used entries are replaced once the cache is
+ * full.
+ *
+ * Cache is invalidated as a whole by incrementing its generation. That has to
+ * be done on any change of subscriptions or roles.
+ */
+struct sigcache {
+	unsigned gen;
+	unsigned long hits, misses;
+	size_t cnt;
+	struct sigcache_entry {
+		/* Next entry in the same bucket */
+		struct sigcache_entry *hnext;
+		/* Entries ordered from the most recently used */
+		struct sigcache_entry *prev, *next;
+		uint32_t hash;
+		unsigned gen;
+		/* Path, source and signal separated by null byte */
+		char *key;
+		size_t keylen, keysiz;
+		bool has_signal;
+		rpcaccess_t access;
+		/* Cached destinations */
+		nbool_t dest;
+		bool any;
+	} *buckets[SIGCACHE_BUCKETS], *head, *tail;
+};
+
+/* Get cache entry for the given signal.
+ *
+ * The entry is either valid one (`hit` is set to `true`) or new one that has to
+ * be filled in by caller (`dest` is already zeroed).
+ */
+[[gnu::nonnull(1, 2, 3, 6)]]
+struct sigcache_entry *sigcache_entry(struct sigcache *cache, const char *path,
+	const char *source, const char *signal, rpcaccess_t access, bool *hit);
+
+/* Invalidate all entries in the cache. */
+[[gnu::nonnull]]
+static inline void sigcache_invalidate(struct sigcache *cache) {
+	cache->gen++;
+}
+
+[[gnu::nonnull]]
+void sigcache_free(struct sigcache *cache);
+
+#endif
@@ -1,25 +1,45 @@
 #include <shv/rpcbroker.h>
-#include "multipack.h"
+#include "broker.h"
 
 struct sigctx {
 	struct rpcbroker_sigctx pub;
 	rpcbroker_t broker;
 	nbool_t destinations;
-	struct multipack multipack;
+	struct pinned pinned;
+	struct msgbuf msgbuf;
+	bool repeat;
 };
 
 static inline struct sigctx *init(rpcbroker_t broker, const char *path,
 	const char *source, const char *signal, rpcaccess_t access) {
-	nbool_t dest = signal_destinations(broker, path, source, signal, access);
-	if (dest == NULL)
+	/* Reuse the released context to not allocate it for every signal */
+	struct sigctx *res = (struct sigctx *)broker->sigctx;
+	if (res)
+		broker->sigctx = NULL;
+	else {
+		res = malloc(sizeof *res);
+		res->broker = broker;
+		res->destinations = NULL;
+		res->pinned = (struct pinned){};
+		res->msgbuf = (struct msgbuf){};
+	}
+	if (!signal_destinations(
+			broker, &res->destinations, path, source, signal, access)) {
+		broker->sigctx = &res->pub;
 		return NULL;
-	struct sigctx *res = malloc(sizeof *res);
-	res->broker = broker;
-	res->destinations = dest;
-	res->pub.pack = multipack_init(broker, &res->multipack, dest);
+	}
+	res->pub.pack = msgbuf_pack(&res->msgbuf);
 	return res;
 }
 
+void sigctx_free(struct rpcbroker_sigctx *ctx) {
+	struct sigctx *c = (struct sigctx *)ctx;
+	free(c->destinations);
+	free(c->pinned.clients);
+	msgbuf_free(&c->msgbuf);
+	free(c);
+}
+
 struct rpcbroker_sigctx *rpcbroker_new_signal(rpcbroker_t broker,
 	const char *path, const char *source, const char *signal, const char *uid,
 	rpcaccess_t access, bool repeat) {
@@ -29,6 +49,7 @@ struct rpcbroker_sigctx *rpcbroker_new_signal(rpcbroker_t broker,
 	if (ctx) {
 		rpcmsg_pack_signal(
 			ctx->pub.pack, path, source, signal, uid, access, repeat);
+		ctx->repeat = repeat;
 		res = &ctx->pub;
 	}
 	broker_unlock(broker);
@@ -38,9 +59,18 @@ struct rpcbroker_sigctx *rpcbroker_new_signal(rpcbroker_t broker,
 static inline bool done(struct sigctx *ctx, bool val) {
 	rpcbroker_t broker = ctx->broker;
 	broker_lock(broker);
-	multipack_done(broker, &ctx->multipack, ctx->destinations, val);
-	free(ctx->destinations);
-	free(ctx);
+	if (val) {
+		/* Context is ours until it is released and thus can be used unlocked */
+		signal_pin(broker, ctx->destinations, &ctx->pinned, NULL);
+		broker_unlock(broker);
+		signal_send(broker, &ctx->pinned, &ctx->msgbuf, ctx->repeat, NULL);
+		broker_lock(broker);
+		clients_unpin(broker, &ctx->pinned);
+	}
+	if (broker->sigctx)
+		sigctx_free(&ctx->pub);
+	else
+		broker->sigctx = &ctx->pub;
 	broker_unlock(broker);
 	return true;
 }
@@ -58,13 +88,25 @@ bool rpcbroker_send_signal_void(rpcbroker_t broker, const char *path,
 	const char *source, const char *signal, const char *uid, rpcaccess_t access,
 	bool repeat) {
 	broker_lock(broker);
-	struct sigctx *ctx = init(broker, path, source, signal, access);
-	bool res = true;
-	if (ctx) {
-		rpcmsg_pack_signal_void(
-			ctx->pub.pack, path, source, signal, uid, access, repeat);
-		res = done(ctx, true);
+	if (!signal_destinations(
+			broker, &broker->sigdest, path, source, signal, access)) {
+		broker_unlock(broker);
+		return true;
 	}
+	cp_pack_t pack = msgbuf_pack(&broker->sigbuf);
+	rpcmsg_pack_signal_void(pack, path, source, signal, uid, access, repeat);
+	/* Shared buffer is packed again only if we no longer reference it */
+	struct msgbuf msgbuf = {};
+	if (broker->sigbuf.buf)
+		msgbuf.buf = rpcbuf_ref(broker->sigbuf.buf);
+	struct pinned pinned = {};
+	signal_pin(broker, broker->sigdest, &pinned, NULL);
 	broker_unlock(broker);
-	return res;
+	signal_send(broker, &pinned, &msgbuf, repeat, NULL);
+	broker_lock(broker);
+	clients_unpin(broker, &pinned);
+	broker_unlock(broker);
+	free(pinned.clients);
+	msgbuf_free(&msgbuf);
+	return true;
 }
@@ -0,0 +1,224 @@
+#include "subindex.h"
+#include <assert.h>
+#include "riseg.h"
+
+static bool indexable(const char *path, const char *end) {
+	for (const char *seg = path; seg; seg = nextseg(seg, end))
+		if (segtype(seg, seglen(seg, end)) == SEG_INVALID)
+			return false;
+	return true;
+}
+
+static struct subtrie_child *find_child(const struct subtrie_child *children,
+	size_t cnt, const char *seg, size_t len) {
+	size_t l = 0, u = cnt;
+	while (l < u) {
+		size_t p = (l + u) / 2;
+		int r = segcmp(children[p].name, seg, len);
+		if (r == 0)
+			return (struct subtrie_child *)&children[p];
+		if (r > 0)
+			u = p;
+		else
+			l = p + 1;
+	}
+	return NULL;
+}
+
+static int childcmp(const void *a, const void *b) {
+	const struct subtrie_child *da = a;
+	const struct subtrie_child *db = b;
+	return strcmp(da->name, db->name);
+}
+
+static struct subtrie *child(struct subtrie *node, const char *seg, size_t len) {
+	switch (segtype(seg, len)) {
+		case SEG_GLOBSTAR:
+			if (node->globstar == NULL)
+				node->globstar = calloc(1, sizeof *node->globstar);
+			return node->globstar;
+		case SEG_WILD:
+			for (size_t i = 0; i < node->wilds_cnt; i++)
+				if (!segcmp(node->wilds[i].name, seg, len))
+					return node->wilds[i].node;
+			struct subtrie_child *wild = ARR_ADD(node->wilds);
+			*wild = (struct subtrie_child){
+				strndup(seg, len), calloc(1, sizeof *wild->node)};
+			return wild->node;
+		default:
+			struct subtrie_child *c =
+				find_child(node->nodes, node->nodes_cnt, seg, len);
+			if (c)
+				return c->node;
+			c = ARR_ADD(node->nodes);
+			*c = (struct subtrie_child){
+				strndup(seg, len), calloc(1, sizeof *c->node)};
+			struct subtrie *res = c->node;
+			ARR_QSORT(node->nodes, childcmp);
+			return res;
+	}
+}
+
+void subindex_add(struct subindex *index, struct subscription *sub) {
+	const char *path_end = strchr(sub->ri, ':');
+	if (path_end == NULL)
+		return; /* Such RI never matches */
+	if (!indexable(sub->ri, path_end)) {
+		*ARR_ADD(index->linear) =
+			(struct subindex_linear){sub, rpcri_compile(sub->ri)};
+		return;
+	}
+	struct subtrie *node = &index->trie;
+	for (const char *seg = sub->ri; seg; seg = nextseg(seg, path_end))
+		node = child(node, seg, seglen(seg, path_end));
+	const char *method = path_end + 1;
+	const char *signal = strchr(method, ':');
+	struct subtrie_leaf *leaf = ARR_ADD(node->leafs);
+	*leaf = (struct subtrie_leaf){
+		.sub = sub,
+		.method = signal ? strndup(method, signal - method) : strdup(method),
+		.signal = signal ? signal + 1 : NULL,
+	};
+}
+
+static bool subtrie_empty(struct subtrie *node) {
+	return node->nodes_cnt == 0 && node->wilds_cnt == 0 &&
+		node->globstar == NULL && node->leafs_cnt == 0;
+}
+
+/* Remove subscription and return true if node is empty now. */
+static bool del(struct subtrie *node, const char *seg, const char *end,
+	struct subscription *sub) {
+	if (seg == NULL) {
+		for (size_t i = 0; i < node->leafs_cnt; i++)
+			if (node->leafs[i].sub == sub) {
+				free(node->leafs[i].method);
+				ARR_DEL(node->leafs, node->leafs + i);
+				break;
+			}
+		return subtrie_empty(node);
+	}
+	size_t len = seglen(seg, end);
+	const char *next = nextseg(seg, end);
+	switch (segtype(seg, len)) {
+		case SEG_GLOBSTAR:
+			if (node->globstar && del(node->globstar, next, end, sub)) {
+				free(node->globstar);
+				node->globstar = NULL;
+			}
+			break;
+		case SEG_WILD:
+			for (size_t i = 0; i < node->wilds_cnt; i++)
+				if (!segcmp(node->wilds[i].name, seg, len)) {
+					if (del(node->wilds[i].node, next, end, sub)) {
+						free(node->wilds[i].name);
+						free(node->wilds[i].node);
+						ARR_DEL(node->wilds, node->wilds + i);
+					}
+					break;
+				}
+			break;
+		default:
+			struct subtrie_child *c =
+				find_child(node->nodes, node->nodes_cnt, seg, len);
+			if (c && del(c->node, next, end, sub)) {
+				free(c->name);
+				free(c->node);
+				ARR_DEL(node->nodes, c);
+			}
+			break;
+	}
+	return subtrie_empty(node);
+}
+
+void subindex_del(struct subindex *index, struct subscription *sub) {
+	const char *path_end = strchr(sub->ri, ':');
+	if (path_end == NULL)
+		return;
+	if (!indexable(sub->ri, path_end)) {
+		for (size_t i = 0; i < index->linear_cnt; i++)
+			if (index->linear[i].sub == sub) {
+				rpcri_free(index->linear[i].ri);
+				ARR_DEL(index->linear, index->linear + i);
+				break;
+			}
+		return;
+	}
+	del(&index->trie, sub->ri, path_end, sub);
+}
+
+
+struct match {
+	nbool_t *dest;
+	const char *path_end;
+	const char *method;
+	const char *signal;
+};
+
+static void match_leafs(const struct subtrie *node, struct match *m) {
+	for (size_t i = 0; i < node->leafs_cnt; i++) {
+		const struct subtrie_leaf *leaf = &node->leafs[i];
+		bool match;
+		if (leaf->signal && m->signal)
+			match = rpcstr_match(leaf->method, m->method) &&
+				rpcstr_match(leaf->signal, m->signal);
+		else
+			/* Same as rpcri_match: the whole rest is matched against method */
+			match = rpcstr_match(strchr(leaf->sub->ri, ':') + 1, m->method);
+		if (match)
+			nbool_or(m->dest, leaf->sub->clients);
+	}
+}
+
+static void match(const struct subtrie *node, const char *seg, struct match *m) {
+	if (seg == NULL) {
+		match_leafs(node, m);
+		/* foo/\** matches also foo */
+		if (node->globstar)
+			match_leafs(node->globstar, m);
+		return;
+	}
+	size_t len = seglen(seg, m->path_end);
+	const char *next = nextseg(seg, m->path_end);
+
+	const struct subtrie_child *c =
+		find_child(node->nodes, node->nodes_cnt, seg, len);
+	if (c)
+		match(c->node, next, m);
+
+	if (node->wilds_cnt) {
+		char str[len + 1];
+		memcpy(str, seg, len);
+		str[len] = '\0';
+		for (size_t i = 0; i < node->wilds_cnt; i++)
+			if (rpcstr_match(node->wilds[i].name, str))
+				match(node->wilds[i].node, next, m);
+	}
+
+	if (node->globstar) {
+		/* Trailing ** matches the rest of the path */
+		match_leafs(node->globstar, m);
+		/* Otherwise it consumes at least one node */
+		const char *s = next;
+		while (true) {
+			match(node->globstar, s, m);
+			if (s == NULL)
+				break;
+			s = nextseg(s, m->path_end);
+		}
+	}
+}
+
+void subindex_match(const struct subindex *index, nbool_t *dest,
+	const char *path, const char *method, const char *signal) {
+	struct match m = {
+		.dest = dest,
+		.path_end = path + strlen(path),
+		.method = method,
+		.signal = signal,
+	};
+	match(&index->trie, path, &m);
+	for (size_t i = 0; i < index->linear_cnt; i++)
+		if (rpcri_match_compiled(index->linear[i].ri, path, method, signal))
+			nbool_or(dest, index->linear[i].sub->clients);
+}
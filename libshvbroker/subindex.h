@@ -0,0 +1,67 @@
+#ifndef SHVBROKER_SUBINDEX_H
+#define SHVBROKER_SUBINDEX_H
+
+#include <shv/rpcri.h>
+#include "arr.h"
+#include "nbool.h"
+
+struct subscription {
+	const char *ri;
+	nbool_t clients;
+};
+
+/* Node of the subscriptions index.
+ *
+ * The path portion of the RI is split to the nodes. Nodes without wildcard
+ * are sorted and looked up directly, nodes with wildcard are matched one by one
+ * and `**` node is handled on its own because it can match multiple nodes.
+ * Subscriptions are stored in the node where their path pattern ends together
+ * with their method and signal patterns.
+ */
+struct subtrie {
+	ARR(
+		struct subtrie_child {
+			char *name;
+			struct subtrie *node;
+		},
+		nodes);
+	ARR(struct subtrie_child, wilds);
+	struct subtrie *globstar;
+	ARR(
+		struct subtrie_leaf {
+			struct subscription *sub;
+			/* Method pattern and signal pattern (NULL if RI has none) */
+			char *method;
+			const char *signal;
+		},
+		leafs);
+};
+
+/* Index of subscriptions used to quickly find subscriptions matching signal.
+ *
+ * Not all RIs can be split to the nodes (such as `?` or bracket expression that
+ * can also match `/` or `**` that is not a whole node). Those are compiled and
+ * matched one by one.
+ */
+struct subindex {
+	struct subtrie trie;
+	ARR(
+		struct subindex_linear {
+			struct subscription *sub;
+			rpcri_t ri;
+		},
+		linear);
+};
+
+[[gnu::nonnull]]
+void subindex_add(struct subindex *index, struct subscription *sub);
+
+[[gnu::nonnull]]
+void subindex_del(struct subindex *index, struct subscription *sub);
+
+/* Add clients of all subscriptions matching given signal to `dest`. */
+[[gnu::nonnull(1, 2, 3, 4)]]
+void subindex_match(const struct subindex *index, nbool_t *dest,
+	const char *path, const char *method, const char *signal);
+
+#endif
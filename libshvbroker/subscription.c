@@ -1,56 +1,167 @@
+#include <sys/socket.h>
+
 #include "broker.h"
 
 static int subcmp(const void *a, const void *b) {
-	const struct subscription *da = a;
-	const struct subscription *db = b;
-	return strcmp(da->ri, db->ri);
+	const struct subscription *const *da = a;
+	const struct subscription *const *db = b;
+	return strcmp((*da)->ri, (*db)->ri);
 }
 
-const char *subscription_ri(struct rpcbroker *broker, const char *ri) {
+static struct subscription **subscription(
+	struct rpcbroker *broker, const char *ri) {
 	struct subscription ref = {.ri = ri};
-	struct subscription *sub = ARR_BSEARCH(&ref, broker->subscriptions, subcmp);
-	return sub ? sub->ri : NULL;
+	struct subscription *refp = &ref;
+	return ARR_BSEARCH(&refp, broker->subscriptions, subcmp);
+}
+
+static void subscription_free(
+	struct rpcbroker *broker, struct subscription **sub) {
+	subindex_del(&broker->subindex, *sub);
+	free((char *)(*sub)->ri);
+	free(*sub);
+	ARR_DEL(broker->subscriptions, sub);
+}
+
+const char *subscription_ri(struct rpcbroker *broker, const char *ri) {
+	struct subscription **sub = subscription(broker, ri);
+	return sub ? (*sub)->ri : NULL;
 }
 
 bool subscribe(struct rpcbroker *broker, const char *ri, int cid) {
-	struct subscription ref = {.ri = ri};
-	struct subscription *sub = ARR_BSEARCH(&ref, broker->subscriptions, subcmp);
+	struct subscription **sub = subscription(broker, ri);
 	if (sub) {
-		if (nbool(sub->clients, cid))
+		if (nbool((*sub)->clients, cid))
 			return false;
-		nbool_set(&sub->clients, cid);
+		sigcache_invalidate(&broker->sigcache);
+		nbool_set(&(*sub)->clients, cid);
 		return true;
 	}
 
-	sub = ARR_ADD(broker->subscriptions);
-	sub->ri = strdup(ri);
-	sub->clients = NULL;
-	nbool_set(&sub->clients, cid);
+	struct subscription *nsub = malloc(sizeof *nsub);
+	nsub->ri = strdup(ri);
+	nsub->clients = NULL;
+	nbool_set(&nsub->clients, cid);
+	*ARR_ADD(broker->subscriptions) = nsub;
+	sigcache_invalidate(&broker->sigcache);
 	ARR_QSORT(broker->subscriptions, subcmp);
+	subindex_add(&broker->subindex, nsub);
 	return true;
 }
 
 bool unsubscribe(struct rpcbroker *broker, const char *ri, int cid) {
-	struct subscription ref = {.ri = ri};
-	struct subscription *sub = ARR_BSEARCH(&ref, broker->subscriptions, subcmp);
-	if (!sub || !nbool(sub->clients, cid))
+	struct subscription **sub = subscription(broker, ri);
+	if (!sub || !nbool((*sub)->clients, cid))
 		return false;
-	nbool_clear(&sub->clients, cid);
-	if (!sub->clients) {
-		free((char *)sub->ri);
-		ARR_DEL(broker->subscriptions, sub);
-	}
+	sigcache_invalidate(&broker->sigcache);
+	nbool_clear(&(*sub)->clients, cid);
+	if (!(*sub)->clients)
+		subscription_free(broker, sub);
 	return true;
 }
 
 void unsubscribe_all(struct rpcbroker *broker, int cid) {
+	sigcache_invalidate(&broker->sigcache);
 	size_t i = 0;
 	while (i < broker->subscriptions_cnt) {
-		nbool_clear(&broker->subscriptions[i].clients, cid);
-		if (broker->subscriptions[i].clients == NULL) {
-			free((char *)broker->subscriptions[i].ri);
-			ARR_DEL(broker->subscriptions, broker->subscriptions + i);
-		} else
+		nbool_clear(&broker->subscriptions[i]->clients, cid);
+		if (broker->subscriptions[i]->clients == NULL)
+			subscription_free(broker, broker->subscriptions + i);
+		else
 			i++;
 	}
 }
+
+bool signal_destinations(struct rpcbroker *broker, nbool_t *dest,
+	const char *path, const char *source, const char *signal,
+	rpcaccess_t access) {
+	bool hit;
+	struct sigcache_entry *e = sigcache_entry(
+		&broker->sigcache, path, source, signal, access, &hit);
+	if (!hit) {
+		subindex_match(&broker->subindex, &e->dest, path, source, signal);
+		for_nbool(e->dest, cid) {
+			if (cid_active(broker, cid) &&
+				broker->clients[cid]->role->access(
+					broker->clients[cid]->role->access_cookie, path, source) >=
+					access)
+				e->any = true;
+			else
+				nbool_unset(e->dest, cid);
+		}
+	}
+	nbool_zero(*dest);
+	nbool_or(dest, e->dest);
+	return e->any;
+}
+
+bool queue_overflow(
+	struct rpcbroker *broker, rpcclient_t client, size_t limit) {
+	size_t queued = rpcclient_queued(client);
+	if (queued <= limit)
+		return false;
+	if (broker->overflow == RPCBROKER_OVERFLOW_DISCONNECT &&
+		queued > broker->queue_high)
+		/* The loop handling this client detects the disconnect */
+		shutdown(rpcclient_pollfd(client), SHUT_RDWR);
+	return true;
+}
+
+bool client_pin(struct pinned *pinned, struct clientctx *c) {
+	if (pinned->cnt == pinned->siz) {
+		size_t nsiz = pinned->siz ? 2 * pinned->siz : 8;
+		struct clientctx **nclients =
+			realloc(pinned->clients, nsiz * sizeof *nclients);
+		if (nclients == NULL) // GCOVR_EXCL_BR_LINE malloc failure only
+			return false;	  // GCOVR_EXCL_LINE
+		pinned->clients = nclients;
+		pinned->siz = nsiz;
+	}
+	pinned->clients[pinned->cnt++] = c;
+	c->pins++;
+	return true;
+}
+
+void clients_unpin(struct rpcbroker *broker, struct pinned *pinned) {
+	bool released = false;
+	for (size_t i = 0; i < pinned->cnt; i++) {
+		struct clientctx *c = pinned->clients[i];
+		/* Unregistered client might be waiting for it */
+		if (--c->pins == 0 && broker->clients[c->cid] != c)
+			released = true;
+	}
+	pinned->cnt = 0;
+	if (released)
+		pthread_cond_broadcast(&broker->unpinned);
+}
+
+void signal_fanout(struct rpcbroker *broker, nbool_t dest,
+	const struct msgbuf *msgbuf, bool repeat, struct clientctx *from) {
+	for_nbool(dest, cid) {
+		if (!cid_active(broker, cid))
+			continue;
+		struct clientctx *c = broker->clients[cid];
+		if (!queue_overflow(broker, rpchandler_client(c->handler),
+				repeat ? broker->queue_low : broker->queue_high))
+			msgbuf_send(msgbuf, c->handler, held_mark(from, c));
+	}
+}
+
+void signal_pin(struct rpcbroker *broker, nbool_t dest, struct pinned *pinned,
+	struct clientctx *from) {
+	for_nbool(dest, cid) {
+		if (cid_active(broker, cid) && client_pin(pinned, broker->clients[cid]))
+			held_mark(from, broker->clients[cid]);
+	}
+}
+
+void signal_send(struct rpcbroker *broker, const struct pinned *pinned,
+	const struct msgbuf *msgbuf, bool repeat, struct clientctx *from) {
+	bool more = from && from->held;
+	for (size_t i = 0; i < pinned->cnt; i++) {
+		rpchandler_t handler = pinned->clients[i]->handler;
+		if (!queue_overflow(broker, rpchandler_client(handler),
+				repeat ? broker->queue_low : broker->queue_high))
+			msgbuf_send(msgbuf, handler, more);
+	}
+}
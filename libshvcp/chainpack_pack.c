@@ -1,4 +1,5 @@
 #include <stdlib.h>
+#include <string.h>
 #include <shv/chainpack.h>
 #include <shv/cp.h>
 #include "common.h"
@@ -8,38 +9,70 @@
 #endif
 
 
+/* Destination for the ChainPack bytes. It is file if ``f`` is not ``NULL``,
+ * memory span if ``ptr`` is not ``NULL`` and otherwise bytes are only counted.
+ */
+struct dst {
+	FILE *f;
+	uint8_t *ptr;
+	size_t len;
+};
+
+static inline bool dst_putc(struct dst *d, uint8_t v) {
+	if (d->f)
+		return fputc_unlocked(v, d->f) == v;
+	if (d->ptr) {
+		if (d->len == 0)
+			return false;
+		*d->ptr++ = v;
+		d->len--;
+	}
+	return true;
+}
+
+static inline bool dst_write(struct dst *d, const void *buf, size_t siz) {
+	if (d->f)
+		return fwrite_unlocked(buf, 1, siz, d->f) == siz;
+	if (d->ptr) {
+		if (d->len < siz)
+			return false;
+		memcpy(d->ptr, buf, siz);
+		d->ptr += siz;
+		d->len -= siz;
+	}
+	return true;
+}
+
 #define PUTC(V) \
 	do { \
-		uint8_t __v = (V); \
-		if (f && fputc_unlocked(__v, f) != __v) \
+		if (!dst_putc(d, (V))) \
 			return -1; \
 		res++; \
 	} while (false)
 #define WRITE(V, SIZ) \
 	do { \
 		size_t __siz = SIZ; \
-		if (f) { \
-			if (fwrite_unlocked((V), 1, __siz, f) != __siz) \
-				return -1; \
-		} \
+		if (!dst_write(d, (V), __siz)) \
+			return -1; \
 		res += __siz; \
 	} while (false)
 #define CALL(FUNC, ...) \
 	do { \
-		ssize_t __cnt = FUNC(f, __VA_ARGS__); \
+		ssize_t __cnt = FUNC(d, __VA_ARGS__); \
 		if (__cnt == -1) \
 			return -1; \
 		res += __cnt; \
 	} while (false)
 
 
-static ssize_t chainpack_pack_int(FILE *f, long long v);
-static ssize_t chainpack_pack_uint(FILE *f, unsigned long long v);
+static ssize_t pack_int(struct dst *d, long long v);
+static ssize_t pack_uint(struct dst *d, unsigned long long v);
 
 
-ssize_t chainpack_pack(FILE *f, const struct cpitem *item) {
+[[gnu::always_inline]]
+static inline ssize_t pack(struct dst *d, const struct cpitem *item) {
 	ssize_t res = 0;
-	if (common_pack(&res, f, item))
+	if (common_pack(&res, d->f, item))
 		return res;
 
 	switch (item->type) {
@@ -54,7 +87,7 @@ ssize_t chainpack_pack(FILE *f, const struct cpitem *item) {
 				PUTC((item->as.Int % 64) + 64);
 			else {
 				PUTC(CPS_Int);
-				CALL(chainpack_pack_int, item->as.Int);
+				CALL(pack_int, item->as.Int);
 			}
 			break;
 		case CPITEM_UINT:
@@ -62,7 +95,7 @@ ssize_t chainpack_pack(FILE *f, const struct cpitem *item) {
 				PUTC(item->as.Int % 64);
 			else {
 				PUTC(CPS_UInt);
-				CALL(chainpack_pack_uint, item->as.UInt);
+				CALL(pack_uint, item->as.UInt);
 			}
 			break;
 		case CPITEM_DOUBLE:
@@ -77,8 +110,8 @@ ssize_t chainpack_pack(FILE *f, const struct cpitem *item) {
 			break;
 		case CPITEM_DECIMAL:
 			PUTC(CPS_Decimal);
-			CALL(chainpack_pack_int, item->as.Decimal.mantissa);
-			CALL(chainpack_pack_int, item->as.Decimal.exponent);
+			CALL(pack_int, item->as.Decimal.mantissa);
+			CALL(pack_int, item->as.Decimal.exponent);
 			break;
 		case CPITEM_BLOB:
 			if (item->as.Blob.flags & CPBI_F_FIRST) {
@@ -86,13 +119,13 @@ ssize_t chainpack_pack(FILE *f, const struct cpitem *item) {
 					PUTC(CPS_BlobChain);
 				} else {
 					PUTC(CPS_Blob);
-					CALL(chainpack_pack_uint,
+					CALL(pack_uint,
 						item->as.Blob.len + item->as.Blob.eoff);
 				}
 			}
 			if (item->as.Blob.len) {
 				if (item->as.Blob.flags & CPBI_F_STREAM)
-					CALL(chainpack_pack_uint, item->as.Blob.len);
+					CALL(pack_uint, item->as.Blob.len);
 				WRITE(item->rbuf, item->as.Blob.len);
 			}
 			if (item->as.Blob.flags & CPBI_F_STREAM &&
@@ -105,7 +138,7 @@ ssize_t chainpack_pack(FILE *f, const struct cpitem *item) {
 					PUTC(CPS_CString);
 				else {
 					PUTC(CPS_String);
-					CALL(chainpack_pack_uint,
+					CALL(pack_uint,
 						(int64_t)item->as.String.len + item->as.String.eoff);
 				}
 			}
@@ -134,7 +167,7 @@ ssize_t chainpack_pack(FILE *f, const struct cpitem *item) {
 				msecs |= 1;
 			if (!ms)
 				msecs |= 2;
-			CALL(chainpack_pack_int, msecs);
+			CALL(pack_int, msecs);
 			break;
 		case CPITEM_LIST:
 			PUTC(CPS_List);
@@ -158,7 +191,17 @@ ssize_t chainpack_pack(FILE *f, const struct cpitem *item) {
 	return res;
 }
 
-static ssize_t chainpack_pack_uint(FILE *f, unsigned long long v) {
+ssize_t chainpack_pack(FILE *f, const struct cpitem *item) {
+	struct dst d = {.f = f, .ptr = NULL};
+	return pack(&d, item);
+}
+
+ssize_t chainpack_pack_buf(uint8_t *buf, size_t siz, const struct cpitem *item) {
+	struct dst d = {.f = NULL, .ptr = buf, .len = siz};
+	return pack(&d, item);
+}
+
+static ssize_t pack_uint(struct dst *d, unsigned long long v) {
 	ssize_t res = 0;
 	unsigned bytes = chainpack_w_uint_bytes(v);
 	uint8_t buf[bytes];
@@ -169,7 +212,7 @@ static ssize_t chainpack_pack_uint(FILE *f, unsigned long long v) {
 	return res;
 }
 
-static ssize_t chainpack_pack_int(FILE *f, long long v) {
+static ssize_t pack_int(struct dst *d, long long v) {
 	ssize_t res = 0;
 	unsigned bytes = chainpack_w_int_bytes(v);
 	uint8_t buf[bytes];
@@ -1,24 +1,94 @@
+#include <string.h>
 #include <sys/param.h>
 #include <shv/chainpack.h>
 #include <shv/cp.h>
 #include "common.h"
 
 
-static size_t chainpack_unpack_uint(FILE *f, uintmax_t *v, enum cperror *err);
-static size_t chainpack_unpack_int(FILE *f, intmax_t *v, enum cperror *err);
-static size_t chainpack_unpack_buf(FILE *f, struct cpitem *item, enum cperror *err);
+/* Source of the ChainPack bytes. It is either file (if ``f`` is not ``NULL``)
+ * or memory span.
+ *
+ * The unpack functions are always inlined and thus the memory variant is
+ * compiled with ``f`` known to be ``NULL``. That removes the file branch from
+ * every byte read and multi-byte fields are read directly from the buffer with
+ * bounds checked only once for the whole field.
+ */
+struct src {
+	FILE *f;
+	const uint8_t *ptr;
+	size_t len;
+};
 
+static inline int src_getc(struct src *s) {
+	if (s->f)
+		return getc_unlocked(s->f);
+	if (s->len == 0)
+		return EOF;
+	s->len--;
+	return *s->ptr++;
+}
 
-size_t chainpack_unpack(FILE *f, struct cpitem *item) {
+static inline void src_ungetc(struct src *s, int c) {
+	if (s->f)
+		ungetc(c, s->f);
+	else {
+		s->ptr--;
+		s->len++;
+	}
+}
+
+/* Read exactly **siz** bytes. The **buf** can be NULL to just skip them. */
+static inline bool src_read(struct src *s, void *buf, size_t siz) {
+	if (s->f) {
+		if (buf)
+			return fread_unlocked(buf, siz, 1, s->f) == 1;
+		while (siz > 0) {
+			size_t bufsiz = MIN(siz, BUFSIZ);
+			uint8_t tmp[bufsiz];
+			if (fread_unlocked(tmp, bufsiz, 1, s->f) != 1)
+				return false;
+			siz -= bufsiz;
+		}
+		return true;
+	}
+	if (s->len < siz) {
+		s->ptr += s->len;
+		s->len = 0;
+		return false;
+	}
+	if (buf)
+		memcpy(buf, s->ptr, siz);
+	s->ptr += siz;
+	s->len -= siz;
+	return true;
+}
+
+static inline bool src_eof(struct src *s) {
+	return s->f ? feof(s->f) : true;
+}
+
+
+[[gnu::always_inline]]
+static inline size_t unpack_uint(
+	struct src *s, uintmax_t *v, enum cperror *err);
+[[gnu::always_inline]]
+static inline size_t unpack_int(struct src *s, intmax_t *v, enum cperror *err);
+[[gnu::always_inline]]
+static inline size_t unpack_buf(
+	struct src *s, struct cpitem *item, enum cperror *err);
+
+
+[[gnu::always_inline]]
+static inline size_t unpack(struct src *s, struct cpitem *item) {
 	size_t res = 0;
-	if (common_unpack(&res, f, item))
+	if (common_unpack(&res, s->f, item))
 		return res;
 #define GETC \
 	({ \
-		int __v = getc_unlocked(f); \
+		int __v = src_getc(s); \
 		if (__v == EOF) { \
 			item->type = CPITEM_INVALID; \
-			item->as.Error = feof(f) ? CPERR_EOF : CPERR_IO; \
+			item->as.Error = src_eof(s) ? CPERR_EOF : CPERR_IO; \
 			return res; \
 		} \
 		res++; \
@@ -27,10 +97,9 @@ size_t chainpack_unpack(FILE *f, struct cpitem *item) {
 #define READ(PTR, SIZ) \
 	do { \
 		size_t __siz = SIZ; \
-		ssize_t __v = fread_unlocked((PTR), __siz, 1, f); \
-		if (__v != 1) { \
+		if (!src_read(s, (PTR), __siz)) { \
 			item->type = CPITEM_INVALID; \
-			item->as.Error = feof(f) ? CPERR_EOF : CPERR_IO; \
+			item->as.Error = src_eof(s) ? CPERR_EOF : CPERR_IO; \
 			return res; \
 		} \
 		res += __siz; \
@@ -38,10 +107,10 @@ size_t chainpack_unpack(FILE *f, struct cpitem *item) {
 #define CALL(FUNC, ...) \
 	do { \
 		enum cperror err = CPERR_NONE; \
-		res += FUNC(f, __VA_ARGS__, &err); \
+		res += FUNC(s, __VA_ARGS__, &err); \
 		if (err != CPERR_NONE) { \
 			item->type = CPITEM_INVALID; \
-			if (err == CPERR_EOF && !feof(f)) \
+			if (err == CPERR_EOF && !src_eof(s)) \
 				item->as.Error = CPERR_IO; \
 			else \
 				item->as.Error = err; \
@@ -56,7 +125,7 @@ size_t chainpack_unpack(FILE *f, struct cpitem *item) {
 		 * we can write this code to serve them both.
 		 */
 		item->as.Blob.flags &= ~CPBI_F_FIRST;
-		CALL(chainpack_unpack_buf, item);
+		CALL(unpack_buf, item);
 		return res;
 	}
 
@@ -85,39 +154,39 @@ size_t chainpack_unpack(FILE *f, struct cpitem *item) {
 				break;
 			case CPS_Int:
 				item->type = CPITEM_INT;
-				CALL(chainpack_unpack_int, &item->as.Int);
+				CALL(unpack_int, &item->as.Int);
 				break;
 			case CPS_UInt:
 				item->type = CPITEM_UINT;
-				CALL(chainpack_unpack_uint, &item->as.UInt);
+				CALL(unpack_uint, &item->as.UInt);
 				break;
 			case CPS_Double:
 				item->type = CPITEM_DOUBLE;
-#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
-				uint8_t *b = (uint8_t *)&(item->as.Double);
-				for (ssize_t i = sizeof(double) - 1; i >= 0; i--)
-					b[i] = GETC;
-#else
 				READ(&item->as.Double, sizeof(double));
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+				uint64_t dbl;
+				memcpy(&dbl, &item->as.Double, sizeof dbl);
+				dbl = __builtin_bswap64(dbl);
+				memcpy(&item->as.Double, &dbl, sizeof dbl);
 #endif
 				break;
 			case CPS_Decimal:
 				item->type = CPITEM_DECIMAL;
-				CALL(chainpack_unpack_int, &item->as.Decimal.mantissa);
+				CALL(unpack_int, &item->as.Decimal.mantissa);
 				intmax_t exp;
-				CALL(chainpack_unpack_int, &exp);
+				CALL(unpack_int, &exp);
 				item->as.Decimal.exponent = exp;
 				break;
 			case CPS_Blob:
 			case CPS_BlobChain:
 				item->type = CPITEM_BLOB;
-				CALL(chainpack_unpack_uint, &ull);
+				CALL(unpack_uint, &ull);
 				// TODO check that we do not crop the value
 				item->as.String.eoff = ull;
 				item->as.Blob.flags = CPBI_F_FIRST;
 				if (scheme == CPS_BlobChain)
 					item->as.Blob.flags |= CPBI_F_STREAM;
-				CALL(chainpack_unpack_buf, item);
+				CALL(unpack_buf, item);
 				break;
 			case CPS_String:
 			case CPS_CString:
@@ -127,16 +196,16 @@ size_t chainpack_unpack(FILE *f, struct cpitem *item) {
 					item->as.String.eoff = 0;
 					item->as.String.flags |= CPBI_F_STREAM;
 				} else {
-					CALL(chainpack_unpack_uint, &ull);
+					CALL(unpack_uint, &ull);
 					// TODO check that we do not crop the value
 					item->as.String.eoff = ull;
 				}
-				CALL(chainpack_unpack_buf, item);
+				CALL(unpack_buf, item);
 				break;
 			case CPS_DateTime:
 				item->type = CPITEM_DATETIME;
 				intmax_t d;
-				CALL(chainpack_unpack_int, &d);
+				CALL(unpack_int, &d);
 				int32_t offset = 0;
 				bool has_tz_offset = d & 1;
 				bool has_not_msec = d & 2;
@@ -169,7 +238,7 @@ size_t chainpack_unpack(FILE *f, struct cpitem *item) {
 				item->type = CPITEM_CONTAINER_END;
 				break;
 			default:
-				ungetc(scheme, f);
+				src_ungetc(s, scheme);
 				item->type = CPITEM_INVALID;
 		}
 	}
@@ -180,10 +249,22 @@ size_t chainpack_unpack(FILE *f, struct cpitem *item) {
 #undef CALL
 }
 
-size_t chainpack_unpack_uint(FILE *f, uintmax_t *v, enum cperror *err) {
+size_t chainpack_unpack(FILE *f, struct cpitem *item) {
+	struct src s = {.f = f};
+	return unpack(&s, item);
+}
+
+size_t chainpack_unpack_buf(const uint8_t *buf, size_t siz, struct cpitem *item) {
+	struct src s = {.f = NULL, .ptr = buf, .len = siz};
+	unpack(&s, item);
+	return s.ptr - buf;
+}
+
+static inline size_t unpack_uint(
+	struct src *s, uintmax_t *v, enum cperror *err) {
 	ssize_t res = 0;
 
-	int head = getc_unlocked(f);
+	int head = src_getc(s);
 	if (head == EOF) {
 		*err = CPERR_EOF;
 		return res;
@@ -193,8 +274,15 @@ size_t chainpack_unpack_uint(FILE *f, uintmax_t *v, enum cperror *err) {
 	unsigned bytes = chainpack_int_bytes(head);
 
 	*v = chainpack_uint_value1(head, bytes);
+	if (s->f == NULL && s->len >= bytes - 1) {
+		/* Fast path for memory where we check bounds only once */
+		for (unsigned i = 1; i < bytes; i++)
+			*v = (*v << 8) | *s->ptr++;
+		s->len -= bytes - 1;
+		return bytes;
+	}
 	for (unsigned i = 1; i < bytes; i++) {
-		int r = getc_unlocked(f);
+		int r = src_getc(s);
 		if (r == EOF) {
 			*err = CPERR_EOF;
 			return res;
@@ -206,8 +294,9 @@ size_t chainpack_unpack_uint(FILE *f, uintmax_t *v, enum cperror *err) {
 	return res;
 }
 
-static size_t chainpack_unpack_int(FILE *f, intmax_t *v, enum cperror *err) {
-	size_t res = chainpack_unpack_uint(f, (uintmax_t *)v, err);
+static inline size_t unpack_int(
+	struct src *s, intmax_t *v, enum cperror *err) {
+	size_t res = unpack_uint(s, (uintmax_t *)v, err);
 
 	if (*err == CPERR_NONE) {
 		/* This is kind of magic that requires some explanation.
@@ -231,7 +320,8 @@ static size_t chainpack_unpack_int(FILE *f, intmax_t *v, enum cperror *err) {
 }
 
 
-static size_t chainpack_unpack_buf(FILE *f, struct cpitem *item, enum cperror *err) {
+static inline size_t unpack_buf(
+	struct src *s, struct cpitem *item, enum cperror *err) {
 	if (item->bufsiz == 0) {
 		item->as.Blob.len = 0;
 		return 0; /* Nowhere to place data so just inform user about type */
@@ -239,9 +329,26 @@ static size_t chainpack_unpack_buf(FILE *f, struct cpitem *item, enum cperror *e
 
 	if (item->as.Blob.flags & CPBI_F_STREAM && item->type == CPITEM_STRING) {
 		/* Handle C string */
+		if (s->f == NULL) {
+			/* Memory: locate the terminator in the whole span at once */
+			size_t siz = MIN(s->len, item->bufsiz);
+			const uint8_t *end = memchr(s->ptr, '\0', siz);
+			size_t len = end ? (size_t)(end - s->ptr) : siz;
+			if (item->buf)
+				memcpy(item->buf, s->ptr, len);
+			item->as.Blob.len = len;
+			if (end) {
+				item->as.Blob.flags |= CPBI_F_LAST;
+				len++;
+			} else if (len < item->bufsiz)
+				*err = CPERR_EOF;
+			s->ptr += len;
+			s->len -= len;
+			return len;
+		}
 		size_t i;
 		for (i = 0; i < item->bufsiz; i++) {
-			int c = getc(f);
+			int c = src_getc(s);
 			if (c == EOF) {
 				*err = CPERR_EOF;
 				return i;
@@ -263,29 +370,18 @@ static size_t chainpack_unpack_buf(FILE *f, struct cpitem *item, enum cperror *e
 	item->as.Blob.len = 0;
 	while (item->as.Blob.len < item->bufsiz) {
 		size_t toread = MIN(item->as.Blob.eoff, item->bufsiz - item->as.Blob.len);
-		if (item->buf) {
-			if (toread > 0 &&
-				fread_unlocked(item->buf + item->as.Blob.len, toread, 1, f) != 1) {
-				*err = CPERR_EOF;
-				break;
-			}
-		} else {
-			for (size_t siz = toread; siz > 0;) {
-				size_t bufsiz = MIN(siz, BUFSIZ);
-				uint8_t buf[bufsiz];
-				if (fread_unlocked(buf, bufsiz, 1, f) != 1) {
-					*err = CPERR_EOF;
-					break;
-				}
-				siz -= bufsiz;
-			}
+		if (toread > 0 &&
+			!src_read(s, item->buf ? item->buf + item->as.Blob.len : NULL,
+				toread)) {
+			*err = CPERR_EOF;
+			break;
 		}
 		res += toread;
 		item->as.Blob.len = toread;
 		item->as.Blob.eoff -= toread;
 		if (item->as.Blob.flags & CPBI_F_STREAM && item->as.Blob.eoff == 0) {
 			uintmax_t ull;
-			res += chainpack_unpack_uint(f, &ull, err);
+			res += unpack_uint(s, &ull, err);
 			if (*err != CPERR_NONE)
 				break;
 			// TODO check that we do not crop the value
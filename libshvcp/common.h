@@ -5,9 +5,9 @@
 
 /* Common handling of the item for unpack functions.
  *
- * This covers initial sanity checks.
+ * This covers initial sanity checks. The file is ``NULL`` for memory buffers.
  */
-[[gnu::nonnull]]
+[[gnu::nonnull(1, 3)]]
 bool common_unpack(size_t *res, FILE *f, struct cpitem *item);
 
 /* Common handling of the item for pack functions.
@@ -14,6 +14,30 @@ cp_pack_t cp_pack_chainpack_init(struct cp_pack_chainpack *pack, FILE *f) {
 	return &pack->func;
 }
 
+static bool cp_pack_buf_func(void *ptr, const struct cpitem *item) {
+	struct cp_pack_buf *p = ptr;
+	if (p->ptr == NULL)
+		return false;
+	ssize_t res = chainpack_pack_buf(p->ptr, p->len, item);
+	if (res < 0) {
+		p->ptr = NULL;
+		p->len = 0;
+		return false;
+	}
+	p->ptr += res;
+	p->len -= res;
+	return true;
+}
+
+cp_pack_t cp_pack_buf_init(struct cp_pack_buf *pack, uint8_t *buf, size_t len) {
+	*pack = (struct cp_pack_buf){
+		.func = cp_pack_buf_func,
+		.ptr = buf,
+		.len = len,
+	};
+	return &pack->func;
+}
+
 static void cpon_state_realloc(struct cpon_state *state) {
 	state->cnt = state->cnt ? state->cnt * 2 : 1;
 	state->ctx = realloc(state->ctx, state->cnt * sizeof *state->ctx);
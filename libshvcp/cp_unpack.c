@@ -16,6 +16,23 @@ cp_unpack_t cp_unpack_chainpack_init(struct cp_unpack_chainpack *unpack, FILE *f
 	return &unpack->func;
 }
 
+static void cp_unpack_buf_func(void *ptr, struct cpitem *item) {
+	struct cp_unpack_buf *p = ptr;
+	size_t res = chainpack_unpack_buf(p->ptr, p->len, item);
+	p->ptr += res;
+	p->len -= res;
+}
+
+cp_unpack_t cp_unpack_buf_init(
+	struct cp_unpack_buf *unpack, const uint8_t *buf, size_t len) {
+	*unpack = (struct cp_unpack_buf){
+		.func = cp_unpack_buf_func,
+		.ptr = buf,
+		.len = len,
+	};
+	return &unpack->func;
+}
+
 static void cpon_state_realloc(struct cpon_state *state) {
 	state->cnt = state->cnt ? state->cnt * 2 : 1;
 	state->ctx = realloc(state->ctx, state->cnt * sizeof *state->ctx);
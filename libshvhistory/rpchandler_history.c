@@ -16,6 +16,7 @@ struct rpchandler_history {
 	bool has_getlog;
 	const char **signals;
 	struct rpchandler_history_facilities *facilities;
+	struct rpchandler_route routes[5];
 };
 
 static void rpc_ls(void *cookie, struct rpchandler_ls *ctx) {
@@ -64,6 +65,12 @@ static void rpc_ls(void *cookie, struct rpchandler_ls *ctx) {
 	}
 }
 
+static struct rpcdir_packed fetch_packed = {.method = &rpchistory_fetch};
+static struct rpcdir_packed span_packed = {.method = &rpchistory_span};
+static struct rpcdir_packed getlog_packed = {.method = &rpchistory_getlog};
+static struct rpcdir_packed getsnapshot_packed = {
+	.method = &rpchistory_getsnapshot};
+
 static void rpc_dir(void *cookie, struct rpchandler_dir *ctx) {
 	struct rpchandler_history *history = cookie;
 	if (!ctx->path)
@@ -74,8 +81,8 @@ static void rpc_dir(void *cookie, struct rpchandler_dir *ctx) {
 				 history->facilities->records;
 			record && *record; record++) {
 			if (!strcmp((*record)->name, ctx->path + strlen(RECORDS_PREFIX))) {
-				rpchandler_dir_result(ctx, &rpchistory_fetch);
-				rpchandler_dir_result(ctx, &rpchistory_span);
+				rpchandler_dir_result_packed(ctx, &fetch_packed);
+				rpchandler_dir_result_packed(ctx, &span_packed);
 			}
 		}
 	} else if (!strncmp(FILES_PREFIX, ctx->path, strlen(FILES_PREFIX))) {
@@ -92,8 +99,8 @@ static void rpc_dir(void *cookie, struct rpchandler_dir *ctx) {
 				/* add getLog method if *s starts with ctx->path and is either
 				 * entire ctx->path or whole path until '/' character.
 				 */
-				rpchandler_dir_result(ctx, &rpchistory_getlog);
-				rpchandler_dir_result(ctx, &rpchistory_getsnapshot);
+				rpchandler_dir_result_packed(ctx, &getlog_packed);
+				rpchandler_dir_result_packed(ctx, &getsnapshot_packed);
 				break;
 			}
 		}
@@ -285,6 +292,17 @@ rpchandler_history_t rpchandler_history_new(
 	res->has_getlog = facilities->funcs->pack_getlog &&
 		facilities->funcs->pack_getsnapshot;
 
+	struct rpchandler_route *route = res->routes;
+	if (res->has_records)
+		*route++ = (struct rpchandler_route){RECORDS_PREFIX, NULL};
+	if (res->has_files)
+		*route++ = (struct rpchandler_route){FILES_PREFIX, NULL};
+	if (res->has_getlog) {
+		*route++ = (struct rpchandler_route){NULL, "getLog"};
+		*route++ = (struct rpchandler_route){NULL, "getSnapshot"};
+	}
+	*route = (struct rpchandler_route){};
+
 	return res;
 }
 
@@ -293,5 +311,6 @@ void rpchandler_history_destroy(rpchandler_history_t history) {
 }
 
 struct rpchandler_stage rpchandler_history_stage(rpchandler_history_t history) {
-	return (struct rpchandler_stage){.funcs = &rpc_funcs, .cookie = history};
+	return (struct rpchandler_stage){
+		.funcs = &rpc_funcs, .cookie = history, .routes = history->routes};
 }
@@ -0,0 +1,92 @@
+#include "ridmap.h"
+#include <stdlib.h>
+#include <assert.h>
+
+static size_t slot(const struct ridmap *map, int rid) {
+	/* Multiplication by odd number scatters IDs but consecutive IDs are still
+	 * placed to distinct slots.
+	 */
+	return ((unsigned)rid * 2654435769u) & (map->siz - 1);
+}
+
+static bool grow(struct ridmap *map) {
+	size_t siz = map->siz ? map->siz * 2 : 16;
+	struct ridmap_item *items = calloc(siz, sizeof *items);
+	if (items == NULL) // GCOVR_EXCL_BR_LINE malloc failure only
+		return false; // GCOVR_EXCL_LINE
+	struct ridmap_item *old = map->items;
+	size_t oldsiz = map->siz;
+	map->items = items;
+	map->siz = siz;
+	for (size_t i = 0; i < oldsiz; i++)
+		if (old[i].rid) {
+			size_t s = slot(map, old[i].rid);
+			while (items[s].rid)
+				s = (s + 1) & (siz - 1);
+			items[s] = old[i];
+		}
+	free(old);
+	return true;
+}
+
+/* Index of the slot with given request ID or of the empty slot */
+static size_t lookup(const struct ridmap *map, int rid) {
+	size_t s = slot(map, rid);
+	while (map->items[s].rid && map->items[s].rid != rid)
+		s = (s + 1) & (map->siz - 1);
+	return s;
+}
+
+void ridmap_free(struct ridmap *map) {
+	free(map->items);
+	map->items = NULL;
+	map->cnt = 0;
+	map->siz = 0;
+}
+
+bool ridmap_add(struct ridmap *map, int rid, void *ptr) {
+	assert(rid != 0);
+	/* Keep the load under 3/4 */
+	if ((map->cnt + 1) * 4 > map->siz * 3 && !grow(map))
+		return false;
+	size_t s = lookup(map, rid);
+	if (map->items[s].rid)
+		return false;
+	map->items[s] = (struct ridmap_item){.rid = rid, .ptr = ptr};
+	map->cnt++;
+	return true;
+}
+
+bool ridmap_del(struct ridmap *map, int rid) {
+	if (map->cnt == 0)
+		return false;
+	size_t mask = map->siz - 1;
+	size_t s = lookup(map, rid);
+	if (map->items[s].rid == 0)
+		return false;
+	/* Shift back the following items so there is no gap in their probing */
+	size_t i = s;
+	while (true) {
+		i = (i + 1) & mask;
+		if (map->items[i].rid == 0)
+			break;
+		size_t home = slot(map, map->items[i].rid);
+		if (((i - home) & mask) >= ((i - s) & mask)) {
+			map->items[s] = map->items[i];
+			s = i;
+		}
+	}
+	map->items[s] = (struct ridmap_item){};
+	map->cnt--;
+	return true;
+}
+
+bool ridmap_has(const struct ridmap *map, int rid) {
+	return map->cnt && map->items[lookup(map, rid)].rid != 0;
+}
+
+void *ridmap_get(const struct ridmap *map, int rid) {
+	if (map->cnt == 0)
+		return NULL;
+	return map->items[lookup(map, rid)].ptr;
+}
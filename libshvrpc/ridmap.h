@@ -0,0 +1,41 @@
+#ifndef SHV_RIDMAP_H
+#define SHV_RIDMAP_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+/* Map of request IDs to pointers.
+ *
+ * This is hash table with open addressing. Zero request ID marks the empty
+ * slot and thus it can't be stored in the map (request IDs are positive).
+ */
+struct ridmap {
+	struct ridmap_item {
+		int rid;
+		void *ptr;
+	} *items;
+	size_t cnt, siz;
+};
+
+[[gnu::nonnull]]
+void ridmap_free(struct ridmap *map);
+
+/* Add request ID with associated pointer. Returns false if it is already in the
+ * map.
+ */
+[[gnu::nonnull(1)]]
+bool ridmap_add(struct ridmap *map, int rid, void *ptr);
+
+/* Remove request ID. Returns false if it wasn't in the map. */
+[[gnu::nonnull]]
+bool ridmap_del(struct ridmap *map, int rid);
+
+/* Check if request ID is in the map. */
+[[gnu::nonnull]]
+bool ridmap_has(const struct ridmap *map, int rid);
+
+/* Get pointer associated with request ID or NULL if it is not in the map. */
+[[gnu::nonnull]]
+void *ridmap_get(const struct ridmap *map, int rid);
+
+#endif
@@ -0,0 +1,289 @@
+#include "riindex.h"
+#include <stdlib.h>
+#include <assert.h>
+#include <string.h>
+#include "riseg.h"
+
+#define ADD(VAR) \
+	({ \
+		VAR = realloc(VAR, (VAR##_cnt + 1) * sizeof *VAR); \
+		assert(VAR); \
+		VAR + VAR##_cnt++; \
+	})
+
+#define DEL(VAR, PTR) \
+	do { \
+		VAR##_cnt -= 1; \
+		memmove((PTR), (PTR) + 1, (VAR##_cnt - ((PTR) - VAR)) * sizeof *VAR); \
+		if (VAR##_cnt == 0) { \
+			free(VAR); \
+			VAR = NULL; \
+		} \
+	} while (false)
+
+static bool indexable(const char *path, const char *end) {
+	for (const char *seg = path; seg; seg = nextseg(seg, end))
+		if (segtype(seg, seglen(seg, end)) == SEG_INVALID)
+			return false;
+	return true;
+}
+
+/* Locate child with given name or place where it should be inserted */
+static bool find_child(const struct ritrie_child *children, size_t cnt,
+	const char *seg, size_t len, size_t *index) {
+	size_t l = 0, u = cnt;
+	while (l < u) {
+		size_t p = (l + u) / 2;
+		int r = segcmp(children[p].name, seg, len);
+		if (r == 0) {
+			*index = p;
+			return true;
+		}
+		if (r > 0)
+			u = p;
+		else
+			l = p + 1;
+	}
+	*index = l;
+	return false;
+}
+
+static struct ritrie *child(struct ritrie *node, const char *seg, size_t len) {
+	switch (segtype(seg, len)) {
+		case SEG_GLOBSTAR:
+			if (node->globstar == NULL)
+				node->globstar = calloc(1, sizeof *node->globstar);
+			return node->globstar;
+		case SEG_WILD:
+			for (size_t i = 0; i < node->wilds_cnt; i++)
+				if (!segcmp(node->wilds[i].name, seg, len))
+					return node->wilds[i].node;
+			struct ritrie_child *wild = ADD(node->wilds);
+			*wild = (struct ritrie_child){
+				strndup(seg, len), calloc(1, sizeof *wild->node)};
+			return wild->node;
+		default:
+			size_t i;
+			if (find_child(node->nodes, node->nodes_cnt, seg, len, &i))
+				return node->nodes[i].node;
+			ADD(node->nodes);
+			memmove(&node->nodes[i + 1], &node->nodes[i],
+				(node->nodes_cnt - i - 1) * sizeof *node->nodes);
+			node->nodes[i] = (struct ritrie_child){
+				strndup(seg, len), calloc(1, sizeof *node->nodes[i].node)};
+			return node->nodes[i].node;
+	}
+}
+
+bool riindex_add(struct riindex *index, const char *ri, void *ptr) {
+	const char *path_end = strchr(ri, ':');
+	if (path_end == NULL)
+		return false; /* Such RI never matches */
+	if (!indexable(ri, path_end)) {
+		*ADD(index->linear) =
+			(struct riindex_linear){strdup(ri), rpcri_compile(ri), ptr};
+		return true;
+	}
+	struct ritrie *node = &index->trie;
+	for (const char *seg = ri; seg; seg = nextseg(seg, path_end))
+		node = child(node, seg, seglen(seg, path_end));
+	struct ritrie_leaf *leaf = ADD(node->leafs);
+	leaf->ri = strdup(ri);
+	leaf->ptr = ptr;
+	const char *method = leaf->ri + (path_end - ri) + 1;
+	const char *signal = strchr(method, ':');
+	leaf->method = signal ? strndup(method, signal - method) : strdup(method);
+	leaf->signal = signal ? signal + 1 : NULL;
+	return true;
+}
+
+static bool ritrie_empty(struct ritrie *node) {
+	return node->nodes_cnt == 0 && node->wilds_cnt == 0 &&
+		node->globstar == NULL && node->leafs_cnt == 0;
+}
+
+/* Remove RI and return true if node is empty now. */
+static bool del(struct ritrie *node, const char *seg, const char *end,
+	const char *ri, void *ptr, bool *found) {
+	if (seg == NULL) {
+		for (size_t i = 0; i < node->leafs_cnt; i++)
+			if (node->leafs[i].ptr == ptr && !strcmp(node->leafs[i].ri, ri)) {
+				free(node->leafs[i].ri);
+				free(node->leafs[i].method);
+				DEL(node->leafs, node->leafs + i);
+				*found = true;
+				break;
+			}
+		return ritrie_empty(node);
+	}
+	size_t len = seglen(seg, end);
+	const char *next = nextseg(seg, end);
+	switch (segtype(seg, len)) {
+		case SEG_GLOBSTAR:
+			if (node->globstar &&
+				del(node->globstar, next, end, ri, ptr, found)) {
+				free(node->globstar);
+				node->globstar = NULL;
+			}
+			break;
+		case SEG_WILD:
+			for (size_t i = 0; i < node->wilds_cnt; i++)
+				if (!segcmp(node->wilds[i].name, seg, len)) {
+					if (del(node->wilds[i].node, next, end, ri, ptr, found)) {
+						free(node->wilds[i].name);
+						free(node->wilds[i].node);
+						DEL(node->wilds, node->wilds + i);
+					}
+					break;
+				}
+			break;
+		default:
+			size_t i;
+			if (find_child(node->nodes, node->nodes_cnt, seg, len, &i) &&
+				del(node->nodes[i].node, next, end, ri, ptr, found)) {
+				free(node->nodes[i].name);
+				free(node->nodes[i].node);
+				DEL(node->nodes, node->nodes + i);
+			}
+			break;
+	}
+	return ritrie_empty(node);
+}
+
+bool riindex_del(struct riindex *index, const char *ri, void *ptr) {
+	const char *path_end = strchr(ri, ':');
+	if (path_end == NULL)
+		return false;
+	if (!indexable(ri, path_end)) {
+		for (size_t i = 0; i < index->linear_cnt; i++)
+			if (index->linear[i].ptr == ptr &&
+				!strcmp(index->linear[i].ri, ri)) {
+				free(index->linear[i].ri);
+				rpcri_free(index->linear[i].cri);
+				DEL(index->linear, index->linear + i);
+				return true;
+			}
+		return false;
+	}
+	bool found = false;
+	del(&index->trie, ri, path_end, ri, ptr, &found);
+	return found;
+}
+
+
+struct match {
+	const char *path_end;
+	const char *source;
+	const char *signal;
+};
+
+static void *match_leafs(const struct ritrie *node, const struct match *m) {
+	for (size_t i = 0; i < node->leafs_cnt; i++) {
+		const struct ritrie_leaf *leaf = &node->leafs[i];
+		bool match;
+		if (leaf->signal && m->signal)
+			match = rpcstr_match(leaf->method, m->source) &&
+				rpcstr_match(leaf->signal, m->signal);
+		else
+			/* Same as rpcri_match: the whole rest is matched against method */
+			match = rpcstr_match(strchr(leaf->ri, ':') + 1, m->source);
+		if (match)
+			return leaf->ptr;
+	}
+	return NULL;
+}
+
+static void *match(
+	const struct ritrie *node, const char *seg, const struct match *m) {
+	void *res;
+	if (seg == NULL) {
+		if ((res = match_leafs(node, m)))
+			return res;
+		/* foo/\** matches also foo */
+		return node->globstar ? match_leafs(node->globstar, m) : NULL;
+	}
+	size_t len = seglen(seg, m->path_end);
+	const char *next = nextseg(seg, m->path_end);
+
+	size_t i;
+	if (find_child(node->nodes, node->nodes_cnt, seg, len, &i) &&
+		(res = match(node->nodes[i].node, next, m)))
+		return res;
+
+	if (node->wilds_cnt) {
+		char str[len + 1];
+		memcpy(str, seg, len);
+		str[len] = '\0';
+		for (size_t i = 0; i < node->wilds_cnt; i++)
+			if (rpcstr_match(node->wilds[i].name, str) &&
+				(res = match(node->wilds[i].node, next, m)))
+				return res;
+	}
+
+	if (node->globstar) {
+		/* Trailing ** matches the rest of the path */
+		if ((res = match_leafs(node->globstar, m)))
+			return res;
+		/* Otherwise it consumes at least one node */
+		const char *s = next;
+		while (true) {
+			if ((res = match(node->globstar, s, m)))
+				return res;
+			if (s == NULL)
+				break;
+			s = nextseg(s, m->path_end);
+		}
+	}
+	return NULL;
+}
+
+void *riindex_match(const struct riindex *index, const char *path,
+	const char *source, const char *signal) {
+	struct match m = {
+		.path_end = path + strlen(path),
+		.source = source,
+		.signal = signal,
+	};
+	void *res = match(&index->trie, path, &m);
+	for (size_t i = 0; !res && i < index->linear_cnt; i++)
+		if (rpcri_match_compiled(index->linear[i].cri, path, source, signal))
+			res = index->linear[i].ptr;
+	return res;
+}
+
+
+static void ritrie_free(struct ritrie *node) {
+	for (size_t i = 0; i < node->nodes_cnt; i++) {
+		free(node->nodes[i].name);
+		ritrie_free(node->nodes[i].node);
+		free(node->nodes[i].node);
+	}
+	free(node->nodes);
+	for (size_t i = 0; i < node->wilds_cnt; i++) {
+		free(node->wilds[i].name);
+		ritrie_free(node->wilds[i].node);
+		free(node->wilds[i].node);
+	}
+	free(node->wilds);
+	if (node->globstar) {
+		ritrie_free(node->globstar);
+		free(node->globstar);
+	}
+	for (size_t i = 0; i < node->leafs_cnt; i++) {
+		free(node->leafs[i].ri);
+		free(node->leafs[i].method);
+	}
+	free(node->leafs);
+	*node = (struct ritrie){};
+}
+
+void riindex_free(struct riindex *index) {
+	ritrie_free(&index->trie);
+	for (size_t i = 0; i < index->linear_cnt; i++) {
+		free(index->linear[i].ri);
+		rpcri_free(index->linear[i].cri);
+	}
+	free(index->linear);
+	index->linear = NULL;
+	index->linear_cnt = 0;
+}
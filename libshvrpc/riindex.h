@@ -0,0 +1,70 @@
+#ifndef SHV_RIINDEX_H
+#define SHV_RIINDEX_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <shv/rpcri.h>
+
+/* Node of the RI index.
+ *
+ * The path portion of the RI is split to the nodes. Nodes without wildcard
+ * are sorted and looked up directly, nodes with wildcard are matched one by one
+ * and `**` node is handled on its own because it can match multiple nodes.
+ * RIs are stored in the node where their path pattern ends together with their
+ * method and signal patterns.
+ */
+struct ritrie {
+	struct ritrie_child {
+		char *name;
+		struct ritrie *node;
+	} *nodes, *wilds;
+	size_t nodes_cnt, wilds_cnt;
+	struct ritrie *globstar;
+	struct ritrie_leaf {
+		char *ri;
+		/* Method pattern and signal pattern (NULL if RI has none) */
+		char *method;
+		const char *signal;
+		void *ptr;
+	} *leafs;
+	size_t leafs_cnt;
+};
+
+/* Index of RIs used to quickly find the one matching signal.
+ *
+ * Not all RIs can be split to the nodes (such as `?` or bracket expression that
+ * can also match `/` or `**` that is not a whole node). Those are compiled and
+ * matched one by one.
+ */
+struct riindex {
+	struct ritrie trie;
+	struct riindex_linear {
+		char *ri;
+		rpcri_t cri;
+		void *ptr;
+	} *linear;
+	size_t linear_cnt;
+};
+
+/* Add RI with associated pointer. RI is copied. Returns false if RI is invalid
+ * (there is no ':').
+ */
+[[gnu::nonnull(1, 2)]]
+bool riindex_add(struct riindex *index, const char *ri, void *ptr);
+
+/* Remove RI with associated pointer. Returns false if there is no such RI. */
+[[gnu::nonnull(1, 2)]]
+bool riindex_del(struct riindex *index, const char *ri, void *ptr);
+
+/* Get pointer associated with RI matching given signal or NULL if there is
+ * none. RIs with more literal path nodes are preferred if multiple of them
+ * match. It doesn't allocate any memory.
+ */
+[[gnu::nonnull(1, 2, 3)]]
+void *riindex_match(const struct riindex *index, const char *path,
+	const char *source, const char *signal);
+
+[[gnu::nonnull]]
+void riindex_free(struct riindex *index);
+
+#endif
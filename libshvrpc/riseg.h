@@ -0,0 +1,58 @@
+#ifndef SHV_RISEG_H
+#define SHV_RISEG_H
+
+#include <stddef.h>
+#include <string.h>
+
+/* Helpers for splitting RI path patterns to the nodes (segments). These are
+ * shared by the RI based indexes in libshvrpc, libshvbroker and shvcbroker.
+ */
+
+enum segtype {
+	SEG_LITERAL,
+	SEG_WILD,
+	SEG_GLOBSTAR,
+	SEG_INVALID,
+};
+
+/* Type of the pattern segment. Only patterns that match within the single node
+ * can be split to the nodes; others are SEG_INVALID.
+ */
+static inline enum segtype segtype(const char *seg, size_t len) {
+	if (len == 2 && seg[0] == '*' && seg[1] == '*')
+		return SEG_GLOBSTAR;
+	enum segtype res = SEG_LITERAL;
+	for (size_t i = 0; i < len; i++)
+		switch (seg[i]) {
+			case '*':
+				/* Double wildcard can match '/' if it is not a whole node */
+				if (i + 1 < len && seg[i + 1] == '*')
+					return SEG_INVALID;
+				res = SEG_WILD;
+				break;
+			case '?':
+			case '[':
+				/* These can match '/' and thus span multiple nodes */
+				return SEG_INVALID;
+		}
+	return res;
+}
+
+/* Get the next path node or NULL if this is the last one. */
+static inline const char *nextseg(const char *seg, const char *end) {
+	const char *res = memchr(seg, '/', end - seg);
+	return res ? res + 1 : NULL;
+}
+
+static inline size_t seglen(const char *seg, const char *end) {
+	const char *res = memchr(seg, '/', end - seg);
+	return (res ?: end) - seg;
+}
+
+/* Compare null terminated node name with segment of given length. */
+static inline int segcmp(const char *name, const char *seg, size_t len) {
+	int res = strncmp(name, seg, len);
+	return res ?: (name[len] != '\0');
+}
+
+#endif
@@ -1,10 +1,16 @@
 #include <stdlib.h>
-#include <semaphore.h>
+#include <string.h>
+#include <time.h>
 #include <shv/rpccall.h>
 
 struct _ctx {
 	struct rpccall_ctx pub;
 	rpccall_func_t func;
+	rpcresponse_t response;
+	/* Number of requests sent so far */
+	int attempts;
+	/* Time when the last attempt is abandoned */
+	struct timespec deadline;
 };
 
 static bool response_callback(struct rpchandler_msg *ctx, void *cookie) {
@@ -24,48 +30,147 @@ static bool response_callback(struct rpchandler_msg *ctx, void *cookie) {
 		c->pub.item = ctx->item;
 		c->func(CALL_S_RESULT, &c->pub);
 	}
-	if (!rpchandler_msg_valid(ctx))
-		return false;
+	/* Error number and message share memory with unpacker and item */
 	c->pub.errnum = RPCERR_NO_ERROR;
 	c->pub.errmsg = NULL;
+	return rpchandler_msg_valid(ctx);
+}
+
+/* Send request for the given call. Returns false if call is terminated and
+ * result is stored to the provided location.
+ */
+static bool call_send(
+	rpchandler_t handler, struct _ctx *c, int timeout, int *result) {
+	cp_pack_t pack = rpchandler_msg_new(handler);
+	c->pub.pack = pack;
+	*result = c->func(CALL_S_REQUEST, &c->pub);
+	if (*result) {
+		rpchandler_msg_drop(handler);
+		return false;
+	}
+	if (!rpchandler_msg_send_more(handler)) {
+		*result = c->func(CALL_S_COMERR, &c->pub);
+		return false;
+	}
+	c->attempts++;
+	clock_gettime(CLOCK_MONOTONIC, &c->deadline);
+	c->deadline.tv_sec += timeout / 1000;
+	c->deadline.tv_nsec += (timeout % 1000) * 1000000;
+	if (c->deadline.tv_nsec >= 1000000000) {
+		c->deadline.tv_sec++;
+		c->deadline.tv_nsec -= 1000000000;
+	}
 	return true;
 }
 
-int _rpccall(rpchandler_t handler, rpchandler_responses_t responses,
-	rpccall_func_t func, void *cookie, int attempts, int timeout) {
-	struct _ctx ctx = {
-		.pub.cookie = cookie,
-		.pub.request_id = rpcmsg_request_id(),
-		.pub.errnum = RPCERR_NO_ERROR,
-		.pub.errmsg = NULL,
-		.func = func,
-	};
-	rpcresponse_t response = rpcresponse_expect(
-		responses, ctx.pub.request_id, response_callback, &ctx);
-	int result = 0;
+/* Milliseconds remaining till the deadline */
+static int call_remaining(const struct _ctx *c) {
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	long res = (c->deadline.tv_sec - now.tv_sec) * 1000 +
+		(c->deadline.tv_nsec - now.tv_nsec) / 1000000;
+	return res > 0 ? res : 0;
+}
 
-	for (int attempt = 0; attempt < attempts; attempt++) {
-		cp_pack_t pack = rpchandler_msg_new(handler);
-		ctx.pub.pack = pack;
-		result = func(CALL_S_REQUEST, &ctx.pub);
-		if (result) {
-			rpchandler_msg_drop(handler);
-			goto term;
+static void call_term(rpchandler_t handler, struct _ctx *c) {
+	free(c->pub.errmsg);
+	if (c->response) /* Response wasn't received */
+		rpchandler_release_request_id(handler, c->pub.request_id);
+	rpcresponse_discard(c->response);
+}
+
+unsigned rpccall_many(rpchandler_t handler, rpchandler_responses_t responses,
+	rpccall_func_t func, void *cookie, unsigned cnt, int *results,
+	int attempts, int timeout) {
+	struct _ctx *ctxs = malloc(cnt * sizeof *ctxs);
+	/* Calls waiting for the response ordered by their deadline. Every call is
+	 * present at most once and thus it can't overflow.
+	 */
+	unsigned *queue = malloc(cnt * sizeof *queue);
+	unsigned qhead = 0, qcnt = 0;
+	unsigned done = 0;
+	int result;
+	if (ctxs == NULL || queue == NULL) { // GCOVR_EXCL_START malloc failure only
+		free(ctxs);
+		free(queue);
+		for (unsigned i = 0; i < cnt; i++) {
+			struct rpccall_ctx pub = {.cookie = cookie, .index = i};
+			result = func(CALL_S_COMERR, &pub);
+			if (results)
+				results[i] = result;
 		}
-		if (!rpchandler_msg_send(handler)) {
-			result = func(CALL_S_COMERR, &ctx.pub);
-			goto term;
+		return 0;
+	} // GCOVR_EXCL_STOP
+
+	for (unsigned i = 0; i < cnt; i++) {
+		struct _ctx *c = &ctxs[i];
+		memcpy(c,
+			&(struct _ctx){
+				.pub.cookie = cookie,
+				.pub.request_id = rpchandler_next_request_id(handler),
+				.pub.index = i,
+				.pub.errnum = RPCERR_NO_ERROR,
+				.pub.errmsg = NULL,
+				.func = func,
+			},
+			sizeof *c);
+		c->response = rpcresponse_expect(
+			responses, c->pub.request_id, response_callback, c);
+	}
+	/* Send all requests at once and only then wait for responses */
+	for (unsigned i = 0; i < cnt; i++) {
+		struct _ctx *c = &ctxs[i];
+		if (c->response == NULL) {
+			/* Request ID is already expected or allocation failed */
+			rpchandler_release_request_id(handler, c->pub.request_id);
+			result = func(CALL_S_COMERR, &c->pub);
+		} else if (attempts <= 0)
+			result = func(CALL_S_TIMERR, &c->pub);
+		else if (call_send(handler, c, timeout, &result)) {
+			queue[(qhead + qcnt++) % cnt] = i;
+			continue;
 		}
-		if (rpcresponse_waitfor(response, timeout)) {
-			response = NULL;
-			result = func(CALL_S_DONE, &ctx.pub);
-			goto term;
+		call_term(handler, c);
+		if (results)
+			results[i] = result;
+	}
+	bool flush = true;
+
+	while (qcnt > 0) {
+		if (flush) {
+			rpchandler_flush(handler);
+			flush = false;
 		}
+		unsigned i = queue[qhead];
+		qhead = (qhead + 1) % cnt;
+		qcnt--;
+		struct _ctx *c = &ctxs[i];
+		if (rpcresponse_waitfor(c->response, call_remaining(c))) {
+			c->response = NULL;
+			result = func(CALL_S_DONE, &c->pub);
+			done++;
+		} else if (c->attempts >= attempts)
+			result = func(CALL_S_TIMERR, &c->pub);
+		else if (call_send(handler, c, timeout, &result)) {
+			/* The new deadline is the latest one and thus goes to the end */
+			queue[(qhead + qcnt++) % cnt] = i;
+			flush = true;
+			continue;
+		}
+		call_term(handler, c);
+		if (results)
+			results[i] = result;
 	}
-	result = func(CALL_S_TIMERR, &ctx.pub);
 
-term:
-	free(ctx.pub.errmsg);
-	rpcresponse_discard(response);
+	free(queue);
+	free(ctxs);
+	return done;
+}
+
+int _rpccall(rpchandler_t handler, rpchandler_responses_t responses,
+	rpccall_func_t func, void *cookie, int attempts, int timeout) {
+	int result;
+	rpccall_many(
+		handler, responses, func, cookie, 1, &result, attempts, timeout);
 	return result;
 }
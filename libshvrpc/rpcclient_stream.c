@@ -2,31 +2,39 @@
 #include <unistd.h>
 #include <errno.h>
 #include <fcntl.h>
+#include <limits.h>
 #include <sys/poll.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
 #include <shv/chainpack.h>
 #include <shv/crc32.h>
 #include <shv/rpcclient_stream.h>
+#include <shv/rpcmsg.h>
 
-#define STX (0xA2)
-#define ETX (0xA3)
-#define ATX (0xA4)
-#define ESC (0xAA)
-#define ESC_STX (0x02)
-#define ESC_ETX (0x03)
-#define ESC_ATX (0x04)
-#define ESC_ESC (0x0A)
-#define ESCX(X) ((X) & 0x0f)
-#define DESCX(X) ((X) | 0xA0)
-#define ESCAPABLE(X) ((X) == STX || (X) == ETX || (X) == ATX || (X) == ESC)
-#define ESCAPED(X) \
-	((X) == ESC_STX || (X) == ESC_ETX || (X) == ESC_ATX || (X) == ESC_ESC)
+#include "serial.h"
 
 #define TIMEOUT_RD (5000)
 #define TIMEOUT_WR (200)
 #define TIMEOUT_WR_BLOCK \
 	(1000) /* Try harder on block that can't be recovered */
-// TODO possibly add two levels of message priority and increase write timeout
-// for requests and responses and keep it low only for signals.
+#define TIMEOUT_WR_REQUEST (2000) /* Requests and responses are not repeated */
+
+#define QIOV (64) /* Maximum number of queued messages written at once */
+
+#define WMETA_DONE (0)
+#define WMETA_START (-1)
+
+/* Message queued to be written. The shared data (if any) follow the data
+ * copied to the message and offset covers both.
+ */
+struct qmsg {
+	struct qmsg *next;
+	size_t off, len, siz;
+	struct rpcbuf *ref;
+	/* Some bytes of the message were already written */
+	bool started;
+	uint8_t data[];
+};
 
 struct ctx {
 	struct rpcclient pub;
@@ -43,14 +51,46 @@ struct ctx {
 	_Atomic int errnum;
 	FILE *fr, *fw;
 
+	/* Class of the message being sent and state of its meta inspection */
+	enum rpcstream_class wclass;
+	int wmeta;
+	bool wmetakey;
+	int timeout[RPCSTREAM_C_CNT];
+	struct rpcstream_stats stats;
+
+	/* Write queue used when pub.queue is set. Every message class has its own
+	 * lane and lanes are switched only on message boundaries. The queued size
+	 * is atomic because it can be queried from other threads.
+	 */
+	struct qlane {
+		struct qmsg *head, **tail;
+	} wq[RPCSTREAM_C_CNT];
+	/* Slot with the queued message being sent */
+	struct qmsg **wqcur;
+	/* Message being sent was partially written without being queued */
+	bool wqdirect;
+	/* Released message kept for reuse */
+	struct qmsg *wqfree;
+	size_t wqbytes;
+	_Atomic size_t wqueued;
+	/* Message being sent is only queued (RPCC_CTRLOP_SENDMSG_MORE) */
+	bool wmore;
+	/* Write file descriptor is not a socket (send can't be used) */
+	bool wnosock;
+
+	/* Receive buffer. We read as much as is available and then consume it. */
+	size_t rbufoff, rbuflen;
+	uint8_t rbuf[BUFSIZ];
+
 	union {
 		struct rpcclient_ctx_block {
 			size_t rmsgoff;
 			char *wbuf;
 			size_t wbuflen, wbufsiz;
+			/* Shared rest of the message written after wbuf */
+			struct rpcbuf *wref;
 		} block;
 		struct rpcclient_ctx_serial {
-			// TODO possibly buffer serial for higher read performance
 			enum {
 				WMSG_NO,   /* Not writing any message */
 				WMSG_ST,   /* Started writting message */
@@ -62,6 +102,7 @@ struct ctx {
 				RMSG_DATA, /* Reading message data */
 				RMSG_ETX,  /* Read ETX but nothing more */
 			} rmsg;
+			bool rerr; /* Error to be reported on the next read */
 			crc32_t rcrc, wcrc;
 		} serial;
 	};
@@ -104,34 +145,346 @@ static ssize_t xread(struct ctx *c, char *buf, size_t siz, int timeout) {
 	}
 	return i;
 }
+
+/* Refill the receive buffer. This must be called only when it is empty. */
+static ssize_t rbuffill(struct ctx *c, int timeout) {
+	ssize_t res = xread(c, (char *)c->rbuf, sizeof c->rbuf, timeout);
+	c->rbufoff = 0;
+	c->rbuflen = res > 0 ? res : 0;
+	return res;
+}
+
+/* Read variant that serves data from the receive buffer. */
+static ssize_t rbufread(struct ctx *c, char *buf, size_t siz, int timeout) {
+	if (c->rbufoff == c->rbuflen) {
+		if (siz >= sizeof c->rbuf)
+			/* There is no point in copying through the buffer */
+			return xread(c, buf, siz, timeout);
+		ssize_t res = rbuffill(c, timeout);
+		if (res <= 0)
+			return res;
+	}
+	size_t avail = c->rbuflen - c->rbufoff;
+	if (siz > avail)
+		siz = avail;
+	memcpy(buf, c->rbuf + c->rbufoff, siz);
+	c->rbufoff += siz;
+	return siz;
+}
+
 static int xreadc(struct ctx *c, int timeout) {
-	uint8_t v;
-	ssize_t res = xread(c, (void *)&v, 1, timeout);
-	if (res > 0)
-		return v;
-	if (res == 0)
-		/* In general this should not happend because read would block but for
-		 * testing purposes we use files with this and for them this is EOF and
-		 * this technically a disconnect.
-		 */
-		return -1;
+	if (c->rbufoff == c->rbuflen) {
+		ssize_t res = rbuffill(c, timeout);
+		if (res == 0)
+			/* In general this should not happend because read would block but
+			 * for testing purposes we use files with this and for them this is
+			 * EOF and this technically a disconnect.
+			 */
+			return -1;
+		if (res < 0)
+			return res;
+	}
+	return c->rbuf[c->rbufoff++];
+}
+
+/* Skip the given number of already written bytes. */
+static void iovskip(struct iovec **iov, int *cnt, size_t siz) {
+	while (*cnt > 0 && siz >= (*iov)->iov_len) {
+		siz -= (*iov)->iov_len;
+		(*iov)++;
+		(*cnt)--;
+	}
+	if (*cnt > 0) {
+		(*iov)->iov_base = (uint8_t *)(*iov)->iov_base + siz;
+		(*iov)->iov_len -= siz;
+	}
+}
+
+/* Write all buffers with single call. The MSG_MORE is used if more data of the
+ * message follows so TCP can merge it to the single packet.
+ */
+static ssize_t xsendv(
+	struct ctx *c, const struct iovec *iov, int cnt, int flags) {
+	ssize_t i;
+	if (!c->wnosock) {
+		struct msghdr msg = {.msg_iov = (struct iovec *)iov, .msg_iovlen = cnt};
+		do
+			i = sendmsg(c->wfd, &msg, flags | MSG_NOSIGNAL);
+		while (i == -1 && errno == EINTR);
+		if (i != -1 || errno != ENOTSOCK)
+			return i;
+		c->wnosock = true;
+	}
+	if (flags & MSG_DONTWAIT)
+		return -1; /* Queue is supported only for sockets (errno is ENOTSOCK) */
+	do
+		i = writev(c->wfd, iov, cnt);
+	while (i == -1 && errno == EINTR);
+	return i;
+}
+
+/* Write as much as possible without blocking. Zero is returned if nothing can
+ * be written right now.
+ */
+static ssize_t qsendv(struct ctx *c, const struct iovec *iov, int cnt) {
+	ssize_t i = xsendv(c, iov, cnt, MSG_DONTWAIT);
+	if (i == -1 && (errno == EAGAIN || errno == EWOULDBLOCK))
+		return 0;
+	return i;
+}
+
+static struct qmsg *qmsg_new(struct ctx *c, size_t siz) {
+	struct qmsg *res = c->wqfree;
+	if (res && res->siz >= siz)
+		c->wqfree = NULL;
+	else {
+		siz = siz > BUFSIZ ? siz : BUFSIZ;
+		res = malloc(sizeof *res + siz);
+		if (res == NULL)
+			return NULL;
+		res->siz = siz;
+	}
+	res->next = NULL;
+	res->off = 0;
+	res->len = 0;
+	res->ref = NULL;
+	res->started = false;
 	return res;
 }
 
-/* Reliable variant of standard write */
-static bool xwrite(struct ctx *c, const void *buf, size_t siz) {
+static inline size_t qmsg_len(const struct qmsg *msg) {
+	return msg->len + (msg->ref ? msg->ref->len : 0);
+}
+
+/* Fill buffers with the rest of the message. At most two are used. */
+static int qmsg_iov(const struct qmsg *msg, struct iovec *iov) {
+	int cnt = 0;
+	if (msg->off < msg->len)
+		iov[cnt++] = (struct iovec){
+			(uint8_t *)msg->data + msg->off, msg->len - msg->off};
+	if (msg->ref) {
+		size_t off = msg->off > msg->len ? msg->off - msg->len : 0;
+		iov[cnt++] = (struct iovec){msg->ref->data + off, msg->ref->len - off};
+	}
+	return cnt;
+}
+
+static void qmsg_free(struct ctx *c, struct qmsg *msg) {
+	rpcbuf_unref(msg->ref);
+	msg->ref = NULL;
+	if (c->wqfree == NULL)
+		c->wqfree = msg;
+	else
+		free(msg);
+}
+
+static void qclear(struct ctx *c) {
+	for (int i = 0; i < RPCSTREAM_C_CNT; i++) {
+		struct qmsg *msg = c->wq[i].head;
+		while (msg) {
+			struct qmsg *next = msg->next;
+			qmsg_free(c, msg);
+			msg = next;
+		}
+		c->wq[i].head = NULL;
+		c->wq[i].tail = &c->wq[i].head;
+	}
+	c->wqcur = NULL;
+	c->wqdirect = false;
+	c->wqbytes = 0;
+	c->wqueued = 0;
+}
+
+/* Queued message being sent. It is created if this is its first queued data. */
+static struct qmsg *qcur(struct ctx *c, size_t siz) {
+	if (c->wqcur == NULL) {
+		struct qlane *lane = &c->wq[c->wclass];
+		struct qmsg *msg = qmsg_new(c, siz);
+		if (msg == NULL) {
+			c->errnum = ENOMEM;
+			return NULL;
+		}
+		/* The lane is empty if we wrote some part directly */
+		msg->started = c->wqdirect;
+		*lane->tail = msg;
+		c->wqcur = lane->tail;
+		lane->tail = &msg->next;
+		c->stats.queued[c->wclass]++;
+	}
+	return *c->wqcur;
+}
+
+/* Queue data of the message being sent. */
+static bool qappend(struct ctx *c, const uint8_t *data, size_t siz) {
+	if (siz == 0)
+		return true;
+	struct qlane *lane = &c->wq[c->wclass];
+	struct qmsg *msg = qcur(c, siz);
+	if (msg == NULL)
+		return false;
+	if (msg->len + siz > msg->siz) {
+		size_t nsiz = msg->siz * 2;
+		while (nsiz < msg->len + siz)
+			nsiz *= 2;
+		msg = realloc(msg, sizeof *msg + nsiz);
+		if (msg == NULL) {
+			c->errnum = ENOMEM;
+			return false;
+		}
+		msg->siz = nsiz;
+		*c->wqcur = msg;
+		lane->tail = &msg->next;
+	}
+	memcpy(msg->data + msg->len, data, siz);
+	msg->len += siz;
+	c->wqbytes += siz;
+	c->wqueued = c->wqbytes;
+	return true;
+}
+
+/* Queue the shared rest of the message being sent. Only the reference is
+ * kept. The `off` bytes of it were already written and in such case nothing is
+ * copied to the message.
+ */
+static bool qappend_ref(struct ctx *c, struct rpcbuf *ref, size_t off) {
+	struct qmsg *msg = qcur(c, 0);
+	if (msg == NULL)
+		return false;
+	msg->ref = rpcbuf_ref(ref);
+	msg->off += off;
+	c->wqbytes += ref->len - off;
+	c->wqueued = c->wqbytes;
+	return true;
+}
+
+/* Write data of the message being sent. It is written directly only if we are
+ * on the message boundary or if this message is already being written. Held
+ * messages are always queued. Only messages queued in lower priority lanes can
+ * be overtaken. The last buffer can be the shared `ref` that is queued by
+ * reference.
+ */
+static bool qwritev(
+	struct ctx *c, struct iovec *iov, int cnt, struct rpcbuf *ref) {
+	bool direct = !c->wmore && c->wqcur == NULL;
+	for (enum rpcstream_class i = 0;
+		i < RPCSTREAM_C_CNT && direct && !c->wqdirect; i++)
+		direct = c->wq[i].head == NULL ||
+			(i > c->wclass && !c->wq[i].head->started);
+	if (direct) {
+		ssize_t i = qsendv(c, iov, cnt);
+		if (i < 0) {
+			c->errnum = errno;
+			return false;
+		}
+		if (i > 0)
+			c->wqdirect = true;
+		iovskip(&iov, &cnt, i);
+	}
+	for (int i = 0; i < cnt; i++) {
+		if (ref && i == cnt - 1 &&
+			(uint8_t *)iov[i].iov_base + iov[i].iov_len ==
+				ref->data + ref->len) {
+			if (!qappend_ref(
+					c, ref, (uint8_t *)iov[i].iov_base - ref->data))
+				return false;
+		} else if (!qappend(c, iov[i].iov_base, iov[i].iov_len))
+			return false;
+	}
+	return true;
+}
+
+/* Lane with the message to be written next. The message that was already
+ * started has to be finished first and then the lanes are written in order of
+ * their priority.
+ */
+static struct qlane *qnext(struct ctx *c) {
+	for (int i = 0; i < RPCSTREAM_C_CNT; i++)
+		if (c->wq[i].head && c->wq[i].head->started)
+			return &c->wq[i];
+	for (int i = 0; i < RPCSTREAM_C_CNT; i++)
+		if (c->wq[i].head)
+			return &c->wq[i];
+	return NULL;
+}
+
+/* Fill buffers with queued messages in the same order qnext provides them. */
+static int qiov(struct ctx *c, struct iovec *iov) {
+	int cnt = 0;
+	struct qmsg *first = NULL;
+	struct qlane *lane = qnext(c);
+	if (lane && lane->head->started) {
+		first = lane->head;
+		cnt += qmsg_iov(first, iov);
+	}
+	for (int i = 0; i < RPCSTREAM_C_CNT; i++)
+		for (struct qmsg *msg = c->wq[i].head; msg && cnt <= QIOV - 2;
+			msg = msg->next)
+			if (msg != first)
+				cnt += qmsg_iov(msg, iov + cnt);
+	return cnt;
+}
+
+/* Write queued messages. Multiple messages are written with single call. */
+static bool qflush(struct ctx *c) {
+	if (c->wfd < 0 || (c->errnum != 0 && c->errnum != EAGAIN))
+		return false;
+	if (c->wqcur || c->wqdirect)
+		return true; /* We can't switch messages while one is being sent */
+	struct iovec iov[QIOV];
+	int cnt;
+	while ((cnt = qiov(c, iov)) > 0) {
+		ssize_t i = qsendv(c, iov, cnt);
+		if (i < 0) {
+			c->errnum = errno;
+			return false;
+		}
+		if (i == 0)
+			break;
+		c->wqbytes -= i;
+		while (i > 0) {
+			struct qlane *lane = qnext(c);
+			struct qmsg *msg = lane->head;
+			size_t siz = qmsg_len(msg) - msg->off;
+			if (siz > (size_t)i)
+				siz = i;
+			msg->started = true;
+			msg->off += siz;
+			i -= siz;
+			if (msg->off == qmsg_len(msg)) {
+				lane->head = msg->next;
+				if (lane->head == NULL)
+					lane->tail = &lane->head;
+				qmsg_free(c, msg);
+			}
+		}
+	}
+	c->wqueued = c->wqbytes;
+	return true;
+}
+
+/* Reliable variant of standard writev. The `more` should be set if more data of
+ * the same message follows. The `ref` is the shared buffer in the last buffer
+ * if it is not NULL.
+ */
+static bool xwritev(struct ctx *c, struct iovec *iov, int cnt,
+	struct rpcbuf *ref, bool more) {
 	if (c->errnum != 0 && c->errnum != EAGAIN)
 		return false;
-	uint8_t *data = (uint8_t *)buf;
+	if (c->pub.queue && !c->wnosock) {
+		if (qwritev(c, iov, cnt, ref))
+			return true;
+		if (c->errnum != ENOTSOCK)
+			return false;
+		/* Queue is supported only for sockets */
+		c->errnum = 0;
+	}
 	struct pollfd pfd = {
 		.fd = c->wfd,
 		.events = POLLOUT,
 	};
-	while (siz > 0) {
-		int pollres = poll(&pfd, 1,
-			c->errnum
-				? 0
-				: (c->proto == RPCSTREAM_P_BLOCK ? TIMEOUT_WR_BLOCK : TIMEOUT_WR));
+	iovskip(&iov, &cnt, 0); /* Skip empty buffers */
+	while (cnt > 0) {
+		int pollres = poll(&pfd, 1, c->errnum ? 0 : c->timeout[c->wclass]);
 		if (pollres < 0) {
 			if (errno == EINTR || errno == EAGAIN)
 				continue;
@@ -139,6 +492,7 @@ static bool xwrite(struct ctx *c, const void *buf, size_t siz) {
 			return false;
 		} else if (pollres == 0) {
 			c->errnum = EWOULDBLOCK;
+			c->stats.timeouts[c->wclass]++;
 			return false;
 		} else if (c->errnum)
 			c->errnum = 0;
@@ -148,20 +502,21 @@ static bool xwrite(struct ctx *c, const void *buf, size_t siz) {
 			return false;
 		}
 
-		ssize_t i = write(c->wfd, data, siz);
+		ssize_t i = xsendv(c, iov, cnt, more ? MSG_MORE : 0);
 		if (i == -1) {
-			if (errno != EINTR) {
-				c->errnum = errno;
-				return false;
-			}
-		} else {
-			data += i;
-			siz -= i;
+			c->errnum = errno;
+			return false;
 		}
+		iovskip(&iov, &cnt, i);
 	}
 	return true;
 }
 
+static bool xwrite(struct ctx *c, const void *buf, size_t siz, bool more) {
+	struct iovec iov = {(void *)buf, siz};
+	return xwritev(c, &iov, 1, NULL, more);
+}
+
 /* Block **********************************************************************/
 
 static ssize_t cookie_read_block(void *cookie, char *buf, size_t size) {
@@ -171,7 +526,7 @@ static ssize_t cookie_read_block(void *cookie, char *buf, size_t size) {
 		size = c->block.rmsgoff;
 	if (size == 0)
 		return 0;
-	ssize_t res = xread(c, buf, size, TIMEOUT_RD);
+	ssize_t res = rbufread(c, buf, size, TIMEOUT_RD);
 	if (res >= 0)
 		c->block.rmsgoff -= res;
 	if (res == -2)
@@ -181,6 +536,8 @@ static ssize_t cookie_read_block(void *cookie, char *buf, size_t size) {
 
 static ssize_t cookie_write_block(void *cookie, const char *buf, size_t size) {
 	struct ctx *c = (struct ctx *)cookie;
+	if (c->block.wref)
+		return 0; /* Shared data must be the rest of the message */
 	while (c->block.wbuflen + size >= c->block.wbufsiz) {
 		c->block.wbufsiz = 2 * (c->block.wbufsiz ?: 4);
 		char *nbuf = realloc(c->block.wbuf, c->block.wbufsiz);
@@ -194,27 +551,41 @@ static ssize_t cookie_write_block(void *cookie, const char *buf, size_t size) {
 }
 
 static bool rpcclient_stream_block_send(struct ctx *c) {
-	if (c->block.wbuflen == 0)
+	struct rpcbuf *ref = c->block.wref;
+	c->block.wref = NULL;
+	if (c->block.wbuflen == 0) {
+		rpcbuf_unref(ref);
 		return false;
-	/* Write size */
-	unsigned bytes = chainpack_w_uint_bytes(c->block.wbuflen);
-	for (unsigned i = 0; i < bytes; i++) {
-		uint8_t v = i == 0 ? chainpack_w_uint_value1(c->block.wbuflen, bytes)
-						   : 0xff & (c->block.wbuflen >> (8 * (bytes - i - 1)));
-		if (!xwrite(c, &v, 1))
-			return false;
 	}
-	/* Write buffer */
-	bool res = xwrite(c, c->block.wbuf, c->block.wbuflen);
+	if (ref && ref->len == 0) {
+		rpcbuf_unref(ref);
+		ref = NULL;
+	}
+	size_t len = c->block.wbuflen + (ref ? ref->len : 0);
+	/* Size is written together with the buffer */
+	uint8_t size[9];
+	unsigned bytes = chainpack_w_uint_bytes(len);
+	for (unsigned i = 0; i < bytes; i++)
+		size[i] = i == 0 ? chainpack_w_uint_value1(len, bytes)
+						 : 0xff & (len >> (8 * (bytes - i - 1)));
+	struct iovec iov[] = {
+		{size, bytes},
+		{c->block.wbuf, c->block.wbuflen},
+		{ref ? ref->data : NULL, ref ? ref->len : 0},
+	};
+	bool res = xwritev(c, iov, ref ? 3 : 2, ref, false);
 	/* Note: We could keep the message on failure here for resend but that would
 	 * not be consistent with stream protocol abilities.
 	 */
 	c->block.wbuflen = 0;
+	rpcbuf_unref(ref);
 	return res;
 }
 
 static bool rpcclient_stream_block_drop(struct ctx *c) {
 	c->block.wbuflen = 0;
+	rpcbuf_unref(c->block.wref);
+	c->block.wref = NULL;
 	// TODO possibly decrease size of the write buffer based on the
 	// some sort of statistics
 	return true;
@@ -240,77 +611,122 @@ static enum rpcclient_msg_type rpcclient_stream_block_nextmsg(struct ctx *c) {
 	return RPCC_MESSAGE;
 }
 
+static bool rpcclient_stream_block_pending(struct ctx *c) {
+	size_t avail = c->rbuflen - c->rbufoff;
+	if (avail <= c->block.rmsgoff)
+		return false;
+	const uint8_t *ptr = c->rbuf + c->rbufoff + c->block.rmsgoff;
+	avail -= c->block.rmsgoff;
+	unsigned bytes = chainpack_int_bytes(*ptr);
+	if (avail < bytes)
+		return false;
+	size_t msgsiz = chainpack_uint_value1(*ptr, bytes);
+	for (unsigned i = 1; i < bytes; i++)
+		msgsiz = (msgsiz << 8) | ptr[i];
+	return avail - bytes >= msgsiz;
+}
+
 /* Serial *********************************************************************/
 
 static ssize_t cookie_read_serial(void *cookie, char *buf, size_t size) {
 	struct ctx *c = (struct ctx *)cookie;
+	if (c->serial.rerr) {
+		c->serial.rerr = false;
+		return -1;
+	}
 	if (c->serial.rmsg != RMSG_DATA)
 		return c->errnum ? -1 : 0;
-	size_t i;
-	for (i = 0; i < size; i++) {
+	bool crc = c->proto == RPCSTREAM_P_SERIAL_CRC;
+	size_t i = 0;
+	while (i < size) {
+		/* Data without special bytes are copied from receive buffer at once */
+		size_t avail = c->rbuflen - c->rbufoff;
+		if (avail > size - i)
+			avail = size - i;
+		size_t run = serial_scan(c->rbuf + c->rbufoff, avail);
+		if (run > 0) {
+			memcpy(buf + i, c->rbuf + c->rbufoff, run);
+			if (crc)
+				c->serial.rcrc =
+					crc32_update(c->serial.rcrc, c->rbuf + c->rbufoff, run);
+			c->rbufoff += run;
+			i += run;
+			continue;
+		}
 		int v = xreadc(c, TIMEOUT_RD);
 		switch (v) {
 			case STX:
 				c->serial.rmsg = RMSG_STX;
-				return -1;
+				goto error;
 			case ETX:
 				c->serial.rmsg = RMSG_ETX;
 				return i;
 			case ESC:
-				c->serial.rcrc = crc32_cupdate(c->serial.rcrc, v);
+				if (crc)
+					c->serial.rcrc = crc32_cupdate(c->serial.rcrc, v);
 				v = xreadc(c, TIMEOUT_RD);
 				if (ESCAPED(v)) {
-					c->serial.rcrc = crc32_cupdate(c->serial.rcrc, v);
-					buf[i] = DESCX(v);
+					if (crc)
+						c->serial.rcrc = crc32_cupdate(c->serial.rcrc, v);
+					buf[i++] = DESCX(v);
 					break;
 				}
 				/* Fall through in case of error or unexpected byte */
 			case ATX:
 				c->serial.rmsg = RMSG_NO;
-				return -1;
+				goto error;
 			default:
 				if (v < 0) {
 					c->serial.rmsg = RMSG_NO;
-					return v;
+					goto error;
 				}
-				c->serial.rcrc = crc32_cupdate(c->serial.rcrc, v);
-				buf[i] = v;
+				if (crc)
+					c->serial.rcrc = crc32_cupdate(c->serial.rcrc, v);
+				buf[i++] = v;
 				break;
 		}
 	}
 	return i;
+
+error:
+	/* The data read so far must not be lost and thus error is postponed */
+	if (i == 0)
+		return -1;
+	c->serial.rerr = true;
+	return i;
 }
 
 static ssize_t cookie_write_serial(void *cookie, const char *data, size_t size) {
 	struct ctx *c = (struct ctx *)cookie;
-	char buf[BUFSIZ];
-	bool esc = false;
+	const uint8_t *src = (const uint8_t *)data;
+	uint8_t buf[BUFSIZ];
 	size_t cnt = 0;
 	while (cnt < size) {
-		size_t i;
-		for (i = 0; i < BUFSIZ && cnt < size; i++) {
-			if (c->serial.wmsg == WMSG_DATA) {
-				if (esc) {
-					buf[i] = ESCX(*data++);
-					cnt++;
-					esc = false;
-				} else {
-					if (ESCAPABLE((uint8_t)*data)) {
-						buf[i] = ESC;
-						esc = true;
-					} else {
-						buf[i] = *data++;
-						cnt++;
-					}
-				}
-				c->serial.wcrc = crc32_cupdate(c->serial.wcrc, buf[i]);
-			} else {
-				buf[i] = STX;
-				c->serial.wmsg = WMSG_DATA;
-				c->serial.wcrc = crc32_init();
+		size_t i = 0;
+		if (c->serial.wmsg != WMSG_DATA) {
+			buf[i++] = STX;
+			c->serial.wmsg = WMSG_DATA;
+			c->serial.wcrc = crc32_init();
+		}
+		size_t crcoff = i; /* STX is not part of CRC */
+		/* Leave space for escape sequence that can't be split */
+		while (i < BUFSIZ - 1 && cnt < size) {
+			size_t len = size - cnt;
+			if (len > BUFSIZ - 1 - i)
+				len = BUFSIZ - 1 - i;
+			size_t run = serial_scan(src + cnt, len);
+			memcpy(buf + i, src + cnt, run);
+			i += run;
+			cnt += run;
+			if (run < len) {
+				buf[i++] = ESC;
+				buf[i++] = ESCX(src[cnt++]);
 			}
 		}
-		if (!xwrite(c, buf, i))
+		if (c->proto == RPCSTREAM_P_SERIAL_CRC)
+			c->serial.wcrc =
+				crc32_update(c->serial.wcrc, buf + crcoff, i - crcoff);
+		if (!xwrite(c, buf, i, true)) /* ETX follows */
 			return cnt;
 	}
 	return size;
@@ -334,7 +750,7 @@ static bool rpcclient_stream_serial_send(struct ctx *c) {
 				buf[i++] = v;
 		}
 	}
-	if (!xwrite(c, buf, i))
+	if (!xwrite(c, buf, i, false))
 		return false;
 	return true;
 }
@@ -344,7 +760,7 @@ static bool rpcclient_stream_serial_drop(struct ctx *c) {
 		return true;
 	c->serial.wmsg = WMSG_NO;
 	uint8_t v = ATX;
-	if (!xwrite(c, &v, 1))
+	if (!xwrite(c, &v, 1, false))
 		return false;
 	return true;
 }
@@ -361,6 +777,7 @@ static enum rpcclient_msg_type rpcclient_stream_serial_nextmsg(struct ctx *c) {
 	}
 	c->serial.rcrc = crc32_init();
 	c->serial.rmsg = RMSG_DATA;
+	c->serial.rerr = false;
 	return RPCC_MESSAGE;
 }
 
@@ -385,17 +802,98 @@ static bool rpcclient_stream_serial_validate(struct ctx *c) {
 	return crc == crc32_finalize(c->serial.rcrc);
 }
 
+static bool rpcclient_stream_serial_pending(struct ctx *c) {
+	const uint8_t *ptr = c->rbuf + c->rbufoff;
+	const uint8_t *end = c->rbuf + c->rbuflen;
+	if (c->serial.rmsg != RMSG_STX) {
+		if ((ptr = memchr(ptr, STX, end - ptr)) == NULL)
+			return false;
+		ptr++;
+	}
+	if ((ptr = memchr(ptr, ETX, end - ptr)) == NULL)
+		return false;
+	ptr++;
+	if (c->proto == RPCSTREAM_P_SERIAL_CRC)
+		for (int i = 0; i < 4; i++) {
+			if (ptr == end)
+				return false;
+			if (*ptr++ == ESC && ptr++ == end)
+				return false;
+		}
+	return true;
+}
+
 /******************************************************************************/
 
-static bool stream_pack(void *ptr, const struct cpitem *item) {
-	struct ctx *c = (struct ctx *)((char *)ptr - offsetof(struct ctx, pub.pack));
-	rpclogger_log_item(c->pub.logger_out, item);
+static void startmsg(struct ctx *c) {
 	if ((c->proto == RPCSTREAM_P_BLOCK && c->block.wbuflen == 0) ||
 		(c->proto != RPCSTREAM_P_BLOCK && c->serial.wmsg == WMSG_NO)) {
 		putc_unlocked(1, c->fw); /* Chainpack identifier */
 		if (c->proto != RPCSTREAM_P_BLOCK)
 			c->serial.wmsg = WMSG_ST;
+		c->wclass = RPCSTREAM_C_SIGNAL;
+		c->wmeta = WMETA_START;
+	}
+}
+
+static void endmsg(struct ctx *c, bool sent) {
+	if (sent)
+		c->stats.sent[c->wclass]++;
+	c->wqcur = NULL;
+	c->wqdirect = false;
+	c->wmore = false;
+	c->wmeta = WMETA_DONE;
+}
+
+/* Requests and responses are recognized by request ID in their meta. The class
+ * can't be changed once some data of the message were written.
+ */
+static void classify(struct ctx *c, const struct cpitem *item) {
+	if (c->wmeta == WMETA_DONE || c->wqcur || c->wqdirect)
+		return;
+	if (c->wmeta == WMETA_START) {
+		c->wmeta = item->type == CPITEM_META ? 1 : WMETA_DONE;
+		c->wmetakey = true;
+		return;
+	}
+	switch (item->type) {
+		case CPITEM_LIST:
+		case CPITEM_MAP:
+		case CPITEM_IMAP:
+		case CPITEM_META:
+			c->wmeta++;
+			return;
+		case CPITEM_CONTAINER_END:
+			/* Container was value and thus key follows (or meta ended) */
+			c->wmeta--;
+			c->wmetakey = true;
+			return;
+		case CPITEM_STRING:
+			if (!(item->as.String.flags & CPBI_F_FIRST))
+				return;
+			break;
+		case CPITEM_BLOB:
+			if (!(item->as.Blob.flags & CPBI_F_FIRST))
+				return;
+			break;
+		default:
+			break;
 	}
+	if (c->wmeta != 1)
+		return;
+	if (c->wmetakey && item->type == CPITEM_INT &&
+		item->as.Int == RPCMSG_TAG_REQUEST_ID) {
+		c->wclass = RPCSTREAM_C_REQUEST;
+		c->wmeta = WMETA_DONE;
+	} else
+		c->wmetakey = !c->wmetakey;
+}
+
+static bool stream_pack(void *ptr, const struct cpitem *item) {
+	struct ctx *c = (struct ctx *)((char *)ptr - offsetof(struct ctx, pub.pack));
+	rpclogger_log_item(c->pub.logger_out, item);
+	startmsg(c);
+	classify(c, item);
 	return chainpack_pack(c->fw, item) > 0;
 }
 
@@ -405,6 +903,27 @@ static void stream_unpack(void *ptr, struct cpitem *item) {
 	rpclogger_log_item(c->pub.logger_in, item);
 }
 
+static size_t stream_rawread(rpcclient_t client, void *buf, size_t siz) {
+	struct ctx *c = (struct ctx *)client;
+	return fread_unlocked(buf, 1, siz, c->fr);
+}
+
+static bool stream_rawwrite(rpcclient_t client, const void *buf, size_t siz) {
+	struct ctx *c = (struct ctx *)client;
+	startmsg(c);
+	return fwrite_unlocked(buf, 1, siz, c->fw) == siz;
+}
+
+/* Block protocol keeps the reference and writes it after the buffered data. */
+static bool stream_rawshare(rpcclient_t client, struct rpcbuf *buf) {
+	struct ctx *c = (struct ctx *)client;
+	startmsg(c);
+	if (c->block.wref)
+		return false;
+	c->block.wref = rpcbuf_ref(buf);
+	return true;
+}
+
 static void flushmsg(struct ctx *c) {
 	/* Flush the rest of the message. Read up to the EOF. */
 	char buf[BUFSIZ];
@@ -429,8 +948,12 @@ static int stream_ctrl(rpcclient_t client, enum rpcclient_ctrlop op) {
 				default_disconnect(c->fds);
 			fclose(c->fr);
 			fclose(c->fw);
-			if (c->proto == RPCSTREAM_P_BLOCK)
+			if (c->proto == RPCSTREAM_P_BLOCK) {
 				free(c->block.wbuf);
+				rpcbuf_unref(c->block.wref);
+			}
+			qclear(c);
+			free(c->wqfree);
 			free(c);
 			return true;
 		case RPCC_CTRLOP_DISCONNECT:
@@ -442,6 +965,10 @@ static int stream_ctrl(rpcclient_t client, enum rpcclient_ctrlop op) {
 				default_disconnect(c->fds);
 			c->rfd = -1;
 			c->wfd = -1;
+			c->rbufoff = 0;
+			c->rbuflen = 0;
+			qclear(c);
+			c->wnosock = false;
 			return true;
 		case RPCC_CTRLOP_RESET:
 			if (c->rfd < 0) {
@@ -451,6 +978,8 @@ static int stream_ctrl(rpcclient_t client, enum rpcclient_ctrlop op) {
 				if (!sendrst || c->rfd < 0)
 					return c->rfd >= 0;
 			}
+			c->wclass = RPCSTREAM_C_REQUEST;
+			c->wmeta = WMETA_DONE;
 			putc_unlocked(0, c->fw);
 			rpclogger_log_reset(c->pub.logger_out);
 			return stream_ctrl(client, RPCC_CTRLOP_SENDMSG);
@@ -465,8 +994,12 @@ static int stream_ctrl(rpcclient_t client, enum rpcclient_ctrlop op) {
 				if (c->proto == RPCSTREAM_P_BLOCK) {
 					flushmsg(c);
 					ret = rpcclient_stream_block_nextmsg(c);
-				} else
+				} else {
+					if (c->serial.rmsg == RMSG_DATA)
+						c->serial.rmsg = RMSG_NO; /* Skip the unread message */
+					flushmsg(c); /* Drop its data buffered in stdio */
 					ret = rpcclient_stream_serial_nextmsg(c);
+				}
 				if (ret != RPCC_MESSAGE)
 					return ret;
 				clearerr(c->fr);
@@ -498,7 +1031,11 @@ static int stream_ctrl(rpcclient_t client, enum rpcclient_ctrlop op) {
 			if (c->proto == RPCSTREAM_P_BLOCK)
 				rpcclient_stream_serial_validate(c);
 			return 0;
+		case RPCC_CTRLOP_SENDMSG_MORE:
+			c->wmore = c->pub.queue;
+			/* Fall through */
 		case RPCC_CTRLOP_SENDMSG: {
+			bool held = c->wmore;
 			bool res;
 			if (c->proto == RPCSTREAM_P_BLOCK) {
 				res = rpcclient_stream_block_send(c);
@@ -506,7 +1043,8 @@ static int stream_ctrl(rpcclient_t client, enum rpcclient_ctrlop op) {
 				fflush(c->fw);
 				res = rpcclient_stream_serial_send(c);
 			}
-			if (c->sclient->flush)
+			endmsg(c, res);
+			if (c->sclient->flush && !held)
 				c->sclient->flush(c->sclient_cookie, c->wfd);
 			rpclogger_log_end(c->pub.logger_out, RPCLOGGER_ET_VALID);
 			if (c->errnum == EWOULDBLOCK)
@@ -526,6 +1064,7 @@ static int stream_ctrl(rpcclient_t client, enum rpcclient_ctrlop op) {
 			}
 
 			// TODO this is pretty much same as send (merge the code)
+			endmsg(c, false);
 			if (c->sclient->flush)
 				c->sclient->flush(c->sclient_cookie, c->wfd);
 			rpclogger_log_end(c->pub.logger_out, RPCLOGGER_ET_INVALID);
@@ -538,6 +1077,21 @@ static int stream_ctrl(rpcclient_t client, enum rpcclient_ctrlop op) {
 			return c->sclient->contrack;
 		case RPCC_CTRLOP_POLLFD:
 			return c->rfd;
+		case RPCC_CTRLOP_PENDING:
+			return c->proto == RPCSTREAM_P_BLOCK
+				? rpcclient_stream_block_pending(c)
+				: rpcclient_stream_serial_pending(c);
+		case RPCC_CTRLOP_FLUSH: {
+			size_t queued = c->wqbytes;
+			bool res = qflush(c);
+			if (res && c->sclient->flush && c->wqbytes != queued)
+				c->sclient->flush(c->sclient_cookie, c->wfd);
+			return res;
+		}
+		case RPCC_CTRLOP_QUEUED: {
+			size_t queued = c->wqueued;
+			return queued > INT_MAX ? INT_MAX : queued;
+		}
 	}
 	/* This should not happen -> implementation error */
 	abort(); // GCOVR_EXCL_LINE
@@ -562,6 +1116,10 @@ rpcclient_t rpcclient_stream_new(const struct rpcclient_stream_funcs *sclient,
 				.peername = stream_peername,
 				.pack = stream_pack,
 				.unpack = stream_unpack,
+				.rawread = stream_rawread,
+				.rawwrite = stream_rawwrite,
+				.rawshare =
+					proto == RPCSTREAM_P_BLOCK ? stream_rawshare : NULL,
 			},
 		.sclient = sclient,
 		.sclient_cookie = sclient_cookie,
@@ -569,6 +1127,16 @@ rpcclient_t rpcclient_stream_new(const struct rpcclient_stream_funcs *sclient,
 		.rfd = rfd,
 		.wfd = wfd,
 		.errnum = 0,
+		.rbufoff = 0,
+		.rbuflen = 0,
+		.wclass = RPCSTREAM_C_SIGNAL,
+		.wmeta = WMETA_DONE,
+		.timeout =
+			{
+				[RPCSTREAM_C_REQUEST] = TIMEOUT_WR_REQUEST,
+				[RPCSTREAM_C_SIGNAL] =
+					proto == RPCSTREAM_P_BLOCK ? TIMEOUT_WR_BLOCK : TIMEOUT_WR,
+			},
 		.fr = fopencookie(res, "r",
 			(cookie_io_functions_t){
 				.read = proto == RPCSTREAM_P_BLOCK ? cookie_read_block
@@ -580,8 +1148,29 @@ rpcclient_t rpcclient_stream_new(const struct rpcclient_stream_funcs *sclient,
 													: cookie_write_serial,
 			}),
 	};
-	setbuf(res->fr, NULL);
+	/* Reading is buffered because read functions never provide data past the
+	 * end of the message.
+	 */
 	if (proto == RPCSTREAM_P_BLOCK)
 		setbuf(res->fw, NULL);
+	for (int i = 0; i < RPCSTREAM_C_CNT; i++)
+		res->wq[i].tail = &res->wq[i].head;
 	return &res->pub;
 }
+
+bool rpcclient_stream_timeout(
+	rpcclient_t client, enum rpcstream_class cls, int timeout) {
+	if (client->ctrl != stream_ctrl)
+		return false;
+	struct ctx *c = (struct ctx *)client;
+	c->timeout[cls] = timeout;
+	return true;
+}
+
+bool rpcclient_stream_stats(rpcclient_t client, struct rpcstream_stats *stats) {
+	if (client->ctrl != stream_ctrl)
+		return false;
+	struct ctx *c = (struct ctx *)client;
+	*stats = c->stats;
+	return true;
+}
@@ -1,4 +1,5 @@
 #include <stdlib.h>
+#include <stdatomic.h>
 #include <shv/rpcdir.h>
 
 #include "rpcdir_key.gperf.h"
@@ -63,6 +64,46 @@ bool rpcdir_pack(cp_pack_t pack, const struct rpcdir *method) {
 	return true;
 }
 
+struct rpcdir_packed_data {
+	size_t len;
+	uint8_t data[];
+};
+
+const uint8_t *rpcdir_packed(struct rpcdir_packed *method, size_t *len) {
+	struct rpcdir_packed_data *res = method->packed;
+	if (res == NULL) {
+		/* Descriptions are short and thus we start with small buffer */
+		size_t siz = 64;
+		while (true) {
+			res = malloc(sizeof *res + siz);
+			if (res == NULL) // GCOVR_EXCL_BR_LINE malloc failure only
+				return NULL; // GCOVR_EXCL_LINE
+			struct cp_pack_buf pbuf;
+			cp_pack_t pack = cp_pack_buf_init(&pbuf, res->data, siz);
+			rpcdir_pack(pack, method->method);
+			if (pbuf.ptr != NULL) {
+				res->len = pbuf.ptr - res->data;
+				break;
+			}
+			free(res);
+			siz *= 2;
+		}
+		/* Concurrent call might have been faster */
+		struct rpcdir_packed_data *expected = NULL;
+		if (!atomic_compare_exchange_strong(&method->packed, &expected, res)) {
+			free(res);
+			res = expected;
+		}
+	}
+	*len = res->len;
+	return res->data;
+}
+
+void rpcdir_packed_free(struct rpcdir_packed *method) {
+	free(method->packed);
+	method->packed = NULL;
+}
+
 static bool unpack_value(cp_unpack_t unpack, struct cpitem *item,
 	struct obstack *obstack, struct rpcdir *res, enum rpcdir_keys key) {
 	switch (key) {
@@ -12,11 +12,23 @@
 #define obstack_chunk_alloc malloc
 #define obstack_chunk_free free
 
+/* Maximum number of nodes in the cache before it is cleared */
+#define NODES_CACHE_SIZE (1024)
+/* Request IDs 1-3 are reserved for login and ping */
+#define RID_FIRST (4)
+
+#include "ridmap.h"
+#include "rpcroute.h"
 #include "strset.h"
 
 struct rpchandler {
 	const struct rpchandler_stage *stages;
 	const struct rpcmsg_meta_limits *meta_limits;
+	struct rpcroute routes;
+	/* Cache of nodes known to exist valid for the given generation */
+	bool nodes_cache;
+	unsigned nodes_gen;
+	struct strset nodes;
 	rpcclient_t client;
 	/* Lock for handler specific variables here */
 	pthread_mutex_t lock;
@@ -29,13 +41,22 @@ struct rpchandler {
 	 */
 	struct timespec last_send;
 
+	/* Obstack is reused for all messages and it is only reset in between them.
+	 * The base is the empty object at the start of the first chunk.
+	 */
 	struct obstack obstack;
+	void *obstack_base;
 	/* The thread receiving messages needs to have priority over others. Other
 	 * threads need to release the lock immediately right after taking it if
 	 * `send_priority` is `true`.
 	 */
 	pthread_mutex_t send_lock;
 	volatile _Atomic bool send_priority;
+
+	/* Request IDs of requests we wait response for and the next one to try */
+	struct ridmap rids;
+	int rid;
+	pthread_mutex_t rid_lock;
 };
 
 struct msg_ctx {
@@ -47,7 +68,6 @@ struct msg_ctx {
 struct ls_ctx {
 	struct rpchandler_ls ctx;
 	struct msg_ctx *mctx;
-	cp_pack_t pack;
 	struct strset strset;
 	bool located;
 };
@@ -63,6 +83,8 @@ struct idle_ctx {
 	struct rpchandler_idle ctx;
 	rpchandler_t handler;
 	bool msg_sent;
+	/* Some message was sent with rpchandler_msg_send_more */
+	bool msg_held;
 };
 
 
@@ -72,19 +94,35 @@ rpchandler_t rpchandler_new(rpcclient_t client,
 	struct rpchandler *res = malloc(sizeof *res);
 	res->stages = stages;
 	res->meta_limits = limits;
+	res->routes = (struct rpcroute){};
+	res->nodes_cache = false;
+	res->nodes = (struct strset){};
 	res->client = client;
 	pthread_mutex_init(&res->lock, NULL);
 	clock_gettime(CLOCK_MONOTONIC, &res->last_send);
 	pthread_mutex_init(&res->send_lock, NULL);
 	res->send_priority = false;
+	obstack_init(&res->obstack);
+	res->obstack_base = obstack_alloc(&res->obstack, 0);
+	res->rids = (struct ridmap){};
+	res->rid = RID_FIRST;
+	pthread_mutex_init(&res->rid_lock, NULL);
 	return res;
 }
 
 void rpchandler_destroy(rpchandler_t handler) {
 	if (handler == NULL)
 		return;
+	/* Wait for anyone still sending through this handler */
+	pthread_mutex_lock(&handler->send_lock);
+	pthread_mutex_unlock(&handler->send_lock);
 	pthread_mutex_destroy(&handler->lock);
 	pthread_mutex_destroy(&handler->send_lock);
+	pthread_mutex_destroy(&handler->rid_lock);
+	ridmap_free(&handler->rids);
+	obstack_free(&handler->obstack, NULL);
+	rpcroute_free(&handler->routes);
+	shv_strset_free(&handler->nodes);
 	free(handler);
 }
 
@@ -96,6 +134,7 @@ void rpchandler_change_stages(
 	rpchandler_t handler, const struct rpchandler_stage *stages) {
 	pthread_mutex_lock(&handler->lock);
 	handler->stages = stages;
+	shv_strset_free(&handler->nodes);
 	pthread_mutex_unlock(&handler->lock);
 }
 
@@ -103,6 +142,55 @@ rpcclient_t rpchandler_client(rpchandler_t handler) {
 	return handler->client;
 }
 
+static _Atomic unsigned nodes_gen = 0;
+
+void rpchandler_cache_nodes(rpchandler_t handler, bool enable) {
+	pthread_mutex_lock(&handler->lock);
+	handler->nodes_cache = enable;
+	shv_strset_free(&handler->nodes);
+	pthread_mutex_unlock(&handler->lock);
+}
+
+void rpchandler_nodes_changed(void) {
+	nodes_gen++;
+}
+
+int _rpchandler_next_request_id(rpchandler_t handler) {
+	pthread_mutex_lock(&handler->rid_lock);
+	int res;
+	do {
+		res = handler->rid;
+		handler->rid = res == INT_MAX ? RID_FIRST : res + 1;
+	} while (ridmap_has(&handler->rids, res));
+	/* The failed allocation only means that ID is not tracked */
+	ridmap_add(&handler->rids, res, NULL);
+	pthread_mutex_unlock(&handler->rid_lock);
+	return res;
+}
+
+int _rpchandler_idle_next_request_id(struct rpchandler_idle *ctx) {
+	struct idle_ctx *ictx = (struct idle_ctx *)ctx;
+	return _rpchandler_next_request_id(ictx->handler);
+}
+
+void _rpchandler_release_request_id(rpchandler_t handler, int request_id) {
+	pthread_mutex_lock(&handler->rid_lock);
+	ridmap_del(&handler->rids, request_id);
+	pthread_mutex_unlock(&handler->rid_lock);
+}
+
+void _rpchandler_msg_release_request_id(
+	struct rpchandler_msg *ctx, int request_id) {
+	struct msg_ctx *mctx = (struct msg_ctx *)ctx;
+	_rpchandler_release_request_id(mctx->handler, request_id);
+}
+
+void _rpchandler_idle_release_request_id(
+	struct rpchandler_idle *ctx, int request_id) {
+	struct idle_ctx *ictx = (struct idle_ctx *)ctx;
+	_rpchandler_release_request_id(ictx->handler, request_id);
+}
+
 static void priority_send_lock(rpchandler_t handler) {
 	handler->send_priority = true;
 	pthread_mutex_lock(&handler->send_lock);
@@ -124,6 +212,24 @@ static void send_unlock(rpchandler_t handler) {
 	pthread_mutex_unlock(&handler->send_lock);
 }
 
+/* Free all objects in the obstack but keep its memory for the next use. The
+ * chunks are replaced by a single one of their combined size if there was more
+ * of them. Handling of the same messages then no longer allocates memory.
+ */
+static void reset_obstack(rpchandler_t handler) {
+	struct obstack *obs = &handler->obstack;
+	if (obs->chunk->prev == NULL) {
+		obstack_free(obs, handler->obstack_base);
+		return;
+	}
+	size_t siz = 0;
+	for (struct _obstack_chunk *ch = obs->chunk; ch; ch = ch->prev)
+		siz += ch->limit - (char *)ch;
+	obstack_free(obs, NULL);
+	obstack_begin(obs, siz);
+	handler->obstack_base = obstack_alloc(obs, 0);
+}
+
 
 static bool common_ls_dir(struct msg_ctx *ctx, char **name) {
 	*name = NULL;
@@ -152,9 +258,31 @@ static bool common_ls_dir(struct msg_ctx *ctx, char **name) {
 	return false;
 }
 
+static bool cached_node(rpchandler_t handler, const char *path) {
+	if (!handler->nodes_cache)
+		return false;
+	unsigned gen = nodes_gen;
+	if (handler->nodes_gen != gen) {
+		shv_strset_free(&handler->nodes);
+		handler->nodes_gen = gen;
+		return false;
+	}
+	return shv_strset_has(&handler->nodes, path);
+}
+
+static void cache_node(rpchandler_t handler, const char *path) {
+	if (!handler->nodes_cache)
+		return;
+	if (handler->nodes.cnt >= NODES_CACHE_SIZE)
+		shv_strset_free(&handler->nodes);
+	shv_strset_add(&handler->nodes, path);
+}
+
 static bool valid_path(rpchandler_t handler, char *path) {
 	if (path == NULL || *path == '\0')
 		return true; /* root node is always valid */
+	if (rpcroute_exists(&handler->routes, path) || cached_node(handler, path))
+		return true;
 	char *slash = strrchr(path, '/');
 	if (slash)
 		*slash = '\0';
@@ -170,6 +298,8 @@ static bool valid_path(rpchandler_t handler, char *path) {
 			s->funcs->ls(s->cookie, &lsctx.ctx);
 	if (slash)
 		*slash = '/';
+	if (lsctx.located)
+		cache_node(handler, path);
 	return lsctx.located;
 }
 
@@ -182,14 +312,19 @@ static void handle_ls(struct msg_ctx *ctx) {
 		.ctx.path = ctx->ctx.meta.path ?: "",
 		.ctx.name = name,
 		.mctx = ctx,
-		.pack = NULL,
 		.strset = (struct strset){},
 		.located = false,
 	};
+	/* Names are collected in the obstack and packed only once all stages are
+	 * called. Stages thus do not run with the send lock held and can take their
+	 * own locks that are also held while sending messages.
+	 */
 	for (const struct rpchandler_stage *s = ctx->handler->stages;
 		s->funcs && !lsctx.located; s++)
 		if (s->funcs->ls)
 			s->funcs->ls(s->cookie, &lsctx.ctx);
+	size_t len = obstack_object_size(&ctx->handler->obstack);
+	const char *names = obstack_finish(&ctx->handler->obstack);
 
 	if (!lsctx.located && lsctx.strset.cnt == 0 &&
 		!valid_path(ctx->handler, ctx->ctx.meta.path)) {
@@ -197,21 +332,27 @@ static void handle_ls(struct msg_ctx *ctx) {
 			"No such node: %s", ctx->ctx.meta.path ?: "");
 		return;
 	}
+	if (lsctx.strset.cnt > 0 && ctx->ctx.meta.path && *ctx->ctx.meta.path)
+		cache_node(ctx->handler, ctx->ctx.meta.path); /* Has child nodes */
+	cp_pack_t pack;
 	if (lsctx.ctx.name == NULL) {
-		if (lsctx.pack == NULL) {
-			lsctx.pack = rpchandler_msg_new_response(&ctx->ctx);
-			cp_pack_list_begin(lsctx.pack);
-		}
-		cp_pack_container_end(lsctx.pack);
+		pack = rpchandler_msg_new_response(&ctx->ctx);
+		cp_pack_list_begin(pack);
+		for (const char *n = names; n < names + len; n += strlen(n) + 1)
+			cp_pack_str(pack, n);
+		cp_pack_container_end(pack);
 		shv_strset_free(&lsctx.strset);
 	} else {
-		lsctx.pack = rpchandler_msg_new_response(&ctx->ctx);
-		cp_pack_bool(lsctx.pack, lsctx.located);
+		pack = rpchandler_msg_new_response(&ctx->ctx);
+		cp_pack_bool(pack, lsctx.located);
 	}
-	cp_pack_container_end(lsctx.pack);
+	cp_pack_container_end(pack);
 	rpchandler_msg_send(&ctx->ctx);
 }
 
+static struct rpcdir_packed dir_packed = {.method = &rpcdir_dir};
+static struct rpcdir_packed ls_packed = {.method = &rpcdir_ls};
+
 static void handle_dir(struct msg_ctx *ctx) {
 	char *name;
 	if (!common_ls_dir(ctx, &name))
@@ -233,8 +374,8 @@ static void handle_dir(struct msg_ctx *ctx) {
 		};
 		if (dirctx.ctx.name == NULL)
 			cp_pack_list_begin(dirctx.pack);
-		rpchandler_dir_result(&dirctx.ctx, &rpcdir_dir);
-		rpchandler_dir_result(&dirctx.ctx, &rpcdir_ls);
+		rpchandler_dir_result_packed(&dirctx.ctx, &dir_packed);
+		rpchandler_dir_result_packed(&dirctx.ctx, &ls_packed);
 		for (const struct rpchandler_stage *s = ctx->handler->stages;
 			s->funcs && !dirctx.located; s++)
 			if (s->funcs->dir)
@@ -249,8 +390,14 @@ static void handle_dir(struct msg_ctx *ctx) {
 }
 
 static bool handle_msg(struct msg_ctx *ctx) {
-	for (const struct rpchandler_stage *s = ctx->handler->stages; s->funcs; s++)
-		if (s->funcs->msg) {
+	struct rpcroute *routes = &ctx->handler->routes;
+	bool request = ctx->ctx.meta.type == RPCMSG_T_REQUEST;
+	if (request)
+		rpcroute_lookup(routes, ctx->ctx.meta.path, ctx->ctx.meta.method);
+	const struct rpchandler_stage *stages = ctx->handler->stages;
+	for (size_t i = 0; stages[i].funcs; i++) {
+		const struct rpchandler_stage *s = &stages[i];
+		if (s->funcs->msg && (!request || rpcroute_pass(routes, i))) {
 			enum rpchandler_msg_res res = s->funcs->msg(s->cookie, &ctx->ctx);
 			if (res != RPCHANDLER_MSG_SKIP) {
 				if (ctx->ctx.unpack == NULL)
@@ -266,6 +413,7 @@ static bool handle_msg(struct msg_ctx *ctx) {
 				return true;
 			}
 		}
+	}
 
 	switch (ctx->ctx.meta.type) {
 		case RPCMSG_T_REQUEST:
@@ -287,12 +435,13 @@ static bool handle_msg(struct msg_ctx *ctx) {
 	return true;
 }
 
-bool rpchandler_next(struct rpchandler *handler) {
+static bool next_msg(struct rpchandler *handler) {
 	bool res = true;
 	pthread_mutex_lock(&handler->lock);
 	switch (rpcclient_nextmsg(handler->client)) {
 		case RPCC_MESSAGE:
-			obstack_init(&handler->obstack);
+			/* Stages can be modified in place and thus check them every time */
+			rpcroute_update(&handler->routes, handler->stages);
 			struct cpitem item;
 			cpitem_unpack_init(&item);
 			struct msg_ctx ctx;
@@ -304,7 +453,7 @@ bool rpchandler_next(struct rpchandler *handler) {
 				res = handle_msg(&ctx);
 			} else
 				rpcclient_ignoremsg(handler->client);
-			obstack_free(&handler->obstack, NULL);
+			reset_obstack(handler);
 			break;
 		case RPCC_RESET:
 			for (const struct rpchandler_stage *s = handler->stages; s->funcs; s++)
@@ -316,15 +465,44 @@ bool rpchandler_next(struct rpchandler *handler) {
 			break; /* Nothing to do */
 	}
 	pthread_mutex_unlock(&handler->lock);
+	return res;
+}
+
+bool rpchandler_next(struct rpchandler *handler) {
+	bool res;
+	/* Handle all messages client already received before we go back to poll */
+	do
+		res = next_msg(handler);
+	while (res && rpcclient_pending(handler->client));
 	return res && rpcclient_connected(handler->client);
 }
 
+bool rpchandler_next_budget(struct rpchandler *handler, unsigned budget) {
+	bool res;
+	do
+		res = next_msg(handler);
+	while (res && budget-- > 1 && rpcclient_pending(handler->client));
+	return res && rpcclient_connected(handler->client);
+}
+
+bool rpchandler_flush(struct rpchandler *handler) {
+	pthread_mutex_lock(&handler->send_lock);
+	bool res = rpcclient_flush(handler->client);
+	pthread_mutex_unlock(&handler->send_lock);
+	return res;
+}
+
 int rpchandler_idling(rpchandler_t handler) {
 	pthread_mutex_lock(&handler->lock);
+	/* Other threads can be sending messages and thus updating last_send */
+	pthread_mutex_lock(&handler->send_lock);
+	struct timespec last_send = handler->last_send;
+	pthread_mutex_unlock(&handler->send_lock);
 	struct idle_ctx ctx = {
-		.ctx.last_send = handler->last_send,
+		.ctx.last_send = last_send,
 		.handler = handler,
 		.msg_sent = false,
+		.msg_held = false,
 	};
 	int res = RPCHANDLER_IDLE_SKIP;
 	for (const struct rpchandler_stage *s = handler->stages;
@@ -335,6 +513,9 @@ int rpchandler_idling(rpchandler_t handler) {
 				res = t;
 		}
 	}
+	if (ctx.msg_held)
+		rpchandler_flush(handler);
+	reset_obstack(handler);
 	pthread_mutex_unlock(&handler->lock);
 	return res == RPCHANDLER_IDLE_STOP ? -1 : abs(res);
 }
@@ -406,6 +587,12 @@ bool _rpchandler_msg_send(rpchandler_t handler) {
 	send_unlock(handler);
 	return res;
 }
+bool _rpchandler_msg_send_more(rpchandler_t handler) {
+	bool res = rpcclient_sendmsg_more(handler->client);
+	clock_gettime(CLOCK_MONOTONIC, &handler->last_send);
+	send_unlock(handler);
+	return res;
+}
 bool _rpchandler_impl_msg_send(struct rpchandler_msg *ctx) {
 	struct msg_ctx *mctx = (struct msg_ctx *)ctx;
 	if (ctx->meta.type != RPCMSG_T_REQUEST &&
@@ -422,6 +609,13 @@ bool _rpchandler_idle_msg_send(struct rpchandler_idle *ctx) {
 	ictx->msg_sent = true;
 	return true;
 }
+bool _rpchandler_idle_msg_send_more(struct rpchandler_idle *ctx) {
+	struct idle_ctx *ictx = (struct idle_ctx *)ctx;
+	if (ictx->msg_sent)
+		return false;
+	ictx->msg_held = true;
+	return _rpchandler_msg_send_more(ictx->handler);
+}
 
 bool _rpchandler_msg_drop(rpchandler_t handler) {
 	bool res = rpcclient_dropmsg(handler->client);
@@ -454,11 +648,7 @@ bool rpchandler_msg_valid(struct rpchandler_msg *ctx) {
 
 
 static void pack_ls_result(struct ls_ctx *lsctx, const char *name) {
-	if (lsctx->pack == NULL) {
-		lsctx->pack = rpchandler_msg_new_response(&lsctx->mctx->ctx);
-		cp_pack_list_begin(lsctx->pack);
-	}
-	cp_pack_str(lsctx->pack, name);
+	obstack_grow0(&lsctx->mctx->handler->obstack, name, strlen(name));
 }
 void rpchandler_ls_result(struct rpchandler_ls *ctx, const char *name) {
 	struct ls_ctx *lsctx = (struct ls_ctx *)ctx;
@@ -508,6 +698,22 @@ void rpchandler_dir_result(struct rpchandler_dir *ctx, const struct rpcdir *meth
 		rpcdir_pack(dirctx->pack, method);
 }
 
+void rpchandler_dir_result_packed(
+	struct rpchandler_dir *ctx, struct rpcdir_packed *method) {
+	struct dir_ctx *dirctx = (struct dir_ctx *)ctx;
+	rpcclient_t client = dirctx->mctx->handler->client;
+	const uint8_t *data;
+	size_t len;
+	if (ctx->name)
+		dirctx->located =
+			dirctx->located || !strcmp(ctx->name, method->method->name);
+	else if (client->rawwrite && !client->logger_out &&
+		(data = rpcdir_packed(method, &len)))
+		client->rawwrite(client, data, len);
+	else
+		rpcdir_pack(dirctx->pack, method->method);
+}
+
 void rpchandler_dir_exists(struct rpchandler_dir *ctx) {
 	struct dir_ctx *dirctx = (struct dir_ctx *)ctx;
 	if (ctx->name)
@@ -11,6 +11,44 @@ static void rpc_ls(void *cookie, struct rpchandler_ls *ctx) {
 		rpchandler_ls_result_const(ctx, ".app");
 }
 
+static struct rpcdir_packed methods[] = {
+	{.method = &(const struct rpcdir){
+		.name = "shvVersionMajor",
+		.result = "i",
+		.flags = RPCDIR_F_GETTER,
+		.access = RPCACCESS_BROWSE,
+	}},
+	{.method = &(const struct rpcdir){
+		.name = "shvVersionMinor",
+		.result = "i",
+		.flags = RPCDIR_F_GETTER,
+		.access = RPCACCESS_BROWSE,
+	}},
+	{.method = &(const struct rpcdir){
+		.name = "name",
+		.result = "s",
+		.flags = RPCDIR_F_GETTER,
+		.access = RPCACCESS_BROWSE,
+	}},
+	{.method = &(const struct rpcdir){
+		.name = "version",
+		.result = "s",
+		.flags = RPCDIR_F_GETTER,
+		.access = RPCACCESS_BROWSE,
+	}},
+	{.method = &(const struct rpcdir){
+		.name = "ping",
+		.access = RPCACCESS_BROWSE,
+	}},
+	{.method = &(const struct rpcdir){
+		.name = "date",
+		.result = "t",
+		.flags = RPCDIR_F_GETTER,
+		.access = RPCACCESS_BROWSE,
+	}},
+};
+#define METHODS_CNT (sizeof methods / sizeof *methods)
+
 static void rpc_dir(void *cookie, struct rpchandler_dir *ctx) {
 	struct rpchandler_app_conf *conf = cookie;
 	if (strcmp(ctx->path, ".app"))
@@ -27,47 +65,9 @@ static void rpc_dir(void *cookie, struct rpchandler_dir *ctx) {
 		return;
 	}
 
-	rpchandler_dir_result(ctx,
-		&(const struct rpcdir){
-			.name = "shvVersionMajor",
-			.result = "i",
-			.flags = RPCDIR_F_GETTER,
-			.access = RPCACCESS_BROWSE,
-		});
-	rpchandler_dir_result(ctx,
-		&(const struct rpcdir){
-			.name = "shvVersionMinor",
-			.result = "i",
-			.flags = RPCDIR_F_GETTER,
-			.access = RPCACCESS_BROWSE,
-		});
-	rpchandler_dir_result(ctx,
-		&(const struct rpcdir){
-			.name = "name",
-			.result = "s",
-			.flags = RPCDIR_F_GETTER,
-			.access = RPCACCESS_BROWSE,
-		});
-	rpchandler_dir_result(ctx,
-		&(const struct rpcdir){
-			.name = "version",
-			.result = "s",
-			.flags = RPCDIR_F_GETTER,
-			.access = RPCACCESS_BROWSE,
-		});
-	rpchandler_dir_result(ctx,
-		&(const struct rpcdir){
-			.name = "ping",
-			.access = RPCACCESS_BROWSE,
-		});
-	if (!conf->disable_date)
-		rpchandler_dir_result(ctx,
-			&(const struct rpcdir){
-				.name = "date",
-				.result = "t",
-				.flags = RPCDIR_F_GETTER,
-				.access = RPCACCESS_BROWSE,
-			});
+	/* The last method is date */
+	for (size_t i = 0; i < METHODS_CNT - (conf->disable_date ? 1 : 0); i++)
+		rpchandler_dir_result_packed(ctx, &methods[i]);
 }
 
 static enum rpchandler_msg_res rpc_msg(void *cookie, struct rpchandler_msg *ctx) {
@@ -126,8 +126,11 @@ static const struct rpchandler_funcs rpc_funcs = {
 	.msg = rpc_msg,
 };
 
+static const struct rpchandler_route rpc_routes[] = {{".app", NULL}, {}};
+
 
 struct rpchandler_stage rpchandler_app_stage(
 	const struct rpchandler_app_conf *conf) {
-	return (struct rpchandler_stage){.funcs = &rpc_funcs, .cookie = (void *)conf};
+	return (struct rpchandler_stage){
+		.funcs = &rpc_funcs, .cookie = (void *)conf, .routes = rpc_routes};
 }
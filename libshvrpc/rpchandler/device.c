@@ -175,7 +175,15 @@ static const struct rpchandler_funcs rpc_funcs = {
 	.msg = rpc_msg,
 };
 
+static const struct rpchandler_route rpc_routes[] = {
+	{".device/alerts", "get"}, {".device", NULL}, {}};
+
 struct rpchandler_stage rpchandler_device_stage(
 	const struct rpchandler_device_conf *conf) {
-	return (struct rpchandler_stage){.funcs = &rpc_funcs, .cookie = (void *)conf};
+	return (struct rpchandler_stage){
+		.funcs = &rpc_funcs,
+		.cookie = (void *)conf,
+		/* Skip alerts if they are not provided */
+		.routes = conf->alerts ? rpc_routes : rpc_routes + 1,
+	};
 }
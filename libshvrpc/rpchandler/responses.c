@@ -1,58 +1,134 @@
 #include <stdlib.h>
+#include <limits.h>
 #include <shv/rpchandler_responses.h>
 
+#include "ridmap.h"
+
+/* Number of responses allocated at once */
+#define SLAB_SIZE (64)
+
+struct rpcresponse {
+	int request_id;
+	rpcresponse_callback_t callback;
+	void *cookie;
+	struct rpchandler_responses *responses;
+	/* Handler request ID was allocated in or NULL */
+	rpchandler_t handler;
+	enum response_state {
+		/* Waiting for the response */
+		R_PENDING,
+		/* Callback is being called */
+		R_RUNNING,
+		/* Response received but not yet released */
+		R_DONE,
+	} state;
+	/* Released as soon as response is received */
+	bool async;
+	/* Next free response */
+	struct rpcresponse *next;
+};
 
 struct rpchandler_responses {
-	struct rpcresponse {
-		int request_id;
-		rpcresponse_callback_t callback;
-		void *cookie;
-		pthread_cond_t cond;
-		struct rpchandler_responses *_Atomic owner;
-		struct rpcresponse *next;
-	} *resp;
+	/* Pending responses by their request ID */
+	struct ridmap pending;
+	/* Responses are allocated in slabs and released to the free list */
+	struct slab {
+		struct slab *next;
+		struct rpcresponse items[SLAB_SIZE];
+	} *slabs;
+	struct rpcresponse *free;
 	pthread_mutex_t lock;
+	/* Broadcasted every time some response is handled */
+	pthread_cond_t cond;
 };
 
+static rpcresponse_t response_alloc(struct rpchandler_responses *resp) {
+	if (resp->free == NULL) {
+		struct slab *slab = malloc(sizeof *slab);
+		if (slab == NULL) // GCOVR_EXCL_BR_LINE malloc failure only
+			return NULL; // GCOVR_EXCL_LINE
+		slab->next = resp->slabs;
+		resp->slabs = slab;
+		for (size_t i = 0; i < SLAB_SIZE; i++) {
+			slab->items[i].next = resp->free;
+			resp->free = &slab->items[i];
+		}
+	}
+	rpcresponse_t res = resp->free;
+	resp->free = res->next;
+	return res;
+}
+
+static void response_release(
+	struct rpchandler_responses *resp, rpcresponse_t response) {
+	response->next = resp->free;
+	resp->free = response;
+}
+
 static enum rpchandler_msg_res rpc_msg(void *cookie, struct rpchandler_msg *ctx) {
 	struct rpchandler_responses *resp = cookie;
-	if (ctx->meta.type != RPCMSG_T_RESPONSE && ctx->meta.type != RPCMSG_T_ERROR)
+	/* Responses with caller IDs are not for us, we only forward them */
+	if ((ctx->meta.type != RPCMSG_T_RESPONSE &&
+			ctx->meta.type != RPCMSG_T_ERROR) ||
+		ctx->meta.cids_cnt > 0 || ctx->meta.request_id <= 0 ||
+		ctx->meta.request_id > INT_MAX)
 		return RPCHANDLER_MSG_SKIP;
 	pthread_mutex_lock(&resp->lock);
-	rpcresponse_t *pr = &resp->resp;
-	while (*pr) {
-		rpcresponse_t r = *pr;
-		if (r->request_id == ctx->meta.request_id) {
-			if (r->callback(ctx, r->cookie)) {
-				*pr = r->next;
-				r->owner = NULL;
-				pthread_cond_signal(&r->cond);
-			}
-			pthread_mutex_unlock(&resp->lock);
-			return RPCHANDLER_MSG_DONE;
-		}
-		pr = &r->next;
-	};
+	rpcresponse_t r = ridmap_get(&resp->pending, ctx->meta.request_id);
+	if (r == NULL) {
+		pthread_mutex_unlock(&resp->lock);
+		return RPCHANDLER_MSG_SKIP;
+	}
+	/* Callback is called without lock so it can expect other responses. The
+	 * response can't be released in the meantime because discard waits for
+	 * the callback to finish.
+	 */
+	r->state = R_RUNNING;
 	pthread_mutex_unlock(&resp->lock);
-	return RPCHANDLER_MSG_SKIP;
+	bool done = r->callback(ctx, r->cookie);
+	if (done)
+		rpchandler_release_request_id(ctx, ctx->meta.request_id);
+	pthread_mutex_lock(&resp->lock);
+	if (done) {
+		ridmap_del(&resp->pending, r->request_id);
+		if (r->async)
+			response_release(resp, r);
+		else
+			r->state = R_DONE;
+	} else
+		r->state = R_PENDING;
+	pthread_cond_broadcast(&resp->cond);
+	pthread_mutex_unlock(&resp->lock);
+	return RPCHANDLER_MSG_DONE;
 }
 
 static struct rpchandler_funcs rpc_funcs = {.msg = rpc_msg};
 
 rpchandler_responses_t rpchandler_responses_new(void) {
 	struct rpchandler_responses *res = malloc(sizeof *res);
-	res->resp = NULL;
+	res->pending = (struct ridmap){};
+	res->slabs = NULL;
+	res->free = NULL;
 	pthread_mutex_init(&res->lock, NULL);
+	pthread_condattr_t attr;
+	pthread_condattr_init(&attr);
+	pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+	pthread_cond_init(&res->cond, &attr);
+	pthread_condattr_destroy(&attr);
 	return res;
 }
 
 void rpchandler_responses_destroy(rpchandler_responses_t resp) {
-	rpcresponse_t r = resp->resp;
-	while (r) {
-		rpcresponse_t pr = r;
-		r = r->next;
-		free(pr);
-	};
+	if (resp == NULL)
+		return;
+	struct slab *slab = resp->slabs;
+	while (slab) {
+		struct slab *pslab = slab;
+		slab = slab->next;
+		free(pslab);
+	}
+	ridmap_free(&resp->pending);
+	pthread_cond_destroy(&resp->cond);
 	pthread_mutex_destroy(&resp->lock);
 	free(resp);
 }
@@ -62,29 +138,51 @@ struct rpchandler_stage rpchandler_responses_stage(
 	return (struct rpchandler_stage){.funcs = &rpc_funcs, .cookie = responses};
 }
 
+static rpcresponse_t expect(rpchandler_responses_t responses, int request_id,
+	rpcresponse_callback_t func, void *cookie, bool async) {
+	pthread_mutex_lock(&responses->lock);
+	rpcresponse_t res = response_alloc(responses);
+	if (res) {
+		*res = (struct rpcresponse){
+			.request_id = request_id,
+			.callback = func,
+			.cookie = cookie,
+			.responses = responses,
+			.handler = NULL,
+			.state = R_PENDING,
+			.async = async,
+		};
+		if (!ridmap_add(&responses->pending, request_id, res)) {
+			response_release(responses, res);
+			res = NULL;
+		}
+	}
+	pthread_mutex_unlock(&responses->lock);
+	return res;
+}
 
 rpcresponse_t rpcresponse_expect(rpchandler_responses_t responses,
 	int request_id, rpcresponse_callback_t func, void *cookie) {
-	rpcresponse_t res = malloc(sizeof *res);
-	res->request_id = request_id;
-	res->callback = func;
-	res->cookie = cookie;
-	pthread_condattr_t attr;
-	pthread_condattr_init(&attr);
-	pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
-	pthread_cond_init(&res->cond, &attr);
-	pthread_condattr_destroy(&attr);
-	res->owner = responses;
-	res->next = NULL;
+	return expect(responses, request_id, func, cookie, false);
+}
+
+bool rpcresponse_expect_async(rpchandler_responses_t responses,
+	int request_id, rpcresponse_callback_t func, void *cookie) {
+	return expect(responses, request_id, func, cookie, true) != NULL;
+}
 
+bool rpcresponse_cancel(rpchandler_responses_t responses, int request_id) {
 	pthread_mutex_lock(&responses->lock);
-	rpcresponse_t *r = &responses->resp;
-	while (*r)
-		r = &(*r)->next;
-	*r = res;
+	rpcresponse_t r;
+	while ((r = ridmap_get(&responses->pending, request_id)) &&
+		r->state == R_RUNNING)
+		pthread_cond_wait(&responses->cond, &responses->lock);
+	if (r) {
+		ridmap_del(&responses->pending, request_id);
+		response_release(responses, r);
+	}
 	pthread_mutex_unlock(&responses->lock);
-
-	return res;
+	return r != NULL;
 }
 
 int rpcresponse_request_id(rpcresponse_t response) {
@@ -95,59 +193,74 @@ void rpcresponse_discard(rpcresponse_t response) {
 	if (response == NULL)
 		return;
 
-	struct rpchandler_responses *responses = response->owner;
-	if (responses) {
-		pthread_mutex_lock(&responses->lock);
-		rpcresponse_t *pr = &responses->resp;
-		while (*pr) {
-			if (*pr == response) {
-				*pr = response->next;
-				break;
-			}
-			pr = &(*pr)->next;
-		}
-		pthread_mutex_unlock(&responses->lock);
+	struct rpchandler_responses *responses = response->responses;
+	pthread_mutex_lock(&responses->lock);
+	while (response->state == R_RUNNING)
+		pthread_cond_wait(&responses->cond, &responses->lock);
+	if (response->state == R_PENDING) {
+		ridmap_del(&responses->pending, response->request_id);
+		if (response->handler)
+			rpchandler_release_request_id(
+				response->handler, response->request_id);
 	}
-	pthread_cond_destroy(&response->cond);
-	free(response);
+	response_release(responses, response);
+	pthread_mutex_unlock(&responses->lock);
 }
 
 bool rpcresponse_waitfor(rpcresponse_t response, int timeout) {
-	struct rpchandler_responses *responses = response->owner;
-	if (responses != NULL) {
-		struct timespec ts_timeout;
-		clock_gettime(CLOCK_MONOTONIC, &ts_timeout);
-		ts_timeout.tv_sec += timeout / 1000;
-		ts_timeout.tv_nsec += (timeout % 1000) * 1000000;
-		pthread_mutex_lock(&responses->lock);
-		/* Note that sporadic wakeup can't because we are the only one waiting */
-		int cr = pthread_cond_timedwait(
-			&response->cond, &responses->lock, &ts_timeout);
-		pthread_mutex_unlock(&responses->lock);
-		if (cr != 0) /* Covers timeout as well as interrupt */
-			return false;
+	struct rpchandler_responses *responses = response->responses;
+	struct timespec ts_timeout;
+	clock_gettime(CLOCK_MONOTONIC, &ts_timeout);
+	ts_timeout.tv_sec += timeout / 1000;
+	ts_timeout.tv_nsec += (timeout % 1000) * 1000000;
+	if (ts_timeout.tv_nsec >= 1000000000) {
+		ts_timeout.tv_sec++;
+		ts_timeout.tv_nsec -= 1000000000;
 	}
-	pthread_cond_destroy(&response->cond);
-	free(response);
+	pthread_mutex_lock(&responses->lock);
+	while (response->state != R_DONE)
+		/* Covers timeout as well as interrupt */
+		if (pthread_cond_timedwait(
+				&responses->cond, &responses->lock, &ts_timeout) != 0 &&
+			response->state != R_DONE) {
+			pthread_mutex_unlock(&responses->lock);
+			return false;
+		}
+	response_release(responses, response);
+	pthread_mutex_unlock(&responses->lock);
 	return true;
 }
 
 
+rpcresponse_t _rpcresponse_send_request(rpchandler_t handler,
+	rpchandler_responses_t responses, int request_id,
+	rpcresponse_callback_t func, void *ctx) {
+	rpcresponse_t res = rpcresponse_expect(responses, request_id, func, ctx);
+	if (res == NULL) {
+		rpchandler_msg_drop(handler);
+		rpchandler_release_request_id(handler, request_id);
+		return NULL;
+	}
+	/* Discard releases the request ID from now on */
+	res->handler = handler;
+	if (!rpchandler_msg_send(handler)) {
+		rpcresponse_discard(res);
+		return NULL;
+	}
+	return res;
+}
+
 rpcresponse_t rpcresponse_send_request_void(rpchandler_t handler,
 	rpchandler_responses_t responses, const char *path, const char *method,
 	const char *uid, rpcresponse_callback_t func, void *ctx) {
 	cp_pack_t pack = rpchandler_msg_new(handler);
 	if (pack == NULL)
 		return NULL;
-	int request_id = rpcmsg_request_id();
+	int request_id = rpchandler_next_request_id(handler);
 	if (!rpcmsg_pack_request_void(pack, path, method, uid, request_id)) {
 		rpchandler_msg_drop(handler);
+		rpchandler_release_request_id(handler, request_id);
 		return NULL;
 	}
-	rpcresponse_t res = rpcresponse_expect(responses, request_id, func, ctx);
-	if (!rpchandler_msg_send(handler)) {
-		rpcresponse_discard(res);
-		return NULL;
-	}
-	return res;
+	return _rpcresponse_send_request(handler, responses, request_id, func, ctx);
 }
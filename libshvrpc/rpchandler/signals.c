@@ -1,27 +1,100 @@
 #include <stdlib.h>
+#include <limits.h>
+#include <string.h>
+#include <shv/rpchandler_impl.h>
 #include <shv/rpchandler_signals.h>
 
+#include "ridmap.h"
+#include "riindex.h"
+
 #define MSGRETRY (5)
 
 struct rpchandler_signals {
 	rpchandler_signal_func_t func;
 	void *cookie;
+	/* Subscriptions sorted by RI */
 	struct subscription {
-		const char *ri;
+		char *ri;
+		enum subscription_op {
+			SUB_DONE,
+			SUB_SUBSCRIBE,
+			SUB_UNSUBSCRIBE,
+		} op;
 		time_t last_msg;
+		/* Request ID of the pending request or zero if not sent yet */
 		int rid;
 	} *subs;
 	size_t cnt, siz;
+	/* RIs of subscriptions by request ID of their pending request */
+	struct ridmap pending;
+	/* Request IDs of abandoned requests to be released in idle */
+	int *abandoned;
+	size_t abandoned_cnt, abandoned_siz;
+	/* Number of subscriptions with operation other than SUB_DONE */
+	size_t todo;
+	/* Routes by their RI */
+	struct riindex routes_index;
+	struct route {
+		char *ri;
+		rpchandler_signal_func_t func;
+		void *cookie;
+	} **routes;
+	size_t routes_cnt, routes_siz;
 	volatile _Atomic bool all_done;
 	pthread_mutex_t lock;
 	pthread_cond_t cond;
 };
 
 
-static int cmpsubs(const void *a, const void *b) {
-	struct subscription *const *da = a;
-	struct subscription *const *db = b;
-	return !strcmp((*da)->ri, (*db)->ri);
+/* Locate subscription with given RI or place where it should be inserted */
+static bool sub_find(
+	struct rpchandler_signals *handler_signals, const char *ri, size_t *index) {
+	size_t low = 0, high = handler_signals->cnt;
+	while (low < high) {
+		size_t mid = low + (high - low) / 2;
+		int cmp = strcmp(handler_signals->subs[mid].ri, ri);
+		if (cmp == 0) {
+			*index = mid;
+			return true;
+		}
+		if (cmp < 0)
+			low = mid + 1;
+		else
+			high = mid;
+	}
+	*index = low;
+	return false;
+}
+
+static void sub_remove(struct rpchandler_signals *handler_signals, size_t i) {
+	free(handler_signals->subs[i].ri);
+	memmove(&handler_signals->subs[i], &handler_signals->subs[i + 1],
+		(--handler_signals->cnt - i) * sizeof *handler_signals->subs);
+}
+
+/* Abandon the pending request. The response to it is no longer expected. Its
+ * request ID is released in the next idle as RPC Handler is required for that.
+ */
+static void sub_abandon(
+	struct rpchandler_signals *handler_signals, struct subscription *sub) {
+	if (sub->rid != 0) {
+		ridmap_del(&handler_signals->pending, sub->rid);
+		if (handler_signals->abandoned_cnt >= handler_signals->abandoned_siz)
+			handler_signals->abandoned = realloc(handler_signals->abandoned,
+				(handler_signals->abandoned_siz =
+						handler_signals->abandoned_siz * 2 ?: 4) *
+					sizeof *handler_signals->abandoned);
+		handler_signals->abandoned[handler_signals->abandoned_cnt++] = sub->rid;
+	}
+	sub->rid = 0;
+	sub->last_msg = 0;
+}
+
+static void update_done(struct rpchandler_signals *handler_signals) {
+	handler_signals->all_done =
+		handler_signals->todo == 0 && handler_signals->abandoned_cnt == 0;
+	if (handler_signals->all_done)
+		pthread_cond_broadcast(&handler_signals->cond);
 }
 
 static enum rpchandler_msg_res rpc_msg(void *cookie, struct rpchandler_msg *ctx) {
@@ -29,39 +102,47 @@ static enum rpchandler_msg_res rpc_msg(void *cookie, struct rpchandler_msg *ctx)
 	switch (ctx->meta.type) {
 		case RPCMSG_T_SIGNAL:
 			pthread_mutex_lock(&handler_signals->lock);
-			if (handler_signals->func) {
+			struct route *route = NULL;
+			if (handler_signals->routes_cnt)
+				route = riindex_match(&handler_signals->routes_index,
+					ctx->meta.path, ctx->meta.source, ctx->meta.signal);
+			if (route)
+				route->func(route->cookie, ctx);
+			else if (handler_signals->func)
 				handler_signals->func(handler_signals->cookie, ctx);
-				pthread_mutex_unlock(&handler_signals->lock);
-				return RPCHANDLER_MSG_DONE;
-			}
 			pthread_mutex_unlock(&handler_signals->lock);
+			if (route || handler_signals->func)
+				return RPCHANDLER_MSG_DONE;
 			break;
 		case RPCMSG_T_RESPONSE:
-			if (!handler_signals->all_done) {
-				pthread_mutex_lock(&handler_signals->lock);
-				bool done = true;
-				for (size_t i = 0; i < handler_signals->cnt; i++)
-					if (ctx->meta.request_id == abs(handler_signals->subs[i].rid)) {
-						if (handler_signals->subs[i].rid < 0) {
-							free((char *)handler_signals->subs[i].ri);
-							memcpy(&handler_signals->subs[i],
-								&handler_signals->subs[i + 1],
-								(--handler_signals->cnt - i) *
-									sizeof *handler_signals->subs);
-						} else
-							handler_signals->subs[i].rid = 0;
-						/* Now only check if we are not done with changes */
-						for (i++; done && i < handler_signals->cnt; i++)
-							if (handler_signals->subs[i].rid != 0)
-								done = false;
-						handler_signals->all_done = done;
-						pthread_mutex_unlock(&handler_signals->lock);
-						return RPCHANDLER_MSG_DONE;
-					} else if (handler_signals->subs[i].rid != 0)
-						done = false;
+		case RPCMSG_T_ERROR:
+			if (handler_signals->all_done || ctx->meta.cids_cnt > 0 ||
+				ctx->meta.request_id <= 0 || ctx->meta.request_id > INT_MAX)
+				break;
+			pthread_mutex_lock(&handler_signals->lock);
+			const char *ri =
+				ridmap_get(&handler_signals->pending, ctx->meta.request_id);
+			size_t i;
+			if (ri == NULL || !sub_find(handler_signals, ri, &i)) {
 				pthread_mutex_unlock(&handler_signals->lock);
+				break;
 			}
-			break;
+			struct subscription *sub = &handler_signals->subs[i];
+			ridmap_del(&handler_signals->pending, sub->rid);
+			/* The new request ID is used on the retry */
+			rpchandler_release_request_id(ctx, sub->rid);
+			sub->rid = 0;
+			if (ctx->meta.type == RPCMSG_T_RESPONSE &&
+				rpchandler_msg_valid(ctx)) {
+				if (sub->op == SUB_UNSUBSCRIBE)
+					sub_remove(handler_signals, i);
+				else
+					sub->op = SUB_DONE;
+				handler_signals->todo--;
+				update_done(handler_signals);
+			}
+			pthread_mutex_unlock(&handler_signals->lock);
+			return RPCHANDLER_MSG_DONE;
 		default:
 			break;
 	}
@@ -71,46 +152,70 @@ static enum rpchandler_msg_res rpc_msg(void *cookie, struct rpchandler_msg *ctx)
 static int rpc_idle(void *cookie, struct rpchandler_idle *ctx) {
 	struct rpchandler_signals *handler_signals = cookie;
 	int res = RPCHANDLER_IDLE_SKIP;
-	if (!handler_signals->all_done) {
-		struct timespec ts;
-		clock_gettime(CLOCK_MONOTONIC, &ts);
-		pthread_mutex_lock(&handler_signals->lock);
-		for (size_t i = 0; i < handler_signals->cnt; i++) {
-			if (handler_signals->subs[i].rid != 0) {
-				time_t difft =
-					handler_signals->subs[i].last_msg + MSGRETRY - ts.tv_sec;
-				if (difft <= 0) {
-					cp_pack_t pack = rpchandler_msg_new(ctx);
-					if (pack) {
-						rpcmsg_pack_request(pack, ".broker/currentClient",
-							handler_signals->subs[i].rid > 0 ? "subscribe"
-															 : "unsubscribe",
-							NULL, abs(handler_signals->subs[i].rid));
-						cp_pack_str(pack, handler_signals->subs[i].ri);
-						cp_pack_container_end(pack);
-						if (rpchandler_msg_send(ctx))
-							handler_signals->subs[i].last_msg = ts.tv_sec;
-					}
-					pthread_mutex_unlock(&handler_signals->lock);
-					return 0;
-				} else if (res > (difft * 1000))
-					res = difft * 1000;
-			}
+	if (handler_signals->all_done)
+		return res;
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	pthread_mutex_lock(&handler_signals->lock);
+	if (handler_signals->abandoned_cnt > 0) {
+		for (size_t i = 0; i < handler_signals->abandoned_cnt; i++)
+			rpchandler_release_request_id(ctx, handler_signals->abandoned[i]);
+		handler_signals->abandoned_cnt = 0;
+		update_done(handler_signals);
+	}
+	/* All due requests are sent at once and written after idle */
+	for (size_t i = 0; i < handler_signals->cnt; i++) {
+		struct subscription *sub = &handler_signals->subs[i];
+		if (sub->op == SUB_DONE)
+			continue;
+		time_t difft = sub->last_msg + MSGRETRY - ts.tv_sec;
+		if (difft > 0) {
+			if (res > (difft * 1000))
+				res = difft * 1000;
+			continue;
+		}
+		if (sub->rid == 0) {
+			sub->rid = rpchandler_next_request_id(ctx);
+			ridmap_add(&handler_signals->pending, sub->rid, sub->ri);
 		}
-		pthread_mutex_unlock(&handler_signals->lock);
+		cp_pack_t pack = rpchandler_msg_new(ctx);
+		if (pack == NULL) { /* Other stage already sent message */
+			res = 0;
+			break;
+		}
+		rpcmsg_pack_request(pack, ".broker/currentClient",
+			sub->op == SUB_SUBSCRIBE ? "subscribe" : "unsubscribe", NULL,
+			sub->rid);
+		cp_pack_str(pack, sub->ri);
+		cp_pack_container_end(pack);
+		if (rpchandler_msg_send_more(ctx))
+			sub->last_msg = ts.tv_sec;
+		if (res > MSGRETRY * 1000)
+			res = MSGRETRY * 1000;
 	}
+	pthread_mutex_unlock(&handler_signals->lock);
 	return res;
 }
 
 static void rpc_reset(void *cookie) {
 	struct rpchandler_signals *handler_signals = cookie;
 	pthread_mutex_lock(&handler_signals->lock);
-	/* Assign request ID to re-subscribe. */
-	for (size_t i = 0; i < handler_signals->cnt; i++) {
-		handler_signals->subs[i].last_msg = 0;
-		handler_signals->subs[i].rid = rpcmsg_request_id();
+	/* There are no subscriptions on the new connection. We only need to
+	 * subscribe again and there is nothing to unsubscribe.
+	 */
+	size_t i = 0;
+	while (i < handler_signals->cnt) {
+		struct subscription *sub = &handler_signals->subs[i];
+		sub_abandon(handler_signals, sub);
+		if (sub->op == SUB_UNSUBSCRIBE)
+			sub_remove(handler_signals, i);
+		else {
+			sub->op = SUB_SUBSCRIBE;
+			i++;
+		}
 	}
-	handler_signals->all_done = false;
+	handler_signals->todo = handler_signals->cnt;
+	update_done(handler_signals);
 	pthread_mutex_unlock(&handler_signals->lock);
 }
 
@@ -128,6 +233,15 @@ rpchandler_signals_t rpchandler_signals_new(
 	res->cnt = 0;
 	res->siz = 4;
 	res->subs = malloc(res->siz * sizeof *res->subs);
+	res->pending = (struct ridmap){};
+	res->abandoned = NULL;
+	res->abandoned_cnt = 0;
+	res->abandoned_siz = 0;
+	res->todo = 0;
+	res->routes_index = (struct riindex){};
+	res->routes = NULL;
+	res->routes_cnt = 0;
+	res->routes_siz = 0;
 	res->all_done = true;
 	pthread_mutex_init(&res->lock, NULL);
 	pthread_cond_init(&res->cond, NULL);
@@ -138,8 +252,18 @@ void rpchandler_signals_destroy(rpchandler_signals_t rpchandler_signals) {
 	if (rpchandler_signals == NULL)
 		return;
 	for (size_t i = 0; i < rpchandler_signals->cnt; i++)
-		free((char *)rpchandler_signals->subs[i].ri);
+		free(rpchandler_signals->subs[i].ri);
 	free(rpchandler_signals->subs);
+	ridmap_free(&rpchandler_signals->pending);
+	free(rpchandler_signals->abandoned);
+	riindex_free(&rpchandler_signals->routes_index);
+	for (size_t i = 0; i < rpchandler_signals->routes_cnt; i++) {
+		free(rpchandler_signals->routes[i]->ri);
+		free(rpchandler_signals->routes[i]);
+	}
+	free(rpchandler_signals->routes);
+	pthread_cond_destroy(&rpchandler_signals->cond);
+	pthread_mutex_destroy(&rpchandler_signals->lock);
 	free(rpchandler_signals);
 }
 
@@ -152,17 +276,25 @@ struct rpchandler_stage rpchandler_signals_stage(
 void rpchandler_signals_subscribe(
 	rpchandler_signals_t handler_signals, const char *ri) {
 	pthread_mutex_lock(&handler_signals->lock);
-	struct subscription ref = {.ri = ri};
-	struct subscription *sub = bsearch(
-		&ref, handler_signals->subs, handler_signals->cnt, sizeof ref, cmpsubs);
-	if (!sub) {
-		if ((handler_signals->cnt + 1) >= handler_signals->siz)
+	size_t i;
+	if (sub_find(handler_signals, ri, &i)) {
+		struct subscription *sub = &handler_signals->subs[i];
+		if (sub->op == SUB_UNSUBSCRIBE) {
+			sub_abandon(handler_signals, sub);
+			sub->op = SUB_SUBSCRIBE;
+			handler_signals->all_done = false;
+		}
+	} else {
+		if (handler_signals->cnt >= handler_signals->siz)
 			handler_signals->subs = realloc(handler_signals->subs,
 				(handler_signals->siz *= 2) * sizeof *handler_signals->subs);
-		handler_signals->subs[handler_signals->cnt++] =
-			(struct subscription){.ri = strdup(ri), .rid = rpcmsg_request_id()};
-		qsort(handler_signals->subs, handler_signals->cnt,
-			sizeof *handler_signals->subs, cmpsubs);
+		memmove(&handler_signals->subs[i + 1], &handler_signals->subs[i],
+			(handler_signals->cnt++ - i) * sizeof *handler_signals->subs);
+		handler_signals->subs[i] = (struct subscription){
+			.ri = strdup(ri),
+			.op = SUB_SUBSCRIBE,
+		};
+		handler_signals->todo++;
 		handler_signals->all_done = false;
 	}
 	pthread_mutex_unlock(&handler_signals->lock);
@@ -171,15 +303,67 @@ void rpchandler_signals_subscribe(
 void rpchandler_signals_unsubscribe(
 	rpchandler_signals_t handler_signals, const char *ri) {
 	pthread_mutex_lock(&handler_signals->lock);
-	struct subscription ref = {.ri = ri};
-	struct subscription *sub = bsearch(
-		&ref, handler_signals->subs, handler_signals->cnt, sizeof ref, cmpsubs);
-	if (sub) {
-		sub->last_msg = 0;
-		sub->rid = -rpcmsg_request_id();
-		handler_signals->all_done = false;
+	size_t i;
+	if (sub_find(handler_signals, ri, &i)) {
+		struct subscription *sub = &handler_signals->subs[i];
+		if (sub->op == SUB_SUBSCRIBE && sub->rid == 0 && sub->last_msg == 0) {
+			/* Subscribe request was not sent yet */
+			sub_remove(handler_signals, i);
+			handler_signals->todo--;
+			update_done(handler_signals);
+		} else if (sub->op != SUB_UNSUBSCRIBE) {
+			sub_abandon(handler_signals, sub);
+			if (sub->op == SUB_DONE)
+				handler_signals->todo++;
+			sub->op = SUB_UNSUBSCRIBE;
+			handler_signals->all_done = false;
+		}
+	}
+	pthread_mutex_unlock(&handler_signals->lock);
+}
+
+bool rpchandler_signals_route(rpchandler_signals_t handler_signals,
+	const char *ri, rpchandler_signal_func_t func, void *cookie) {
+	struct route *route = malloc(sizeof *route);
+	*route = (struct route){.ri = strdup(ri), .func = func, .cookie = cookie};
+	pthread_mutex_lock(&handler_signals->lock);
+	bool res = riindex_add(&handler_signals->routes_index, ri, route);
+	if (res) {
+		if (handler_signals->routes_cnt >= handler_signals->routes_siz)
+			handler_signals->routes = realloc(handler_signals->routes,
+				(handler_signals->routes_siz =
+						handler_signals->routes_siz * 2 ?: 4) *
+					sizeof *handler_signals->routes);
+		handler_signals->routes[handler_signals->routes_cnt++] = route;
+	}
+	pthread_mutex_unlock(&handler_signals->lock);
+	if (!res) {
+		free(route->ri);
+		free(route);
+	}
+	return res;
+}
+
+bool rpchandler_signals_unroute(rpchandler_signals_t handler_signals,
+	const char *ri, rpchandler_signal_func_t func, void *cookie) {
+	pthread_mutex_lock(&handler_signals->lock);
+	struct route *route = NULL;
+	for (size_t i = 0; i < handler_signals->routes_cnt; i++) {
+		struct route *r = handler_signals->routes[i];
+		if (r->func == func && r->cookie == cookie && !strcmp(r->ri, ri)) {
+			route = r;
+			handler_signals->routes[i] =
+				handler_signals->routes[--handler_signals->routes_cnt];
+			riindex_del(&handler_signals->routes_index, ri, route);
+			break;
+		}
 	}
 	pthread_mutex_unlock(&handler_signals->lock);
+	if (route) {
+		free(route->ri);
+		free(route);
+	}
+	return route != NULL;
 }
 
 bool rpchandler_signals_status(rpchandler_signals_t rpchandler_signals) {
@@ -190,7 +374,7 @@ bool rpchandler_signals_wait(
 	rpchandler_signals_t rpchandler_signals, struct timespec *abstime) {
 	bool res = true;
 	pthread_mutex_lock(&rpchandler_signals->lock);
-	if (!rpchandler_signals->all_done) {
+	while (res && !rpchandler_signals->all_done) {
 		if (abstime)
 			res = pthread_cond_timedwait(&rpchandler_signals->cond,
 					  &rpchandler_signals->lock, abstime) == 0;
@@ -86,8 +86,8 @@ static bool rpcri_match_one(const char *pattern, const char *string, size_t n) {
 			}
 		}
 		/* foo/\** can also match foo itself. Handle this special case */
-		if (*p == '/' && (n - (p - pattern)) == 3 && *(p + 1) == '*' &&
-			*(p + 2) == '*')
+		if (*p == '/' && *string == '\0' && (n - (p - pattern)) == 3 &&
+			*(p + 1) == '*' && *(p + 2) == '*')
 			return true;
 
 		if (*p != *string)
@@ -0,0 +1,287 @@
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <shv/rpcri.h>
+
+/* The pattern is compiled to the nondeterministic automaton that is simulated
+ * with bit-parallel (shift-and) algorithm. Every pattern token is one state
+ * with one more state being the final one. Tokens are either characters
+ * (literal, '?' or bracket expression) that advance to the next state or
+ * wildcards that loop on themselves and have epsilon transition to the next
+ * state. Matching thus processes every character of the string exactly once
+ * with work proportional only to the pattern length.
+ */
+
+#define WORDBITS (64)
+
+struct prog {
+	/* Number of words for the set of states */
+	size_t words;
+	/* The longest sequence of wildcards (epsilon transitions) */
+	unsigned rounds;
+	/* Characters class index to the `masks` */
+	uint8_t cmap[256];
+	/* Sets of states: wildcards, '*', '**', accepting and then masks for
+	 * every character class (states reachable by that character).
+	 */
+	uint64_t data[];
+};
+#define P_EPS(P) ((P)->data)
+#define P_STAR(P) ((P)->data + (P)->words)
+#define P_GLOBSTAR(P) ((P)->data + 2 * (P)->words)
+#define P_ACCEPT(P) ((P)->data + 3 * (P)->words)
+#define P_MASK(P, C) ((P)->data + (4 + (P)->cmap[(uint8_t)(C)]) * (P)->words)
+
+struct rpcri {
+	struct prog *path;
+	/* Method and signal are used only if RI has signal part */
+	struct prog *method;
+	struct prog *signal;
+	/* Everything after path (also method if there is no signal part) */
+	struct prog *rest;
+};
+
+struct token {
+	enum { T_CHAR, T_STAR, T_GLOBSTAR } type;
+	/* Match also end of the string */
+	bool endopt;
+	uint64_t set[256 / WORDBITS];
+};
+
+static inline void setbit(uint64_t *set, size_t i) {
+	set[i / WORDBITS] |= (uint64_t)1 << (i % WORDBITS);
+}
+
+static inline bool getbit(const uint64_t *set, size_t i) {
+	return set[i / WORDBITS] & ((uint64_t)1 << (i % WORDBITS));
+}
+
+static const char *bracket(struct token *tok, const char *p, const char *end) {
+	bool neg = p < end && *p == '!';
+	if (neg)
+		p++;
+	/* The first character can be ']' and thus is not checked */
+	if (p < end)
+		do {
+			uint8_t first = *p++;
+			if (end - p > 1 && *p == '-' && p[1] != ']') {
+				for (unsigned c = first; c <= (uint8_t)p[1]; c++)
+					setbit(tok->set, c);
+				p += 2;
+			} else
+				setbit(tok->set, first);
+		} while (p < end && *p != ']');
+	if (neg)
+		for (size_t i = 0; i < 256 / WORDBITS; i++)
+			tok->set[i] = ~tok->set[i];
+	if (p < end)
+		p++;
+	return p;
+}
+
+static size_t tokenize(
+	struct token *toks, const char *pattern, size_t len, bool last) {
+	const char *end = pattern + len;
+	size_t cnt = 0;
+	const char *p = pattern;
+	while (p < end) {
+		struct token *tok = &toks[cnt++];
+		*tok = (struct token){.type = T_CHAR};
+		switch (*p) {
+			case '*':
+				p++;
+				tok->type = T_STAR;
+				if (p < end && *p == '*') {
+					p++;
+					tok->type = T_GLOBSTAR;
+				}
+				break;
+			case '?':
+				p++;
+				for (size_t i = 0; i < 256 / WORDBITS; i++)
+					tok->set[i] = ~(uint64_t)0;
+				break;
+			case '[':
+				const char *start = ++p;
+				p = bracket(tok, p, end);
+				/* Negation at the end of the RI matches also end of string */
+				if (last && p == end && *start == '!')
+					tok->endopt = true;
+				break;
+			default:
+				setbit(tok->set, (uint8_t)*p++);
+				break;
+		}
+		tok->set[0] &= ~(uint64_t)1; /* Never match the terminating null */
+	}
+	/* foo/\** can also match foo itself */
+	if (cnt >= 2 && toks[cnt - 1].type == T_GLOBSTAR && len >= 3 &&
+		!memcmp(end - 3, "/**", 3))
+		toks[cnt - 2].endopt = true;
+	return cnt;
+}
+
+static struct prog *compile(const char *pattern, size_t len, bool last) {
+	struct token *toks = malloc((len ?: 1) * sizeof *toks);
+	if (toks == NULL)
+		return NULL;
+	size_t cnt = tokenize(toks, pattern, len, last);
+	size_t words = (cnt + WORDBITS) / WORDBITS;
+
+	/* States reachable by every character with duplicates merged */
+	uint64_t(*cols)[words] = calloc(256, sizeof *cols);
+	if (cols == NULL) {
+		free(toks);
+		return NULL;
+	}
+	uint8_t cmap[256];
+	size_t classes = 0;
+	for (unsigned c = 0; c < 256; c++) {
+		for (size_t i = 0; i < cnt; i++)
+			if (toks[i].type == T_CHAR && getbit(toks[i].set, c))
+				setbit(cols[classes], i + 1);
+		size_t cls;
+		for (cls = 0; cls < classes; cls++)
+			if (!memcmp(cols[cls], cols[classes], sizeof *cols))
+				break;
+		if (cls == classes)
+			classes++;
+		else
+			memset(cols[classes], 0, sizeof *cols);
+		cmap[c] = cls;
+	}
+
+	struct prog *res =
+		calloc(1, sizeof *res + (4 + classes) * words * sizeof(uint64_t));
+	if (res) {
+		res->words = words;
+		memcpy(res->cmap, cmap, sizeof cmap);
+		memcpy(P_MASK(res, 0), cols, classes * sizeof *cols);
+		unsigned run = 0;
+		for (size_t i = 0; i < cnt; i++) {
+			if (toks[i].type == T_CHAR)
+				run = 0;
+			else {
+				setbit(P_EPS(res), i);
+				setbit(toks[i].type == T_STAR ? P_STAR(res) : P_GLOBSTAR(res), i);
+				if (++run > res->rounds)
+					res->rounds = run;
+			}
+			if (toks[i].endopt)
+				setbit(P_ACCEPT(res), i);
+		}
+		setbit(P_ACCEPT(res), cnt);
+	}
+	free(cols);
+	free(toks);
+	return res;
+}
+
+/* Follow epsilon transitions of wildcards. */
+static inline void closure(const struct prog *prog, uint64_t *states) {
+	const uint64_t *eps = P_EPS(prog);
+	for (unsigned r = 0; r < prog->rounds; r++) {
+		uint64_t carry = 0;
+		for (size_t w = 0; w < prog->words; w++) {
+			uint64_t e = states[w] & eps[w];
+			states[w] |= (e << 1) | carry;
+			carry = e >> (WORDBITS - 1);
+		}
+	}
+}
+
+/* Match for patterns with states fitting to a single word (the common case). */
+static bool match_word(const struct prog *prog, const char *str) {
+	const uint64_t eps = *P_EPS(prog);
+	const uint64_t star = *P_STAR(prog);
+	const uint64_t globstar = *P_GLOBSTAR(prog);
+	uint64_t states = 1;
+	for (unsigned r = 0; r < prog->rounds; r++)
+		states |= (states & eps) << 1;
+	for (; *str != '\0'; str++) {
+		uint64_t loop = globstar | (*str != '/' ? star : 0);
+		states = ((states << 1) & *P_MASK(prog, *str)) | (states & loop);
+		if (!states)
+			return false;
+		for (unsigned r = 0; r < prog->rounds && (states & eps); r++)
+			states |= (states & eps) << 1;
+	}
+	return states & *P_ACCEPT(prog);
+}
+
+static bool match(const struct prog *prog, const char *str) {
+	size_t words = prog->words;
+	if (words == 1)
+		return match_word(prog, str);
+	uint64_t states[words];
+	memset(states, 0, sizeof states);
+	states[0] = 1;
+	closure(prog, states);
+	const uint64_t *star = P_STAR(prog);
+	const uint64_t *globstar = P_GLOBSTAR(prog);
+	for (; *str != '\0'; str++) {
+		const uint64_t *mask = P_MASK(prog, *str);
+		uint64_t carry = 0;
+		uint64_t any = 0;
+		for (size_t w = 0; w < words; w++) {
+			uint64_t s = states[w];
+			uint64_t loop = globstar[w] | (*str != '/' ? star[w] : 0);
+			states[w] = (((s << 1) | carry) & mask[w]) | (s & loop);
+			carry = s >> (WORDBITS - 1);
+			any |= states[w];
+		}
+		if (!any)
+			return false;
+		closure(prog, states);
+	}
+	const uint64_t *accept = P_ACCEPT(prog);
+	for (size_t w = 0; w < words; w++)
+		if (states[w] & accept[w])
+			return true;
+	return false;
+}
+
+rpcri_t rpcri_compile(const char *ri) {
+	const char *path_end = strchr(ri, ':');
+	if (!path_end)
+		return NULL;
+	const char *method = path_end + 1;
+	const char *method_end = strchr(method, ':');
+
+	struct rpcri *res = calloc(1, sizeof *res);
+	if (res == NULL)
+		return NULL;
+	res->path = compile(ri, path_end - ri, false);
+	res->rest = compile(method, strlen(method), true);
+	bool ok = res->path && res->rest;
+	if (method_end) {
+		res->method = compile(method, method_end - method, false);
+		res->signal = compile(method_end + 1, strlen(method_end + 1), true);
+		ok = ok && res->method && res->signal;
+	}
+	if (!ok) {
+		rpcri_free(res);
+		return NULL;
+	}
+	return res;
+}
+
+bool rpcri_match_compiled(
+	rpcri_t ri, const char *path, const char *method, const char *signal) {
+	if (!match(ri->path, path))
+		return false;
+	if (signal == NULL || ri->signal == NULL)
+		return match(ri->rest, method);
+	return match(ri->method, method) && match(ri->signal, signal);
+}
+
+void rpcri_free(rpcri_t ri) {
+	if (ri == NULL)
+		return;
+	free(ri->path);
+	free(ri->method);
+	free(ri->signal);
+	free(ri->rest);
+	free(ri);
+}
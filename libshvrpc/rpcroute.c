@@ -0,0 +1,120 @@
+#include "rpcroute.h"
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+
+static unsigned pathhash(const char *path, size_t len) {
+	unsigned res = 2166136261;
+	for (size_t i = 0; i < len; i++) {
+		res ^= (unsigned char)path[i];
+		res *= 16777619;
+	}
+	return res;
+}
+
+static bool changed(const struct rpcroute *idx,
+	const struct rpchandler_stage *stages) {
+	size_t i = 0;
+	for (; stages[i].funcs; i++)
+		if (i >= idx->cnt || idx->routes[i] != stages[i].routes)
+			return true;
+	return i != idx->cnt;
+}
+
+void rpcroute_update(
+	struct rpcroute *idx, const struct rpchandler_stage *stages) {
+	if (!changed(idx, stages))
+		return;
+	rpcroute_free(idx);
+
+	size_t entries = 0;
+	for (; stages[idx->cnt].funcs; idx->cnt++)
+		for (const struct rpchandler_route *r = stages[idx->cnt].routes;
+			r && (r->path || r->method); r++)
+			entries++;
+	idx->routes = malloc(idx->cnt * sizeof *idx->routes);
+	idx->marks = calloc(idx->cnt, sizeof *idx->marks);
+	assert(idx->cnt == 0 || (idx->routes && idx->marks));
+	idx->gen = 0;
+	if (entries) {
+		idx->nbuckets = 2;
+		while (idx->nbuckets < 2 * entries)
+			idx->nbuckets *= 2;
+		idx->entries = malloc(entries * sizeof *idx->entries);
+		idx->buckets = calloc(idx->nbuckets, sizeof *idx->buckets);
+		assert(idx->entries && idx->buckets);
+	}
+
+	struct rpcroute_entry *e = idx->entries;
+	for (size_t i = 0; i < idx->cnt; i++) {
+		idx->routes[i] = stages[i].routes;
+		for (const struct rpchandler_route *r = stages[i].routes;
+			r && (r->path || r->method); r++, e++) {
+			*e = (struct rpcroute_entry){
+				.path = r->path,
+				.pathlen = r->path ? strlen(r->path) : 0,
+				.method = r->method,
+				.stage = i,
+			};
+			struct rpcroute_entry **list = &idx->any;
+			if (r->path)
+				list = &idx->buckets[pathhash(e->path, e->pathlen) &
+					(idx->nbuckets - 1)];
+			e->next = *list;
+			*list = e;
+		}
+	}
+}
+
+static void mark(struct rpcroute *idx, struct rpcroute_entry *e,
+	const char *path, size_t len, const char *method) {
+	for (; e; e = e->next)
+		if ((e->path == NULL ||
+				(e->pathlen == len && !memcmp(e->path, path, len))) &&
+			(e->method == NULL || (method && !strcmp(e->method, method))))
+			idx->marks[e->stage] = idx->gen;
+}
+
+void rpcroute_lookup(
+	struct rpcroute *idx, const char *path, const char *method) {
+	/* Marks from the previous cycle of generations must not match */
+	if (++idx->gen == 0) {
+		memset(idx->marks, 0, idx->cnt * sizeof *idx->marks);
+		idx->gen = 1;
+	}
+	mark(idx, idx->any, NULL, 0, method);
+	if (idx->nbuckets == 0)
+		return;
+	path = path ?: "";
+	size_t len = strlen(path);
+	mark(idx, idx->buckets[pathhash(path, len) & (idx->nbuckets - 1)], path,
+		len, method);
+	for (size_t i = 0; i < len; i++)
+		if (path[i] == '/')
+			mark(idx,
+				idx->buckets[pathhash(path, i + 1) & (idx->nbuckets - 1)],
+				path, i + 1, method);
+}
+
+bool rpcroute_exists(const struct rpcroute *idx, const char *path) {
+	if (idx->nbuckets == 0)
+		return false;
+	size_t len = strlen(path);
+	if (len > 0 && path[len - 1] == '/')
+		return false; /* Such path can match only prefix */
+	for (struct rpcroute_entry *e =
+			 idx->buckets[pathhash(path, len) & (idx->nbuckets - 1)];
+		e; e = e->next)
+		if (e->pathlen == len && !memcmp(e->path, path, len))
+			return true;
+	return false;
+}
+
+void rpcroute_free(struct rpcroute *idx) {
+	free(idx->routes);
+	free(idx->marks);
+	free(idx->entries);
+	free(idx->buckets);
+	*idx = (struct rpcroute){};
+}
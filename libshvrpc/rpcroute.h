@@ -0,0 +1,54 @@
+#ifndef SHV_RPCROUTE_H
+#define SHV_RPCROUTE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <shv/rpchandler.h>
+
+/* Index of routes of RPC Handler stages.
+ *
+ * Routes are hashed by their path. The request is looked up by its path and
+ * then by every prefix of it that ends with '/'. Routes without path are kept
+ * aside. Stages matching the request are marked with the current generation.
+ */
+struct rpcroute {
+	/* Routes of stages as they were indexed */
+	const struct rpchandler_route **routes;
+	size_t cnt;
+	struct rpcroute_entry {
+		const char *path;
+		size_t pathlen;
+		const char *method;
+		size_t stage;
+		struct rpcroute_entry *next;
+	} *entries, **buckets, *any;
+	size_t nbuckets;
+	unsigned *marks;
+	unsigned gen;
+};
+
+/* Index routes of given stages. Index is updated only if routes changed. */
+[[gnu::nonnull]]
+void rpcroute_update(
+	struct rpcroute *idx, const struct rpchandler_stage *stages);
+
+/* Mark stages with route matching given path and method. */
+[[gnu::nonnull(1)]]
+void rpcroute_lookup(
+	struct rpcroute *idx, const char *path, const char *method);
+
+/* Check if stage should be called for the last looked up request. */
+[[gnu::nonnull]]
+static inline bool rpcroute_pass(const struct rpcroute *idx, size_t stage) {
+	return stage >= idx->cnt || idx->routes[stage] == NULL ||
+		idx->marks[stage] == idx->gen;
+}
+
+/* Check if there is route with exactly given path. */
+[[gnu::nonnull]]
+bool rpcroute_exists(const struct rpcroute *idx, const char *path);
+
+[[gnu::nonnull]]
+void rpcroute_free(struct rpcroute *idx);
+
+#endif
@@ -714,7 +714,8 @@ static int can_ctrl(rpcclient_t client, enum rpcclient_ctrlop op) {
 			pthread_mutex_unlock(&c->mtx);
 			rpclogger_log_end(c->pub.logger_in, RPCLOGGER_ET_UNKNOWN);
 			return 0;
-		case RPCC_CTRLOP_SENDMSG: {
+		case RPCC_CTRLOP_SENDMSG:
+		case RPCC_CTRLOP_SENDMSG_MORE: { /* Messages are never queued */
 			bool res = true;
 			if (canid(c->wframe) != 0) {
 				candata(c->wframe)[1] |= 0x80;
@@ -744,6 +745,12 @@ static int can_ctrl(rpcclient_t client, enum rpcclient_ctrlop op) {
 			return false; /* Yes, CAN doesn't fully emulate conntrack. */
 		case RPCC_CTRLOP_POLLFD:
 			return c->reventfd;
+		case RPCC_CTRLOP_PENDING:
+			return false; /* Every message is signaled on reventfd */
+		case RPCC_CTRLOP_FLUSH:
+			return true; /* Messages are never queued */
+		case RPCC_CTRLOP_QUEUED:
+			return 0;
 	}
 	/* This should not happen -> implementation error */
 	abort(); // GCOVR_EXCL_LINE
@@ -41,11 +41,12 @@ static struct addrinfo *tcp_addrinfo(const char *location, int port) {
 	return addrs;
 }
 
-void tcp_flush(void *cookie, int fd) {
+/* Messages are written with a single write call or with MSG_MORE and thus
+ * there is no need for the Nagle's algorithm to merge them.
+ */
+static void tcp_nodelay(int fd) {
 	int flag = 1;
-	setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, (char *)&flag, sizeof(int));
-	flag = 0;
-	setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, (char *)&flag, sizeof(int));
+	setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &flag, sizeof flag);
 }
 
 /* Client *********************************************************************/
@@ -71,8 +72,10 @@ static bool tcp_client_connect(void *cookie, int fd[2]) {
 		}
 	}
 	freeaddrinfo(addrs);
-	if (nfd != -1)
+	if (nfd != -1) {
+		tcp_nodelay(nfd);
 		fd[0] = fd[1] = nfd;
+	}
 	return false;
 }
 
@@ -92,7 +95,6 @@ static size_t tcp_client_peername(void *cookie, int fd[2], char *buf, size_t siz
 static const struct rpcclient_stream_funcs sclient = {
 	.connect = tcp_client_connect,
 	.disconnect = tcp_client_disconnect,
-	.flush = tcp_flush,
 	.peername = tcp_client_peername,
 	.contrack = true,
 };
@@ -137,7 +139,6 @@ static size_t tcp_server_peername(void *cookie, int fd[2], char *buf, size_t siz
 
 static const struct rpcclient_stream_funcs sserver = {
 	.disconnect = tcp_server_disconnect,
-	.flush = tcp_flush,
 	.peername = tcp_server_peername,
 	.contrack = true,
 };
@@ -160,6 +161,7 @@ static rpcclient_t tcp_server_accept(struct rpcserver *server) {
 	int fd = accept(s->fd, NULL, NULL);
 	if (fd == -1)
 		return NULL;
+	tcp_nodelay(fd);
 	return rpcclient_stream_new(&sserver, NULL, s->proto, fd, fd);
 }
 
@@ -0,0 +1,86 @@
+#ifndef SHV_SERIAL_H
+#define SHV_SERIAL_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+/* Bytes with special meaning in the Serial protocol */
+#define STX (0xA2)
+#define ETX (0xA3)
+#define ATX (0xA4)
+#define ESC (0xAA)
+#define ESC_STX (0x02)
+#define ESC_ETX (0x03)
+#define ESC_ATX (0x04)
+#define ESC_ESC (0x0A)
+#define ESCX(X) ((X) & 0x0f)
+#define DESCX(X) ((X) | 0xA0)
+#define ESCAPABLE(X) ((X) == STX || (X) == ETX || (X) == ATX || (X) == ESC)
+#define ESCAPED(X) \
+	((X) == ESC_STX || (X) == ESC_ETX || (X) == ESC_ATX || (X) == ESC_ESC)
+
+/* Get number of bytes before the first special byte (or `len` if there is
+ * none). Such bytes can be copied as they are.
+ *
+ * The data is scanned 16 bytes at a time with SSE2 or NEON when available.
+ * Otherwise 8 bytes are checked at once and only the word containing the
+ * special byte is inspected byte by byte.
+ */
+[[gnu::nonnull]]
+static inline size_t serial_scan(const uint8_t *data, size_t len) {
+	size_t i = 0;
+#if defined(__SSE2__)
+	const __m128i stx = _mm_set1_epi8((char)STX);
+	const __m128i etx = _mm_set1_epi8((char)ETX);
+	const __m128i atx = _mm_set1_epi8((char)ATX);
+	const __m128i esc = _mm_set1_epi8((char)ESC);
+	for (; i + 16 <= len; i += 16) {
+		__m128i v = _mm_loadu_si128((const __m128i *)(data + i));
+		__m128i m = _mm_or_si128(
+			_mm_or_si128(_mm_cmpeq_epi8(v, stx), _mm_cmpeq_epi8(v, etx)),
+			_mm_or_si128(_mm_cmpeq_epi8(v, atx), _mm_cmpeq_epi8(v, esc)));
+		unsigned mask = _mm_movemask_epi8(m);
+		if (mask)
+			return i + __builtin_ctz(mask);
+	}
+#elif defined(__ARM_NEON)
+	const uint8x16_t stx = vdupq_n_u8(STX);
+	const uint8x16_t etx = vdupq_n_u8(ETX);
+	const uint8x16_t atx = vdupq_n_u8(ATX);
+	const uint8x16_t esc = vdupq_n_u8(ESC);
+	for (; i + 16 <= len; i += 16) {
+		uint8x16_t v = vld1q_u8(data + i);
+		uint8x16_t m = vorrq_u8(vorrq_u8(vceqq_u8(v, stx), vceqq_u8(v, etx)),
+			vorrq_u8(vceqq_u8(v, atx), vceqq_u8(v, esc)));
+		/* Narrow every byte to four bits of the 64 bits mask */
+		uint64_t mask = vget_lane_u64(
+			vreinterpret_u64_u8(vshrn_n_u16(vreinterpretq_u16_u8(m), 4)), 0);
+		if (mask)
+			return i + __builtin_ctzll(mask) / 4;
+	}
+#else
+#define REP(B) (0x0101010101010101ULL * (B))
+#define HASZERO(V) (((V) - REP(0x01)) & ~(V) & REP(0x80))
+	for (; i + 8 <= len; i += 8) {
+		uint64_t v;
+		memcpy(&v, data + i, sizeof v);
+		if (HASZERO(v ^ REP(STX)) | HASZERO(v ^ REP(ETX)) |
+			HASZERO(v ^ REP(ATX)) | HASZERO(v ^ REP(ESC)))
+			break;
+	}
+#undef HASZERO
+#undef REP
+#endif
+	for (; i < len; i++)
+		if (ESCAPABLE(data[i]))
+			return i;
+	return len;
+}
+
+#endif
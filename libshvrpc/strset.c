@@ -57,6 +57,7 @@ void shv_strset_free(struct strset *set) {
 		if (set->items[i].dyn)
 			free((void *)set->items[i].str);
 	free(set->items);
+	set->items = NULL;
 	set->cnt = 0;
 	set->siz = 0;
 }
@@ -79,3 +80,12 @@ bool shv_strset_add_dyn(struct strset *set, char *str) {
 		free(str);
 	return result;
 }
+
+bool shv_strset_has(const struct strset *set, const char *str) {
+	unsigned hsh = strhash(str);
+	for (size_t pos = strpos(set, hsh);
+		pos < set->cnt && set->items[pos].hash == hsh; pos++)
+		if (!strcmp(set->items[pos].str, str))
+			return true;
+	return false;
+}
@@ -31,6 +31,10 @@ bool shv_strset_add_const(struct strset *set, const char *str);
 [[gnu::nonnull]]
 bool shv_strset_add_dyn(struct strset *set, char *str);
 
+/* Check if item is in the set. */
+[[gnu::nonnull]]
+bool shv_strset_has(const struct strset *set, const char *str);
+
 
 
 #endif
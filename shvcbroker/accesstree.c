@@ -0,0 +1,240 @@
+#include "accesstree.h"
+#include <stdlib.h>
+#include <string.h>
+#include <shv/rpcri.h>
+#include "riseg.h"
+
+#define obstack_chunk_alloc malloc
+#define obstack_chunk_free free
+
+struct leaf {
+	struct leaf *next;
+	/* Method pattern (the rest of RI after path) */
+	const char *method;
+	rpcaccess_t access;
+};
+
+struct node {
+	const char *name;
+	/* Siblings (used for wildcard nodes and while tree is being compiled) */
+	struct node *next;
+	/* Nodes without wildcards, sorted once tree is compiled */
+	struct node *lits;
+	struct node **nodes;
+	size_t nodes_cnt;
+	struct node *wilds;
+	struct node *globstar;
+	/* Sorted from the highest access level */
+	struct leaf *leafs;
+	/* The highest access level granted by this node and its subtree */
+	rpcaccess_t max;
+};
+
+struct linear {
+	struct linear *next;
+	const char *ri;
+	rpcaccess_t access;
+};
+
+struct accesstree {
+	struct node root;
+	/* RIs that can't be split to the nodes, sorted from the highest access */
+	struct linear *linear;
+};
+
+static struct node *newnode(
+	struct node **list, const char *seg, size_t len, struct obstack *obstack) {
+	struct node *res = obstack_alloc(obstack, sizeof *res);
+	*res = (struct node){
+		.name = obstack_copy0(obstack, seg, len),
+		.next = *list,
+	};
+	*list = res;
+	return res;
+}
+
+static struct node *child(
+	struct node *node, const char *seg, size_t len, struct obstack *obstack) {
+	struct node **list;
+	switch (segtype(seg, len)) {
+		case SEG_GLOBSTAR:
+			if (node->globstar == NULL) {
+				node->globstar = obstack_alloc(obstack, sizeof *node->globstar);
+				*node->globstar = (struct node){};
+			}
+			return node->globstar;
+		case SEG_WILD:
+			list = &node->wilds;
+			break;
+		default:
+			list = &node->lits;
+			break;
+	}
+	for (struct node *n = *list; n; n = n->next)
+		if (!segcmp(n->name, seg, len))
+			return n;
+	return newnode(list, seg, len, obstack);
+}
+
+static void add(struct accesstree *tree, const char *ri, rpcaccess_t access,
+	struct obstack *obstack) {
+	const char *path_end = strchr(ri, ':');
+	if (path_end == NULL)
+		return; /* Such RI never matches */
+	bool indexable = true;
+	for (const char *seg = ri; seg && indexable; seg = nextseg(seg, path_end))
+		indexable = segtype(seg, seglen(seg, path_end)) != SEG_INVALID;
+	/* RIs are added from the highest access and thus appending keeps the lists
+	 * sorted.
+	 */
+	if (!indexable) {
+		struct linear **l = &tree->linear;
+		while (*l)
+			l = &(*l)->next;
+		*l = obstack_alloc(obstack, sizeof **l);
+		**l = (struct linear){.ri = ri, .access = access};
+		return;
+	}
+	struct node *node = &tree->root;
+	for (const char *seg = ri; seg; seg = nextseg(seg, path_end))
+		node = child(node, seg, seglen(seg, path_end), obstack);
+	struct leaf **l = &node->leafs;
+	while (*l)
+		l = &(*l)->next;
+	*l = obstack_alloc(obstack, sizeof **l);
+	**l = (struct leaf){.method = path_end + 1, .access = access};
+}
+
+static int nodecmp(const void *a, const void *b) {
+	struct node *const *da = a;
+	struct node *const *db = b;
+	return strcmp((*da)->name, (*db)->name);
+}
+
+/* Sort literal nodes and compute the highest access level of subtrees. */
+static rpcaccess_t finalize(struct node *node, struct obstack *obstack) {
+	node->max = node->leafs ? node->leafs->access : RPCACCESS_NONE;
+	for (struct node *n = node->lits; n; n = n->next)
+		node->nodes_cnt++;
+	if (node->nodes_cnt) {
+		node->nodes =
+			obstack_alloc(obstack, node->nodes_cnt * sizeof *node->nodes);
+		size_t i = 0;
+		for (struct node *n = node->lits; n; n = n->next)
+			node->nodes[i++] = n;
+		qsort(node->nodes, node->nodes_cnt, sizeof *node->nodes, nodecmp);
+	}
+	for (size_t i = 0; i < node->nodes_cnt; i++) {
+		rpcaccess_t max = finalize(node->nodes[i], obstack);
+		if (max > node->max)
+			node->max = max;
+	}
+	for (struct node *n = node->wilds; n; n = n->next) {
+		rpcaccess_t max = finalize(n, obstack);
+		if (max > node->max)
+			node->max = max;
+	}
+	if (node->globstar) {
+		rpcaccess_t max = finalize(node->globstar, obstack);
+		if (max > node->max)
+			node->max = max;
+	}
+	return node->max;
+}
+
+struct accesstree *accesstree_compile(
+	char **ri_access[RPCACCESS_ADMIN + 1], struct obstack *obstack) {
+	struct accesstree *res = obstack_alloc(obstack, sizeof *res);
+	*res = (struct accesstree){};
+	for (rpcaccess_t access = RPCACCESS_ADMIN; access > 0; access--)
+		if (ri_access[access])
+			for (char **ri = ri_access[access]; *ri; ri++)
+				add(res, *ri, access, obstack);
+	finalize(&res->root, obstack);
+	return res;
+}
+
+
+struct lookup {
+	const char *path_end;
+	const char *method;
+	rpcaccess_t access;
+};
+
+static void lookup_leafs(const struct node *node, struct lookup *l) {
+	for (struct leaf *leaf = node->leafs; leaf && leaf->access > l->access;
+		leaf = leaf->next)
+		if (rpcstr_match(leaf->method, l->method)) {
+			l->access = leaf->access;
+			return;
+		}
+}
+
+static struct node *lookup_lit(
+	const struct node *node, const char *seg, size_t len) {
+	size_t b = 0, e = node->nodes_cnt;
+	while (b < e) {
+		size_t p = (b + e) / 2;
+		int r = segcmp(node->nodes[p]->name, seg, len);
+		if (r == 0)
+			return node->nodes[p];
+		if (r > 0)
+			e = p;
+		else
+			b = p + 1;
+	}
+	return NULL;
+}
+
+static void lookup(const struct node *node, const char *seg, struct lookup *l) {
+	if (node->max <= l->access)
+		return; /* Nothing better can be found here */
+	if (seg == NULL) {
+		lookup_leafs(node, l);
+		/* foo/\** matches also foo */
+		if (node->globstar)
+			lookup_leafs(node->globstar, l);
+		return;
+	}
+	size_t len = seglen(seg, l->path_end);
+	const char *next = nextseg(seg, l->path_end);
+
+	const struct node *n = lookup_lit(node, seg, len);
+	if (n)
+		lookup(n, next, l);
+
+	if (node->wilds) {
+		char str[len + 1];
+		memcpy(str, seg, len);
+		str[len] = '\0';
+		for (n = node->wilds; n; n = n->next)
+			if (rpcstr_match(n->name, str))
+				lookup(n, next, l);
+	}
+
+	if (node->globstar && node->globstar->max > l->access) {
+		/* Trailing ** matches the rest of the path */
+		lookup_leafs(node->globstar, l);
+		/* Otherwise it consumes at least one node */
+		for (const char *s = next; true; s = nextseg(s, l->path_end)) {
+			lookup(node->globstar, s, l);
+			if (s == NULL)
+				break;
+		}
+	}
+}
+
+rpcaccess_t accesstree_access(
+	const struct accesstree *tree, const char *path, const char *method) {
+	struct lookup l = {
+		.path_end = path + strlen(path),
+		.method = method,
+		.access = RPCACCESS_NONE,
+	};
+	lookup(&tree->root, path, &l);
+	for (struct linear *lin = tree->linear; lin && lin->access > l.access;
+		lin = lin->next)
+		if (rpcri_match(lin->ri, path, method, NULL))
+			return lin->access;
+	return l.access;
+}
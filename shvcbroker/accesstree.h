@@ -0,0 +1,29 @@
+#ifndef _SHVCBROKER_ACCESSTREE_H_
+#define _SHVCBROKER_ACCESSTREE_H_
+
+#include <obstack.h>
+#include <shv/rpcaccess.h>
+
+/* Access rules of the role compiled to the single tree.
+ *
+ * The path portion of the RIs is split to the nodes and every node knows the
+ * highest access level granted in its subtree. The access for the path and
+ * method is thus found in a single walk that skips subtrees that can't grant
+ * more than what was already found.
+ */
+struct accesstree;
+
+/* Compile access RIs of the role.
+ *
+ * The tree is allocated in the provided obstack and thus is released with it.
+ */
+[[gnu::nonnull]]
+struct accesstree *accesstree_compile(
+	char **ri_access[RPCACCESS_ADMIN + 1], struct obstack *obstack);
+
+/* Get the highest access level granted for the given method. */
+[[gnu::nonnull]]
+rpcaccess_t accesstree_access(
+	const struct accesstree *tree, const char *path, const char *method);
+
+#endif
@@ -314,6 +314,10 @@ struct config *config_load(const char *path, struct obstack *obstack) {
 			UNPACK_ERROR("Role must exist", "users", conf->users[i].name, "role");
 	}
 
+	for (size_t i = 0; i < conf->roles_cnt; i++)
+		conf->roles[i].access =
+			accesstree_compile(conf->roles[i].ri_access, obstack);
+
 	return conf;
 	// NOLINTEND(clang-analyzer-unix.Malloc)
 }
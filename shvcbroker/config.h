@@ -6,6 +6,7 @@
 #include <shv/rpcaccess.h>
 #include <shv/rpcri.h>
 #include <shv/rpcurl.h>
+#include "accesstree.h"
 
 struct user {
 	const char *name;
@@ -18,6 +19,8 @@ struct role {
 	const char *name;
 	char **ri_access[RPCACCESS_ADMIN + 1];
 	char **ri_mount_points;
+	/* Compiled ri_access */
+	struct accesstree *access;
 };
 
 struct autosetup {
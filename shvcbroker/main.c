@@ -32,14 +32,6 @@ static void sigint_handler(int status) {
 	halt = true;
 }
 
-static bool rpcri_match_oneof(char **ris, const char *path, const char *method) {
-	if (ris)
-		for (char **ri = ris; *ri; ri++)
-			if (rpcri_match(*ri, path, method, NULL))
-				return true;
-	return false;
-}
-
 static bool rpcpath_match_oneof(char **patterns, const char *path) {
 	if (patterns)
 		for (char **pattern = patterns; *pattern; pattern++)
@@ -49,12 +41,8 @@ static bool rpcpath_match_oneof(char **patterns, const char *path) {
 }
 
 static rpcaccess_t rpcaccess(void *cookie, const char *path, const char *method) {
-	char ***ri_access = cookie;
-	if (ri_access)
-		for (rpcaccess_t access = RPCACCESS_ADMIN; access > 0; access--)
-			if (rpcri_match_oneof(ri_access[access], path, method))
-				return access;
-	return RPCACCESS_NONE;
+	struct accesstree *tree = cookie;
+	return tree ? accesstree_access(tree, path, method) : RPCACCESS_NONE;
 }
 
 static void free_role(struct rpcbroker_role *role) {
@@ -91,7 +79,7 @@ static struct rpcbroker_login_res login(
 	*res = (struct rpcbroker_role){
 		.name = role->name,
 		.access = rpcaccess,
-		.access_cookie = role->ri_access,
+		.access_cookie = role->access,
 		.mount_point = mount_point,
 		.subscriptions = autosetup ? (const char **)autosetup->subscriptions : NULL,
 		.free = free_role,
@@ -117,6 +105,7 @@ static int new_client(
 	stages[1] = rpchandler_app_stage(ctx->app_conf);
 	stages[3] = (struct rpchandler_stage){};
 	rpchandler_t handler = rpchandler_new(client, stages, NULL);
+	rpchandler_cache_nodes(handler, true);
 	int cid =
 		rpcbroker_client_register(broker, handler, &stages[0], &stages[2], NULL);
 	fprintf(stderr, "New client [%d]: %s\n", cid, peername);
@@ -149,7 +138,7 @@ int main(int argc, char **argv) {
 	signal(SIGTERM, sigint_handler);
 	int ec = 1;
 
-	struct rpcbroker_state bstate;
+	struct rpcbroker_state bstate = {};
 	bstate.name = ctx.conf->name;
 	bstate.new_client = new_client;
 	bstate.del_client = del_client;
@@ -157,7 +146,8 @@ int main(int argc, char **argv) {
 
 	ctx.app_conf = &(struct rpchandler_app_conf){
 		.name = "shvcbroker", .version = PROJECT_VERSION};
-	bstate.broker = rpcbroker_new(ctx.conf->name, login, &ctx, RPCBROKER_F_NOLOCK);
+	bstate.broker = rpcbroker_new(ctx.conf->name, login, &ctx,
+		ctx.opts.threads ? 0 : RPCBROKER_F_NOLOCK);
 
 	bstate.servers = calloc(ctx.conf->listen_cnt, sizeof *bstate.servers);
 	bstate.servers_cnt = ctx.conf->listen_cnt;
@@ -173,7 +163,7 @@ int main(int argc, char **argv) {
 	}
 
 	fprintf(stderr, "SHV RPC Broker is running.\n");
-	rpcbroker_run(&bstate, &halt);
+	rpcbroker_run_threads(&bstate, &halt, ctx.opts.threads);
 	fprintf(stderr, "SHV RPC Broker is terminating.\n");
 
 	ec = 0;
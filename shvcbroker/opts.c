@@ -6,7 +6,7 @@
 
 
 static void print_usage(const char *argv0) {
-	fprintf(stderr, "%s [-vqdVh] [-c FILE]\n", argv0);
+	fprintf(stderr, "%s [-vqdVh] [-c FILE] [-j NUM]\n", argv0);
 }
 
 static void print_help(const char *argv0) {
@@ -15,6 +15,7 @@ static void print_help(const char *argv0) {
 	fprintf(stderr, "\n");
 	fprintf(stderr, "Arguments:\n");
 	fprintf(stderr, "  -c FILE  Path to the configuration file\n");
+	fprintf(stderr, "  -j NUM   Number of threads handling clients\n");
 	fprintf(stderr, "  -v       Increase logging level of the communication\n");
 	fprintf(stderr, "  -q       Decrease logging level of the communication\n");
 	fprintf(stderr, "  -d       Set maximal logging level of the communication\n");
@@ -26,14 +27,24 @@ void parse_opts(int argc, char **argv, struct opts *opts) {
 	*opts = (struct opts){
 		.config = NULL,
 		.verbose = 0,
+		.threads = 0,
 	};
 
 	int c;
-	while ((c = getopt(argc, argv, "c:vqdVh")) != -1) {
+	while ((c = getopt(argc, argv, "c:j:vqdVh")) != -1) {
 		switch (c) {
 			case 'c':
 				opts->config = optarg;
 				break;
+			case 'j': {
+				char *end;
+				opts->threads = strtoul(optarg, &end, 10);
+				if (*end != '\0') {
+					fprintf(stderr, "Invalid number of threads: %s\n", optarg);
+					exit(-1);
+				}
+				break;
+			}
 			case 'v':
 				if (opts->verbose < UINT_MAX)
 					opts->verbose++;
@@ -5,6 +5,7 @@
 struct opts {
 	const char *config;
 	unsigned verbose;
+	unsigned threads;
 };
 
 /* Parse arguments. */
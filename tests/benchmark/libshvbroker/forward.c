@@ -0,0 +1,213 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <poll.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdatomic.h>
+#include <time.h>
+#include <obstack.h>
+#include <shv/rpcbroker.h>
+#include <shv/rpcmsg.h>
+#include <shv/rpctransport.h>
+
+/* Benchmark of the signals forwarding by the broker.
+ *
+ * Every client publishes signals and it is subscribed to the signals of all
+ * clients and thus every signal is forwarded to all of them. The broker runs
+ * with different number of threads to see how forwarding scales with them.
+ */
+
+#define obstack_chunk_alloc malloc
+#define obstack_chunk_free free
+
+#define CLIENTS (8)
+#define SIGNALS (20000)
+
+struct peer {
+	rpcclient_t client;
+	unsigned received;
+	pthread_t sender, receiver;
+};
+
+static atomic_uint registered;
+
+static rpcaccess_t access_all(
+	void *cookie, const char *path, const char *method) {
+	return RPCACCESS_ADMIN;
+}
+
+static const char *subscriptions[] = {"**:*:chng", NULL};
+
+static void role_free(struct rpcbroker_role *role) {
+	free((char *)role->mount_point);
+	free(role);
+}
+
+static int new_client(
+	void *cookie, rpcbroker_t broker, rpcserver_t server, rpcclient_t client) {
+	struct rpchandler_stage *stages = calloc(3, sizeof *stages);
+	rpchandler_t handler = rpchandler_new(client, stages, NULL);
+	struct rpcbroker_role *role = malloc(sizeof *role);
+	char *mount_point;
+	asprintf(&mount_point, "test/device%u", atomic_load(&registered));
+	*role = (struct rpcbroker_role){
+		.name = "benchmark",
+		.access = access_all,
+		.mount_point = mount_point,
+		.subscriptions = subscriptions,
+		.free = role_free,
+	};
+	int res = rpcbroker_client_register(
+		broker, handler, &stages[0], &stages[1], role);
+	atomic_fetch_add(&registered, 1);
+	return res;
+}
+
+static void del_client(void *cookie, rpcbroker_t broker, int cid) {
+	rpchandler_t handler = rpcbroker_client_handler(broker, cid);
+	rpcbroker_client_unregister(broker, cid);
+	rpcclient_t client = rpchandler_client(handler);
+	free((struct rpchandler_stage *)rpchandler_stages(handler));
+	rpchandler_destroy(handler);
+	rpcclient_destroy(client);
+}
+
+static void *sender(void *arg) {
+	struct peer *peer = arg;
+	for (int i = 0; i < SIGNALS; i++) {
+		cp_pack_t pack = rpcclient_pack(peer->client);
+		rpcmsg_pack_signal(
+			pack, "value", "get", "chng", NULL, RPCACCESS_READ, false);
+		cp_pack_int(pack, i);
+		cp_pack_container_end(pack);
+		rpcclient_sendmsg(peer->client);
+	}
+	return NULL;
+}
+
+static void *receiver(void *arg) {
+	struct peer *peer = arg;
+	struct obstack obstack;
+	obstack_init(&obstack);
+	void *obase = obstack_alloc(&obstack, 0);
+	struct pollfd pfd = {
+		.fd = rpcclient_pollfd(peer->client),
+		.events = POLLIN,
+	};
+	while (peer->received < CLIENTS * SIGNALS) {
+		/* Stop if some signals were not delivered */
+		if (!rpcclient_pending(peer->client) && poll(&pfd, 1, 5000) != 1)
+			break;
+		if (rpcclient_nextmsg(peer->client) != RPCC_MESSAGE)
+			continue;
+		struct cpitem item;
+		cpitem_unpack_init(&item);
+		struct rpcmsg_meta meta;
+		if (rpcmsg_head_unpack(
+				rpcclient_unpack(peer->client), &item, &meta, NULL, &obstack)) {
+			int val;
+			cp_unpack_int(rpcclient_unpack(peer->client), &item, val);
+			if (rpcclient_validmsg(peer->client))
+				peer->received++;
+		} else
+			rpcclient_ignoremsg(peer->client);
+		obstack_free(&obstack, obase);
+	}
+	obstack_free(&obstack, NULL);
+	return NULL;
+}
+
+struct run {
+	struct rpcbroker_state state;
+	unsigned threads;
+};
+
+static volatile sig_atomic_t halt;
+
+static void sigusr1(int sig) {
+	halt = 1;
+}
+
+static void *broker_thread(void *arg) {
+	struct run *run = arg;
+	rpcbroker_run_threads(&run->state, &halt, run->threads);
+	return NULL;
+}
+
+static void bench(const char *dir, unsigned threads) {
+	char *location;
+	asprintf(&location, "%s/socket%u", dir, threads);
+	struct run run = {.threads = threads};
+	rpcserver_t server = rpcserver_unix_new(location, RPCSTREAM_P_BLOCK);
+	run.state = (struct rpcbroker_state){
+		.broker = rpcbroker_new(
+			"benchmark", NULL, NULL, threads ? 0 : RPCBROKER_F_NOLOCK),
+		.servers = &server,
+		.servers_cnt = 1,
+		.new_client = new_client,
+		.del_client = del_client,
+	};
+	/* Measure forwarding and not the signals dropped due to the full queue */
+	rpcbroker_queue_limits(
+		run.state.broker, 64 * 1024, SIZE_MAX, RPCBROKER_OVERFLOW_DROP);
+	atomic_store(&registered, 0);
+	halt = 0;
+	pthread_t thread;
+	pthread_create(&thread, NULL, broker_thread, &run);
+
+	struct peer peers[CLIENTS];
+	for (unsigned i = 0; i < CLIENTS; i++) {
+		peers[i] = (struct peer){
+			.client = rpcclient_unix_new(location, RPCSTREAM_P_BLOCK),
+		};
+		rpcclient_reset(peers[i].client);
+	}
+	/* Signals must not be sent before all clients are subscribed */
+	while (atomic_load(&registered) < CLIENTS)
+		usleep(1000);
+
+	struct timespec start, end;
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for (unsigned i = 0; i < CLIENTS; i++) {
+		pthread_create(&peers[i].receiver, NULL, receiver, &peers[i]);
+		pthread_create(&peers[i].sender, NULL, sender, &peers[i]);
+	}
+	unsigned long received = 0;
+	for (unsigned i = 0; i < CLIENTS; i++) {
+		pthread_join(peers[i].sender, NULL);
+		pthread_join(peers[i].receiver, NULL);
+		received += peers[i].received;
+	}
+	clock_gettime(CLOCK_MONOTONIC, &end);
+
+	pthread_kill(thread, SIGUSR1);
+	pthread_join(thread, NULL);
+	for (unsigned i = 0; i < CLIENTS; i++)
+		rpcclient_destroy(peers[i].client);
+	rpcserver_destroy(server);
+	rpcbroker_destroy(run.state.broker);
+	unlink(location);
+	free(location);
+
+	double elapsed = (end.tv_sec - start.tv_sec) +
+		(end.tv_nsec - start.tv_nsec) / 1000000000.;
+	bool lost = received != (unsigned long)CLIENTS * CLIENTS * SIGNALS;
+	printf("%u threads: %10.0f signal/s delivered%s\n", threads,
+		received / elapsed, lost ? " (LOST)" : "");
+}
+
+int main(void) {
+	/* Signal interrupts the broker's poll and thus it notices the halt */
+	sigaction(SIGUSR1, &(struct sigaction){.sa_handler = sigusr1}, NULL);
+	char dir[] = "/tmp/benchmark-forward-XXXXXX";
+	if (mkdtemp(dir) == NULL)
+		return 1;
+	bench(dir, 0);
+	bench(dir, 1);
+	bench(dir, 2);
+	bench(dir, 4);
+	rmdir(dir);
+	return 0;
+}
@@ -0,0 +1,126 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <shv/rpcri.h>
+
+#include "subindex.h"
+
+/* Benchmark of the subscriptions matching.
+ *
+ * The index is compared against the linear match of all subscriptions with
+ * rpcri_match. Subscriptions are per device with some of them using wildcards
+ * and there are also a few generic ones.
+ */
+
+#define SIGNALS (100000)
+#define CLIENTS (64)
+
+static double elapsed(struct timespec *start) {
+	struct timespec end;
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	return (end.tv_sec - start->tv_sec) +
+		(end.tv_nsec - start->tv_nsec) / 1000000000.;
+}
+
+static char *subscription_ri(unsigned i) {
+	char *res;
+	switch (i % 8) {
+		case 0:
+			asprintf(&res, "site%u/device%u/**:*:*", i / 100, i);
+			break;
+		case 1:
+			asprintf(&res, "site%u/device%u/status:get:chng", i / 100, i);
+			break;
+		case 2:
+			asprintf(&res, "site%u/*/status:get:chng", i);
+			break;
+		case 3:
+			asprintf(&res, "site%u/device%u/**:get:*", i / 100, i);
+			break;
+		default:
+			asprintf(&res, "site%u/device%u/value%u:*:chng", i / 100, i, i % 8);
+			break;
+	}
+	return res;
+}
+
+static void bench(unsigned cnt) {
+	struct subscription *subs = malloc(cnt * sizeof *subs);
+	struct subindex index = {};
+	for (unsigned i = 0; i < cnt; i++) {
+		subs[i] = (struct subscription){.ri = subscription_ri(i), .clients = NULL};
+		nbool_set(&subs[i].clients, i % CLIENTS);
+		subindex_add(&index, &subs[i]);
+	}
+	const char *generic[] = {"**:*:lsmod", "test/**:*:*", "**:ls:*"};
+	struct subscription gsubs[3];
+	for (unsigned i = 0; i < 3; i++) {
+		gsubs[i] = (struct subscription){.ri = generic[i], .clients = NULL};
+		nbool_set(&gsubs[i].clients, i);
+		subindex_add(&index, &gsubs[i]);
+	}
+
+	char(*paths)[64] = malloc(SIGNALS * sizeof *paths);
+	srand(42);
+	for (unsigned i = 0; i < SIGNALS; i++) {
+		unsigned dev = rand() % cnt;
+		snprintf(paths[i], sizeof *paths, "site%u/device%u/value%u", dev / 100,
+			dev, dev % 8);
+	}
+
+	nbool_t dest = NULL;
+	unsigned long matched = 0;
+	struct timespec start;
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for (unsigned i = 0; i < SIGNALS; i++) {
+		nbool_zero(dest);
+		subindex_match(&index, &dest, paths[i], "get", "chng");
+		matched += dest ? nbool_nbits(dest) : 0;
+	}
+	double tindex = elapsed(&start);
+
+	/* Linear match is much slower and thus we do only fraction of signals */
+	unsigned lsignals = SIGNALS / (cnt / 1000);
+	unsigned long lmatched = 0, imatched = 0;
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for (unsigned i = 0; i < lsignals; i++) {
+		nbool_zero(dest);
+		for (unsigned y = 0; y < cnt; y++)
+			if (rpcri_match(subs[y].ri, paths[i], "get", "chng"))
+				nbool_or(&dest, subs[y].clients);
+		for (unsigned y = 0; y < 3; y++)
+			if (rpcri_match(gsubs[y].ri, paths[i], "get", "chng"))
+				nbool_or(&dest, gsubs[y].clients);
+		lmatched += dest ? nbool_nbits(dest) : 0;
+	}
+	double tlinear = elapsed(&start);
+	for (unsigned i = 0; i < lsignals; i++) {
+		nbool_zero(dest);
+		subindex_match(&index, &dest, paths[i], "get", "chng");
+		imatched += dest ? nbool_nbits(dest) : 0;
+	}
+
+	printf("%7u subscriptions: index %10.0f signal/s, linear %10.0f signal/s, "
+		   "%.2f dest/signal%s\n",
+		cnt, SIGNALS / tindex, lsignals / tlinear, (double)matched / SIGNALS,
+		lmatched == imatched ? "" : " (MISMATCH)");
+
+	for (unsigned i = 0; i < cnt; i++) {
+		subindex_del(&index, &subs[i]);
+		free((char *)subs[i].ri);
+		free(subs[i].clients);
+	}
+	for (unsigned i = 0; i < 3; i++) {
+		subindex_del(&index, &gsubs[i]);
+		free(gsubs[i].clients);
+	}
+	free(dest);
+	free(paths);
+	free(subs);
+}
+
+int main(void) {
+	bench(10000);
+	bench(100000);
+	return 0;
+}
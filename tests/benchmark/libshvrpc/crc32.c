@@ -0,0 +1,66 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <shv/crc32.h>
+
+/* Benchmark of the CRC32 calculation.
+ *
+ * The crc32_update is compared against the plain calculation with a single
+ * table lookup per byte for different sizes of the data.
+ */
+
+#define BYTES (256 * 1024 * 1024)
+
+static uint32_t table[256];
+
+static crc32_t bytewise(crc32_t crc, const uint8_t *data, size_t len) {
+	while (len--)
+		crc = table[(crc ^ *data++) & 0xff] ^ (crc >> 8);
+	return crc;
+}
+
+static double elapsed(struct timespec *start) {
+	struct timespec end;
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	return (end.tv_sec - start->tv_sec) +
+		(end.tv_nsec - start->tv_nsec) / 1000000000.;
+}
+
+static void bench(const uint8_t *data, size_t siz) {
+	unsigned cnt = BYTES / siz;
+	crc32_t crc = crc32_init(), bcrc = crc32_init();
+	struct timespec start;
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for (unsigned i = 0; i < cnt; i++)
+		bcrc = bytewise(bcrc, data, siz);
+	double tbytewise = elapsed(&start);
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for (unsigned i = 0; i < cnt; i++)
+		crc = crc32_update(crc, data, siz);
+	double tupdate = elapsed(&start);
+
+	printf("%8zu B %10.1f MiB/s, bytewise %8.1f MiB/s%s\n", siz,
+		BYTES / tupdate / (1024 * 1024), BYTES / tbytewise / (1024 * 1024),
+		crc == bcrc ? "" : " (MISMATCH)");
+}
+
+int main(void) {
+	for (uint32_t i = 0; i < 256; i++) {
+		uint32_t crc = i;
+		for (int j = 0; j < 8; j++)
+			crc = (crc >> 1) ^ (0xedb88320 & -(crc & 1));
+		table[i] = crc;
+	}
+	static uint8_t data[64 * 1024];
+	srand(42);
+	for (size_t i = 0; i < sizeof data; i++)
+		data[i] = rand();
+
+	bench(data, 16);
+	bench(data, 63);
+	bench(data, 256);
+	bench(data, 4096);
+	bench(data, sizeof data);
+	return 0;
+}
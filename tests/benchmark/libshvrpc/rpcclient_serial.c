@@ -0,0 +1,82 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <time.h>
+#include <shv/rpcclient_stream.h>
+#include <shv/rpctransport.h>
+
+/* Benchmark of the RPC Client Stream throughput.
+ *
+ * Messages with large blob are sent from the separate thread over the pipe and
+ * received in the main one. The blob contains random data and thus about one
+ * in 64 bytes has to be escaped by the Serial protocol.
+ */
+
+#define MESSAGES (2000)
+#define BLOBSIZ (64 * 1024)
+
+static const struct rpcclient_stream_funcs sfuncs = {};
+
+static uint8_t blob[BLOBSIZ];
+
+static void *sender(void *arg) {
+	rpcclient_t client = arg;
+	for (int i = 0; i < MESSAGES; i++) {
+		cp_pack_blob(rpcclient_pack(client), blob, BLOBSIZ);
+		rpcclient_sendmsg(client);
+	}
+	return NULL;
+}
+
+static void bench(const char *name, enum rpcstream_proto proto) {
+	int pipes[2];
+	rpcclient_t client = rpcclient_pipe_new(pipes, proto);
+	fcntl(pipes[1], F_SETFL, 0);
+	rpcclient_t sclient =
+		rpcclient_stream_new(&sfuncs, NULL, proto, pipes[0], pipes[1]);
+	pthread_t thread;
+	struct timespec start, end;
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	pthread_create(&thread, NULL, sender, sclient);
+
+	static uint8_t buf[BLOBSIZ];
+	struct pollfd pfd = {.fd = rpcclient_pollfd(client), .events = POLLIN};
+	unsigned received = 0;
+	while (received < MESSAGES) {
+		if (!rpcclient_pending(client))
+			poll(&pfd, 1, -1);
+		if (rpcclient_nextmsg(client) != RPCC_MESSAGE)
+			continue;
+		struct cpitem item;
+		cpitem_unpack_init(&item);
+		item.buf = buf;
+		item.bufsiz = BLOBSIZ;
+		do
+			cp_unpack(rpcclient_unpack(client), &item);
+		while (item.type == CPITEM_BLOB && !(item.as.Blob.flags & CPBI_F_LAST));
+		if (rpcclient_validmsg(client))
+			received++;
+	}
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	pthread_join(thread, NULL);
+	rpcclient_destroy(sclient);
+	rpcclient_destroy(client);
+
+	double elapsed = (end.tv_sec - start.tv_sec) +
+		(end.tv_nsec - start.tv_nsec) / 1000000000.;
+	printf("%-10s %8.1f MiB/s\n", name,
+		(double)MESSAGES * BLOBSIZ / elapsed / (1024 * 1024));
+}
+
+int main(void) {
+	srand(42);
+	for (size_t i = 0; i < BLOBSIZ; i++)
+		blob[i] = rand();
+	bench("block", RPCSTREAM_P_BLOCK);
+	bench("serial", RPCSTREAM_P_SERIAL);
+	bench("serialcrc", RPCSTREAM_P_SERIAL_CRC);
+	return 0;
+}
@@ -0,0 +1,112 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <time.h>
+#include <obstack.h>
+#include <shv/rpcclient_stream.h>
+#include <shv/rpcmsg.h>
+#include <shv/rpctransport.h>
+
+/* Benchmark of the RPC Client Stream receive path.
+ *
+ * The messages are sent from the separate thread and received and unpacked in
+ * the main one. The read and poll calls are counted (with linker's wrap
+ * option) only for the receiving thread.
+ */
+
+#define obstack_chunk_alloc malloc
+#define obstack_chunk_free free
+
+#define MESSAGES (100000)
+
+static _Thread_local bool counting = false;
+static unsigned long cnt_read, cnt_poll;
+
+ssize_t __real_read(int fd, void *buf, size_t count);
+ssize_t __wrap_read(int fd, void *buf, size_t count) {
+	if (counting)
+		cnt_read++;
+	return __real_read(fd, buf, count);
+}
+
+int __real_poll(struct pollfd *fds, nfds_t nfds, int timeout);
+int __wrap_poll(struct pollfd *fds, nfds_t nfds, int timeout) {
+	if (counting)
+		cnt_poll++;
+	return __real_poll(fds, nfds, timeout);
+}
+
+static const struct rpcclient_stream_funcs sfuncs = {};
+
+static void *sender(void *arg) {
+	rpcclient_t client = arg;
+	for (int i = 0; i < MESSAGES; i++) {
+		cp_pack_t pack = rpcclient_pack(client);
+		rpcmsg_pack_request(pack, "test/device/track/1", "get", NULL, 4 + i % 60);
+		cp_pack_int(pack, i);
+		cp_pack_container_end(pack);
+		rpcclient_sendmsg(client);
+	}
+	return NULL;
+}
+
+static void bench(const char *name, enum rpcstream_proto proto) {
+	int pipes[2];
+	rpcclient_t client = rpcclient_pipe_new(pipes, proto);
+	fcntl(pipes[1], F_SETFL, 0);
+	rpcclient_t sclient =
+		rpcclient_stream_new(&sfuncs, NULL, proto, pipes[0], pipes[1]);
+	pthread_t thread;
+	pthread_create(&thread, NULL, sender, sclient);
+
+	struct obstack obstack;
+	obstack_init(&obstack);
+	void *obase = obstack_alloc(&obstack, 0);
+	struct pollfd pfd = {.fd = rpcclient_pollfd(client), .events = POLLIN};
+	unsigned received = 0;
+	struct timespec start, end;
+	cnt_read = 0;
+	cnt_poll = 0;
+	counting = true;
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	while (received < MESSAGES) {
+		if (!rpcclient_pending(client))
+			poll(&pfd, 1, -1);
+		if (rpcclient_nextmsg(client) != RPCC_MESSAGE)
+			continue;
+		struct cpitem item;
+		cpitem_unpack_init(&item);
+		struct rpcmsg_meta meta;
+		if (rpcmsg_head_unpack(
+				rpcclient_unpack(client), &item, &meta, NULL, &obstack)) {
+			int val;
+			cp_unpack_int(rpcclient_unpack(client), &item, val);
+			if (rpcclient_validmsg(client))
+				received++;
+		} else
+			rpcclient_ignoremsg(client);
+		obstack_free(&obstack, obase);
+	}
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	counting = false;
+	obstack_free(&obstack, NULL);
+	pthread_join(thread, NULL);
+	rpcclient_destroy(sclient);
+	rpcclient_destroy(client);
+
+	double elapsed = (end.tv_sec - start.tv_sec) +
+		(end.tv_nsec - start.tv_nsec) / 1000000000.;
+	printf("%-10s %8.2f read/msg %8.2f poll/msg %10.0f msg/s\n", name,
+		(double)cnt_read / MESSAGES, (double)cnt_poll / MESSAGES,
+		MESSAGES / elapsed);
+}
+
+int main(void) {
+	bench("block", RPCSTREAM_P_BLOCK);
+	bench("serial", RPCSTREAM_P_SERIAL);
+	bench("serialcrc", RPCSTREAM_P_SERIAL_CRC);
+	return 0;
+}
@@ -0,0 +1,111 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <time.h>
+#include <shv/rpchandler.h>
+#include <shv/rpchandler_impl.h>
+#include <shv/rpcclient_stream.h>
+#include <shv/rpctransport.h>
+
+/* Benchmark of the RPC Handler's dir method.
+ *
+ * The node with many methods is described by the stage the same way as the
+ * regular one and the other one with packed method descriptions. The requests
+ * are sent over the pipe and handled in the same thread.
+ */
+
+#define REQUESTS (20000)
+#define METHODS (50)
+
+#define obstack_chunk_alloc malloc
+#define obstack_chunk_free free
+
+static struct rpcdir methods[METHODS];
+static struct rpcdir_packed packed[METHODS];
+
+static void rpc_dir(void *cookie, struct rpchandler_dir *ctx) {
+	if (!strcmp(ctx->path, "plain"))
+		for (int i = 0; i < METHODS; i++)
+			rpchandler_dir_result(ctx, &methods[i]);
+	else if (!strcmp(ctx->path, "packed"))
+		for (int i = 0; i < METHODS; i++)
+			rpchandler_dir_result_packed(ctx, &packed[i]);
+}
+
+static void rpc_ls(void *cookie, struct rpchandler_ls *ctx) {
+	if (ctx->path[0] == '\0') {
+		rpchandler_ls_result_const(ctx, "plain");
+		rpchandler_ls_result_const(ctx, "packed");
+	}
+}
+
+static const struct rpchandler_funcs funcs = {.ls = rpc_ls, .dir = rpc_dir};
+static const struct rpchandler_stage stages[] = {{.funcs = &funcs}, {}};
+static const struct rpcclient_stream_funcs sfuncs = {};
+
+static void bench(const char *path) {
+	int pipes[2];
+	rpcclient_t client = rpcclient_pipe_new(pipes, RPCSTREAM_P_BLOCK);
+	fcntl(pipes[1], F_SETFL, 0);
+	rpcclient_t peer = rpcclient_stream_new(
+		&sfuncs, NULL, RPCSTREAM_P_BLOCK, pipes[0], pipes[1]);
+	rpchandler_t handler = rpchandler_new(client, stages, NULL);
+	struct obstack obstack;
+	obstack_init(&obstack);
+	void *obase = obstack_alloc(&obstack, 0);
+
+	struct timespec start, end;
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	unsigned valid = 0;
+	for (int i = 0; i < REQUESTS; i++) {
+		rpcmsg_pack_request_void(rpcclient_pack(peer), path, "dir", NULL, i);
+		rpcclient_sendmsg(peer);
+		rpchandler_next(handler);
+		if (rpcclient_nextmsg(peer) != RPCC_MESSAGE)
+			continue;
+		struct cpitem item;
+		cpitem_unpack_init(&item);
+		struct rpcmsg_meta meta;
+		if (rpcmsg_head_unpack(
+				rpcclient_unpack(peer), &item, &meta, NULL, &obstack) &&
+			meta.type == RPCMSG_T_RESPONSE) {
+			cp_unpack_skip(rpcclient_unpack(peer), &item);
+			valid += rpcclient_validmsg(peer);
+		}
+		obstack_free(&obstack, obase);
+	}
+	clock_gettime(CLOCK_MONOTONIC, &end);
+
+	obstack_free(&obstack, NULL);
+	rpchandler_destroy(handler);
+	rpcclient_destroy(client);
+	rpcclient_destroy(peer);
+
+	double elapsed = (end.tv_sec - start.tv_sec) +
+		(end.tv_nsec - start.tv_nsec) / 1000000000.;
+	printf("%-10s %10.0f dir/s%s\n", path, REQUESTS / elapsed,
+		valid == REQUESTS ? "" : " (INVALID)");
+}
+
+int main(void) {
+	char *names[METHODS];
+	for (int i = 0; i < METHODS; i++) {
+		asprintf(&names[i], "method%d", i);
+		methods[i] = (struct rpcdir){
+			.name = names[i],
+			.param = "i|n",
+			.result = "{i:value,t:time}",
+			.flags = i % 2 ? RPCDIR_F_GETTER : 0,
+			.access = RPCACCESS_READ,
+		};
+		packed[i] = (struct rpcdir_packed){.method = &methods[i]};
+	}
+	bench("plain");
+	bench("packed");
+	for (int i = 0; i < METHODS; i++) {
+		rpcdir_packed_free(&packed[i]);
+		free(names[i]);
+	}
+	return 0;
+}
@@ -0,0 +1,59 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <shv/rpcri.h>
+
+/* Benchmark of the RPC RI matching.
+ *
+ * The rpcri_match is compared against the compiled RI. The common RIs are used
+ * as well as ones with multiple wildcards on the deep path where backtracking
+ * of rpcri_match takes long time.
+ */
+
+#define MATCHES (1000000)
+
+static double elapsed(struct timespec *start) {
+	struct timespec end;
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	return (end.tv_sec - start->tv_sec) +
+		(end.tv_nsec - start->tv_nsec) / 1000000000.;
+}
+
+static void bench(const char *ri, const char *path, const char *method,
+	const char *signal, unsigned cnt) {
+	unsigned long matched = 0, cmatched = 0;
+	struct timespec start;
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for (unsigned i = 0; i < cnt; i++)
+		matched += rpcri_match(ri, path, method, signal);
+	double tmatch = elapsed(&start);
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	rpcri_t cri = rpcri_compile(ri);
+	for (unsigned i = 0; i < cnt; i++)
+		cmatched += rpcri_match_compiled(cri, path, method, signal);
+	double tcompiled = elapsed(&start);
+	rpcri_free(cri);
+
+	printf("%-32.32s %12.0f match/s, compiled %12.0f match/s%s\n", ri,
+		cnt / tmatch, cnt / tcompiled, matched == cmatched ? "" : " (MISMATCH)");
+}
+
+int main(void) {
+	const char *path = "site/device/track/4";
+	bench("**:*:*", path, "get", "chng", MATCHES);
+	bench("site/device/track/4:get:chng", path, "get", "chng", MATCHES);
+	bench("site/*/track/*:get:*chng", path, "get", "chng", MATCHES);
+	bench("site/**/track/[0-9]:*:chng", path, "get", "chng", MATCHES);
+	bench("test/**:*:*", path, "get", "chng", MATCHES);
+
+	/* Deep path with multiple double wildcards that do not match */
+	char deep[256] = "";
+	for (int i = 0; i < 40; i++)
+		strcat(deep, "node/");
+	strcat(deep, "value");
+	bench("**/node/**/node/**/node/**/x:get", deep, "get", NULL, 100);
+	bench("**/*e/**/*e/**/*e/**/*e/**/x:get", deep, "get", NULL, 1);
+	return 0;
+}
@@ -0,0 +1,111 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <time.h>
+#include <obstack.h>
+#include <shv/rpcri.h>
+
+#include "config.h"
+
+/* Benchmark of the role access resolution.
+ *
+ * The configuration with a large role is generated and loaded. Access of the
+ * compiled tree is compared with matching every RI from the highest access
+ * level as shvcbroker did before.
+ */
+
+#define obstack_chunk_alloc malloc
+#define obstack_chunk_free free
+
+#define SITES (50)
+#define DEVICES (8)
+#define LOOKUPS (1000000)
+
+static double elapsed(struct timespec *start) {
+	struct timespec end;
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	return (end.tv_sec - start->tv_sec) +
+		(end.tv_nsec - start->tv_nsec) / 1000000000.;
+}
+
+static void write_ris(FILE *f, const char *access, const char *fmt) {
+	fprintf(f, "\"%s\":[", access);
+	for (unsigned s = 0; s < SITES; s++)
+		for (unsigned d = 0; d < DEVICES; d++) {
+			fprintf(f, s || d ? ",\"" : "\"");
+			fprintf(f, fmt, s, d);
+			fputc('"', f);
+		}
+	fputs("],", f);
+}
+
+static char *config(void) {
+	char *path = strdup("/tmp/benchmark-accesstree-XXXXXX");
+	FILE *f = fdopen(mkstemp(path), "w");
+	fputs("{\"roles\":{\"operator\":{\"access\":{", f);
+	fputs("\"bws\":[\"**:ls\",\"**:dir\",\".app:*\"],", f);
+	write_ris(f, "rd", "site%u/device%u/**:get");
+	write_ris(f, "wr", "site%u/device%u/config/*:set");
+	write_ris(f, "cmd", "site%u/device%u/track/*:reset");
+	write_ris(f, "srv", "site%u/device%u/fw:*");
+	fputs("\"su\":[\".broker/**:*\"]", f);
+	fputs("}}}}", f);
+	fclose(f);
+	return path;
+}
+
+static rpcaccess_t rpcaccess(
+	struct role *role, const char *path, const char *method) {
+	for (rpcaccess_t access = RPCACCESS_ADMIN; access > 0; access--)
+		if (role->ri_access[access])
+			for (char **ri = role->ri_access[access]; *ri; ri++)
+				if (rpcri_match(*ri, path, method, NULL))
+					return access;
+	return RPCACCESS_NONE;
+}
+
+int main(void) {
+	struct obstack obstack;
+	obstack_init(&obstack);
+	char *path = config();
+	struct config *conf = config_load(path, &obstack);
+	unlink(path);
+	free(path);
+	if (conf == NULL)
+		return 1;
+	struct role *role = config_get_role(conf, "operator");
+
+	static const char *const methods[] = {"ls", "get", "set", "reset", "name"};
+	char(*paths)[64] = malloc(LOOKUPS * sizeof *paths);
+	srand(42);
+	for (unsigned i = 0; i < LOOKUPS; i++) {
+		static const char *const nodes[] = {"", "/status", "/config/limit",
+			"/track/4", "/fw", "/unknown/node"};
+		snprintf(paths[i], sizeof *paths, "site%u/device%u%s", rand() % SITES,
+			rand() % (DEVICES * 2), nodes[rand() % 6]);
+	}
+
+	unsigned long sum = 0, lsum = 0;
+	struct timespec start;
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for (unsigned i = 0; i < LOOKUPS; i++)
+		sum += accesstree_access(role->access, paths[i], methods[i % 5]);
+	double ttree = elapsed(&start);
+
+	unsigned llookups = LOOKUPS / 100;
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for (unsigned i = 0; i < llookups; i++)
+		lsum += rpcaccess(role, paths[i], methods[i % 5]);
+	double tlinear = elapsed(&start);
+	for (unsigned i = 0; i < llookups; i++)
+		lsum -= accesstree_access(role->access, paths[i], methods[i % 5]);
+
+	printf("%u rules: tree %10.0f lookup/s, linear %10.0f lookup/s, "
+		   "%.2f avg access%s\n",
+		4 * SITES * DEVICES + 4, LOOKUPS / ttree, llookups / tlinear,
+		(double)sum / LOOKUPS, lsum == 0 ? "" : " (MISMATCH)");
+
+	free(paths);
+	obstack_free(&obstack, NULL);
+	return 0;
+}
@@ -47,11 +47,12 @@ async def test_shvcbroker_help(shvcbroker_exec):
     stdout, stderr = await subproc(*shvcbroker_exec, "-h")
     assert stdout == [b""]
     assert stderr == [
-        f"{shvcbroker_exec[-1]} [-vqdVh] [-c FILE]".encode(),
+        f"{shvcbroker_exec[-1]} [-vqdVh] [-c FILE] [-j NUM]".encode(),
         b"SHV RPC Broker.",
         b"",
         b"Arguments:",
         b"  -c FILE  Path to the configuration file",
+        b"  -j NUM   Number of threads handling clients",
         b"  -v       Increase logging level of the communication",
         b"  -q       Decrease logging level of the communication",
         b"  -d       Set maximal logging level of the communication",
@@ -22,9 +22,9 @@ from .device import Device
 logger = logging.getLogger(__name__)
 
 
-@pytest.fixture(name="shvcbroker")
-async def fixture_shvcbroker(shvcbroker_exec, tmp_path, url):
-    """SHVC broker."""
+@pytest.fixture(name="shvcbroker", params=[[], ["-j", "2"]], ids=["main", "threads"])
+async def fixture_shvcbroker(request, shvcbroker_exec, tmp_path, url):
+    """SHVC broker (handling clients in the main thread or in two threads)."""
     conf = tmp_path / "config.cpon"
     with conf.open("w") as file:
         file.write(
@@ -45,7 +45,7 @@ async def fixture_shvcbroker(shvcbroker_exec, tmp_path, url):
             })
         )
 
-    cmd = [shvcbroker_exec[0], *shvcbroker_exec[1:], "-d", "-c", conf]
+    cmd = [shvcbroker_exec[0], *shvcbroker_exec[1:], "-d", "-c", conf, *request.param]
     proc = await asyncio.create_subprocess_exec(*cmd)
 
     while True:
@@ -146,6 +146,12 @@ async def test_ls(client, device, path, result):
                 RpcDir(
                     name="disconnectClient", param="i", access=RpcAccess.SUPER_SERVICE
                 ),
+                RpcDir(
+                    name="signalCache",
+                    param="n",
+                    result="{i:hits,i:misses,i:size}",
+                    access=RpcAccess.SUPER_SERVICE,
+                ),
             ],
         ),
         (
@@ -204,7 +210,13 @@ async def test_dir_exists(client, path, method, result):
             ".broker/currentClient",
             "info",
             None,
-            {"clientId": 1, "role": "test", "subscriptions": {}, "userName": "test"},
+            {
+                "clientId": 1,
+                "role": "test",
+                "sendQueue": 0,
+                "subscriptions": {},
+                "userName": "test",
+            },
         ),
         (".broker/currentClient", "subscriptions", None, {}),
         ("test/device/value", "get", None, 42),
@@ -223,7 +235,13 @@ async def test_call(client, device, path, method, param, result):
             ".broker",
             "clientInfo",
             1,
-            {"clientId": 1, "role": "admin", "subscriptions": {}, "userName": "admin"},
+            {
+                "clientId": 1,
+                "role": "admin",
+                "sendQueue": 0,
+                "subscriptions": {},
+                "userName": "admin",
+            },
         ),
         (
             ".broker",
@@ -233,6 +251,7 @@ async def test_call(client, device, path, method, param, result):
                 "clientId": 2,
                 "mountPoint": "test/device",
                 "role": "test",
+                "sendQueue": 0,
                 "subscriptions": {},
                 "userName": "test",
             },
@@ -246,6 +265,7 @@ async def test_call(client, device, path, method, param, result):
                 "clientId": 2,
                 "mountPoint": "test/device",
                 "role": "test",
+                "sendQueue": 0,
                 "subscriptions": {},
                 "userName": "test",
             },
@@ -258,6 +278,7 @@ async def test_call(client, device, path, method, param, result):
                 "clientId": 2,
                 "mountPoint": "test/device",
                 "role": "test",
+                "sendQueue": 0,
                 "subscriptions": {},
                 "userName": "test",
             },
@@ -269,7 +290,13 @@ async def test_call(client, device, path, method, param, result):
             ".broker/currentClient",
             "info",
             None,
-            {"clientId": 1, "role": "admin", "subscriptions": {}, "userName": "admin"},
+            {
+                "clientId": 1,
+                "role": "admin",
+                "sendQueue": 0,
+                "subscriptions": {},
+                "userName": "admin",
+            },
         ),
     ),
 )
@@ -285,6 +312,7 @@ async def test_admin_call(admin_client, device, path, method, param, result):
         (".broker", "clientInfo"),
         (".broker", "mounts"),
         (".broker", "mountedClientInfo"),
+        (".broker", "signalCache"),
     ),
 )
 async def test_not_enough_access(client, path, method):
@@ -52,3 +52,21 @@ TEST(nbool, or) {
 	free(o);
 	free(v);
 }
+
+TEST(nbool, zero) {
+	nbool_t v = NULL;
+	nbool_zero(v);
+	nbool_set(&v, 3);
+	nbool_set(&v, 42);
+	nbool_unset(v, 3);
+	ck_assert(!nbool(v, 3));
+	ck_assert(nbool(v, 42));
+	nbool_unset(v, 42);
+	ck_assert_ptr_nonnull(v);
+	ck_assert_int_eq(v->cnt, 42 / NBOOL_N + 1);
+	nbool_set(&v, 8);
+	nbool_zero(v);
+	ck_assert_ptr_nonnull(v);
+	ck_assert(!nbool(v, 8));
+	free(v);
+}
@@ -0,0 +1,140 @@
+#include <stdlib.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdatomic.h>
+#include <poll.h>
+#include <shv/rpcbroker.h>
+#include <shv/rpcmsg.h>
+#include <shv/rpctransport.h>
+
+#define SUITE "rpcbroker_run"
+#include <check_suite.h>
+#include "tmpdir.h"
+
+#define QUEUE_LOW (1024)
+#define QUEUE_HIGH (8 * 1024)
+#define PARAM_SIZE (1024)
+#define MSGS (2048) /* Enough to not fit to the socket buffers */
+
+static rpcaccess_t access_admin(
+	void *cookie, const char *path, const char *method) {
+	return RPCACCESS_ADMIN;
+}
+
+static struct rpcbroker_login_res login(
+	void *cookie, const struct rpclogin *login, const char *nonce) {
+	return (struct rpcbroker_login_res){};
+}
+
+static const struct rpcbroker_role roles[] = {
+	{.name = "stalled", .access = access_admin, .mount_point = "test/stalled"},
+	{.name = "source", .access = access_admin},
+};
+
+static atomic_int registered;
+
+static int new_client(
+	void *cookie, rpcbroker_t broker, rpcserver_t server, rpcclient_t client) {
+	struct rpchandler_stage *stages = calloc(3, sizeof *stages);
+	rpchandler_t handler = rpchandler_new(client, stages, NULL);
+	int cid = rpcbroker_client_register(broker, handler, &stages[0], &stages[1],
+		&roles[atomic_load(&registered)]);
+	atomic_fetch_add(&registered, 1);
+	return cid;
+}
+
+static void del_client(void *cookie, rpcbroker_t broker, int cid) {
+	rpchandler_t handler = rpcbroker_client_handler(broker, cid);
+	rpcbroker_client_unregister(broker, cid);
+	rpcclient_t client = rpchandler_client(handler);
+	free((struct rpchandler_stage *)rpchandler_stages(handler));
+	rpchandler_destroy(handler);
+	rpcclient_destroy(client);
+}
+
+static volatile sig_atomic_t halt;
+static void wakeup(int sig) {}
+
+static void *broker_thread(void *arg) {
+	rpcbroker_run(arg, &halt);
+	return NULL;
+}
+
+static rpcclient_t connect_client(const char *location, int cnt) {
+	rpcclient_t c = rpcclient_unix_new(location, RPCSTREAM_P_BLOCK);
+	ck_assert_ptr_nonnull(c);
+	ck_assert(rpcclient_reset(c));
+	while (atomic_load(&registered) < cnt) {}
+	return c;
+}
+
+static void *source_thread(void *arg) {
+	rpcclient_t c = arg;
+	uint8_t param[PARAM_SIZE] = {};
+	for (int i = 0; i < MSGS; i++) {
+		cp_pack_t pack = rpcclient_pack(c);
+		rpcmsg_pack_request(pack, "test/stalled", "set", NULL, i + 1);
+		cp_pack_blob(pack, param, PARAM_SIZE);
+		cp_pack_container_end(pack);
+		ck_assert(rpcclient_sendmsg(c));
+	}
+	return NULL;
+}
+
+TEST_CASE(all, setup_tmpdir, teardown_tmpdir) {}
+
+TEST(all, stalled_reader) {
+	char *location = tmpdir_path("socket");
+	rpcserver_t s = rpcserver_unix_new(location, RPCSTREAM_P_BLOCK);
+	ck_assert_ptr_nonnull(s);
+	rpcbroker_t broker = rpcbroker_new("test", login, NULL, 0);
+	rpcbroker_queue_limits(
+		broker, QUEUE_LOW, QUEUE_HIGH, RPCBROKER_OVERFLOW_DROP);
+	struct rpcbroker_state state = {
+		.broker = broker,
+		.servers = &s,
+		.servers_cnt = 1,
+		.new_client = new_client,
+		.del_client = del_client,
+		.budget = 1,
+	};
+	atomic_store(&registered, 0);
+	halt = 0;
+	signal(SIGUSR1, wakeup);
+	pthread_t bthread;
+	pthread_create(&bthread, NULL, broker_thread, &state);
+
+	rpcclient_t stalled = connect_client(location, 1);
+	rpcclient_t source = connect_client(location, 2);
+	pthread_t sthread;
+	pthread_create(&sthread, NULL, source_thread, source);
+
+	/* Source is not read while destination has too much queued */
+	rpchandler_t handler = rpcbroker_client_handler(broker, 0);
+	for (int i = 0; i < 100; i++) {
+		ck_assert_uint_le(rpcclient_queued(rpchandler_client(handler)),
+			QUEUE_HIGH + 2 * PARAM_SIZE);
+		poll(NULL, 0, 10);
+	}
+
+	/* All requests are delivered once destination starts reading */
+	for (int i = 0; i < MSGS; i++) {
+		if (!rpcclient_pending(stalled)) {
+			struct pollfd pfd = {
+				.fd = rpcclient_pollfd(stalled), .events = POLLIN};
+			ck_assert_int_eq(poll(&pfd, 1, 1000), 1);
+		}
+		ck_assert_int_eq(rpcclient_nextmsg(stalled), RPCC_MESSAGE);
+		rpcclient_ignoremsg(stalled);
+	}
+	pthread_join(sthread, NULL);
+
+	halt = 1;
+	pthread_kill(bthread, SIGUSR1);
+	pthread_join(bthread, NULL);
+	rpcclient_destroy(stalled);
+	rpcclient_destroy(source);
+	rpcbroker_destroy(broker);
+	rpcserver_destroy(s);
+	free(location);
+}
@@ -0,0 +1,87 @@
+#include "sigcache.h"
+#include <stdio.h>
+
+#define SUITE "sigcache"
+#include <check_suite.h>
+
+static struct sigcache cache;
+
+static void setup(void) {
+	cache = (struct sigcache){};
+}
+
+static void teardown(void) {
+	sigcache_free(&cache);
+}
+
+TEST_CASE(entry, setup, teardown) {}
+
+TEST(entry, hit) {
+	bool hit;
+	struct sigcache_entry *e = sigcache_entry(
+		&cache, "test/device", "get", "chng", RPCACCESS_READ, &hit);
+	ck_assert(!hit);
+	nbool_set(&e->dest, 3);
+	e->any = true;
+	ck_assert_ptr_eq(sigcache_entry(&cache, "test/device", "get", "chng",
+						 RPCACCESS_READ, &hit),
+		e);
+	ck_assert(hit);
+	ck_assert(e->any);
+	ck_assert(nbool(e->dest, 3));
+	ck_assert_int_eq(cache.hits, 1);
+	ck_assert_int_eq(cache.misses, 1);
+}
+END_TEST
+
+TEST(entry, key) {
+	bool hit;
+	sigcache_entry(&cache, "test/device", "get", "chng", RPCACCESS_READ, &hit);
+	sigcache_entry(&cache, "test/device", "get", "chng", RPCACCESS_WRITE, &hit);
+	ck_assert(!hit);
+	sigcache_entry(&cache, "test/device", "get", NULL, RPCACCESS_READ, &hit);
+	ck_assert(!hit);
+	sigcache_entry(&cache, "test/device", "getchng", "", RPCACCESS_READ, &hit);
+	ck_assert(!hit);
+	sigcache_entry(&cache, "test", "device", "getchng", RPCACCESS_READ, &hit);
+	ck_assert(!hit);
+	sigcache_entry(&cache, "test/device", "get", NULL, RPCACCESS_READ, &hit);
+	ck_assert(hit);
+	ck_assert_int_eq(cache.cnt, 5);
+}
+END_TEST
+
+TEST(entry, invalidate) {
+	bool hit;
+	struct sigcache_entry *e = sigcache_entry(
+		&cache, "test/device", "get", "chng", RPCACCESS_READ, &hit);
+	nbool_set(&e->dest, 3);
+	e->any = true;
+	sigcache_invalidate(&cache);
+	ck_assert_ptr_eq(sigcache_entry(&cache, "test/device", "get", "chng",
+						 RPCACCESS_READ, &hit),
+		e);
+	ck_assert(!hit);
+	ck_assert(!e->any);
+	ck_assert(!nbool(e->dest, 3));
+}
+END_TEST
+
+TEST(entry, lru) {
+	bool hit;
+	char path[16];
+	for (int i = 0; i <= SIGCACHE_SIZE; i++) {
+		snprintf(path, sizeof path, "node%d", i);
+		sigcache_entry(&cache, path, "get", "chng", RPCACCESS_READ, &hit);
+		/* Keep the first one in use */
+		sigcache_entry(&cache, "node0", "get", "chng", RPCACCESS_READ, &hit);
+		ck_assert(hit || i == 0);
+	}
+	ck_assert_int_eq(cache.cnt, SIGCACHE_SIZE);
+	sigcache_entry(&cache, "node1", "get", "chng", RPCACCESS_READ, &hit);
+	ck_assert(!hit);
+	snprintf(path, sizeof path, "node%d", SIGCACHE_SIZE);
+	sigcache_entry(&cache, path, "get", "chng", RPCACCESS_READ, &hit);
+	ck_assert(hit);
+}
+END_TEST
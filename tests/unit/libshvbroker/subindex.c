@@ -0,0 +1,81 @@
+#include "subindex.h"
+#include <shv/rpcri.h>
+
+#define SUITE "subindex"
+#include <check_suite.h>
+
+static const char *const ris[] = {
+	"**:*:*",
+	"test/**:get:chng",
+	"test/*/status:*",
+	"test/device/status:get:*",
+	"te?t/device/**:*:*",
+	"test/[a-d]*/status:ls:lsmod",
+	"**/status:*:chng",
+	"other/**:*:*",
+	":*:*",
+};
+#define RIS_CNT (sizeof ris / sizeof *ris)
+
+static struct subscription subs[RIS_CNT];
+static struct subindex subidx;
+
+static void setup(void) {
+	subidx = (struct subindex){};
+	for (size_t i = 0; i < RIS_CNT; i++) {
+		subs[i] = (struct subscription){.ri = ris[i], .clients = NULL};
+		nbool_set(&subs[i].clients, i);
+		subindex_add(&subidx, &subs[i]);
+	}
+}
+
+static void teardown(void) {
+	for (size_t i = 0; i < RIS_CNT; i++) {
+		subindex_del(&subidx, &subs[i]);
+		free(subs[i].clients);
+	}
+	ck_assert_int_eq(subidx.trie.nodes_cnt, 0);
+	ck_assert_int_eq(subidx.trie.wilds_cnt, 0);
+	ck_assert_ptr_null(subidx.trie.globstar);
+	ck_assert_int_eq(subidx.trie.leafs_cnt, 0);
+	ck_assert_int_eq(subidx.linear_cnt, 0);
+}
+
+TEST_CASE(match, setup, teardown) {}
+
+static const struct {
+	const char *path;
+	const char *method;
+	const char *signal;
+} signals_d[] = {
+	{"test/device/status", "get", "chng"},
+	{"test/device/status", "ls", "lsmod"},
+	{"test", "get", "chng"},
+	{"testfoo", "get", "chng"},
+	{"test/device/value/status", "set", "chng"},
+	{"tesst/device", "get", "chng"},
+	{"", "get", "chng"},
+	{"other", "get", NULL},
+	{"status", "get", "chng"},
+};
+ARRAY_TEST(match, match_as_rpcri, signals_d) {
+	nbool_t dest = NULL;
+	subindex_match(&subidx, &dest, _d.path, _d.method, _d.signal);
+	for (size_t i = 0; i < RIS_CNT; i++)
+		ck_assert_msg(nbool(dest, i) ==
+				rpcri_match(ris[i], _d.path, _d.method, _d.signal),
+			"Invalid match of %s", ris[i]);
+	free(dest);
+}
+END_TEST
+
+TEST(match, unsubscribed) {
+	subindex_del(&subidx, &subs[0]);
+	nbool_t dest = NULL;
+	subindex_match(&subidx, &dest, "test/device/status", "get", "chng");
+	ck_assert(!nbool(dest, 0));
+	ck_assert(nbool(dest, 1));
+	free(dest);
+	subindex_add(&subidx, &subs[0]);
+}
+END_TEST
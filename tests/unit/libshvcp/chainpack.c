@@ -88,6 +88,31 @@ ARRAY_TEST(unpack, unpack_single, single_d) {
 }
 END_TEST
 
+ARRAY_TEST(pack, pack_single_buf, single_d) {
+	uint8_t buf[BUFSIZ];
+	ck_assert_int_eq(chainpack_pack_buf(buf, BUFSIZ, &_d.item), _d.cp.len);
+	ck_assert_mem_eq(buf, _d.cp.v, _d.cp.len);
+	ck_assert_int_eq(chainpack_pack_buf(NULL, 0, &_d.item), _d.cp.len);
+	ck_assert_int_eq(chainpack_pack_buf(buf, _d.cp.len - 1, &_d.item), -1);
+}
+END_TEST
+ARRAY_TEST(unpack, unpack_single_buf, single_d) {
+	uint8_t buf[BUFSIZ];
+	struct cpitem item = {.buf = buf, .bufsiz = BUFSIZ};
+	ck_assert_int_eq(chainpack_unpack_buf(_d.cp.v, _d.cp.len, &item), _d.cp.len);
+	ck_assert_item(item, _d.item);
+}
+END_TEST
+ARRAY_TEST(unpack, unpack_single_buf_truncated, single_d) {
+	uint8_t buf[BUFSIZ];
+	struct cpitem item = {.buf = buf, .bufsiz = BUFSIZ};
+	ck_assert_int_eq(
+		chainpack_unpack_buf(_d.cp.v, _d.cp.len - 1, &item), _d.cp.len - 1);
+	ck_assert_int_eq(item.type, CPITEM_INVALID);
+	ck_assert_int_eq(item.as.Error, CPERR_EOF);
+}
+END_TEST
+
 
 static const struct bdata skip_d[] = {
 	B(0x86, 0x03, 'f', 'o', 'o'),					   /* String */
@@ -103,3 +128,25 @@ ARRAY_TEST(unpack, skip) {
 	fclose(f);
 }
 END_TEST
+ARRAY_TEST(unpack, skip_buf, skip_d) {
+	struct cpitem item = {.buf = NULL, .bufsiz = BUFSIZ};
+	ck_assert_int_eq(chainpack_unpack_buf(_d.v, _d.len, &item), _d.len);
+}
+END_TEST
+
+TEST(unpack, unpack_cstring_parts_buf) {
+	const struct bdata d = B(0x8e, 'f', 'o', 'o', 0x00);
+	char buf[2];
+	struct cpitem item = {.chr = buf, .bufsiz = 2};
+	ck_assert_int_eq(chainpack_unpack_buf(d.v, d.len, &item), 3);
+	ck_assert_int_eq(item.type, CPITEM_STRING);
+	ck_assert_int_eq(item.as.String.len, 2);
+	ck_assert_int_eq(item.as.String.flags, CPBI_F_FIRST | CPBI_F_STREAM);
+	ck_assert_mem_eq(buf, "fo", 2);
+	ck_assert_int_eq(chainpack_unpack_buf(d.v + 3, d.len - 3, &item), 2);
+	ck_assert_int_eq(item.type, CPITEM_STRING);
+	ck_assert_int_eq(item.as.String.len, 1);
+	ck_assert_int_eq(item.as.String.flags, CPBI_F_STREAM | CPBI_F_LAST);
+	ck_assert_mem_eq(buf, "o", 1);
+}
+END_TEST
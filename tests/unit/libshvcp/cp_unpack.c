@@ -22,6 +22,16 @@ TEST(unpack, chainpack_unpack_null) {
 	unpack_free(unpack);
 }
 END_TEST
+TEST(unpack, chainpack_buf_unpack_null) {
+	struct bdata b = B(CPS_Null);
+	cp_unpack_t unpack = unpack_chainpack_buf(&b);
+	struct cpitem item = (struct cpitem){};
+	cp_unpack(unpack, &item);
+	ck_assert_item_type(item, CPITEM_NULL);
+	ck_assert_uint_eq(item.bufsiz, 0);
+	unpack_free(unpack);
+}
+END_TEST
 TEST(unpack, cpon_unpack_null) {
 	const char *str = "null";
 	cp_unpack_t unpack = unpack_cpon(str);
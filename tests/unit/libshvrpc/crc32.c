@@ -28,3 +28,37 @@ TEST(all, single_byte) {
 		ck_assert_int_eq(val, rval);
 	}
 }
+
+TEST(all, check_value) {
+	ck_assert_int_eq(crc32((uint8_t *)"123456789", 9), 0xcbf43926);
+}
+END_TEST
+
+/* Covers all calculation paths with different data alignments */
+#define DATA_SIZ (1024)
+static uint8_t *test_data(void) {
+	static uint8_t data[DATA_SIZ];
+	for (size_t i = 0; i < DATA_SIZ; i++)
+		data[i] = (i * 2654435761U) >> 13;
+	return data;
+}
+
+TEST(all, lengths) {
+	uint8_t *data = test_data();
+	for (size_t off = 0; off < 16; off++)
+		for (size_t len = 0; len <= DATA_SIZ - off; len += len < 300 ? 1 : 97)
+			ck_assert_int_eq(crc32_update(crc32_init(), data + off, len),
+				refcupdate(crc32_init(), data + off, len));
+}
+END_TEST
+
+TEST(all, combine) {
+	uint8_t *data = test_data();
+	uint32_t crc = crc32(data, DATA_SIZ);
+	for (size_t split = 0; split <= DATA_SIZ; split += 31)
+		ck_assert_int_eq(crc32_combine(crc32(data, split),
+							 crc32(data + split, DATA_SIZ - split),
+							 DATA_SIZ - split),
+			crc);
+}
+END_TEST
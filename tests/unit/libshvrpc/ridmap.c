@@ -0,0 +1,48 @@
+#include <stdlib.h>
+#include <ridmap.h>
+
+#define SUITE "ridmap"
+#include <check_suite.h>
+
+
+TEST_CASE(all) {}
+
+TEST(all, single) {
+	struct ridmap map = {};
+	int value;
+	ck_assert(!ridmap_has(&map, 4));
+	ck_assert_ptr_null(ridmap_get(&map, 4));
+	ck_assert(!ridmap_del(&map, 4));
+	ck_assert(ridmap_add(&map, 4, &value));
+	ck_assert(!ridmap_add(&map, 4, NULL));
+	ck_assert_int_eq(map.cnt, 1);
+	ck_assert(ridmap_has(&map, 4));
+	ck_assert_ptr_eq(ridmap_get(&map, 4), &value);
+	ck_assert(!ridmap_has(&map, 5));
+	ck_assert_ptr_null(ridmap_get(&map, 5));
+	ck_assert(ridmap_del(&map, 4));
+	ck_assert(!ridmap_has(&map, 4));
+	ck_assert_ptr_null(ridmap_get(&map, 4));
+	ck_assert_int_eq(map.cnt, 0);
+	ridmap_free(&map);
+}
+END_TEST
+
+/* Remove every third ID and check that the rest is still reachable */
+TEST(all, many) {
+	static int values[10001];
+	struct ridmap map = {};
+	for (int i = 1; i <= 10000; i++)
+		ck_assert(ridmap_add(&map, i * 7, &values[i]));
+	for (int i = 1; i <= 10000; i += 3)
+		ck_assert(ridmap_del(&map, i * 7));
+	for (int i = 1; i <= 10000; i++) {
+		ck_assert(ridmap_has(&map, i * 7) == (i % 3 != 1));
+		ck_assert_ptr_eq(
+			ridmap_get(&map, i * 7), i % 3 != 1 ? &values[i] : NULL);
+		ck_assert(!ridmap_has(&map, i * 7 + 1));
+	}
+	ck_assert_int_eq(map.cnt, 6666);
+	ridmap_free(&map);
+}
+END_TEST
@@ -0,0 +1,107 @@
+#include <riindex.h>
+
+#define SUITE "riindex"
+#include <check_suite.h>
+
+
+TEST_CASE(all) {}
+
+static const char *const ris[] = {
+	"test/device/track:get:chng",
+	"test/device/*:get:chng",
+	"test/*/track:*:*",
+	"test/**:get:*",
+	"**:*:*",
+	"test/device/track:*",
+	"test/dev?ce/track:get:chng",
+	"test/[a-z]*/track:get:chng",
+	"test/device**:get:chng",
+	"test/device/track/**:get:chng",
+	"other:get:chng",
+};
+
+static const struct {
+	const char *path;
+	const char *source;
+	const char *signal;
+} match_d[] = {
+	{"test/device/track", "get", "chng"},
+	{"test/device/track", "get", "mod"},
+	{"test/device/track", "set", "chng"},
+	{"test/device/other", "get", "chng"},
+	{"test/devices/track", "get", "chng"},
+	{"test/device", "get", "chng"},
+	{"test", "get", "chng"},
+	{"test/device/track/sub", "get", "chng"},
+	{"other", "get", "chng"},
+	{"other", "get", "mod"},
+	{".app", "name", "chng"},
+	{"", "get", "chng"},
+};
+/* Index with a single RI matches the same way as rpcri_match */
+ARRAY_TEST(all, match) {
+	for (size_t i = 0; i < sizeof ris / sizeof *ris; i++) {
+		struct riindex index = {};
+		ck_assert(riindex_add(&index, ris[i], (void *)ris[i]));
+		void *res = riindex_match(&index, _d.path, _d.source, _d.signal);
+		if (rpcri_match(ris[i], _d.path, _d.source, _d.signal))
+			ck_assert_msg(res == ris[i], "%s", ris[i]);
+		else
+			ck_assert_msg(res == NULL, "%s", ris[i]);
+		riindex_free(&index);
+	}
+}
+END_TEST
+
+/* Index with all RIs matches the one with the most literal path nodes */
+static const struct {
+	const char *path;
+	const char *source;
+	const char *signal;
+	const char *ri;
+} prefer_d[] = {
+	{"test/device/track", "get", "chng", "test/device/track:get:chng"},
+	{"test/device/track", "set", "chng", "test/device/track:*"},
+	{"test/device/track", "get", "mod", "test/device/track:*"},
+	{"test/device/other", "get", "chng", "test/device/*:get:chng"},
+	{"test/other/track", "set", "chng", "test/*/track:*:*"},
+	{"test/other/track", "get", "chng", "test/*/track:*:*"},
+	{"test/other", "get", "chng", "test/**:get:*"},
+	{"test/device/track/sub", "get", "chng", "test/device/track/**:get:chng"},
+	{"test/devicex", "get", "chng", "test/**:get:*"},
+	{"test/devicex", "set", "chng", "**:*:*"},
+	{"other", "get", "chng", "other:get:chng"},
+	{".app", "name", "chng", "**:*:*"},
+};
+ARRAY_TEST(all, prefer) {
+	struct riindex index = {};
+	for (size_t i = 0; i < sizeof ris / sizeof *ris; i++)
+		ck_assert(riindex_add(&index, ris[i], (void *)ris[i]));
+	const char *res = riindex_match(&index, _d.path, _d.source, _d.signal);
+	ck_assert_pstr_eq(res, _d.ri);
+	riindex_free(&index);
+}
+END_TEST
+
+TEST(all, del) {
+	struct riindex index = {};
+	int a, b;
+	ck_assert(!riindex_add(&index, "invalid", &a));
+	ck_assert(riindex_add(&index, "test/**:*:*", &a));
+	ck_assert(riindex_add(&index, "test/**:*:*", &b));
+	ck_assert(riindex_add(&index, "test/dev?ce:*:*", &a));
+	ck_assert_ptr_eq(riindex_match(&index, "test/device", "get", "chng"), &a);
+	ck_assert(riindex_del(&index, "test/**:*:*", &a));
+	ck_assert(!riindex_del(&index, "test/**:*:*", &a));
+	ck_assert(!riindex_del(&index, "test/*:*:*", &b));
+	ck_assert(!riindex_del(&index, "invalid", &b));
+	ck_assert_ptr_eq(riindex_match(&index, "test/device", "get", "chng"), &b);
+	ck_assert(riindex_del(&index, "test/**:*:*", &b));
+	ck_assert_ptr_eq(riindex_match(&index, "test/device", "get", "chng"), &a);
+	ck_assert(riindex_del(&index, "test/dev?ce:*:*", &a));
+	ck_assert_ptr_null(riindex_match(&index, "test/device", "get", "chng"));
+	ck_assert_ptr_null(index.trie.nodes);
+	ck_assert_ptr_null(index.linear);
+	riindex_free(&index);
+}
+END_TEST
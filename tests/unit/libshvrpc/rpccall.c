@@ -0,0 +1,186 @@
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <shv/rpccall.h>
+#include <shv/rpcclient_stream.h>
+#include <shv/rpctransport.h>
+#define obstack_chunk_alloc malloc
+#define obstack_chunk_free free
+
+#define SUITE "rpccall"
+#include <check_suite.h>
+
+#define CALLS (1000)
+/* Every call with index divisible by this number is not responded to on the
+ * first attempt.
+ */
+#define LOSSY (7)
+/* Call that is never responded to */
+#define LOST (CALLS - 1)
+
+static const struct rpcclient_stream_funcs sfuncs = {};
+
+static rpchandler_t handler;
+static rpchandler_responses_t responses;
+static struct rpchandler_stage stages[2];
+static rpcclient_t peer;
+static pthread_t handler_thread, peer_thread;
+
+/* Peer receives requests and responds to them in the reverse order once it
+ * receives all first attempts. The retries are responded to right away. It
+ * terminates once it receives request for the method "stop".
+ */
+static void *responder(void *arg) {
+	static int rids[CALLS];
+	static int params[CALLS];
+	bool seen[CALLS] = {};
+	struct obstack obstack;
+	obstack_init(&obstack);
+	void *obase = obstack_alloc(&obstack, 0);
+	struct pollfd pfd = {.fd = rpcclient_pollfd(peer), .events = POLLIN};
+	int cnt = 0;
+	bool stop = false;
+	while (!stop) {
+		if (!rpcclient_pending(peer))
+			poll(&pfd, 1, -1);
+		if (rpcclient_nextmsg(peer) != RPCC_MESSAGE)
+			continue;
+		struct cpitem item;
+		cpitem_unpack_init(&item);
+		struct rpcmsg_meta meta;
+		int param = -1;
+		if (!rpcmsg_head_unpack(
+				rpcclient_unpack(peer), &item, &meta, NULL, &obstack))
+			goto next;
+		stop = !strcmp(meta.method, "stop");
+		cp_unpack_int(rpcclient_unpack(peer), &item, param);
+		if (!rpcclient_validmsg(peer) || param < 0 || param >= CALLS)
+			goto next;
+		bool first = !seen[param];
+		seen[param] = true;
+		if (param == LOST || (first && param % LOSSY == 0))
+			goto next;
+		rids[cnt] = meta.request_id;
+		params[cnt++] = param;
+		if (first && cnt < CALLS - (CALLS - 1) / LOSSY - 2)
+			goto next;
+		for (int i = cnt - 1; i >= 0; i--) {
+			cp_pack_t pack = rpcclient_pack(peer);
+			struct rpcmsg_meta meta = {.request_id = rids[i]};
+			rpcmsg_pack_response(pack, &meta);
+			cp_pack_int(pack, params[i] * 2);
+			cp_pack_container_end(pack);
+			rpcclient_sendmsg(peer);
+		}
+		cnt = 0;
+next:
+		obstack_free(&obstack, obase);
+	}
+	obstack_free(&obstack, NULL);
+	return NULL;
+}
+
+static void setup(void) {
+	int pipes[2];
+	rpcclient_t client = rpcclient_pipe_new(pipes, RPCSTREAM_P_BLOCK);
+	fcntl(pipes[1], F_SETFL, 0);
+	peer = rpcclient_stream_new(
+		&sfuncs, NULL, RPCSTREAM_P_BLOCK, pipes[0], pipes[1]);
+	responses = rpchandler_responses_new();
+	stages[0] = rpchandler_responses_stage(responses);
+	stages[1] = (struct rpchandler_stage){};
+	handler = rpchandler_new(client, stages, NULL);
+	rpchandler_spawn_thread(handler, &handler_thread, NULL);
+	pthread_create(&peer_thread, NULL, responder, NULL);
+}
+
+static void teardown(void) {
+	cp_pack_t pack = rpchandler_msg_new(handler);
+	rpcmsg_pack_request_void(pack, "test", "stop", NULL, 1);
+	rpchandler_msg_send(handler);
+	pthread_join(peer_thread, NULL);
+	/* Handler's thread terminates on disconnect */
+	rpcclient_destroy(peer);
+	pthread_join(handler_thread, NULL);
+	rpcclient_t client = rpchandler_client(handler);
+	rpchandler_destroy(handler);
+	rpchandler_responses_destroy(responses);
+	rpcclient_destroy(client);
+}
+
+TEST_CASE(all, setup, teardown) {}
+
+
+struct calls {
+	int results[CALLS];
+	int requests[CALLS];
+};
+
+static int call_func(enum rpccall_stage stage, struct rpccall_ctx *ctx) {
+	struct calls *calls = ctx->cookie;
+	switch (stage) {
+		case CALL_S_REQUEST:
+			calls->requests[ctx->index]++;
+			rpcmsg_pack_request(
+				ctx->pack, "test", "get", NULL, ctx->request_id);
+			cp_pack_int(ctx->pack, ctx->index);
+			cp_pack_container_end(ctx->pack);
+			break;
+		case CALL_S_RESULT:
+			cp_unpack_int(ctx->unpack, ctx->item, calls->results[ctx->index]);
+			break;
+		case CALL_S_DONE:
+			return ctx->errnum == RPCERR_NO_ERROR ? 1 : 2;
+		case CALL_S_COMERR:
+			return 3;
+		case CALL_S_TIMERR:
+			return 4;
+	}
+	return 0;
+}
+
+TEST(all, many) {
+	static struct calls calls;
+	int results[CALLS];
+	ck_assert_uint_eq(rpccall_many(handler, responses, call_func, &calls,
+						  CALLS, results, 3, 200),
+		CALLS - 1);
+	for (int i = 0; i < CALLS; i++) {
+		if (i == LOST) {
+			ck_assert_int_eq(results[i], 4);
+			ck_assert_int_eq(calls.requests[i], 3);
+			continue;
+		}
+		ck_assert_int_eq(results[i], 1);
+		ck_assert_int_eq(calls.results[i], i * 2);
+		ck_assert_int_eq(calls.requests[i], i % LOSSY ? 1 : 2);
+	}
+}
+END_TEST
+
+TEST(all, single) {
+	static struct calls calls;
+	ck_assert_int_eq(rpccall(handler, responses, call_func, &calls, 3, 200), 1);
+	ck_assert_int_eq(calls.results[0], 0);
+	ck_assert_int_eq(calls.requests[0], 2);
+}
+END_TEST
+
+static bool clash_callback(struct rpchandler_msg *ctx, void *cookie) {
+	return true;
+}
+
+TEST(all, request_id_clash) {
+	static struct calls calls;
+	int request_id = rpchandler_next_request_id(handler);
+	rpchandler_release_request_id(handler, request_id);
+	/* The next request ID is already expected by someone else */
+	ck_assert(rpcresponse_expect_async(
+		responses, request_id + 1, clash_callback, NULL));
+	ck_assert_int_eq(rpccall(handler, responses, call_func, &calls, 3, 200), 3);
+	ck_assert_int_eq(calls.requests[0], 0);
+	ck_assert(rpcresponse_cancel(responses, request_id + 1));
+}
+END_TEST
@@ -212,6 +212,32 @@ TEST(block, block_send_reset) {
 }
 END_TEST
 
+TEST(block, block_pending) {
+	create_client(RPCSTREAM_P_BLOCK, &block_3msgs);
+	ck_assert(!rpcclient_pending(client));
+	ck_assert_int_eq(rpcclient_nextmsg(client), RPCC_MESSAGE);
+	ck_assert(rpcclient_validmsg(client));
+	ck_assert(rpcclient_pending(client));
+	ck_assert_int_eq(rpcclient_nextmsg(client), RPCC_MESSAGE);
+	/* The unread message must be skipped */
+	ck_assert(rpcclient_pending(client));
+	ck_assert_int_eq(rpcclient_nextmsg(client), RPCC_MESSAGE);
+	ck_assert(rpcclient_validmsg(client));
+	ck_assert(!rpcclient_pending(client));
+}
+END_TEST
+
+TEST(block, block_rawfwd) {
+	create_client(RPCSTREAM_P_BLOCK, &long_text_block_msg);
+	ck_assert(rpcclient_rawfwd_possible(client, client));
+	ck_assert_int_eq(rpcclient_nextmsg(client), RPCC_MESSAGE);
+	ck_assert(rpcclient_rawfwd(client, client));
+	ck_assert(rpcclient_validmsg(client));
+	ck_assert(rpcclient_sendmsg(client));
+	ck_assert_clientres(long_text_block_msg);
+}
+END_TEST
+
 TEST(block, block_pollfd) {
 	create_client(RPCSTREAM_P_BLOCK, NULL);
 	ck_assert_int_ne(rpcclient_pollfd(client), 0);
@@ -265,6 +291,21 @@ TEST(serial, serial_receive) {
 }
 END_TEST
 
+TEST(serial, serial_pending) {
+	create_client(RPCSTREAM_P_SERIAL, &serial_3msg);
+	ck_assert(!rpcclient_pending(client));
+	ck_assert_int_eq(rpcclient_nextmsg(client), RPCC_MESSAGE);
+	ck_assert(rpcclient_validmsg(client));
+	ck_assert(rpcclient_pending(client));
+	ck_assert_int_eq(rpcclient_nextmsg(client), RPCC_MESSAGE);
+	ck_assert(rpcclient_validmsg(client));
+	ck_assert(rpcclient_pending(client));
+	ck_assert_int_eq(rpcclient_nextmsg(client), RPCC_MESSAGE);
+	ck_assert(rpcclient_validmsg(client));
+	ck_assert(!rpcclient_pending(client));
+}
+END_TEST
+
 /* This checks that aborted message is invalid even if validly received. */
 static const struct bdata serial_msgabort = B(0xa2, 0x01, 0x6a, 0xa4);
 TEST(serial, serial_receive_abort) {
@@ -329,6 +370,16 @@ TEST(serial, serial_send) {
 }
 END_TEST
 
+TEST(serial, serial_rawfwd) {
+	create_client(RPCSTREAM_P_SERIAL, &serial_escmsg);
+	ck_assert_int_eq(rpcclient_nextmsg(client), RPCC_MESSAGE);
+	ck_assert(rpcclient_rawfwd(client, client));
+	ck_assert(rpcclient_validmsg(client));
+	ck_assert(rpcclient_sendmsg(client));
+	ck_assert_clientres(serial_escmsg);
+}
+END_TEST
+
 TEST(serial, serial_drop) {
 	create_client(RPCSTREAM_P_SERIAL, NULL);
 	ck_assert(cp_pack_int(rpcclient_pack(client), 42));
@@ -449,6 +500,36 @@ TEST(serial_crc, serial_crc_drop) {
 }
 END_TEST
 
+/* Spans multiple write buffers and contains all special bytes */
+#define LARGE_SIZ (3 * BUFSIZ + 7)
+TEST(serial_crc, serial_crc_large) {
+	uint8_t *data = malloc(LARGE_SIZ);
+	for (size_t i = 0; i < LARGE_SIZ; i++)
+		data[i] = i * 7;
+	create_client(RPCSTREAM_P_SERIAL_CRC, NULL);
+	ck_assert(cp_pack_blob(rpcclient_pack(client), data, LARGE_SIZ));
+	ck_assert(rpcclient_sendmsg(client));
+	finalize_client();
+
+	struct bdata sent = clientres;
+	clientres = (struct bdata){};
+	create_client(RPCSTREAM_P_SERIAL_CRC, &sent);
+	ck_assert_int_eq(rpcclient_nextmsg(client), RPCC_MESSAGE);
+	struct cpitem item;
+	cpitem_unpack_init(&item);
+	uint8_t *rdata;
+	size_t rsiz;
+	cp_unpack_memdup(rpcclient_unpack(client), &item, &rdata, &rsiz);
+	ck_assert_int_eq(item.type, CPITEM_BLOB);
+	ck_assert(rpcclient_validmsg(client));
+	finalize_client();
+	ck_assert_bdata(rdata, rsiz, ((struct bdata){data, LARGE_SIZ}));
+	free(rdata);
+	free(data);
+	free((uint8_t *)sent.v);
+}
+END_TEST
+
 TEST(serial_crc, serial_crc_send_reset) {
 	create_client(RPCSTREAM_P_SERIAL_CRC, NULL);
 	ck_assert(rpcclient_reset(client));
@@ -1,3 +1,4 @@
+#include <string.h>
 #include <shv/rpcdir.h>
 #define obstack_chunk_alloc malloc
 #define obstack_chunk_free free
@@ -49,6 +50,39 @@ TEST(pack, pack_dir) {
 }
 
 
+TEST_CASE(packed) {}
+
+static void packed_test(const struct rpcdir *dir) {
+	struct rpcdir_packed packed = {.method = dir};
+	size_t len;
+	const uint8_t *data = rpcdir_packed(&packed, &len);
+	ck_assert_ptr_nonnull(data);
+	uint8_t buf[BUFSIZ];
+	struct cp_pack_buf pbuf;
+	rpcdir_pack(cp_pack_buf_init(&pbuf, buf, BUFSIZ), dir);
+	ck_assert_int_eq(len, pbuf.ptr - buf);
+	ck_assert_mem_eq(data, buf, len);
+	/* The second call provides the cached data */
+	size_t len2;
+	ck_assert_ptr_eq(rpcdir_packed(&packed, &len2), data);
+	ck_assert_int_eq(len2, len);
+	rpcdir_packed_free(&packed);
+	ck_assert_ptr_null(packed.packed);
+}
+
+ARRAY_TEST(packed, packed, pairs_d) {
+	packed_test(&_d.dir);
+}
+
+TEST(packed, packed_long) {
+	char param[BUFSIZ / 2];
+	memset(param, 'x', sizeof param - 1);
+	param[sizeof param - 1] = '\0';
+	packed_test(&(struct rpcdir){
+		.name = "long", .param = param, .access = RPCACCESS_READ});
+}
+
+
 TEST_CASE(unpack) {}
 
 static void unpacker_test(struct cpondir _d) {
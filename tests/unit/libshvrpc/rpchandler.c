@@ -0,0 +1,238 @@
+#include <stdlib.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <shv/rpchandler.h>
+#include <shv/rpchandler_responses.h>
+#include <shv/rpcclient_stream.h>
+#include <shv/rpctransport.h>
+#define obstack_chunk_alloc malloc
+#define obstack_chunk_free free
+
+#define SUITE "rpchandler"
+#include <check_suite.h>
+
+#define INFLIGHT (10000)
+
+static const struct rpcclient_stream_funcs sfuncs = {};
+
+static rpchandler_t handler;
+static rpchandler_responses_t responses;
+static struct rpchandler_stage stages[2];
+static rpcclient_t peer;
+
+static void setup(void) {
+	int pipes[2];
+	rpcclient_t client = rpcclient_pipe_new(pipes, RPCSTREAM_P_BLOCK);
+	fcntl(pipes[1], F_SETFL, 0);
+	peer = rpcclient_stream_new(
+		&sfuncs, NULL, RPCSTREAM_P_BLOCK, pipes[0], pipes[1]);
+	responses = rpchandler_responses_new();
+	stages[0] = rpchandler_responses_stage(responses);
+	stages[1] = (struct rpchandler_stage){};
+	handler = rpchandler_new(client, stages, NULL);
+}
+
+static void teardown(void) {
+	rpcclient_t client = rpchandler_client(handler);
+	rpchandler_destroy(handler);
+	rpchandler_responses_destroy(responses);
+	rpcclient_destroy(client);
+	rpcclient_destroy(peer);
+}
+
+TEST_CASE(all, setup, teardown) {}
+
+
+static int cmpint(const void *a, const void *b) {
+	return *(const int *)a - *(const int *)b;
+}
+
+static void *allocate_ids(void *arg) {
+	int *ids = arg;
+	for (int i = 0; i < INFLIGHT; i++)
+		ids[i] = rpchandler_next_request_id(handler);
+	return NULL;
+}
+
+TEST(all, request_id_unique) {
+	static int ids[4][INFLIGHT];
+	pthread_t threads[4];
+	for (int i = 0; i < 4; i++)
+		pthread_create(&threads[i], NULL, allocate_ids, ids[i]);
+	for (int i = 0; i < 4; i++)
+		pthread_join(threads[i], NULL);
+	int *all = &ids[0][0];
+	qsort(all, 4 * INFLIGHT, sizeof *all, cmpint);
+	ck_assert_int_ge(all[0], 4);
+	for (int i = 1; i < 4 * INFLIGHT; i++)
+		ck_assert_int_ne(all[i - 1], all[i]);
+	for (int i = 0; i < 4 * INFLIGHT; i++)
+		rpchandler_release_request_id(handler, all[i]);
+}
+END_TEST
+
+
+static bool response_callback(struct rpchandler_msg *ctx, void *cookie) {
+	int *received = cookie;
+	int value = -1;
+	if (rpcmsg_has_value(ctx->item))
+		cp_unpack_int(ctx->unpack, ctx->item, value);
+	if (!rpchandler_msg_valid(ctx))
+		return false;
+	ck_assert_int_eq(value, ctx->meta.request_id);
+	(*received)++;
+	return true;
+}
+
+/* Peer receives all requests first and only then it responds to them in the
+ * reverse order.
+ */
+static void *responder(void *arg) {
+	static int rids[INFLIGHT];
+	struct obstack obstack;
+	obstack_init(&obstack);
+	void *obase = obstack_alloc(&obstack, 0);
+	struct pollfd pfd = {.fd = rpcclient_pollfd(peer), .events = POLLIN};
+	int cnt = 0;
+	while (cnt < INFLIGHT) {
+		if (!rpcclient_pending(peer))
+			poll(&pfd, 1, -1);
+		if (rpcclient_nextmsg(peer) != RPCC_MESSAGE)
+			continue;
+		struct cpitem item;
+		cpitem_unpack_init(&item);
+		struct rpcmsg_meta meta;
+		if (rpcmsg_head_unpack(rpcclient_unpack(peer), &item, &meta, NULL,
+				&obstack) &&
+			rpcclient_validmsg(peer))
+			rids[cnt++] = meta.request_id;
+		obstack_free(&obstack, obase);
+	}
+	for (int i = INFLIGHT - 1; i >= 0; i--) {
+		cp_pack_t pack = rpcclient_pack(peer);
+		struct rpcmsg_meta meta = {.request_id = rids[i]};
+		rpcmsg_pack_response(pack, &meta);
+		cp_pack_int(pack, rids[i]);
+		cp_pack_container_end(pack);
+		rpcclient_sendmsg(peer);
+	}
+	obstack_free(&obstack, NULL);
+	return NULL;
+}
+
+TEST(all, inflight) {
+	pthread_t thread;
+	pthread_create(&thread, NULL, responder, NULL);
+	static rpcresponse_t resp[INFLIGHT];
+	int received = 0;
+	for (int i = 0; i < INFLIGHT; i++) {
+		resp[i] = rpcresponse_send_request_void(handler, responses, "test",
+			"get", NULL, response_callback, &received);
+		ck_assert_ptr_nonnull(resp[i]);
+	}
+	struct pollfd pfd = {
+		.fd = rpcclient_pollfd(rpchandler_client(handler)), .events = POLLIN};
+	while (received < INFLIGHT) {
+		ck_assert_int_eq(poll(&pfd, 1, 5000), 1);
+		ck_assert(rpchandler_next(handler));
+	}
+	pthread_join(thread, NULL);
+	for (int i = 0; i < INFLIGHT; i++)
+		ck_assert(rpcresponse_waitfor(resp[i], 0));
+}
+END_TEST
+
+TEST(all, inflight_async) {
+	pthread_t thread;
+	pthread_create(&thread, NULL, responder, NULL);
+	int received = 0;
+	int cancelled = 0;
+	for (int i = 0; i < INFLIGHT; i++) {
+		int request_id = rpchandler_next_request_id(handler);
+		ck_assert(rpcresponse_expect_async(
+			responses, request_id, response_callback, &received));
+		ck_assert(!rpcresponse_expect_async(
+			responses, request_id, response_callback, &received));
+		cp_pack_t pack = rpchandler_msg_new(handler);
+		ck_assert(
+			rpcmsg_pack_request_void(pack, "test", "get", NULL, request_id));
+		ck_assert(rpchandler_msg_send(handler));
+		if (i % 100 == 0) {
+			ck_assert(rpcresponse_cancel(responses, request_id));
+			rpchandler_release_request_id(handler, request_id);
+			cancelled++;
+		}
+	}
+	struct pollfd pfd = {
+		.fd = rpcclient_pollfd(rpchandler_client(handler)), .events = POLLIN};
+	while (received < INFLIGHT - cancelled) {
+		ck_assert_int_eq(poll(&pfd, 1, 5000), 1);
+		ck_assert(rpchandler_next(handler));
+	}
+	pthread_join(thread, NULL);
+	ck_assert_int_eq(received, INFLIGHT - cancelled);
+	ck_assert(!rpcresponse_cancel(responses, 4));
+}
+END_TEST
+
+static void send_response(int request_id, intmax_t *cids, size_t cids_cnt) {
+	cp_pack_t pack = rpcclient_pack(peer);
+	struct rpcmsg_meta meta = {
+		.request_id = request_id, .cids = cids, .cids_cnt = cids_cnt};
+	rpcmsg_pack_response(pack, &meta);
+	cp_pack_int(pack, request_id);
+	cp_pack_container_end(pack);
+	ck_assert(rpcclient_sendmsg(peer));
+}
+
+TEST(all, response_cids) {
+	int received = 0;
+	int request_id = rpchandler_next_request_id(handler);
+	ck_assert(rpcresponse_expect_async(
+		responses, request_id, response_callback, &received));
+	/* Response with caller IDs is for someone else */
+	send_response(request_id, (intmax_t[]){3}, 1);
+	ck_assert(rpchandler_next(handler));
+	ck_assert_int_eq(received, 0);
+	send_response(request_id, NULL, 0);
+	ck_assert(rpchandler_next(handler));
+	ck_assert_int_eq(received, 1);
+}
+END_TEST
+
+TEST(all, send_request) {
+	int received = 0;
+	rpcresponse_t response;
+	rpcresponse_send_request(handler, responses, "test", "set", NULL,
+		response_callback, &received, response) {
+		cp_pack_int(packer, 42);
+	}
+	ck_assert_ptr_nonnull(response);
+	ck_assert_int_eq(rpcclient_nextmsg(peer), RPCC_MESSAGE);
+	struct obstack obstack;
+	obstack_init(&obstack);
+	struct cpitem item;
+	cpitem_unpack_init(&item);
+	struct rpcmsg_meta meta;
+	ck_assert(rpcmsg_head_unpack(
+		rpcclient_unpack(peer), &item, &meta, NULL, &obstack));
+	int value;
+	ck_assert(cp_unpack_int(rpcclient_unpack(peer), &item, value));
+	ck_assert_int_eq(value, 42);
+	ck_assert(rpcclient_validmsg(peer));
+	ck_assert_int_eq(meta.type, RPCMSG_T_REQUEST);
+	ck_assert_str_eq(meta.method, "set");
+	send_response(meta.request_id, NULL, 0);
+	obstack_free(&obstack, NULL);
+	ck_assert(rpchandler_next(handler));
+	ck_assert(rpcresponse_waitfor(response, 0));
+	ck_assert_int_eq(received, 1);
+
+	rpcresponse_send_request(handler, responses, "test", "set", NULL,
+		response_callback, &received, response) {
+		break;
+	}
+	ck_assert_ptr_null(response);
+}
+END_TEST
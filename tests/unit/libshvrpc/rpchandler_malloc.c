@@ -0,0 +1,144 @@
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <obstack.h>
+#include <shv/rpchandler.h>
+#include <shv/rpchandler_impl.h>
+#include <shv/rpcclient_stream.h>
+#include <shv/rpctransport.h>
+
+#define SUITE "rpchandler_malloc"
+#include <check_suite.h>
+
+/* This checks that RPC Handler doesn't allocate memory in steady state. The
+ * allocations are counted with linker's wrap option only while handler
+ * processes the message.
+ */
+
+#define obstack_chunk_alloc malloc
+#define obstack_chunk_free free
+
+static _Thread_local bool counting = false;
+static unsigned long allocs;
+
+void *__real_malloc(size_t size);
+void *__wrap_malloc(size_t size) {
+	if (counting)
+		allocs++;
+	return __real_malloc(size);
+}
+
+void *__real_calloc(size_t nmemb, size_t size);
+void *__wrap_calloc(size_t nmemb, size_t size) {
+	if (counting)
+		allocs++;
+	return __real_calloc(nmemb, size);
+}
+
+void *__real_realloc(void *ptr, size_t size);
+void *__wrap_realloc(void *ptr, size_t size) {
+	if (counting)
+		allocs++;
+	return __real_realloc(ptr, size);
+}
+
+
+static enum rpchandler_msg_res echo_msg(
+	void *cookie, struct rpchandler_msg *ctx) {
+	if (ctx->meta.type != RPCMSG_T_REQUEST || strcmp(ctx->meta.method, "echo"))
+		return RPCHANDLER_MSG_SKIP;
+	char *str = NULL;
+	if (rpcmsg_has_value(ctx->item))
+		str = cp_unpack_strdupo(
+			ctx->unpack, ctx->item, rpchandler_obstack(ctx));
+	if (!rpchandler_msg_valid(ctx))
+		return RPCHANDLER_MSG_DONE;
+	cp_pack_t pack = rpchandler_msg_new_response(ctx);
+	cp_pack_str(pack, str ?: "");
+	cp_pack_container_end(pack);
+	rpchandler_msg_send_response(ctx, pack);
+	return RPCHANDLER_MSG_DONE;
+}
+
+static const struct rpchandler_funcs echo_funcs = {.msg = echo_msg};
+static const struct rpchandler_stage stages[] = {{.funcs = &echo_funcs}, {}};
+static const struct rpcclient_stream_funcs sfuncs = {};
+
+static rpchandler_t handler;
+static rpcclient_t peer;
+static struct obstack obstack;
+static void *obase;
+
+static void setup(void) {
+	int pipes[2];
+	rpcclient_t client = rpcclient_pipe_new(pipes, RPCSTREAM_P_BLOCK);
+	fcntl(pipes[1], F_SETFL, 0);
+	peer = rpcclient_stream_new(
+		&sfuncs, NULL, RPCSTREAM_P_BLOCK, pipes[0], pipes[1]);
+	handler = rpchandler_new(client, stages, NULL);
+	obstack_init(&obstack);
+	obase = obstack_alloc(&obstack, 0);
+}
+
+static void teardown(void) {
+	rpcclient_t client = rpchandler_client(handler);
+	rpchandler_destroy(handler);
+	rpcclient_destroy(client);
+	rpcclient_destroy(peer);
+	obstack_free(&obstack, NULL);
+}
+
+/* Send request with given string to the handler, let it handle it and receive
+ * the response. Returns number of allocations performed by the handler.
+ */
+static unsigned long echo(const char *str, int rid) {
+	cp_pack_t pack = rpcclient_pack(peer);
+	rpcmsg_pack_request(pack, "test", "echo", NULL, rid);
+	cp_pack_str(pack, str);
+	cp_pack_container_end(pack);
+	ck_assert(rpcclient_sendmsg(peer));
+
+	allocs = 0;
+	counting = true;
+	ck_assert(rpchandler_next(handler));
+	counting = false;
+
+	ck_assert_int_eq(rpcclient_nextmsg(peer), RPCC_MESSAGE);
+	struct cpitem item;
+	cpitem_unpack_init(&item);
+	struct rpcmsg_meta meta;
+	ck_assert(rpcmsg_head_unpack(
+		rpcclient_unpack(peer), &item, &meta, NULL, &obstack));
+	ck_assert_int_eq(meta.type, RPCMSG_T_RESPONSE);
+	ck_assert_int_eq(meta.request_id, rid);
+	char *res = cp_unpack_strdupo(rpcclient_unpack(peer), &item, &obstack);
+	ck_assert(rpcclient_validmsg(peer));
+	ck_assert_str_eq(res, str);
+	obstack_free(&obstack, obase);
+	return allocs;
+}
+
+TEST_CASE(all, setup, teardown) {}
+
+TEST(all, steady) {
+	for (int i = 0; i < 10; i++)
+		echo("warm up", i);
+	for (int i = 10; i < 1000; i++)
+		ck_assert_int_eq(echo("Hello", i), 0);
+}
+END_TEST
+
+/* Data that do not fit the obstack's chunk are allocated only the first time */
+TEST(all, large) {
+	char *str = malloc(BUFSIZ * 4);
+	memset(str, 'x', BUFSIZ * 4 - 1);
+	str[BUFSIZ * 4 - 1] = '\0';
+	for (int i = 0; i < 10; i++)
+		echo(str, i);
+	for (int i = 10; i < 100; i++) {
+		ck_assert_int_eq(echo(str, i), 0);
+		ck_assert_int_eq(echo("Hello", i), 0);
+	}
+	free(str);
+}
+END_TEST
@@ -0,0 +1,205 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <shv/rpchandler_signals.h>
+#include <shv/rpcclient_stream.h>
+#include <shv/rpctransport.h>
+#define obstack_chunk_alloc malloc
+#define obstack_chunk_free free
+
+#define SUITE "rpchandler_signals"
+#include <check_suite.h>
+
+#define SUBS (2000)
+
+static const struct rpcclient_stream_funcs sfuncs = {};
+
+static rpchandler_t handler;
+static rpchandler_signals_t signals;
+static struct rpchandler_stage stages[2];
+static rpcclient_t peer;
+static char *ris[SUBS];
+static int unrouted;
+
+static void unrouted_signal(void *cookie, struct rpchandler_msg *ctx) {
+	unrouted++;
+}
+
+static void setup(void) {
+	int pipes[2];
+	rpcclient_t client = rpcclient_pipe_new(pipes, RPCSTREAM_P_BLOCK);
+	fcntl(pipes[1], F_SETFL, 0);
+	peer = rpcclient_stream_new(
+		&sfuncs, NULL, RPCSTREAM_P_BLOCK, pipes[0], pipes[1]);
+	unrouted = 0;
+	signals = rpchandler_signals_new(unrouted_signal, NULL);
+	stages[0] = rpchandler_signals_stage(signals);
+	stages[1] = (struct rpchandler_stage){};
+	handler = rpchandler_new(client, stages, NULL);
+	for (int i = 0; i < SUBS; i++)
+		asprintf(&ris[i], "test/%d:*:chng", i);
+}
+
+static void teardown(void) {
+	rpcclient_t client = rpchandler_client(handler);
+	rpchandler_destroy(handler);
+	rpchandler_signals_destroy(signals);
+	rpcclient_destroy(client);
+	rpcclient_destroy(peer);
+	for (int i = 0; i < SUBS; i++)
+		free(ris[i]);
+}
+
+TEST_CASE(all, setup, teardown) {}
+
+
+/* Peer receives all requests with the given method and only then it responds
+ * to them in the reverse order. Every RI must be requested only once.
+ */
+static void *responder(void *arg) {
+	const char *method = arg;
+	static int rids[SUBS];
+	bool seen[SUBS] = {};
+	struct obstack obstack;
+	obstack_init(&obstack);
+	void *obase = obstack_alloc(&obstack, 0);
+	struct pollfd pfd = {.fd = rpcclient_pollfd(peer), .events = POLLIN};
+	int cnt = 0;
+	while (cnt < SUBS) {
+		if (!rpcclient_pending(peer))
+			ck_assert_int_eq(poll(&pfd, 1, 5000), 1);
+		if (rpcclient_nextmsg(peer) != RPCC_MESSAGE)
+			continue;
+		struct cpitem item;
+		cpitem_unpack_init(&item);
+		struct rpcmsg_meta meta;
+		ck_assert(rpcmsg_head_unpack(
+			rpcclient_unpack(peer), &item, &meta, NULL, &obstack));
+		ck_assert_str_eq(meta.path, ".broker/currentClient");
+		ck_assert_str_eq(meta.method, method);
+		char *ri = cp_unpack_strdupo(rpcclient_unpack(peer), &item, &obstack);
+		ck_assert(rpcclient_validmsg(peer));
+		int i;
+		ck_assert_int_eq(sscanf(ri, "test/%d:*:chng", &i), 1);
+		ck_assert(!seen[i]);
+		seen[i] = true;
+		rids[cnt++] = meta.request_id;
+		obstack_free(&obstack, obase);
+	}
+	for (int i = SUBS - 1; i >= 0; i--) {
+		cp_pack_t pack = rpcclient_pack(peer);
+		struct rpcmsg_meta meta = {.request_id = rids[i]};
+		rpcmsg_pack_response_void(pack, &meta);
+		rpcclient_sendmsg(peer);
+	}
+	obstack_free(&obstack, NULL);
+	return NULL;
+}
+
+/* All requests must be sent by a single idle call */
+static void burst(const char *method) {
+	pthread_t thread;
+	pthread_create(&thread, NULL, responder, (void *)method);
+	ck_assert(!rpchandler_signals_status(signals));
+	ck_assert_int_gt(rpchandler_idling(handler), 0);
+	struct pollfd pfd = {
+		.fd = rpcclient_pollfd(rpchandler_client(handler)), .events = POLLIN};
+	while (!rpchandler_signals_status(signals)) {
+		ck_assert_int_eq(poll(&pfd, 1, 5000), 1);
+		ck_assert(rpchandler_next(handler));
+	}
+	pthread_join(thread, NULL);
+	ck_assert(rpchandler_signals_wait(signals, NULL));
+}
+
+TEST(all, resubscribe) {
+	/* Not in order and with duplicates */
+	for (int i = SUBS - 1; i >= 0; i--)
+		rpchandler_signals_subscribe(signals, ris[i]);
+	for (int i = 0; i < SUBS; i += 2)
+		rpchandler_signals_subscribe(signals, ris[i]);
+	burst("subscribe");
+	ck_assert_int_eq(rpchandler_idling(handler), RPCHANDLER_IDLE_SKIP);
+
+	ck_assert(rpcclient_reset(peer));
+	struct pollfd pfd = {
+		.fd = rpcclient_pollfd(rpchandler_client(handler)), .events = POLLIN};
+	ck_assert_int_eq(poll(&pfd, 1, 5000), 1);
+	ck_assert(rpchandler_next(handler));
+	burst("subscribe");
+
+	for (int i = 0; i < SUBS; i++)
+		rpchandler_signals_unsubscribe(signals, ris[i]);
+	burst("unsubscribe");
+}
+END_TEST
+
+TEST(all, unsubscribe_unsent) {
+	for (int i = 0; i < SUBS; i++)
+		rpchandler_signals_subscribe(signals, ris[i]);
+	ck_assert(!rpchandler_signals_status(signals));
+	for (int i = 0; i < SUBS; i++)
+		rpchandler_signals_unsubscribe(signals, ris[i]);
+	ck_assert(rpchandler_signals_status(signals));
+	ck_assert_int_eq(rpchandler_idling(handler), RPCHANDLER_IDLE_SKIP);
+}
+END_TEST
+
+
+static void route_signal(void *cookie, struct rpchandler_msg *ctx) {
+	int *cnt = cookie;
+	(*cnt)++;
+}
+
+/* Send signal with given path and let handler process it */
+static void send_signal(const char *path) {
+	ck_assert(rpcmsg_pack_signal_void(rpcclient_pack(peer), path, "get",
+		"chng", NULL, RPCACCESS_READ, false));
+	ck_assert(rpcclient_sendmsg(peer));
+	ck_assert(rpchandler_next(handler));
+}
+
+TEST(all, route) {
+	static int cnts[SUBS];
+	int wild = 0;
+	for (int i = 0; i < SUBS; i++)
+		ck_assert(rpchandler_signals_route(
+			signals, ris[i], route_signal, &cnts[i]));
+	ck_assert(rpchandler_signals_route(
+		signals, "test/**:get:*", route_signal, &wild));
+	ck_assert(!rpchandler_signals_route(
+		signals, "invalid", route_signal, &wild));
+	/* Routes do not subscribe */
+	ck_assert(rpchandler_signals_status(signals));
+
+	char path[32];
+	for (int i = 0; i < SUBS; i++) {
+		snprintf(path, sizeof path, "test/%d", i);
+		send_signal(path);
+	}
+	for (int i = 0; i < SUBS; i++)
+		ck_assert_int_eq(cnts[i], 1);
+	send_signal("test/0/sub");
+	ck_assert_int_eq(wild, 1);
+	send_signal("other");
+	ck_assert_int_eq(unrouted, 1);
+
+	ck_assert(rpchandler_signals_unroute(
+		signals, ris[0], route_signal, &cnts[0]));
+	ck_assert(!rpchandler_signals_unroute(
+		signals, ris[1], route_signal, &cnts[0]));
+	send_signal("test/0");
+	send_signal("test/1");
+	ck_assert_int_eq(cnts[0], 1);
+	ck_assert_int_eq(cnts[1], 2);
+	ck_assert_int_eq(wild, 2);
+	ck_assert(rpchandler_signals_unroute(
+		signals, "test/**:get:*", route_signal, &wild));
+	send_signal("test/0");
+	ck_assert_int_eq(wild, 2);
+	ck_assert_int_eq(unrouted, 2);
+}
+END_TEST
@@ -1,3 +1,4 @@
+#include <string.h>
 #include <shv/rpcri.h>
 
 #define SUITE "rpcri"
@@ -86,6 +87,13 @@ static struct rid ri_d[] = {
 		.signal = NULL,
 		false,
 	},
+	{
+		"test/**:get",
+		.path = "testfoo",
+		.method = "get",
+		.signal = NULL,
+		false,
+	},
 	{
 		"t?st:get",
 		.path = "test",
@@ -334,3 +342,37 @@ ARRAY_TEST(match, match_ri, ri_d) {
 	match_test(_d);
 }
 END_TEST
+
+ARRAY_TEST(match, match_compiled, ri_d) {
+	/* Invalid RI can't be compiled and never matches */
+	rpcri_t ri = rpcri_compile(_d.resource);
+	bool match = ri && rpcri_match_compiled(ri, _d.path, _d.method, _d.signal);
+	ck_assert_int_eq(match, _d.match);
+	rpcri_free(ri);
+}
+END_TEST
+
+TEST(match, compile_invalid) {
+	ck_assert_ptr_null(rpcri_compile("test/**"));
+}
+END_TEST
+
+/* Pattern that has more states than fits to a single word */
+TEST(match, compiled_long) {
+	rpcri_t ri = rpcri_compile(
+		"*a*a*a*a*a*a*a*a*a*a*a*a*a*a*a*a*a*a*a*a*a*a*a*a*a*a*a*a*a*a*a*a*a*a*"
+		"a*a*a*a*a*a*b:get");
+	ck_assert_ptr_nonnull(ri);
+	char path[128];
+	memset(path, 'a', sizeof path - 2);
+	path[sizeof path - 2] = 'b';
+	path[sizeof path - 1] = '\0';
+	ck_assert(rpcri_match_compiled(ri, path, "get", NULL));
+	path[sizeof path - 2] = 'a';
+	ck_assert(!rpcri_match_compiled(ri, path, "get", NULL));
+	path[40] = '/';
+	path[sizeof path - 2] = 'b';
+	ck_assert(!rpcri_match_compiled(ri, path, "get", NULL));
+	rpcri_free(ri);
+}
+END_TEST
@@ -0,0 +1,83 @@
+#include <rpcroute.h>
+
+#define SUITE "rpcroute"
+#include <check_suite.h>
+
+
+TEST_CASE(all) {}
+
+static const struct rpchandler_funcs funcs = {};
+
+static const struct rpchandler_route app_routes[] = {{".app", NULL}, {}};
+static const struct rpchandler_route prefix_routes[] = {
+	{"test/", "get"}, {"test/device", "set"}, {}};
+static const struct rpchandler_route any_routes[] = {{NULL, "getLog"}, {}};
+static const struct rpchandler_route no_routes[] = {{}};
+
+static const struct rpchandler_stage stages[] = {
+	{.funcs = &funcs, .routes = app_routes},
+	{.funcs = &funcs, .routes = prefix_routes},
+	{.funcs = &funcs, .routes = any_routes},
+	{.funcs = &funcs},
+	{.funcs = &funcs, .routes = no_routes},
+	{},
+};
+
+static const struct {
+	const char *path;
+	const char *method;
+	bool pass[5];
+} lookup_d[] = {
+	{".app", "name", {true, false, false, true, false}},
+	{".app/foo", "name", {false, false, false, true, false}},
+	{"", "ls", {false, false, false, true, false}},
+	{NULL, "ls", {false, false, false, true, false}},
+	{"test/device", "get", {false, true, false, true, false}},
+	{"test/device", "set", {false, true, false, true, false}},
+	{"test/device/sub", "get", {false, true, false, true, false}},
+	{"test/device/sub", "set", {false, false, false, true, false}},
+	{"test", "get", {false, false, false, true, false}},
+	{"testx/device", "get", {false, false, false, true, false}},
+	{"test/device", "getLog", {false, false, true, true, false}},
+	{".app", "getLog", {true, false, true, true, false}},
+};
+ARRAY_TEST(all, lookup) {
+	struct rpcroute idx = {};
+	rpcroute_update(&idx, stages);
+	/* Lookup multiple times to check that previous marks are not used */
+	rpcroute_lookup(&idx, ".app", "name");
+	rpcroute_lookup(&idx, "test/device", "getLog");
+	rpcroute_lookup(&idx, _d.path, _d.method);
+	for (size_t i = 0; i < 5; i++)
+		ck_assert_msg(rpcroute_pass(&idx, i) == _d.pass[i], "Stage %zu", i);
+	rpcroute_free(&idx);
+}
+END_TEST
+
+TEST(all, exists) {
+	struct rpcroute idx = {};
+	rpcroute_update(&idx, stages);
+	ck_assert(rpcroute_exists(&idx, ".app"));
+	ck_assert(rpcroute_exists(&idx, "test/device"));
+	ck_assert(!rpcroute_exists(&idx, "test/"));
+	ck_assert(!rpcroute_exists(&idx, "test"));
+	ck_assert(!rpcroute_exists(&idx, ".app/foo"));
+	rpcroute_free(&idx);
+}
+END_TEST
+
+TEST(all, update) {
+	struct rpchandler_stage st[] = {{.funcs = &funcs}, {}};
+	struct rpcroute idx = {};
+	rpcroute_update(&idx, st);
+	ck_assert(!rpcroute_exists(&idx, ".app"));
+	st[0].routes = app_routes;
+	rpcroute_update(&idx, st);
+	ck_assert(rpcroute_exists(&idx, ".app"));
+	rpcroute_lookup(&idx, ".app", "name");
+	ck_assert(rpcroute_pass(&idx, 0));
+	rpcroute_lookup(&idx, ".device", "name");
+	ck_assert(!rpcroute_pass(&idx, 0));
+	rpcroute_free(&idx);
+}
+END_TEST
@@ -1,15 +1,21 @@
 #include <stdlib.h>
 #include <unistd.h>
 #include <limits.h>
+#include <obstack.h>
 #include <linux/can/raw.h>
 #include <linux/if.h>
 #include <poll.h>
 #include <pthread.h>
 #include <pty.h>
 #include <shv/cp_unpack.h>
+#include <shv/rpcclient_stream.h>
+#include <shv/rpcmsg.h>
 #include <shv/rpctransport.h>
 #include "shvc_config.h"
 
+#define obstack_chunk_alloc malloc
+#define obstack_chunk_free free
+
 #define SUITE "rpctransport"
 #include <check_suite.h>
 #include "tcpport.h"
@@ -104,6 +110,270 @@ TEST(unx, unix_exchange) {
 	free(location);
 }
 
+#define QUEUE_MSGS (100000) /* Enough to not fit to the socket buffer */
+static pthread_barrier_t queue_barrier;
+static void *unix_queue_client(void *arg) {
+	char *location = arg;
+	rpcclient_t c = rpcclient_unix_new(location, RPCSTREAM_P_BLOCK);
+	ck_assert_ptr_nonnull(c);
+	ck_assert(rpcclient_reset(c));
+	pthread_barrier_wait(&queue_barrier);
+	for (int i = 0; i < QUEUE_MSGS; i++) {
+		if (!rpcclient_pending(c))
+			pollfd(rpcclient_pollfd(c));
+		ck_assert_int_eq(rpcclient_nextmsg(c), RPCC_MESSAGE);
+		int rval;
+		struct cpitem item;
+		cpitem_unpack_init(&item);
+		ck_assert(cp_unpack_int(rpcclient_unpack(c), &item, rval));
+		ck_assert_int_eq(rval, i);
+		ck_assert(rpcclient_validmsg(c));
+	}
+	rpcclient_destroy(c);
+	return NULL;
+}
+TEST(unx, unix_queue) {
+	char *location = tmpdir_path("socket");
+	rpcserver_t s = rpcserver_unix_new(location, RPCSTREAM_P_BLOCK);
+	ck_assert_ptr_nonnull(s);
+
+	pthread_barrier_init(&queue_barrier, NULL, 2);
+	pthread_t thread;
+	pthread_create(&thread, NULL, unix_queue_client, location);
+
+	rpcclient_t c = rpcserver_accept(s);
+	ck_assert_ptr_nonnull(c);
+	c->queue = true;
+	/* Nothing is read by the other side and thus this would block */
+	for (int i = 0; i < QUEUE_MSGS; i++)
+		test_send(c, i);
+	ck_assert_uint_gt(rpcclient_queued(c), 0);
+	pthread_barrier_wait(&queue_barrier);
+	while (rpcclient_queued(c) > 0) {
+		struct pollfd pfd = {.fd = rpcclient_pollfd(c), .events = POLLOUT};
+		ck_assert_int_eq(poll(&pfd, 1, -1), 1);
+		ck_assert(rpcclient_flush(c));
+	}
+
+	pthread_join(thread, NULL);
+	pthread_barrier_destroy(&queue_barrier);
+	rpcclient_destroy(c);
+	rpcserver_destroy(s);
+	free(location);
+}
+
+#define MORE_MSGS (10)
+TEST(unx, unix_queue_more) {
+	char *location = tmpdir_path("socket");
+	rpcserver_t s = rpcserver_unix_new(location, RPCSTREAM_P_BLOCK);
+	ck_assert_ptr_nonnull(s);
+	rpcclient_t cl = rpcclient_unix_new(location, RPCSTREAM_P_BLOCK);
+	ck_assert_ptr_nonnull(cl);
+	ck_assert(rpcclient_reset(cl));
+
+	rpcclient_t c = rpcserver_accept(s);
+	ck_assert_ptr_nonnull(c);
+	c->queue = true;
+	for (int i = 0; i < MORE_MSGS; i++) {
+		ck_assert(cp_pack_int(rpcclient_pack(c), i));
+		ck_assert(rpcclient_sendmsg_more(c));
+	}
+	struct rpcstream_stats stats;
+	ck_assert(rpcclient_stream_stats(c, &stats));
+	ck_assert_uint_eq(stats.sent[RPCSTREAM_C_SIGNAL], MORE_MSGS);
+	ck_assert_uint_eq(stats.queued[RPCSTREAM_C_SIGNAL], MORE_MSGS);
+	ck_assert_uint_gt(rpcclient_queued(c), 0);
+	/* Nothing is written until flush */
+	struct pollfd pfd = {.fd = rpcclient_pollfd(cl), .events = POLLIN};
+	ck_assert_int_eq(poll(&pfd, 1, 0), 0);
+	ck_assert(rpcclient_flush(c));
+	ck_assert_uint_eq(rpcclient_queued(c), 0);
+
+	for (int i = 0; i < MORE_MSGS; i++) {
+		if (!rpcclient_pending(cl))
+			pollfd(rpcclient_pollfd(cl));
+		ck_assert_int_eq(rpcclient_nextmsg(cl), RPCC_MESSAGE);
+		int rval;
+		struct cpitem item;
+		cpitem_unpack_init(&item);
+		ck_assert(cp_unpack_int(rpcclient_unpack(cl), &item, rval));
+		ck_assert_int_eq(rval, i);
+		ck_assert(rpcclient_validmsg(cl));
+	}
+
+	rpcclient_destroy(cl);
+	rpcclient_destroy(c);
+	rpcserver_destroy(s);
+	free(location);
+}
+
+TEST(unx, unix_queue_share) {
+	char *location = tmpdir_path("socket");
+	rpcserver_t s = rpcserver_unix_new(location, RPCSTREAM_P_BLOCK);
+	ck_assert_ptr_nonnull(s);
+	rpcclient_t cl = rpcclient_unix_new(location, RPCSTREAM_P_BLOCK);
+	ck_assert_ptr_nonnull(cl);
+	ck_assert(rpcclient_reset(cl));
+
+	rpcclient_t c = rpcserver_accept(s);
+	ck_assert_ptr_nonnull(c);
+	c->queue = true;
+	struct rpcbuf *buf = rpcbuf_new(BUFSIZ);
+	ck_assert_ptr_nonnull(buf);
+	struct cp_pack_buf pack_buf;
+	cp_pack_t pack = cp_pack_buf_init(&pack_buf, buf->data, buf->siz);
+	ck_assert(cp_pack_int(pack, 42));
+	buf->len = pack_buf.ptr - buf->data;
+	ck_assert(rpcclient_rawshare(c, buf));
+	ck_assert(rpcclient_sendmsg_more(c));
+	/* Queued message holds reference instead of the copy */
+	ck_assert_uint_eq(buf->refs, 2);
+	ck_assert(rpcclient_flush(c));
+	ck_assert_uint_eq(rpcclient_queued(c), 0);
+	ck_assert_uint_eq(buf->refs, 1);
+	rpcbuf_unref(buf);
+
+	if (!rpcclient_pending(cl))
+		pollfd(rpcclient_pollfd(cl));
+	ck_assert_int_eq(rpcclient_nextmsg(cl), RPCC_MESSAGE);
+	int rval;
+	struct cpitem item;
+	cpitem_unpack_init(&item);
+	ck_assert(cp_unpack_int(rpcclient_unpack(cl), &item, rval));
+	ck_assert_int_eq(rval, 42);
+	ck_assert(rpcclient_validmsg(cl));
+
+	rpcclient_destroy(cl);
+	rpcclient_destroy(c);
+	rpcserver_destroy(s);
+	free(location);
+}
+
+TEST(unx, unix_queue_order) {
+	char *location = tmpdir_path("socket");
+	rpcserver_t s = rpcserver_unix_new(location, RPCSTREAM_P_BLOCK);
+	ck_assert_ptr_nonnull(s);
+	rpcclient_t cl = rpcclient_unix_new(location, RPCSTREAM_P_BLOCK);
+	ck_assert_ptr_nonnull(cl);
+	ck_assert(rpcclient_reset(cl));
+
+	rpcclient_t c = rpcserver_accept(s);
+	ck_assert_ptr_nonnull(c);
+	c->queue = true;
+	ck_assert(
+		rpcmsg_pack_request_void(rpcclient_pack(c), "test", "get", NULL, 42));
+	ck_assert(rpcclient_sendmsg_more(c));
+	/* Signal must not overtake the queued request */
+	ck_assert(rpcmsg_pack_signal_void(
+		rpcclient_pack(c), "test", "get", "chng", NULL, RPCACCESS_READ, false));
+	ck_assert(rpcclient_sendmsg(c));
+	ck_assert(rpcclient_flush(c));
+	ck_assert_uint_eq(rpcclient_queued(c), 0);
+
+	struct obstack obstack;
+	obstack_init(&obstack);
+	const enum rpcmsg_type types[] = {RPCMSG_T_REQUEST, RPCMSG_T_SIGNAL};
+	for (size_t i = 0; i < sizeof types / sizeof *types; i++) {
+		if (!rpcclient_pending(cl))
+			pollfd(rpcclient_pollfd(cl));
+		ck_assert_int_eq(rpcclient_nextmsg(cl), RPCC_MESSAGE);
+		struct cpitem item;
+		cpitem_unpack_init(&item);
+		struct rpcmsg_meta meta;
+		ck_assert(rpcmsg_head_unpack(
+			rpcclient_unpack(cl), &item, &meta, NULL, &obstack));
+		ck_assert(rpcclient_validmsg(cl));
+		ck_assert_int_eq(meta.type, types[i]);
+	}
+	obstack_free(&obstack, NULL);
+
+	rpcclient_destroy(cl);
+	rpcclient_destroy(c);
+	rpcserver_destroy(s);
+	free(location);
+}
+
+static int queue_signals;
+static void *unix_queue_priority_client(void *arg) {
+	char *location = arg;
+	rpcclient_t c = rpcclient_unix_new(location, RPCSTREAM_P_BLOCK);
+	ck_assert_ptr_nonnull(c);
+	ck_assert(rpcclient_reset(c));
+	pthread_barrier_wait(&queue_barrier);
+	pthread_barrier_wait(&queue_barrier);
+	struct obstack obstack;
+	obstack_init(&obstack);
+	int signals = 0;
+	bool response = false;
+	while (signals < queue_signals || !response) {
+		if (!rpcclient_pending(c))
+			pollfd(rpcclient_pollfd(c));
+		ck_assert_int_eq(rpcclient_nextmsg(c), RPCC_MESSAGE);
+		struct cpitem item;
+		cpitem_unpack_init(&item);
+		struct rpcmsg_meta meta;
+		ck_assert(rpcmsg_head_unpack(
+			rpcclient_unpack(c), &item, &meta, NULL, &obstack));
+		ck_assert(rpcclient_validmsg(c));
+		if (meta.type == RPCMSG_T_RESPONSE) {
+			ck_assert_int_eq(meta.request_id, 42);
+			/* Response must overtake the queued signals */
+			ck_assert_int_lt(signals, queue_signals);
+			response = true;
+		} else {
+			ck_assert_int_eq(meta.type, RPCMSG_T_SIGNAL);
+			signals++;
+		}
+		obstack_free(&obstack, NULL);
+		obstack_init(&obstack);
+	}
+	obstack_free(&obstack, NULL);
+	rpcclient_destroy(c);
+	return NULL;
+}
+TEST(unx, unix_queue_priority) {
+	char *location = tmpdir_path("socket");
+	rpcserver_t s = rpcserver_unix_new(location, RPCSTREAM_P_BLOCK);
+	ck_assert_ptr_nonnull(s);
+
+	pthread_barrier_init(&queue_barrier, NULL, 2);
+	pthread_t thread;
+	pthread_create(&thread, NULL, unix_queue_priority_client, location);
+
+	rpcclient_t c = rpcserver_accept(s);
+	ck_assert_ptr_nonnull(c);
+	c->queue = true;
+	pthread_barrier_wait(&queue_barrier);
+	struct rpcstream_stats stats;
+	queue_signals = 0;
+	do {
+		ck_assert(rpcmsg_pack_signal_void(rpcclient_pack(c), "test", "get",
+			"chng", NULL, RPCACCESS_READ, false));
+		ck_assert(rpcclient_sendmsg(c));
+		queue_signals++;
+		ck_assert(rpcclient_stream_stats(c, &stats));
+	} while (stats.queued[RPCSTREAM_C_SIGNAL] < 100);
+	ck_assert(rpcmsg_pack_response_void(rpcclient_pack(c),
+		&(struct rpcmsg_meta){.type = RPCMSG_T_RESPONSE, .request_id = 42}));
+	ck_assert(rpcclient_sendmsg(c));
+	ck_assert(rpcclient_stream_stats(c, &stats));
+	ck_assert_uint_eq(stats.sent[RPCSTREAM_C_SIGNAL], queue_signals);
+	ck_assert_uint_eq(stats.sent[RPCSTREAM_C_REQUEST], 1);
+	ck_assert_uint_eq(stats.queued[RPCSTREAM_C_REQUEST], 1);
+	pthread_barrier_wait(&queue_barrier);
+	while (rpcclient_queued(c) > 0) {
+		struct pollfd pfd = {.fd = rpcclient_pollfd(c), .events = POLLOUT};
+		ck_assert_int_eq(poll(&pfd, 1, -1), 1);
+		ck_assert(rpcclient_flush(c));
+	}
+
+	pthread_join(thread, NULL);
+	pthread_barrier_destroy(&queue_barrier);
+	rpcclient_destroy(c);
+	rpcserver_destroy(s);
+	free(location);
+}
+
 
 TEST_CASE(tty) {}
 
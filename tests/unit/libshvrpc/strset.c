@@ -90,3 +90,20 @@ TEST(all, alphabet) {
 	shv_strset_free(&set);
 }
 END_TEST
+
+TEST(all, has) {
+	struct strset set = {};
+
+	shv_strset_add_const(&set, "foo");
+	shv_strset_add(&set, "bar");
+	shv_strset_add_const(&set, "boooooooooooooooo");
+
+	ck_assert(shv_strset_has(&set, "foo"));
+	ck_assert(shv_strset_has(&set, "bar"));
+	ck_assert(shv_strset_has(&set, "boooooooooooooooo"));
+	ck_assert(!shv_strset_has(&set, "fee"));
+	ck_assert(!shv_strset_has(&set, ""));
+
+	shv_strset_free(&set);
+}
+END_TEST
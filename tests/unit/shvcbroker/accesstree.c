@@ -0,0 +1,80 @@
+#include <stdlib.h>
+#include <obstack.h>
+#include <shv/rpcri.h>
+
+#define obstack_chunk_alloc malloc
+#define obstack_chunk_free free
+
+#define SUITE "accesstree"
+#include <check_suite.h>
+
+#include <accesstree.h>
+
+static struct obstack obstack;
+static struct accesstree *tree;
+
+static char **ri_access[RPCACCESS_ADMIN + 1] = {
+	[RPCACCESS_BROWSE] = (char *[]){"**:ls", "**:dir", NULL},
+	[RPCACCESS_READ] = (char *[]){"test/**:get", "test/*/status:*", NULL},
+	[RPCACCESS_WRITE] =
+		(char *[]){"test/device/**:set", "test/?ev/track:*", NULL},
+	[RPCACCESS_COMMAND] = (char *[]){"test/device/track/*:reset", NULL},
+	[RPCACCESS_SERVICE] = (char *[]){"invalid", "foo*/**:*", NULL},
+	[RPCACCESS_ADMIN] = (char *[]){".broker/**:*", NULL},
+};
+
+static rpcaccess_t rpcaccess(const char *path, const char *method) {
+	for (rpcaccess_t access = RPCACCESS_ADMIN; access > 0; access--)
+		if (ri_access[access])
+			for (char **ri = ri_access[access]; *ri; ri++)
+				if (rpcri_match(*ri, path, method, NULL))
+					return access;
+	return RPCACCESS_NONE;
+}
+
+static void setup(void) {
+	obstack_init(&obstack);
+	tree = accesstree_compile(ri_access, &obstack);
+}
+
+static void teardown(void) {
+	obstack_free(&obstack, NULL);
+}
+
+TEST_CASE(access, setup, teardown) {}
+
+static const struct {
+	const char *path;
+	const char *method;
+	rpcaccess_t access;
+} access_d[] = {
+	{"", "ls", RPCACCESS_BROWSE},
+	{"", "get", RPCACCESS_NONE},
+	{".app", "dir", RPCACCESS_BROWSE},
+	{"test", "get", RPCACCESS_READ},
+	{"testfoo", "get", RPCACCESS_NONE},
+	{"test/device", "get", RPCACCESS_READ},
+	{"test/device", "set", RPCACCESS_WRITE},
+	{"test/device/status", "set", RPCACCESS_WRITE},
+	{"test/other/status", "set", RPCACCESS_READ},
+	{"test/other/status", "ls", RPCACCESS_READ},
+	{"test/dev/track", "set", RPCACCESS_WRITE},
+	{"test/device/track/1", "reset", RPCACCESS_COMMAND},
+	{"test/device/track/1/2", "reset", RPCACCESS_NONE},
+	{"foobar", "get", RPCACCESS_SERVICE},
+	{"foobar/a/b", "get", RPCACCESS_SERVICE},
+	{".broker", "ls", RPCACCESS_ADMIN},
+	{".broker/client/1", "get", RPCACCESS_ADMIN},
+};
+ARRAY_TEST(access, access) {
+	ck_assert_int_eq(accesstree_access(tree, _d.path, _d.method), _d.access);
+	ck_assert_int_eq(rpcaccess(_d.path, _d.method), _d.access);
+}
+END_TEST
+
+TEST(access, empty) {
+	struct accesstree *empty =
+		accesstree_compile((char **[RPCACCESS_ADMIN + 1]){}, &obstack);
+	ck_assert_int_eq(accesstree_access(empty, "test", "ls"), RPCACCESS_NONE);
+}
+END_TEST
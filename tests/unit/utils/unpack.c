@@ -6,6 +6,7 @@
 struct unpack {
 	union {
 		struct cp_unpack_chainpack chainpack;
+		struct cp_unpack_buf buf;
 		struct cp_unpack_cpon cpon;
 	};
 	bool is_cpon;
@@ -19,6 +20,13 @@ cp_unpack_t unpack_chainpack(struct bdata *b) {
 	return cp_unpack_chainpack_init(&u->chainpack, u->f);
 }
 
+cp_unpack_t unpack_chainpack_buf(struct bdata *b) {
+	struct unpack *u = malloc(sizeof *u);
+	u->f = NULL;
+	u->is_cpon = false;
+	return cp_unpack_buf_init(&u->buf, b->v, b->len);
+}
+
 cp_unpack_t unpack_cpon(const char *str) {
 	struct unpack *u = malloc(sizeof *u);
 	u->f = fmemopen((void *)str, strlen(str), "r");
@@ -30,6 +38,7 @@ void unpack_free(cp_unpack_t unpack) {
 	struct unpack *u = (struct unpack *)unpack;
 	if (u->is_cpon)
 		free(u->cpon.state.ctx);
-	fclose(u->f);
+	if (u->f)
+		fclose(u->f);
 	free(u);
 }
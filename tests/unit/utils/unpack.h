@@ -6,6 +6,8 @@
 
 cp_unpack_t unpack_chainpack(struct bdata *);
 
+cp_unpack_t unpack_chainpack_buf(struct bdata *);
+
 cp_unpack_t unpack_cpon(const char *str);
 
 void unpack_free(cp_unpack_t);